@@ -0,0 +1,121 @@
+#!/usr/bin/env python
+#
+# mkatlas.py -- pack rEFInd's icons into a single icon atlas file
+#
+# Copyright (c) 2013 Roderick W. Smith
+#
+# Distributed under the terms of the GNU General Public License (GPL)
+# version 3 (GPLv3), a copy of which must be distributed with this source
+# code or binaries made from it.
+#
+# Usage: mkatlas.py OUTPUT ICONDIR [NAME=IMAGEFILE ...]
+#
+# Every .icns and .png file in ICONDIR is decoded and stored at each of the
+# sizes in ICON_SIZES that it provides (.icns files) or has (.png files),
+# under its name minus its extension. Extra NAME=IMAGEFILE arguments add
+# other images, such as selection_small and selection_big, at their own
+# sizes. rEFInd reads an atlas called icons.atlas from its icons directory
+# (or from the directory named by icons_dir) with a single read, and uses
+# its images directly, but only when no individual icon file of the same
+# name exists in that directory. To build the standard atlas:
+#
+#   python mkatlas.py ../icons/icons.atlas ../icons \
+#       selection_small=back-selected-small.png \
+#       selection_big=back-selected-big.png
+#
+# File format (all values little-endian):
+#
+#   header:      UINT32 signature ("rEFa"), UINT16 version (1),
+#                UINT16 flags (1 = premultiplied alpha), UINT32 image
+#                count, UINT32 reserved
+#   index:       one 64-byte record per image: CHAR16 name[24] (UTF-16,
+#                NUL-padded), UINT16 width, UINT16 height, UINT32 flags
+#                (1 = has alpha), UINT32 offset of pixels from the start
+#                of the file, UINT32 reserved
+#   pixel data:  width * height BGRA pixels per image, alpha
+#                premultiplied, starting on 4-byte boundaries
+
+from __future__ import print_function
+import sys, os.path, struct
+try:
+    from PIL import Image
+except ImportError:
+    import Image
+
+ICON_SIZES = (32, 48, 128)
+SIGNATURE = b"rEFa"
+VERSION = 1
+FLAG_PREMULTIPLIED = 1
+IMAGE_HAS_ALPHA = 1
+NAME_LENGTH = 24
+HEADER_SIZE = 16
+INDEX_SIZE = 64
+
+def premultiplied_bgra(image):
+    """Returns image's pixels as a premultiplied BGRA byte string."""
+    image = image.convert("RGBA")
+    data = bytearray()
+    for (r, g, b, a) in image.getdata():
+        data.extend(((b * a + 127) // 255, (g * a + 127) // 255, (r * a + 127) // 255, a))
+    return bytes(data)
+
+def icns_sizes(filename):
+    """Yields (size, image) for each size in ICON_SIZES in an .icns file."""
+    for size in ICON_SIZES:
+        image = Image.open(filename)
+        available = [s[0] for s in image.info.get("sizes", ()) if len(s) < 3 or s[2] == 1]
+        if size not in available:
+            continue
+        image.size = (size, size)
+        image.load()
+        if image.size == (size, size):
+            yield (size, image)
+
+def add_image(images, name, image):
+    if len(name) >= NAME_LENGTH:
+        print(" %s: name too long, skipped" % name)
+        return
+    (width, height) = image.size
+    print(" %s: %d x %d" % (name, width, height))
+    images.append((name, width, height, premultiplied_bgra(image)))
+
+### main program
+
+if len(sys.argv) < 3:
+    print("Usage: %s OUTPUT ICONDIR [NAME=IMAGEFILE ...]" % sys.argv[0])
+    sys.exit(1)
+
+output, icondir = sys.argv[1], sys.argv[2]
+images = []
+
+for filename in sorted(os.listdir(icondir)):
+    (basename, extension) = os.path.splitext(filename)
+    path = os.path.join(icondir, filename)
+    if extension.lower() == ".icns":
+        for (size, image) in icns_sizes(path):
+            add_image(images, basename, image)
+    elif extension.lower() == ".png":
+        image = Image.open(path)
+        if image.size[0] == image.size[1] and image.size[0] in ICON_SIZES:
+            add_image(images, basename, image)
+
+for arg in sys.argv[3:]:
+    (name, filename) = arg.split("=", 1)
+    add_image(images, name, Image.open(filename))
+
+offset = HEADER_SIZE + INDEX_SIZE * len(images)
+header = SIGNATURE + struct.pack("<HHII", VERSION, FLAG_PREMULTIPLIED, len(images), 0)
+index = b""
+for (name, width, height, pixels) in images:
+    index += name.encode("utf-16-le").ljust(NAME_LENGTH * 2, b"\0")
+    index += struct.pack("<HHIII", width, height, IMAGE_HAS_ALPHA, offset, 0)
+    offset += len(pixels)
+
+f = open(output, "wb")
+f.write(header)
+f.write(index)
+for image in images:
+    f.write(image[3])
+f.close()
+
+print("%s: %d images, %d bytes" % (output, len(images), offset))
@@ -0,0 +1,404 @@
+/*
+ * libeg/blend.c
+ * Compositing and pixel plane functions
+ *
+ * Copyright (c) 2006 Christoph Pfisterer
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the
+ *    distribution.
+ *
+ *  * Neither the name of Christoph Pfisterer nor the names of the
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/*
+ * Modifications copyright (c) 2013 Roderick W. Smith
+ *
+ * Modifications distributed under the terms of the GNU General Public
+ * License (GPL) version 3 (GPLv3), a copy of which must be distributed
+ * with this source code or binaries made from it.
+ *
+ */
+
+// The functions here sit under all icon, text, and selection drawing. On
+// x86-64 and AArch64, whose baseline instruction sets always include SSE2
+// and NEON, respectively, egRawCompose(), egRawCopy(), and egFillImageArea()
+// work on four pixels at a time using GCC vector extensions, which compile
+// to those instructions without any further compiler options or CPU
+// checks. Each vector path computes exactly what the scalar code does, so
+// results are identical on all platforms; test/blendbench.c checks this.
+//
+// Images that have been through egPremultiplyImage() (as decoded icons and
+// embedded images are) store their colors pre-multiplied by alpha, which
+// reduces blending to Comp * (255 - Alpha) / 255 + Top, and which makes
+// fully transparent pixels all zero. egRawComposePremultiplied() skips such
+// pixels and copies fully opaque ones, four at a time where possible, so
+// icons' transparent surroundings and solid interiors cost almost nothing.
+//
+// This file depends only on basic EFI types, so that it can also be built
+// for the host by test/blendbench.c.
+
+#ifdef HOST_POSIX
+#include "test/host_libeg.h"
+#else
+#include "libegint.h"
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__aarch64__))
+#define EG_VECTOR_PIXELS 4
+
+// Four pixels, each viewed as one 32-bit word (0xAARRGGBB) or as two 16-bit
+// fields. EG_V4U32_UNALIGNED may be used to access pixels at any address.
+typedef UINT32 EG_V4U32 __attribute__((vector_size(16)));
+typedef UINT16 EG_V8U16 __attribute__((vector_size(16)));
+typedef UINT8 EG_V16U8 __attribute__((vector_size(16)));
+typedef UINT64 EG_V2U64 __attribute__((vector_size(16)));
+typedef UINT32 EG_V4U32_UNALIGNED __attribute__((vector_size(16), may_alias, aligned(4)));
+
+// Blend four Top pixels over four Comp pixels, leaving Comp's alpha values
+// unchanged, just as egRawCompose()'s scalar loop does. Blue and red (and
+// then green, alone) are spread into 16-bit fields, where each channel's
+// Comp * (255 - Alpha) + Top * Alpha + 0x80 fits without overflowing into
+// its neighbor.
+static inline EG_V4U32 egBlendVector(IN EG_V4U32 Comp, IN EG_V4U32 Top) {
+   const EG_V4U32 LowBytes = { 0x00FF00FF, 0x00FF00FF, 0x00FF00FF, 0x00FF00FF };
+   const EG_V4U32 LowByte = { 0x000000FF, 0x000000FF, 0x000000FF, 0x000000FF };
+   const EG_V4U32 AlphaMask = { 0xFF000000, 0xFF000000, 0xFF000000, 0xFF000000 };
+   const EG_V8U16 Round = { 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 };
+   EG_V4U32 Alpha32;
+   EG_V8U16 Alpha, RevAlpha, BlueRed, Green;
+
+   Alpha32 = Top >> 24;
+   Alpha = (EG_V8U16) (Alpha32 | (Alpha32 << 16));
+   RevAlpha = (EG_V8U16) LowBytes - Alpha;
+   BlueRed = (EG_V8U16) (Comp & LowBytes) * RevAlpha + (EG_V8U16) (Top & LowBytes) * Alpha + Round;
+   BlueRed = (BlueRed + (BlueRed >> 8)) >> 8;
+   Green = (EG_V8U16) ((Comp >> 8) & LowByte) * RevAlpha + (EG_V8U16) ((Top >> 8) & LowByte) * Alpha + Round;
+   Green = (Green + (Green >> 8)) >> 8;
+   return (EG_V4U32) BlueRed | (((EG_V4U32) Green & LowByte) << 8) | (Comp & AlphaMask);
+} // static EG_V4U32 egBlendVector()
+
+// Blend four premultiplied Top pixels over four Comp pixels, alpha included,
+// just as egRawComposePremultiplied()'s scalar loop does.
+static inline EG_V4U32 egBlendPremultipliedVector(IN EG_V4U32 Comp, IN EG_V4U32 Top) {
+   const EG_V4U32 LowBytes = { 0x00FF00FF, 0x00FF00FF, 0x00FF00FF, 0x00FF00FF };
+   const EG_V8U16 Round = { 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 };
+   EG_V4U32 Alpha32;
+   EG_V8U16 RevAlpha, BlueRed, GreenAlpha;
+
+   Alpha32 = Top >> 24;
+   RevAlpha = (EG_V8U16) LowBytes - (EG_V8U16) (Alpha32 | (Alpha32 << 16));
+   BlueRed = (EG_V8U16) (Comp & LowBytes) * RevAlpha + Round;
+   BlueRed = (BlueRed + (BlueRed >> 8)) >> 8;
+   GreenAlpha = (EG_V8U16) ((Comp >> 8) & LowBytes) * RevAlpha + Round;
+   GreenAlpha = (GreenAlpha + (GreenAlpha >> 8)) >> 8;
+   // add bytewise, so that (as in the scalar code) channels can't carry
+   return (EG_V4U32) ((EG_V16U8) Top + (EG_V16U8) ((EG_V4U32) BlueRed | ((EG_V4U32) GreenAlpha << 8)));
+} // static EG_V4U32 egBlendPremultipliedVector()
+#endif
+
+// Returns Value * Alpha / 255, rounded, computed as egRawCompose() does.
+static inline UINT8 egScaleChannel(IN UINTN Value, IN UINTN Alpha) {
+   UINTN Temp = Value * Alpha + 0x80;
+
+   return (UINT8) ((Temp + (Temp >> 8)) >> 8);
+} // static UINT8 egScaleChannel()
+
+//
+// Compositing
+//
+
+VOID egRestrictImageArea(IN EG_IMAGE *Image,
+                         IN UINTN AreaPosX, IN UINTN AreaPosY,
+                         IN OUT UINTN *AreaWidth, IN OUT UINTN *AreaHeight)
+{
+    if (AreaPosX >= Image->Width || AreaPosY >= Image->Height) {
+        // out of bounds, operation has no effect
+        *AreaWidth  = 0;
+        *AreaHeight = 0;
+    } else {
+        // calculate affected area
+        if (*AreaWidth > Image->Width - AreaPosX)
+            *AreaWidth = Image->Width - AreaPosX;
+        if (*AreaHeight > Image->Height - AreaPosY)
+            *AreaHeight = Image->Height - AreaPosY;
+    }
+}
+
+VOID egFillImage(IN OUT EG_IMAGE *CompImage, IN EG_PIXEL *Color)
+{
+    egFillImageArea(CompImage, 0, 0, CompImage->Width, CompImage->Height, Color);
+}
+
+VOID egFillImageArea(IN OUT EG_IMAGE *CompImage,
+                     IN UINTN AreaPosX, IN UINTN AreaPosY,
+                     IN UINTN AreaWidth, IN UINTN AreaHeight,
+                     IN EG_PIXEL *Color)
+{
+    UINTN       x, y;
+    EG_PIXEL    FillColor;
+    EG_PIXEL    *PixelPtr;
+    EG_PIXEL    *PixelBasePtr;
+#ifdef EG_VECTOR_PIXELS
+    EG_V4U32    FillVector;
+#endif
+
+    egRestrictImageArea(CompImage, AreaPosX, AreaPosY, &AreaWidth, &AreaHeight);
+
+    if (AreaWidth > 0) {
+        FillColor = *Color;
+        if (!CompImage->HasAlpha)
+            FillColor.a = 0;
+
+        // a contiguous area can be filled as one long row
+        if (AreaWidth == CompImage->Width) {
+            AreaWidth *= AreaHeight;
+            AreaHeight = 1;
+        }
+#ifdef EG_VECTOR_PIXELS
+        CopyMem(&FillVector[0], &FillColor, sizeof(EG_PIXEL));
+        FillVector[1] = FillVector[2] = FillVector[3] = FillVector[0];
+#endif
+
+        PixelBasePtr = CompImage->PixelData + AreaPosY * CompImage->Width + AreaPosX;
+        for (y = 0; y < AreaHeight; y++) {
+            PixelPtr = PixelBasePtr;
+            x = 0;
+#ifdef EG_VECTOR_PIXELS
+            for (; x + EG_VECTOR_PIXELS <= AreaWidth; x += EG_VECTOR_PIXELS, PixelPtr += EG_VECTOR_PIXELS)
+                *(EG_V4U32_UNALIGNED *) PixelPtr = FillVector;
+#endif
+            for (; x < AreaWidth; x++, PixelPtr++)
+                *PixelPtr = FillColor;
+            PixelBasePtr += CompImage->Width;
+        }
+    }
+}
+
+VOID egRawCopy(IN OUT EG_PIXEL *CompBasePtr, IN EG_PIXEL *TopBasePtr,
+               IN UINTN Width, IN UINTN Height,
+               IN UINTN CompLineOffset, IN UINTN TopLineOffset)
+{
+    UINTN       x, y;
+    EG_PIXEL    *TopPtr, *CompPtr;
+
+    // contiguous rows can be copied as one long row
+    if ((Width == CompLineOffset) && (Width == TopLineOffset)) {
+        Width *= Height;
+        Height = 1;
+    }
+
+    for (y = 0; y < Height; y++) {
+        TopPtr = TopBasePtr;
+        CompPtr = CompBasePtr;
+        x = 0;
+#ifdef EG_VECTOR_PIXELS
+        for (; x + EG_VECTOR_PIXELS <= Width; x += EG_VECTOR_PIXELS) {
+            *(EG_V4U32_UNALIGNED *) CompPtr = *(EG_V4U32_UNALIGNED *) TopPtr;
+            TopPtr += EG_VECTOR_PIXELS, CompPtr += EG_VECTOR_PIXELS;
+        }
+#endif
+        for (; x < Width; x++) {
+            *CompPtr = *TopPtr;
+            TopPtr++, CompPtr++;
+        }
+        TopBasePtr += TopLineOffset;
+        CompBasePtr += CompLineOffset;
+    }
+}
+
+VOID egRawCompose(IN OUT EG_PIXEL *CompBasePtr, IN EG_PIXEL *TopBasePtr,
+                  IN UINTN Width, IN UINTN Height,
+                  IN UINTN CompLineOffset, IN UINTN TopLineOffset)
+{
+    UINTN       x, y;
+    EG_PIXEL    *TopPtr, *CompPtr;
+    UINTN       Alpha;
+    UINTN       RevAlpha;
+    UINTN       Temp;
+
+    for (y = 0; y < Height; y++) {
+        TopPtr = TopBasePtr;
+        CompPtr = CompBasePtr;
+        x = 0;
+#ifdef EG_VECTOR_PIXELS
+        for (; x + EG_VECTOR_PIXELS <= Width; x += EG_VECTOR_PIXELS) {
+            *(EG_V4U32_UNALIGNED *) CompPtr = egBlendVector(*(EG_V4U32_UNALIGNED *) CompPtr, *(EG_V4U32_UNALIGNED *) TopPtr);
+            TopPtr += EG_VECTOR_PIXELS, CompPtr += EG_VECTOR_PIXELS;
+        }
+#endif
+        for (; x < Width; x++) {
+            Alpha = TopPtr->a;
+            RevAlpha = 255 - Alpha;
+            Temp = (UINTN)CompPtr->b * RevAlpha + (UINTN)TopPtr->b * Alpha + 0x80;
+            CompPtr->b = (Temp + (Temp >> 8)) >> 8;
+            Temp = (UINTN)CompPtr->g * RevAlpha + (UINTN)TopPtr->g * Alpha + 0x80;
+            CompPtr->g = (Temp + (Temp >> 8)) >> 8;
+            Temp = (UINTN)CompPtr->r * RevAlpha + (UINTN)TopPtr->r * Alpha + 0x80;
+            CompPtr->r = (Temp + (Temp >> 8)) >> 8;
+            /*
+            CompPtr->b = ((UINTN)CompPtr->b * RevAlpha + (UINTN)TopPtr->b * Alpha) / 255;
+            CompPtr->g = ((UINTN)CompPtr->g * RevAlpha + (UINTN)TopPtr->g * Alpha) / 255;
+            CompPtr->r = ((UINTN)CompPtr->r * RevAlpha + (UINTN)TopPtr->r * Alpha) / 255;
+            */
+            TopPtr++, CompPtr++;
+        }
+        TopBasePtr += TopLineOffset;
+        CompBasePtr += CompLineOffset;
+    }
+}
+
+// Like egRawCompose(), but for premultiplied Top pixels, and producing a
+// proper alpha channel: each channel becomes Top + Comp * (255 - Alpha) / 255.
+VOID egRawComposePremultiplied(IN OUT EG_PIXEL *CompBasePtr, IN EG_PIXEL *TopBasePtr,
+                               IN UINTN Width, IN UINTN Height,
+                               IN UINTN CompLineOffset, IN UINTN TopLineOffset)
+{
+    UINTN       x, y, RevAlpha;
+    EG_PIXEL    *TopPtr, *CompPtr;
+#ifdef EG_VECTOR_PIXELS
+    const UINT64 AlphaMask = 0xFF000000FF000000ULL;
+    EG_V4U32    Top;
+    EG_V2U64    Top64;
+#endif
+
+    for (y = 0; y < Height; y++) {
+        TopPtr = TopBasePtr;
+        CompPtr = CompBasePtr;
+        x = 0;
+#ifdef EG_VECTOR_PIXELS
+        for (; x + EG_VECTOR_PIXELS <= Width; x += EG_VECTOR_PIXELS) {
+            Top = *(EG_V4U32_UNALIGNED *) TopPtr;
+            Top64 = (EG_V2U64) Top;
+            if ((Top64[0] | Top64[1]) == 0) {
+                // all four transparent; nothing to do
+            } else if ((Top64[0] & Top64[1] & AlphaMask) == AlphaMask) {
+                *(EG_V4U32_UNALIGNED *) CompPtr = Top;
+            } else {
+                *(EG_V4U32_UNALIGNED *) CompPtr = egBlendPremultipliedVector(*(EG_V4U32_UNALIGNED *) CompPtr, Top);
+            }
+            TopPtr += EG_VECTOR_PIXELS, CompPtr += EG_VECTOR_PIXELS;
+        }
+#endif
+        for (; x < Width; x++, TopPtr++, CompPtr++) {
+            if (TopPtr->a == 255) {
+                *CompPtr = *TopPtr;
+            } else if ((TopPtr->a != 0) || (TopPtr->b != 0) || (TopPtr->g != 0) || (TopPtr->r != 0)) {
+                RevAlpha = 255 - TopPtr->a;
+                CompPtr->b = TopPtr->b + egScaleChannel(CompPtr->b, RevAlpha);
+                CompPtr->g = TopPtr->g + egScaleChannel(CompPtr->g, RevAlpha);
+                CompPtr->r = TopPtr->r + egScaleChannel(CompPtr->r, RevAlpha);
+                CompPtr->a = TopPtr->a + egScaleChannel(CompPtr->a, RevAlpha);
+            }
+        }
+        TopBasePtr += TopLineOffset;
+        CompBasePtr += CompLineOffset;
+    }
+}
+
+// Multiply the colors of Count pixels by their alpha values.
+VOID egPremultiplyPixels(IN OUT EG_PIXEL *PixelPtr, IN UINTN Count)
+{
+    UINTN       i;
+
+    for (i = 0; i < Count; i++, PixelPtr++) {
+        if (PixelPtr->a != 255) {
+            PixelPtr->b = egScaleChannel(PixelPtr->b, PixelPtr->a);
+            PixelPtr->g = egScaleChannel(PixelPtr->g, PixelPtr->a);
+            PixelPtr->r = egScaleChannel(PixelPtr->r, PixelPtr->a);
+        }
+    }
+}
+
+// Convert Image's colors to premultiplied form, if it has an alpha channel
+// and they aren't already.
+VOID egPremultiplyImage(IN OUT EG_IMAGE *Image)
+{
+    if ((Image == NULL) || !Image->HasAlpha || Image->Premultiplied)
+        return;
+    egPremultiplyPixels(Image->PixelData, Image->Width * Image->Height);
+    Image->Premultiplied = TRUE;
+}
+
+VOID egComposeImage(IN OUT EG_IMAGE *CompImage, IN EG_IMAGE *TopImage, IN UINTN PosX, IN UINTN PosY)
+{
+    UINTN       CompWidth, CompHeight;
+
+    CompWidth  = TopImage->Width;
+    CompHeight = TopImage->Height;
+    egRestrictImageArea(CompImage, PosX, PosY, &CompWidth, &CompHeight);
+
+    // compose
+    if (CompWidth > 0) {
+        if (TopImage->HasAlpha && TopImage->Premultiplied) {
+            // keep CompImage's colors and alpha consistent with what's added to it
+            egPremultiplyImage(CompImage);
+            egRawComposePremultiplied(CompImage->PixelData + PosY * CompImage->Width + PosX, TopImage->PixelData,
+                                      CompWidth, CompHeight, CompImage->Width, TopImage->Width);
+        } else if (TopImage->HasAlpha) {
+            egRawCompose(CompImage->PixelData + PosY * CompImage->Width + PosX, TopImage->PixelData,
+                         CompWidth, CompHeight, CompImage->Width, TopImage->Width);
+        } else {
+            egRawCopy(CompImage->PixelData + PosY * CompImage->Width + PosX, TopImage->PixelData,
+                      CompWidth, CompHeight, CompImage->Width, TopImage->Width);
+        }
+    }
+} /* VOID egComposeImage() */
+
+//
+// misc internal functions
+//
+
+VOID egInsertPlane(IN UINT8 *SrcDataPtr, IN UINT8 *DestPlanePtr, IN UINTN PixelCount)
+{
+    UINTN i;
+
+    for (i = 0; i < PixelCount; i++) {
+        *DestPlanePtr = *SrcDataPtr++;
+        DestPlanePtr += 4;
+    }
+}
+
+VOID egSetPlane(IN UINT8 *DestPlanePtr, IN UINT8 Value, IN UINTN PixelCount)
+{
+    UINTN i;
+
+    for (i = 0; i < PixelCount; i++) {
+        *DestPlanePtr = Value;
+        DestPlanePtr += 4;
+    }
+}
+
+VOID egCopyPlane(IN UINT8 *SrcPlanePtr, IN UINT8 *DestPlanePtr, IN UINTN PixelCount)
+{
+    UINTN i;
+
+    for (i = 0; i < PixelCount; i++) {
+        *DestPlanePtr = *SrcPlanePtr;
+        DestPlanePtr += 4, SrcPlanePtr += 4;
+    }
+}
+
+/* EOF */
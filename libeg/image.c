@@ -68,6 +68,7 @@ EG_IMAGE * egCreateImage(IN UINTN Width, IN UINTN Height, IN BOOLEAN HasAlpha)
     NewImage->Width = Width;
     NewImage->Height = Height;
     NewImage->HasAlpha = HasAlpha;
+    NewImage->Premultiplied = FALSE;
     return NewImage;
 }
 
@@ -92,6 +93,7 @@ EG_IMAGE * egCopyImage(IN EG_IMAGE *Image)
         return NULL;
 
     CopyMem(NewImage->PixelData, Image->PixelData, Image->Width * Image->Height * sizeof(EG_PIXEL));
+    NewImage->Premultiplied = Image->Premultiplied;
     return NewImage;
 }
 
@@ -107,6 +109,7 @@ EG_IMAGE * egCropImage(IN EG_IMAGE *Image, IN UINTN StartX, IN UINTN StartY, IN
    NewImage = egCreateImage(Width, Height, Image->HasAlpha);
    if (NewImage == NULL)
       return NULL;
+   NewImage->Premultiplied = Image->Premultiplied;
 
    for (y = 0; y < Height; y++) {
       for (x = 0; x < Width; x++) {
@@ -222,7 +225,7 @@ EFI_STATUS egSaveFile(IN EFI_FILE* BaseDir OPTIONAL, IN CHAR16 *FileName,
 // Decode the specified image data. The IconSize parameter is relevant only
 // for ICNS, for which it selects which ICNS sub-image is decoded.
 // Returns a pointer to the resulting EG_IMAGE or NULL if decoding failed.
-static EG_IMAGE * egDecodeAny(IN UINT8 *FileData, IN UINTN FileDataLength, IN UINTN IconSize, IN BOOLEAN WantAlpha)
+EG_IMAGE * egDecodeAny(IN UINT8 *FileData, IN UINTN FileDataLength, IN UINTN IconSize, IN BOOLEAN WantAlpha)
 {
    EG_IMAGE        *NewImage = NULL;
 
@@ -235,17 +238,43 @@ static EG_IMAGE * egDecodeAny(IN UINT8 *FileData, IN UINTN FileDataLength, IN UI
    return NewImage;
 }
 
-EG_IMAGE * egLoadImage(IN EFI_FILE* BaseDir, IN CHAR16 *FileName, IN BOOLEAN WantAlpha)
+// Read up to Size bytes of the open file Context into Buffer, for
+// egDecodePNGStream(). Returns the number of bytes read.
+static UINTN egReadFileData(IN VOID *Context, OUT UINT8 *Buffer, IN UINTN Size)
+{
+    EFI_FILE_HANDLE FileHandle = (EFI_FILE_HANDLE) Context;
+
+    if (EFI_ERROR(refit_call3_wrapper(FileHandle->Read, FileHandle, &Size, Buffer)))
+        return 0;
+    return Size;
+}
+
+// Load an image, shrinking it (keeping its proportions) to fit within
+// MaxWidth x MaxHeight if it's bigger; either may be 0 for no limit. A PNG
+// is decoded as it's read, so that a large background never needs more
+// memory than the final image and a small window; other formats are read
+// into memory whole.
+EG_IMAGE * egLoadScaledImage(IN EFI_FILE* BaseDir, IN CHAR16 *FileName, IN UINTN MaxWidth, IN UINTN MaxHeight,
+                             IN BOOLEAN WantAlpha)
 {
     EFI_STATUS      Status;
+    EFI_FILE_HANDLE FileHandle;
     UINT8           *FileData;
-    UINTN           FileDataLength;
-    EG_IMAGE        *NewImage;
+    UINTN           FileDataLength, NewWidth, NewHeight;
+    EG_IMAGE        *NewImage, *ScaledImage;
 
     if (BaseDir == NULL || FileName == NULL)
         return NULL;
 
-    // load file
+    Status = refit_call5_wrapper(BaseDir->Open, BaseDir, &FileHandle, FileName, EFI_FILE_MODE_READ, 0);
+    if (EFI_ERROR(Status))
+        return NULL;
+    NewImage = egDecodePNGStream(egReadFileData, FileHandle, MaxWidth, MaxHeight, WantAlpha);
+    refit_call1_wrapper(FileHandle->Close, FileHandle);
+    if (NewImage != NULL)
+        return NewImage;
+
+    // not a PNG (or not one that could be decoded as it was read), so load the whole file
     Status = egLoadFile(BaseDir, FileName, &FileData, &FileDataLength);
     if (EFI_ERROR(Status))
         return NULL;
@@ -253,18 +282,32 @@ EG_IMAGE * egLoadImage(IN EFI_FILE* BaseDir, IN CHAR16 *FileName, IN BOOLEAN Wan
     // decode it
     NewImage = egDecodeAny(FileData, FileDataLength, 128, WantAlpha);
     FreePool(FileData);
+    if (NewImage != NULL) {
+        egGetFitSize(NewImage->Width, NewImage->Height, MaxWidth, MaxHeight, &NewWidth, &NewHeight);
+        if ((NewWidth != NewImage->Width) || (NewHeight != NewImage->Height)) {
+            ScaledImage = egScaleImage(NewImage, NewWidth, NewHeight);
+            egFreeImage(NewImage);
+            NewImage = ScaledImage;
+        }
+    }
 
     return NewImage;
+} // EG_IMAGE * egLoadScaledImage()
+
+EG_IMAGE * egLoadImage(IN EFI_FILE* BaseDir, IN CHAR16 *FileName, IN BOOLEAN WantAlpha)
+{
+    return egLoadScaledImage(BaseDir, FileName, 0, 0, WantAlpha);
 }
 
-// Load an icon from (BaseDir)/Path, extracting the icon of size IconSize x IconSize.
+// Load an icon from (BaseDir)/Path, extracting the icon of size IconSize x IconSize,
+// as multiplied by GlobalConfig.Scale. An icon of any other size is scaled to fit.
 // Returns a pointer to the image data, or NULL if the icon could not be loaded.
 EG_IMAGE * egLoadIcon(IN EFI_FILE* BaseDir, IN CHAR16 *Path, IN UINTN IconSize)
 {
     EFI_STATUS      Status;
     UINT8           *FileData;
     UINTN           FileDataLength;
-    EG_IMAGE        *NewImage;
+    EG_IMAGE        *NewImage, *ScaledImage;
 
     if (BaseDir == NULL || Path == NULL)
         return NULL;
@@ -275,53 +318,443 @@ EG_IMAGE * egLoadIcon(IN EFI_FILE* BaseDir, IN CHAR16 *Path, IN UINTN IconSize)
        return NULL;
 
     // decode it
+    IconSize *= GlobalConfig.Scale;
     NewImage = egDecodeAny(FileData, FileDataLength, IconSize, TRUE);
     FreePool(FileData);
-    if ((NewImage->Width != IconSize) || (NewImage->Height != IconSize)) {
-       Print(L"Warning: Attempt to load icon of the wrong size from '%s'\n", Path);
-       MyFreePool(NewImage);
-       NewImage = NULL;
+    if ((NewImage != NULL) && ((NewImage->Width != IconSize) || (NewImage->Height != IconSize))) {
+       ScaledImage = egScaleImage(NewImage, IconSize, IconSize);
+       egFreeImage(NewImage);
+       NewImage = ScaledImage;
     }
 
     return NewImage;
 } // EG_IMAGE *egLoadIcon()
 
+//
+// Icon atlases
+//
+
+// An icons directory may hold a prebuilt atlas, made by images/mkatlas.py,
+// that holds many decoded icons in one file. It's read with one call to
+// egLoadFile(), and images taken from it point into that buffer.
+
+#define ICON_ATLAS_BASENAME    L"icons"
+#define ICON_ATLAS_EXTENSION   L"atlas"
+#define ATLAS_SIGNATURE        0x61464572   /* "rEFa" */
+#define ATLAS_VERSION          1
+#define ATLAS_PREMULTIPLIED    0x0001
+#define ATLAS_IMAGE_HAS_ALPHA  0x0001
+#define ATLAS_NAME_LENGTH      24
+
+typedef struct {
+   UINT32    Signature;
+   UINT16    Version;
+   UINT16    Flags;
+   UINT32    ImageCount;
+   UINT32    Reserved;
+} EG_ATLAS_HEADER;
+
+typedef struct {
+   CHAR16    Name[ATLAS_NAME_LENGTH];
+   UINT16    Width;
+   UINT16    Height;
+   UINT32    Flags;
+   UINT32    Offset;      // of the image's pixels, from the start of the file
+   UINT32    Reserved;
+} EG_ATLAS_INDEX;
+
+// A loaded atlas. Users counts the cached icons whose pixels lie in Data;
+// an atlas whose icons directory index has been freed (Detached) is freed
+// when its last such icon is.
+typedef struct {
+   UINT8             *Data;
+   EG_ATLAS_HEADER   *Header;
+   EG_ATLAS_INDEX    *Index;
+   UINTN             Users;
+   BOOLEAN           Detached;
+} EG_ATLAS;
+
+// Load (BaseDir)/DirName/icons.atlas, checking that every image in its index
+// lies within the file. Returns NULL if the file can't be read or is invalid.
+static EG_ATLAS * egLoadAtlas(IN EFI_FILE *BaseDir, IN CHAR16 *DirName) {
+   EFI_STATUS  Status;
+   EG_ATLAS    *Atlas;
+   UINT8       *FileData;
+   UINTN       FileDataLength, i, PixelCount;
+   CHAR16      FileName[256];
+
+   SPrint(FileName, 255, L"%s\\%s.%s", DirName, ICON_ATLAS_BASENAME, ICON_ATLAS_EXTENSION);
+   Status = egLoadFile(BaseDir, FileName, &FileData, &FileDataLength);
+   if (EFI_ERROR(Status))
+      return NULL;
+
+   Atlas = AllocateZeroPool(sizeof(EG_ATLAS));
+   if (Atlas == NULL) {
+      FreePool(FileData);
+      return NULL;
+   }
+   Atlas->Data = FileData;
+   Atlas->Header = (EG_ATLAS_HEADER *) FileData;
+   Atlas->Index = (EG_ATLAS_INDEX *) (FileData + sizeof(EG_ATLAS_HEADER));
+   if ((FileDataLength < sizeof(EG_ATLAS_HEADER)) || (Atlas->Header->Signature != ATLAS_SIGNATURE) ||
+       (Atlas->Header->Version != ATLAS_VERSION) ||
+       (Atlas->Header->ImageCount > (FileDataLength - sizeof(EG_ATLAS_HEADER)) / sizeof(EG_ATLAS_INDEX))) {
+      Print(L"Warning: '%s' is not a valid icon atlas\n", FileName);
+      FreePool(FileData);
+      FreePool(Atlas);
+      return NULL;
+   } // if
+
+   for (i = 0; i < Atlas->Header->ImageCount; i++) {
+      PixelCount = (UINTN) Atlas->Index[i].Width * (UINTN) Atlas->Index[i].Height;
+      Atlas->Index[i].Name[ATLAS_NAME_LENGTH - 1] = 0;
+      if (((Atlas->Index[i].Offset % sizeof(EG_PIXEL)) != 0) || (Atlas->Index[i].Offset > FileDataLength) ||
+          (PixelCount > (FileDataLength - Atlas->Index[i].Offset) / sizeof(EG_PIXEL))) {
+         // unusable; make sure that it's never found
+         Atlas->Index[i].Name[0] = 0;
+      }
+   } // for
+   return Atlas;
+} // static EG_ATLAS * egLoadAtlas()
+
+// Free Atlas once it's detached from its icons directory and no cached icon
+// uses it.
+static VOID egReleaseAtlas(IN EG_ATLAS *Atlas) {
+   if (Atlas == NULL)
+      return;
+   if (Atlas->Users > 0)
+      Atlas->Users--;
+   if (Atlas->Detached && (Atlas->Users == 0)) {
+      FreePool(Atlas->Data);
+      FreePool(Atlas);
+   }
+} // static VOID egReleaseAtlas()
+
+// Returns an image whose pixels are those of the image named Name in Atlas,
+// with a width and height of Size (or of any size, if Size is 0), or NULL
+// if Atlas has no such image. The pixels belong to Atlas, so the returned
+// image must be freed with FreePool(), never with egFreeImage().
+static EG_IMAGE * egFindAtlasImage(IN EG_ATLAS *Atlas, IN CHAR16 *Name, IN UINTN Size) {
+   EG_ATLAS_INDEX  *Entry;
+   EG_IMAGE        *Image;
+   UINTN           i;
+
+   if ((Atlas == NULL) || (Name == NULL))
+      return NULL;
+   for (i = 0; i < Atlas->Header->ImageCount; i++) {
+      Entry = &(Atlas->Index[i]);
+      if (((Size == 0) || ((Entry->Width == Size) && (Entry->Height == Size))) && (Entry->Name[0] != 0) &&
+          (StriCmp(Entry->Name, Name) == 0)) {
+         Image = AllocatePool(sizeof(EG_IMAGE));
+         if (Image == NULL)
+            return NULL;
+         Image->Width = Entry->Width;
+         Image->Height = Entry->Height;
+         Image->HasAlpha = ((Entry->Flags & ATLAS_IMAGE_HAS_ALPHA) != 0);
+         Image->Premultiplied = Image->HasAlpha && ((Atlas->Header->Flags & ATLAS_PREMULTIPLIED) != 0);
+         Image->PixelData = (EG_PIXEL *) (Atlas->Data + Entry->Offset);
+         return Image;
+      } // if
+   } // for
+   return NULL;
+} // static EG_IMAGE * egFindAtlasImage()
+
+//
+// Icon directory index
+//
+
+#define ICON_INDEX_BUCKETS  64
+
+// One file in an icons directory, hashed by its name minus its extension
+typedef struct _eg_icon_file {
+   CHAR16                  *FileName;
+   UINTN                   BaseLength;  // length of FileName without its extension
+   UINT32                  Hash;        // FoldedHash() of FileName without its extension
+   struct _eg_icon_file    *Next;
+} EG_ICON_FILE;
+
+// The contents of an icons directory, read at most once until the icon
+// cache is flushed, and its icon atlas, if it has one
+typedef struct {
+   BOOLEAN                 Listed;
+   EG_ICON_FILE            *Buckets[ICON_INDEX_BUCKETS];
+   EG_ATLAS                *Atlas;
+} EG_ICON_DIR;
+
+// Indexes of GlobalConfig.IconsDir (0) and DEFAULT_ICONS_DIR (1)
+static EG_ICON_DIR IconDirs[2];
+
+static EG_ICON_FILE * egFindIconInDir(IN EG_ICON_DIR *Dir, IN CHAR16 *BaseName, IN UINT32 Hash, IN CHAR16 *Extension);
+
+// Returns the index of the icons directory DirName, listing it first if
+// necessary. DirNumber is 0 for GlobalConfig.IconsDir and 1 for
+// DEFAULT_ICONS_DIR.
+static EG_ICON_DIR * egGetIconDir(IN UINTN DirNumber, IN CHAR16 *DirName) {
+   EG_ICON_DIR     *Dir = &IconDirs[DirNumber];
+   EG_ICON_FILE    *File;
+   REFIT_DIR_ITER  DirIter;
+   EFI_FILE_INFO   *DirEntry;
+   CHAR16          BaseName[256];
+   UINTN           i;
+
+   if (Dir->Listed)
+      return Dir;
+   Dir->Listed = TRUE;
+   DirIterOpen(SelfDir, DirName, &DirIter);
+   while (DirIterNext(&DirIter, 2, NULL, &DirEntry)) {
+      File = AllocateZeroPool(sizeof(EG_ICON_FILE));
+      if (File == NULL)
+         break;
+      File->FileName = StrDuplicate(DirEntry->FileName);
+      File->BaseLength = StrLen(DirEntry->FileName);
+      for (i = 0; DirEntry->FileName[i] != 0; i++) {
+         if (DirEntry->FileName[i] == L'.')
+            File->BaseLength = i;
+      }
+      if ((File->FileName == NULL) || (File->BaseLength >= 256)) {
+         MyFreePool(File->FileName);
+         FreePool(File);
+         continue;
+      }
+      CopyMem(BaseName, DirEntry->FileName, File->BaseLength * sizeof(CHAR16));
+      BaseName[File->BaseLength] = 0;
+      File->Hash = FoldedHash(BaseName);
+      File->Next = Dir->Buckets[File->Hash % ICON_INDEX_BUCKETS];
+      Dir->Buckets[File->Hash % ICON_INDEX_BUCKETS] = File;
+   } // while
+   DirIterClose(&DirIter);
+   if (egFindIconInDir(Dir, ICON_ATLAS_BASENAME, FoldedHash(ICON_ATLAS_BASENAME), ICON_ATLAS_EXTENSION) != NULL)
+      Dir->Atlas = egLoadAtlas(SelfDir, DirName);
+   return Dir;
+} // static EG_ICON_DIR * egGetIconDir()
+
+// Returns the file in Dir named BaseName.Extension, or NULL if none exists.
+static EG_ICON_FILE * egFindIconInDir(IN EG_ICON_DIR *Dir, IN CHAR16 *BaseName, IN UINT32 Hash, IN CHAR16 *Extension) {
+   EG_ICON_FILE *File;
+   UINTN        BaseLength = StrLen(BaseName);
+
+   for (File = Dir->Buckets[Hash % ICON_INDEX_BUCKETS]; File != NULL; File = File->Next) {
+      if ((File->Hash == Hash) && (File->BaseLength == BaseLength) && (File->FileName[BaseLength] == L'.') &&
+          (StriCmp(File->FileName + BaseLength + 1, Extension) == 0))
+         return File;
+   } // for
+   return NULL;
+} // static EG_ICON_FILE * egFindIconInDir()
+
+// Free the icons directory indexes, so that the directories will be read
+// again when next needed. Atlases still in use by cached icons are freed
+// along with the last of those icons.
+static VOID egFreeIconDirs(VOID) {
+   EG_ICON_FILE *File;
+   UINTN        i, j;
+
+   for (i = 0; i < 2; i++) {
+      for (j = 0; j < ICON_INDEX_BUCKETS; j++) {
+         while ((File = IconDirs[i].Buckets[j]) != NULL) {
+            IconDirs[i].Buckets[j] = File->Next;
+            MyFreePool(File->FileName);
+            FreePool(File);
+         } // while
+      } // for
+      if (IconDirs[i].Atlas != NULL) {
+         IconDirs[i].Atlas->Detached = TRUE;
+         if (IconDirs[i].Atlas->Users == 0) {
+            FreePool(IconDirs[i].Atlas->Data);
+            FreePool(IconDirs[i].Atlas);
+         }
+         IconDirs[i].Atlas = NULL;
+      }
+      IconDirs[i].Listed = FALSE;
+   } // for
+} // static VOID egFreeIconDirs()
+
 // Returns an icon with any extension in ICON_EXTENSIONS from either the directory
 // specified by GlobalConfig.IconsDir or DEFAULT_ICONS_DIR. The input BaseName
 // should be the icon name without an extension. For instance, if BaseName is
 // os_linux, GlobalConfig.IconsDir is myicons, DEFAULT_ICONS_DIR is icons, and
 // ICON_EXTENSIONS is "icns,png", this function will return myicons/os_linux.icns,
 // myicons/os_linux.png, icons/os_linux.icns, or icons/os_linux.png, in that
-// order of preference. Returns NULL if no such icon can be found. All file
-// references are relative to SelfDir.
-EG_IMAGE * egFindIcon(IN CHAR16 *BaseName, IN UINTN IconSize) {
-   CHAR16 *LoadDir, *Extension;
-   CHAR16 FileName[256];
-   UINTN i;
-   EG_IMAGE *Image = NULL;
-
-   if (GlobalConfig.IconsDir != NULL)
-      LoadDir = GlobalConfig.IconsDir;
-   else
-      LoadDir = StrDuplicate(DEFAULT_ICONS_DIR);
-
-   while ((LoadDir != NULL) && (Image == NULL)) {
+// order of preference. If a directory has no such file but has an icon atlas
+// with a BaseName icon of the right size (IconSize, as multiplied by
+// GlobalConfig.Scale), that icon is used instead, and *FromAtlas is set to
+// the atlas (and its user count incremented); otherwise *FromAtlas is set to
+// NULL. An atlas icon of any other size is scaled into a new image, which
+// doesn't need the atlas. Returns NULL if no such icon can be found. All
+// file references are relative to SelfDir. Files are looked up in the
+// directories' indexes, so only files that exist are opened.
+static EG_IMAGE * egFindIconFile(IN CHAR16 *BaseName, IN UINTN IconSize, OUT EG_ATLAS **FromAtlas) {
+   CHAR16        *DirNames[2], *Extension;
+   CHAR16        FileName[256];
+   EG_ICON_DIR   *Dir;
+   EG_ICON_FILE  *File;
+   UINT32        Hash;
+   UINTN         i, d;
+   EG_IMAGE      *Image = NULL, *AtlasImage;
+
+   *FromAtlas = NULL;
+   DirNames[0] = GlobalConfig.IconsDir;
+   DirNames[1] = DEFAULT_ICONS_DIR;
+   Hash = FoldedHash(BaseName);
+   for (d = 0; (d < 2) && (Image == NULL); d++) {
+      if (DirNames[d] == NULL)
+         continue;
+      Dir = egGetIconDir(d, DirNames[d]);
       i = 0;
       while (((Extension = FindCommaDelimited(ICON_EXTENSIONS, i++)) != NULL) && (Image == NULL)) {
-         SPrint(FileName, 255, L"%s\\%s.%s", LoadDir, BaseName, Extension);
-         Image = egLoadIcon(SelfDir, FileName, IconSize);
+         File = egFindIconInDir(Dir, BaseName, Hash, Extension);
+         if (File != NULL) {
+            SPrint(FileName, 255, L"%s\\%s", DirNames[d], File->FileName);
+            Image = egLoadIcon(SelfDir, FileName, IconSize);
+         }
          MyFreePool(Extension);
       } // while()
-      if (LoadDir == GlobalConfig.IconsDir) {
-         LoadDir = StrDuplicate(DEFAULT_ICONS_DIR);
-      } else {
-         MyFreePool(LoadDir);
-         LoadDir = NULL;
-      } // if/else
-   } // while()
+      if ((Image == NULL) && (Dir->Atlas != NULL)) {
+         Image = egFindAtlasImage(Dir->Atlas, BaseName, IconSize * GlobalConfig.Scale);
+         if (Image != NULL) {
+            Dir->Atlas->Users++;
+            *FromAtlas = Dir->Atlas;
+         } else {
+            AtlasImage = egFindAtlasImage(Dir->Atlas, BaseName, 0);
+            if (AtlasImage != NULL) {
+               Image = egScaleImage(AtlasImage, IconSize * GlobalConfig.Scale, IconSize * GlobalConfig.Scale);
+               FreePool(AtlasImage);
+            }
+         } // if/else
+      } // if
+   } // for
    return Image;
+} // static EG_IMAGE * egFindIconFile()
+
+// Returns a copy of the image named Name, of any size, from the icon atlas
+// of GlobalConfig.IconsDir or, failing that, of DEFAULT_ICONS_DIR, or NULL if
+// neither atlas has one. This is meant for images that aren't icons, such
+// as the selection images. The caller should free the returned image.
+EG_IMAGE * egLoadAtlasImage(IN CHAR16 *Name) {
+   CHAR16      *DirNames[2];
+   EG_IMAGE    *AtlasImage, *Image = NULL;
+   UINTN       d;
+
+   DirNames[0] = GlobalConfig.IconsDir;
+   DirNames[1] = DEFAULT_ICONS_DIR;
+   for (d = 0; (d < 2) && (Image == NULL); d++) {
+      if (DirNames[d] == NULL)
+         continue;
+      AtlasImage = egFindAtlasImage(egGetIconDir(d, DirNames[d])->Atlas, Name, 0);
+      if (AtlasImage != NULL) {
+         Image = egCopyImage(AtlasImage);
+         FreePool(AtlasImage);
+      }
+   } // for
+   return Image;
+} // EG_IMAGE * egLoadAtlasImage()
+
+//
+// Decoded icon cache
+//
+
+// Icons looked up by egFindIcon(), including ones that weren't found, so
+// that each icon is searched for, decoded, and (if need be) scaled only
+// once no matter how many menu entries use it. RefCount is the number of
+// egFindIcon() calls that returned Image, less the number of
+// egReleaseIcon() calls for it.
+typedef struct _eg_icon_cache {
+   CHAR16                  *BaseName;
+   UINTN                   IconSize;
+   EG_IMAGE                *Image;    // NULL if the icon wasn't found
+   EG_ATLAS                *Atlas;    // holds Image's pixels, or NULL
+   UINTN                   RefCount;
+   struct _eg_icon_cache   *Next;
+} EG_ICON_CACHE;
+
+static EG_ICON_CACHE *IconCache = NULL;
+
+// Returns the icon named BaseName, as found by egFindIconFile(), from the
+// icon cache, searching for and decoding it only if it's not already
+// cached. The returned image is shared and must NOT be freed; callers may
+// pass it to egReleaseIcon() when they no longer need it.
+EG_IMAGE * egFindIcon(IN CHAR16 *BaseName, IN UINTN IconSize) {
+   EG_ICON_CACHE *Cached;
+   EG_ATLAS      *Atlas;
+
+   if (BaseName == NULL)
+      return NULL;
+   for (Cached = IconCache; Cached != NULL; Cached = Cached->Next) {
+      if ((Cached->IconSize == IconSize) && (StriCmp(Cached->BaseName, BaseName) == 0))
+         break;
+   } // for
+
+   if (Cached == NULL) {
+      Cached = AllocateZeroPool(sizeof(EG_ICON_CACHE));
+      if (Cached == NULL)
+         return egFindIconFile(BaseName, IconSize, &Atlas);
+      Cached->BaseName = StrDuplicate(BaseName);
+      Cached->IconSize = IconSize;
+      Cached->Image = egFindIconFile(BaseName, IconSize, &(Cached->Atlas));
+      Cached->Next = IconCache;
+      IconCache = Cached;
+   } // if
+   if (Cached->Image != NULL)
+      Cached->RefCount++;
+   return Cached->Image;
 } // EG_IMAGE * egFindIcon()
 
+// Take another reference to an icon returned by egFindIcon(), for a second
+// user that will pass it to egReleaseIcon() in turn. Images that didn't
+// come from egFindIcon() are ignored. Returns Image.
+EG_IMAGE * egRetainIcon(IN EG_IMAGE *Image) {
+   EG_ICON_CACHE *Cached;
+
+   if (Image == NULL)
+      return NULL;
+   for (Cached = IconCache; Cached != NULL; Cached = Cached->Next) {
+      if (Cached->Image == Image) {
+         Cached->RefCount++;
+         break;
+      } // if
+   } // for
+   return Image;
+} // EG_IMAGE * egRetainIcon()
+
+// Drop a reference to an icon returned by egFindIcon(). Images that didn't
+// come from egFindIcon() are ignored.
+VOID egReleaseIcon(IN EG_IMAGE *Image) {
+   EG_ICON_CACHE *Cached;
+
+   if (Image == NULL)
+      return;
+   for (Cached = IconCache; Cached != NULL; Cached = Cached->Next) {
+      if (Cached->Image == Image) {
+         if (Cached->RefCount > 0)
+            Cached->RefCount--;
+         return;
+      } // if
+   } // for
+} // VOID egReleaseIcon()
+
+// Free cached icons that are no longer referenced, forget icons that
+// weren't found, and discard the icons directory indexes, so that changes
+// to the icons directories (or to GlobalConfig.IconsDir) take effect.
+VOID egFlushIconCache(VOID) {
+   EG_ICON_CACHE *Cached, **Link = &IconCache;
+
+   while ((Cached = *Link) != NULL) {
+      if (Cached->RefCount == 0) {
+         *Link = Cached->Next;
+         if (Cached->Atlas != NULL) {
+            FreePool(Cached->Image);
+            egReleaseAtlas(Cached->Atlas);
+         } else {
+            egFreeImage(Cached->Image);
+         }
+         MyFreePool(Cached->BaseName);
+         FreePool(Cached);
+      } else {
+         Link = &(Cached->Next);
+      } // if/else
+   } // while
+   egFreeIconDirs();
+} // VOID egFlushIconCache()
+
 EG_IMAGE * egPrepareEmbeddedImage(IN EG_EMBEDDED_IMAGE *EmbeddedImage, IN BOOLEAN WantAlpha)
 {
     EG_IMAGE            *NewImage;
@@ -400,144 +833,27 @@ EG_IMAGE * egPrepareEmbeddedImage(IN EG_EMBEDDED_IMAGE *EmbeddedImage, IN BOOLEA
         egSetPlane(PLPTR(NewImage, a), WantAlpha ? 255 : 0, PixelCount);
     }
 
+    egPremultiplyImage(NewImage);
     return NewImage;
 }
 
-//
-// Compositing
-//
-
-VOID egRestrictImageArea(IN EG_IMAGE *Image,
-                         IN UINTN AreaPosX, IN UINTN AreaPosY,
-                         IN OUT UINTN *AreaWidth, IN OUT UINTN *AreaHeight)
-{
-    if (AreaPosX >= Image->Width || AreaPosY >= Image->Height) {
-        // out of bounds, operation has no effect
-        *AreaWidth  = 0;
-        *AreaHeight = 0;
-    } else {
-        // calculate affected area
-        if (*AreaWidth > Image->Width - AreaPosX)
-            *AreaWidth = Image->Width - AreaPosX;
-        if (*AreaHeight > Image->Height - AreaPosY)
-            *AreaHeight = Image->Height - AreaPosY;
-    }
-}
-
-VOID egFillImage(IN OUT EG_IMAGE *CompImage, IN EG_PIXEL *Color)
-{
-    UINTN       i;
-    EG_PIXEL    FillColor;
-    EG_PIXEL    *PixelPtr;
-
-    FillColor = *Color;
-    if (!CompImage->HasAlpha)
-        FillColor.a = 0;
-
-    PixelPtr = CompImage->PixelData;
-    for (i = 0; i < CompImage->Width * CompImage->Height; i++, PixelPtr++)
-        *PixelPtr = FillColor;
-}
-
-VOID egFillImageArea(IN OUT EG_IMAGE *CompImage,
-                     IN UINTN AreaPosX, IN UINTN AreaPosY,
-                     IN UINTN AreaWidth, IN UINTN AreaHeight,
-                     IN EG_PIXEL *Color)
-{
-    UINTN       x, y;
-    EG_PIXEL    FillColor;
-    EG_PIXEL    *PixelPtr;
-    EG_PIXEL    *PixelBasePtr;
-
-    egRestrictImageArea(CompImage, AreaPosX, AreaPosY, &AreaWidth, &AreaHeight);
-
-    if (AreaWidth > 0) {
-        FillColor = *Color;
-        if (!CompImage->HasAlpha)
-            FillColor.a = 0;
-
-        PixelBasePtr = CompImage->PixelData + AreaPosY * CompImage->Width + AreaPosX;
-        for (y = 0; y < AreaHeight; y++) {
-            PixelPtr = PixelBasePtr;
-            for (x = 0; x < AreaWidth; x++, PixelPtr++)
-                *PixelPtr = FillColor;
-            PixelBasePtr += CompImage->Width;
-        }
-    }
-}
-
-VOID egRawCopy(IN OUT EG_PIXEL *CompBasePtr, IN EG_PIXEL *TopBasePtr,
-               IN UINTN Width, IN UINTN Height,
-               IN UINTN CompLineOffset, IN UINTN TopLineOffset)
-{
-    UINTN       x, y;
-    EG_PIXEL    *TopPtr, *CompPtr;
-
-    for (y = 0; y < Height; y++) {
-        TopPtr = TopBasePtr;
-        CompPtr = CompBasePtr;
-        for (x = 0; x < Width; x++) {
-            *CompPtr = *TopPtr;
-            TopPtr++, CompPtr++;
-        }
-        TopBasePtr += TopLineOffset;
-        CompBasePtr += CompLineOffset;
-    }
-}
-
-VOID egRawCompose(IN OUT EG_PIXEL *CompBasePtr, IN EG_PIXEL *TopBasePtr,
-                  IN UINTN Width, IN UINTN Height,
-                  IN UINTN CompLineOffset, IN UINTN TopLineOffset)
-{
-    UINTN       x, y;
-    EG_PIXEL    *TopPtr, *CompPtr;
-    UINTN       Alpha;
-    UINTN       RevAlpha;
-    UINTN       Temp;
-
-    for (y = 0; y < Height; y++) {
-        TopPtr = TopBasePtr;
-        CompPtr = CompBasePtr;
-        for (x = 0; x < Width; x++) {
-            Alpha = TopPtr->a;
-            RevAlpha = 255 - Alpha;
-            Temp = (UINTN)CompPtr->b * RevAlpha + (UINTN)TopPtr->b * Alpha + 0x80;
-            CompPtr->b = (Temp + (Temp >> 8)) >> 8;
-            Temp = (UINTN)CompPtr->g * RevAlpha + (UINTN)TopPtr->g * Alpha + 0x80;
-            CompPtr->g = (Temp + (Temp >> 8)) >> 8;
-            Temp = (UINTN)CompPtr->r * RevAlpha + (UINTN)TopPtr->r * Alpha + 0x80;
-            CompPtr->r = (Temp + (Temp >> 8)) >> 8;
-            /*
-            CompPtr->b = ((UINTN)CompPtr->b * RevAlpha + (UINTN)TopPtr->b * Alpha) / 255;
-            CompPtr->g = ((UINTN)CompPtr->g * RevAlpha + (UINTN)TopPtr->g * Alpha) / 255;
-            CompPtr->r = ((UINTN)CompPtr->r * RevAlpha + (UINTN)TopPtr->r * Alpha) / 255;
-            */
-            TopPtr++, CompPtr++;
-        }
-        TopBasePtr += TopLineOffset;
-        CompBasePtr += CompLineOffset;
-    }
-}
-
-VOID egComposeImage(IN OUT EG_IMAGE *CompImage, IN EG_IMAGE *TopImage, IN UINTN PosX, IN UINTN PosY)
+// Returns Image enlarged by GlobalConfig.Scale, freeing the original, or
+// Image itself if there's no scaling to do, if the enlarged image would be
+// bigger than MaxWidth x MaxHeight (as when a theme's image was made for
+// the enlarged size), or if memory runs out.
+EG_IMAGE * egApplyScale(IN EG_IMAGE *Image, IN UINTN MaxWidth, IN UINTN MaxHeight)
 {
-    UINTN       CompWidth, CompHeight;
-
-    CompWidth  = TopImage->Width;
-    CompHeight = TopImage->Height;
-    egRestrictImageArea(CompImage, PosX, PosY, &CompWidth, &CompHeight);
+    EG_IMAGE *NewImage;
 
-    // compose
-    if (CompWidth > 0) {
-        if (TopImage->HasAlpha) {
-            egRawCompose(CompImage->PixelData + PosY * CompImage->Width + PosX, TopImage->PixelData,
-                         CompWidth, CompHeight, CompImage->Width, TopImage->Width);
-        } else {
-            egRawCopy(CompImage->PixelData + PosY * CompImage->Width + PosX, TopImage->PixelData,
-                      CompWidth, CompHeight, CompImage->Width, TopImage->Width);
-        }
-    }
-} /* VOID egComposeImage() */
+    if ((Image == NULL) || (GlobalConfig.Scale <= 1) ||
+        (Image->Width * GlobalConfig.Scale > MaxWidth) || (Image->Height * GlobalConfig.Scale > MaxHeight))
+        return Image;
+    NewImage = egScaleImage(Image, Image->Width * GlobalConfig.Scale, Image->Height * GlobalConfig.Scale);
+    if (NewImage == NULL)
+        return Image;
+    egFreeImage(Image);
+    return NewImage;
+} // EG_IMAGE * egApplyScale()
 
 EG_IMAGE * egEnsureImageSize(IN EG_IMAGE *Image, IN UINTN Width, IN UINTN Height, IN EG_PIXEL *Color)
 {
@@ -553,6 +869,8 @@ EG_IMAGE * egEnsureImageSize(IN EG_IMAGE *Image, IN UINTN Width, IN UINTN Height
         egFreeImage(Image);
         return NULL;
     }
+    if (Image->Premultiplied)
+        egPremultiplyImage(NewImage);
     Image->HasAlpha = FALSE;
     egComposeImage(NewImage, Image, 0, 0);
     egFreeImage(Image);
@@ -560,38 +878,4 @@ EG_IMAGE * egEnsureImageSize(IN EG_IMAGE *Image, IN UINTN Width, IN UINTN Height
     return NewImage;
 }
 
-//
-// misc internal functions
-//
-
-VOID egInsertPlane(IN UINT8 *SrcDataPtr, IN UINT8 *DestPlanePtr, IN UINTN PixelCount)
-{
-    UINTN i;
-
-    for (i = 0; i < PixelCount; i++) {
-        *DestPlanePtr = *SrcDataPtr++;
-        DestPlanePtr += 4;
-    }
-}
-
-VOID egSetPlane(IN UINT8 *DestPlanePtr, IN UINT8 Value, IN UINTN PixelCount)
-{
-    UINTN i;
-
-    for (i = 0; i < PixelCount; i++) {
-        *DestPlanePtr = Value;
-        DestPlanePtr += 4;
-    }
-}
-
-VOID egCopyPlane(IN UINT8 *SrcPlanePtr, IN UINT8 *DestPlanePtr, IN UINTN PixelCount)
-{
-    UINTN i;
-
-    for (i = 0; i < PixelCount; i++) {
-        *DestPlanePtr = *SrcPlanePtr;
-        DestPlanePtr += 4, SrcPlanePtr += 4;
-    }
-}
-
 /* EOF */
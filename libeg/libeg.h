@@ -57,6 +57,7 @@ typedef struct {
     UINTN       Width;
     UINTN       Height;
     BOOLEAN     HasAlpha;
+    BOOLEAN     Premultiplied;  // color channels are pre-multiplied by alpha
     EG_PIXEL    *PixelData;
 } EG_IMAGE;
 
@@ -100,13 +101,22 @@ EG_IMAGE * egCreateImage(IN UINTN Width, IN UINTN Height, IN BOOLEAN HasAlpha);
 EG_IMAGE * egCreateFilledImage(IN UINTN Width, IN UINTN Height, IN BOOLEAN HasAlpha, IN EG_PIXEL *Color);
 EG_IMAGE * egCopyImage(IN EG_IMAGE *Image);
 EG_IMAGE * egCropImage(IN EG_IMAGE *Image, IN UINTN StartX, IN UINTN StartY, IN UINTN Width, IN UINTN Height);
+EG_IMAGE * egScaleImage(IN EG_IMAGE *Image, IN UINTN NewWidth, IN UINTN NewHeight);
+EG_IMAGE * egEnlargeImage(IN EG_IMAGE *Image, IN UINTN Factor);
 VOID egFreeImage(IN EG_IMAGE *Image);
 
 EG_IMAGE * egLoadImage(IN EFI_FILE* BaseDir, IN CHAR16 *FileName, IN BOOLEAN WantAlpha);
+EG_IMAGE * egLoadScaledImage(IN EFI_FILE* BaseDir, IN CHAR16 *FileName, IN UINTN MaxWidth, IN UINTN MaxHeight,
+                             IN BOOLEAN WantAlpha);
 EG_IMAGE * egLoadIcon(IN EFI_FILE* BaseDir, IN CHAR16 *FileName, IN UINTN IconSize);
 EG_IMAGE * egFindIcon(IN CHAR16 *BaseName, IN UINTN IconSize);
+EG_IMAGE * egRetainIcon(IN EG_IMAGE *Image);
+VOID egReleaseIcon(IN EG_IMAGE *Image);
+VOID egFlushIconCache(VOID);
+EG_IMAGE * egLoadAtlasImage(IN CHAR16 *Name);
 EG_IMAGE * egPrepareEmbeddedImage(IN EG_EMBEDDED_IMAGE *EmbeddedImage, IN BOOLEAN WantAlpha);
 
+EG_IMAGE * egApplyScale(IN EG_IMAGE *Image, IN UINTN MaxWidth, IN UINTN MaxHeight);
 EG_IMAGE * egEnsureImageSize(IN EG_IMAGE *Image, IN UINTN Width, IN UINTN Height, IN EG_PIXEL *Color);
 
 EFI_STATUS egLoadFile(IN EFI_FILE* BaseDir, IN CHAR16 *FileName,
@@ -126,6 +136,9 @@ UINTN egGetFontCellWidth(VOID);
 UINTN egComputeTextWidth(IN CHAR16 *Text);
 VOID egMeasureText(IN CHAR16 *Text, OUT UINTN *Width, OUT UINTN *Height);
 VOID egRenderText(IN CHAR16 *Text, IN OUT EG_IMAGE *CompImage, IN UINTN PosX, IN UINTN PosY, IN UINT8 BGBrightness);
+EG_IMAGE * egRenderTextRun(IN CHAR16 *Text, IN EG_IMAGE *Background OPTIONAL, IN EG_PIXEL *Color OPTIONAL,
+                           IN UINTN AreaPosX, IN UINTN AreaPosY, IN UINTN Width, IN UINTN Height,
+                           IN UINTN TextPosX, IN UINTN TextPosY);
 VOID egLoadFont(IN CHAR16 *Filename);
 
 VOID egClearScreen(IN EG_PIXEL *Color);
@@ -136,6 +149,8 @@ VOID egDrawImageArea(IN EG_IMAGE *Image,
                      IN UINTN AreaWidth, IN UINTN AreaHeight,
                      IN UINTN ScreenPosX, IN UINTN ScreenPosY);
 VOID egDisplayMessage(IN CHAR16 *Text, EG_PIXEL *BGColor);
+VOID egFlush(VOID);
+VOID egInvalidateShadow(VOID);
 EG_IMAGE * egCopyScreen(VOID);
 VOID egScreenShot(VOID);
 BOOLEAN egSetTextMode(UINT32 RequestedMode);
@@ -50,6 +50,25 @@
 
 typedef EG_IMAGE * (*EG_DECODE_FUNC)(IN UINT8 *FileData, IN UINTN FileDataLength, IN UINTN IconSize, IN BOOLEAN WantAlpha);
 
+// Shrinks an image as its rows arrive; see scale.c
+typedef struct EG_ROW_SCALER EG_ROW_SCALER;
+
+#define EG_NO_GLYPH     0xFFFF
+#define EG_GLYPH_CELLS  128
+
+// A bitmap (PSF2) font; see load_psf.c
+typedef struct {
+   UINT8       *Data;                 // the font file, holding the packed glyphs
+   UINT8       *Glyphs;
+   UINTN       GlyphCount, GlyphSize, RowBytes;
+   UINTN       Width, Height;         // of the glyphs in the file
+   UINTN       Scale;                 // factor by which glyphs are enlarged when expanded
+   UINTN       DefaultGlyph;
+   UINT16      *Pages[256];           // glyph numbers for each 256-character page, or NULL
+   EG_IMAGE    *Cells[2];             // expanded glyphs, in dark and light colors
+   UINT16      CellGlyphs[2][EG_GLYPH_CELLS];
+} EG_BITMAP_FONT;
+
 /* functions */
 
 BOOLEAN egSetScreenSize(IN OUT UINTN *ScreenWidth, IN OUT UINTN *ScreenHeight);
@@ -63,6 +82,11 @@ VOID egRawCopy(IN OUT EG_PIXEL *CompBasePtr, IN EG_PIXEL *TopBasePtr,
 VOID egRawCompose(IN OUT EG_PIXEL *CompBasePtr, IN EG_PIXEL *TopBasePtr,
                   IN UINTN Width, IN UINTN Height,
                   IN UINTN CompLineOffset, IN UINTN TopLineOffset);
+VOID egRawComposePremultiplied(IN OUT EG_PIXEL *CompBasePtr, IN EG_PIXEL *TopBasePtr,
+                               IN UINTN Width, IN UINTN Height,
+                               IN UINTN CompLineOffset, IN UINTN TopLineOffset);
+VOID egPremultiplyPixels(IN OUT EG_PIXEL *PixelPtr, IN UINTN Count);
+VOID egPremultiplyImage(IN OUT EG_IMAGE *Image);
 
 #define PLPTR(imagevar, colorname) ((UINT8 *) &((imagevar)->PixelData->colorname))
 
@@ -73,9 +97,21 @@ VOID egCopyPlane(IN UINT8 *SrcPlanePtr, IN UINT8 *DestPlanePtr, IN UINTN PixelCo
 
 EG_IMAGE * egDecodeBMP(IN UINT8 *FileData, IN UINTN FileDataLength, IN UINTN IconSize, IN BOOLEAN WantAlpha);
 EG_IMAGE * egDecodeICNS(IN UINT8 *FileData, IN UINTN FileDataLength, IN UINTN IconSize, IN BOOLEAN WantAlpha);
+EG_IMAGE * egDecodeAny(IN UINT8 *FileData, IN UINTN FileDataLength, IN UINTN IconSize, IN BOOLEAN WantAlpha);
 
 VOID egEncodeBMP(IN EG_IMAGE *Image, OUT UINT8 **FileData, OUT UINTN *FileDataLength);
 
+VOID egGetFitSize(IN UINTN Width, IN UINTN Height, IN UINTN MaxWidth, IN UINTN MaxHeight,
+                  OUT UINTN *NewWidth, OUT UINTN *NewHeight);
+EG_ROW_SCALER * egCreateRowScaler(IN EG_IMAGE *Image, IN UINTN SrcWidth, IN UINTN SrcHeight);
+VOID egScaleRow(IN OUT EG_ROW_SCALER *Scaler, IN EG_PIXEL *Row);
+VOID egFreeRowScaler(IN EG_ROW_SCALER *Scaler);
+
+EG_BITMAP_FONT * egDecodePSF(IN UINT8 *FileData, IN UINTN FileDataLength);
+VOID egFreeBitmapFont(IN EG_BITMAP_FONT *Font);
+VOID egSetBitmapFontScale(IN OUT EG_BITMAP_FONT *Font, IN UINTN Scale);
+EG_PIXEL * egGetGlyphPixels(IN EG_BITMAP_FONT *Font, IN CHAR16 Char, IN BOOLEAN Light);
+
 
 #endif /* __LIBEG_LIBEGINT_H__ */
 
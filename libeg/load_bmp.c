@@ -198,6 +198,7 @@ EG_IMAGE * egDecodeBMP(IN UINT8 *FileData, IN UINTN FileDataLength, IN UINTN Ico
         }
     }
     
+    egPremultiplyImage(NewImage);
     return NewImage;
 }
 
@@ -97,7 +97,8 @@ EG_IMAGE * egDecodeICNS(IN UINT8 *FileData, IN UINTN FileDataLength, IN UINTN Ic
     EG_IMAGE            *NewImage;
     UINT8               *Ptr, *BufferEnd, *DataPtr, *MaskPtr;
     UINT32              BlockLen, DataLen, MaskLen;
-    UINTN               FetchPixelSize, PixelCount, i;
+    UINTN               FetchPixelSize, PixelCount, i, Fallback = 0;
+    static UINTN        FallbackSizes[] = { 128, 48, 32, 16 };
     UINT8               *CompData;
     UINTN               CompLen;
     UINT8               *SrcPtr;
@@ -168,12 +169,12 @@ EG_IMAGE * egDecodeICNS(IN UINT8 *FileData, IN UINTN FileDataLength, IN UINTN Ic
             Ptr += BlockLen;
         }
 
-        /* FUTURE: try to load a different size and scale it later
-            if (DataPtr == NULL && FetchPixelSize == 32) {
-                FetchPixelSize = 128;
-                continue;
-            }
-        */
+        // if there's no icon of the requested size, try the others, largest
+        // first; egLoadIcon() scales the result to the requested size
+        if (DataPtr == NULL && Fallback < sizeof(FallbackSizes) / sizeof(FallbackSizes[0])) {
+            FetchPixelSize = FallbackSizes[Fallback++];
+            continue;
+        }
         break;
     }
 
@@ -218,8 +219,7 @@ EG_IMAGE * egDecodeICNS(IN UINT8 *FileData, IN UINTN FileDataLength, IN UINTN Ic
     else
         egSetPlane(PLPTR(NewImage, a), WantAlpha ? 255 : 0, PixelCount);
 
-    // FUTURE: scale to originally requested size if we had to load another size
-
+    egPremultiplyImage(NewImage);
     return NewImage;
 } // EG_IMAGE * egDecodeICNS()
 
@@ -0,0 +1,250 @@
+/*
+ * libeg/load_psf.c
+ * Loading PC Screen Font (PSF2) bitmap fonts
+ *
+ * Copyright (c) 2013 Roderick W. Smith
+ * All rights reserved.
+ *
+ * This program is distributed under the terms of the GNU General Public
+ * License (GPL) version 3 (GPLv3), a copy of which must be distributed
+ * with this source code or binaries made from it.
+ *
+ */
+
+// PSF2 is the format of the Linux console's fonts (as in
+// /usr/share/consolefonts, once gunzipped). A PSF2 file holds a header,
+// 1-bit-per-pixel glyph bitmaps, and an optional table mapping each glyph
+// to the Unicode characters it represents. The glyphs stay packed in the
+// file data, so even a font covering thousands of characters takes little
+// memory. A two-level table (one 256-entry page per high byte) maps each
+// character to its glyph, and glyphs are expanded into premultiplied
+// pixels, in a small cache of cells for each of the two text colors, only
+// when they're drawn.
+
+#include "libegint.h"
+
+#define PSF2_MAGIC            0x864ab572
+#define PSF2_HAS_UNICODE      0x01
+#define PSF2_SEPARATOR        0xFF
+#define PSF2_START_SEQUENCE   0xFE
+
+// The largest glyph drawn; anything bigger is surely a corrupt file
+#define PSF2_MAX_GLYPH_SIZE   256
+
+typedef struct {
+   UINT32   Magic;
+   UINT32   Version;
+   UINT32   HeaderSize;
+   UINT32   Flags;
+   UINT32   GlyphCount;
+   UINT32   GlyphSize;   // bytes per glyph
+   UINT32   Height;
+   UINT32   Width;
+} PSF2_HEADER;
+
+// Make Glyph the glyph for Char, unless Char already has one.
+static VOID egMapGlyph(IN OUT EG_BITMAP_FONT *Font, IN UINTN Char, IN UINTN Glyph) {
+   UINT16   *Page;
+   UINTN    i;
+
+   if ((Char > 0xFFFF) || (Glyph >= EG_NO_GLYPH))
+      return;
+   Page = Font->Pages[Char >> 8];
+   if (Page == NULL) {
+      Page = AllocatePool(256 * sizeof(UINT16));
+      if (Page == NULL)
+         return;
+      for (i = 0; i < 256; i++)
+         Page[i] = EG_NO_GLYPH;
+      Font->Pages[Char >> 8] = Page;
+   }
+   if (Page[Char & 0xFF] == EG_NO_GLYPH)
+      Page[Char & 0xFF] = (UINT16) Glyph;
+} // static VOID egMapGlyph()
+
+// Returns Char's glyph, or EG_NO_GLYPH if it has none.
+static UINTN egFindGlyph(IN EG_BITMAP_FONT *Font, IN UINTN Char) {
+   if ((Char > 0xFFFF) || (Font->Pages[Char >> 8] == NULL))
+      return EG_NO_GLYPH;
+   return Font->Pages[Char >> 8][Char & 0xFF];
+} // static UINTN egFindGlyph()
+
+// Read the PSF2 Unicode table, which starts at Ptr and ends before End. Each
+// glyph's entry is a list of UTF-8 characters, optionally followed by
+// sequences of characters (each introduced by PSF2_START_SEQUENCE) that the
+// glyph also represents, ending with PSF2_SEPARATOR. Sequences and
+// characters beyond the Basic Multilingual Plane are ignored, since EFI
+// strings can't hold them.
+static VOID egReadUnicodeTable(IN OUT EG_BITMAP_FONT *Font, IN UINT8 *Ptr, IN UINT8 *End) {
+   UINTN    Glyph = 0, Char, Length, i;
+   BOOLEAN  InSequence = FALSE;
+
+   while ((Ptr < End) && (Glyph < Font->GlyphCount)) {
+      if (*Ptr == PSF2_SEPARATOR) {
+         Glyph++;
+         InSequence = FALSE;
+         Ptr++;
+         continue;
+      }
+      if (*Ptr == PSF2_START_SEQUENCE) {
+         InSequence = TRUE;
+         Ptr++;
+         continue;
+      }
+
+      // decode one UTF-8 character
+      if (*Ptr < 0x80) {
+         Char = *Ptr;
+         Length = 1;
+      } else if ((*Ptr & 0xE0) == 0xC0) {
+         Char = *Ptr & 0x1F;
+         Length = 2;
+      } else if ((*Ptr & 0xF0) == 0xE0) {
+         Char = *Ptr & 0x0F;
+         Length = 3;
+      } else {
+         Char = 0x10000;   // too big (or invalid); skip it
+         Length = ((*Ptr & 0xF8) == 0xF0) ? 4 : 1;
+      }
+      if ((UINTN) (End - Ptr) < Length)
+         return;
+      for (i = 1; i < Length; i++)
+         Char = (Char << 6) | (Ptr[i] & 0x3F);
+      Ptr += Length;
+      if (!InSequence)
+         egMapGlyph(Font, Char, Glyph);
+   } // while
+} // static VOID egReadUnicodeTable()
+
+// Returns a font for the PSF2 data in FileData, which then belongs to the
+// font, or NULL (leaving FileData to the caller) if FileData isn't a usable
+// PSF2 font.
+EG_BITMAP_FONT * egDecodePSF(IN UINT8 *FileData, IN UINTN FileDataLength)
+{
+   PSF2_HEADER    *Header = (PSF2_HEADER *) FileData;
+   EG_BITMAP_FONT *Font;
+   UINTN          RowBytes, GlyphsLength, i;
+
+   if ((FileData == NULL) || (FileDataLength < sizeof(PSF2_HEADER)) || (Header->Magic != PSF2_MAGIC) ||
+       (Header->HeaderSize < sizeof(PSF2_HEADER)) || (Header->HeaderSize > FileDataLength) ||
+       (Header->Width == 0) || (Header->Width > PSF2_MAX_GLYPH_SIZE) ||
+       (Header->Height == 0) || (Header->Height > PSF2_MAX_GLYPH_SIZE) || (Header->GlyphCount == 0))
+      return NULL;
+   RowBytes = (Header->Width + 7) / 8;
+   if ((Header->GlyphSize < RowBytes * Header->Height) ||
+       (Header->GlyphCount > (FileDataLength - Header->HeaderSize) / Header->GlyphSize))
+      return NULL;
+   GlyphsLength = Header->GlyphCount * Header->GlyphSize;
+
+   Font = AllocateZeroPool(sizeof(EG_BITMAP_FONT));
+   if (Font == NULL)
+      return NULL;
+   Font->Data = FileData;
+   Font->Glyphs = FileData + Header->HeaderSize;
+   Font->GlyphCount = (Header->GlyphCount < EG_NO_GLYPH) ? Header->GlyphCount : EG_NO_GLYPH;
+   Font->GlyphSize = Header->GlyphSize;
+   Font->RowBytes = RowBytes;
+   Font->Width = Header->Width;
+   Font->Height = Header->Height;
+   Font->Scale = 1;
+   for (i = 0; i < EG_GLYPH_CELLS; i++)
+      Font->CellGlyphs[0][i] = Font->CellGlyphs[1][i] = EG_NO_GLYPH;
+
+   if (Header->Flags & PSF2_HAS_UNICODE) {
+      egReadUnicodeTable(Font, Font->Glyphs + GlyphsLength, FileData + FileDataLength);
+   } else {
+      // glyphs are in character order
+      for (i = 0; i < Font->GlyphCount; i++)
+         egMapGlyph(Font, i, i);
+   }
+
+   // characters without glyphs get the replacement character's, if any
+   Font->DefaultGlyph = egFindGlyph(Font, 0xFFFD);
+   if (Font->DefaultGlyph == EG_NO_GLYPH)
+      Font->DefaultGlyph = egFindGlyph(Font, L'?');
+   if (Font->DefaultGlyph == EG_NO_GLYPH)
+      Font->DefaultGlyph = 0;
+   return Font;
+} // EG_BITMAP_FONT * egDecodePSF()
+
+VOID egFreeBitmapFont(IN EG_BITMAP_FONT *Font)
+{
+   UINTN i;
+
+   if (Font == NULL)
+      return;
+   for (i = 0; i < 256; i++) {
+      if (Font->Pages[i] != NULL)
+         FreePool(Font->Pages[i]);
+   }
+   for (i = 0; i < 2; i++) {
+      if (Font->Cells[i] != NULL)
+         egFreeImage(Font->Cells[i]);
+   }
+   FreePool(Font->Data);
+   FreePool(Font);
+} // VOID egFreeBitmapFont()
+
+// Make glyphs Scale times their size in the file, discarding any that were
+// already expanded at another size.
+VOID egSetBitmapFontScale(IN OUT EG_BITMAP_FONT *Font, IN UINTN Scale)
+{
+   UINTN i;
+
+   if ((Font == NULL) || (Scale == 0) || (Scale == Font->Scale))
+      return;
+   for (i = 0; i < 2; i++) {
+      if (Font->Cells[i] != NULL)
+         egFreeImage(Font->Cells[i]);
+      Font->Cells[i] = NULL;
+   }
+   for (i = 0; i < EG_GLYPH_CELLS; i++)
+      Font->CellGlyphs[0][i] = Font->CellGlyphs[1][i] = EG_NO_GLYPH;
+   Font->Scale = Scale;
+} // VOID egSetBitmapFontScale()
+
+// Returns the pixels of Char's glyph, Width * Scale by Height * Scale (with a
+// line offset of Width * Scale), in light (white) or dark (black)
+// premultiplied pixels, expanding the glyph into its color's cache of cells
+// if it isn't already there. Returns NULL if memory runs out.
+EG_PIXEL * egGetGlyphPixels(IN EG_BITMAP_FONT *Font, IN CHAR16 Char, IN BOOLEAN Light)
+{
+   EG_PIXEL    Ink, *Cell, *PixelPtr;
+   UINT8       *Bits;
+   UINTN       Glyph, Slot, Color, CellWidth, CellHeight, x, y;
+
+   Color = Light ? 1 : 0;
+   CellWidth = Font->Width * Font->Scale;
+   CellHeight = Font->Height * Font->Scale;
+   if (Font->Cells[Color] == NULL) {
+      Font->Cells[Color] = egCreateImage(CellWidth, CellHeight * EG_GLYPH_CELLS, TRUE);
+      if (Font->Cells[Color] == NULL)
+         return NULL;
+      Font->Cells[Color]->Premultiplied = TRUE;
+   }
+
+   Glyph = egFindGlyph(Font, Char);
+   if ((Glyph == EG_NO_GLYPH) || (Glyph >= Font->GlyphCount))
+      Glyph = Font->DefaultGlyph;
+   Slot = Glyph % EG_GLYPH_CELLS;
+   Cell = Font->Cells[Color]->PixelData + Slot * CellWidth * CellHeight;
+   if (Font->CellGlyphs[Color][Slot] == Glyph)
+      return Cell;
+
+   Ink.b = Ink.g = Ink.r = Light ? 255 : 0;
+   Ink.a = 255;
+   PixelPtr = Cell;
+   for (y = 0; y < CellHeight; y++) {
+      Bits = Font->Glyphs + Glyph * Font->GlyphSize + (y / Font->Scale) * Font->RowBytes;
+      for (x = 0; x < CellWidth; x++, PixelPtr++) {
+         if (Bits[(x / Font->Scale) >> 3] & (0x80 >> ((x / Font->Scale) & 7)))
+            *PixelPtr = Ink;
+         else
+            *(UINT32 *) PixelPtr = 0;
+      }
+   } // for
+   Font->CellGlyphs[Color][Slot] = (UINT16) Glyph;
+   return Cell;
+} // EG_PIXEL * egGetGlyphPixels()
+
+/* EOF */
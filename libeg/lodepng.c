@@ -44,8 +44,11 @@ Rename this file to lodepng.cpp to use it for C++, or to lodepng.c to use it for
 // #include <stdio.h>
 // #include <stdlib.h>
 
+#ifndef HOST_POSIX
 #include "global.h"
 #include "../refind/screen.h"
+#include "libegint.h"
+#endif
 
 #ifdef LODEPNG_COMPILE_CPP
 #include <fstream>
@@ -109,6 +112,7 @@ static void *myrealloc(void *ptr, size_t new_size) {
    if (new_pool && ptr) {
       old_size = report_size(ptr);
       CopyMem(new_pool, ptr, (old_size < new_size) ? old_size : new_size);
+      myfree(ptr);
    }
    return new_pool;
 }
@@ -374,7 +378,7 @@ static void string_set(char** out, const char* in)
 
 unsigned lodepng_read32bitInt(const unsigned char* buffer)
 {
-  return (buffer[0] << 24) | (buffer[1] << 16) | (buffer[2] << 8) | buffer[3];
+  return ((unsigned)buffer[0] << 24) | ((unsigned)buffer[1] << 16) | ((unsigned)buffer[2] << 8) | buffer[3];
 }
 
 #if defined(LODEPNG_COMPILE_PNG) || defined(LODEPNG_COMPILE_ENCODER)
@@ -494,6 +498,21 @@ static unsigned readBitsFromStream(size_t* bitpointer, const unsigned char* bits
   }
   return result;
 }
+
+/*same as readBitsFromStream for up to 17 bits, but reads whole bytes when the three bytes that can hold
+the bits are all inside the stream*/
+static unsigned readBitsFromStreamFast(size_t* bitpointer, const unsigned char* bitstream,
+                                       size_t nbits, size_t inbitlength)
+{
+  if(*bitpointer + 24 <= inbitlength)
+  {
+    const unsigned char* p = &bitstream[*bitpointer >> 3];
+    unsigned result = ((unsigned)p[0] | ((unsigned)p[1] << 8) | ((unsigned)p[2] << 16)) >> (*bitpointer & 7);
+    (*bitpointer) += nbits;
+    return result & ((1u << nbits) - 1u);
+  }
+  return readBitsFromStream(bitpointer, bitstream, nbits);
+}
 #endif /*LODEPNG_COMPILE_DECODER*/
 
 /* ////////////////////////////////////////////////////////////////////////// */
@@ -545,6 +564,7 @@ typedef struct HuffmanTree
   unsigned* tree2d;
   unsigned* tree1d;
   unsigned* lengths; /*the lengths of the codes of the 1d-tree*/
+  unsigned* table; /*lookup table for the first FIRSTBITS bits of a code, see HuffmanTree_makeTable*/
   unsigned maxbitlen; /*maximum number of bits a single code can get*/
   unsigned numcodes; /*number of symbols in the alphabet = number of codes*/
 } HuffmanTree;
@@ -567,6 +587,7 @@ static void HuffmanTree_init(HuffmanTree* tree)
   tree->tree2d = 0;
   tree->tree1d = 0;
   tree->lengths = 0;
+  tree->table = 0;
 }
 
 static void HuffmanTree_cleanup(HuffmanTree* tree)
@@ -574,6 +595,47 @@ static void HuffmanTree_cleanup(HuffmanTree* tree)
   myfree(tree->tree2d);
   myfree(tree->tree1d);
   myfree(tree->lengths);
+  myfree(tree->table);
+}
+
+/*number of bits the decoder looks up at once in the table of a tree*/
+#define FIRSTBITS 9
+
+/*
+The table lets the decoder handle the first FIRSTBITS bits of a code with one
+lookup, instead of walking the 2D tree one bit at a time. It's indexed by the
+next FIRSTBITS bits of the stream (the first bit in the lowest position).
+Each entry holds, in its low 16 bits, the symbol whose code those bits start
+with, or, if the code is longer, the position in tree2d reached after all
+FIRSTBITS bits plus numcodes (like the values in tree2d), and in its upper
+bits the number of bits used. An entry of 0 means the walk went outside the
+tree, so that the slow bit by bit decoding reports the error.
+*/
+static unsigned HuffmanTree_makeTable(HuffmanTree* tree)
+{
+  unsigned i, bit, treepos, ct;
+
+  tree->table = (unsigned*)mymalloc((1u << FIRSTBITS) * sizeof(unsigned));
+  if(!tree->table) return 83; /*alloc fail*/
+
+  for(i = 0; i < (1u << FIRSTBITS); i++)
+  {
+    treepos = 0;
+    for(bit = 0; bit < FIRSTBITS; bit++)
+    {
+      ct = tree->tree2d[(treepos << 1) + ((i >> bit) & 1)];
+      if(ct < tree->numcodes)
+      {
+        tree->table[i] = ((bit + 1) << 16) | ct;
+        break;
+      }
+      treepos = ct - tree->numcodes;
+      if(treepos >= tree->numcodes) break; /*table[i] stays 0*/
+    }
+    if(bit == FIRSTBITS) tree->table[i] = (FIRSTBITS << 16) | (treepos + tree->numcodes);
+  }
+
+  return 0;
 }
 
 /*the tree representation used by the decoder. return value is error*/
@@ -633,7 +695,7 @@ static unsigned HuffmanTree_make2DTree(HuffmanTree* tree)
     if(tree->tree2d[n] == 32767) tree->tree2d[n] = 0; /*remove possible remaining 32767's*/
   }
 
-  return 0;
+  return HuffmanTree_makeTable(tree);
 }
 
 /*
@@ -977,6 +1039,20 @@ static unsigned huffmanDecodeSymbol(const unsigned char* in, size_t* bp,
                                     const HuffmanTree* codetree, size_t inbitlength)
 {
   unsigned treepos = 0, ct;
+  if(*bp + 16 <= inbitlength)
+  {
+    /*look up the first FIRSTBITS bits in the table; both bytes read are inside the stream*/
+    const unsigned char* p = &in[*bp >> 3];
+    unsigned entry = codetree->table[(((unsigned)p[0] | ((unsigned)p[1] << 8)) >> (*bp & 7))
+                                     & ((1u << FIRSTBITS) - 1)];
+    if(entry)
+    {
+      (*bp) += entry >> 16;
+      ct = entry & 0xFFFF;
+      if(ct < codetree->numcodes) return ct;
+      treepos = ct - codetree->numcodes; /*continue bit by bit below*/
+    }
+  }
   for(;;)
   {
     if(*bp >= inbitlength) return (unsigned)(-1); /*error: end of input memory reached without endcode*/
@@ -1001,11 +1077,11 @@ static unsigned huffmanDecodeSymbol(const unsigned char* in, size_t* bp,
 /* ////////////////////////////////////////////////////////////////////////// */
 
 /*get the tree of a deflated block with fixed tree, as specified in the deflate specification*/
-static void getTreeInflateFixed(HuffmanTree* tree_ll, HuffmanTree* tree_d)
+static unsigned getTreeInflateFixed(HuffmanTree* tree_ll, HuffmanTree* tree_d)
 {
-  /*TODO: check for out of memory errors*/
-  generateFixedLitLenTree(tree_ll);
-  generateFixedDistanceTree(tree_d);
+  unsigned error = generateFixedLitLenTree(tree_ll);
+  if(error) return error;
+  return generateFixedDistanceTree(tree_d);
 }
 
 /*get the tree of a deflated block with dynamic tree, the tree itself is also Huffman compressed with a known tree*/
@@ -1164,50 +1240,57 @@ static unsigned inflateHuffmanBlock(ucvector* out, const unsigned char* in, size
   HuffmanTree tree_ll; /*the huffman tree for literal and length codes*/
   HuffmanTree tree_d; /*the huffman tree for distance codes*/
   size_t inbitlength = inlength * 8;
+  /*working copies of *bp and *pos, which can stay in registers because the writes to out->data can't
+  change them*/
+  size_t bitpos, outpos;
 
   HuffmanTree_init(&tree_ll);
   HuffmanTree_init(&tree_d);
 
-  if(btype == 1) getTreeInflateFixed(&tree_ll, &tree_d);
+  if(btype == 1) error = getTreeInflateFixed(&tree_ll, &tree_d);
   else if(btype == 2) error = getTreeInflateDynamic(&tree_ll, &tree_d, in, bp, inlength);
 
+  bitpos = *bp;
+  outpos = *pos;
   while(!error) /*decode all symbols until end reached, breaks at end code*/
   {
     /*code_ll is literal, length or end code*/
-    unsigned code_ll = huffmanDecodeSymbol(in, bp, &tree_ll, inbitlength);
+    unsigned code_ll = huffmanDecodeSymbol(in, &bitpos, &tree_ll, inbitlength);
     if(code_ll <= 255) /*literal symbol*/
     {
-      if((*pos) >= out->size)
+      if(outpos >= out->size)
       {
         /*reserve more room at once*/
-        if(!ucvector_resize(out, ((*pos) + 1) * 2)) ERROR_BREAK(83 /*alloc fail*/);
+        if(!ucvector_resize(out, (outpos + 1) * 2)) ERROR_BREAK(83 /*alloc fail*/);
       }
-      out->data[(*pos)] = (unsigned char)(code_ll);
-      (*pos)++;
+      out->data[outpos] = (unsigned char)(code_ll);
+      outpos++;
     }
     else if(code_ll >= FIRST_LENGTH_CODE_INDEX && code_ll <= LAST_LENGTH_CODE_INDEX) /*length code*/
     {
       unsigned code_d, distance;
       unsigned numextrabits_l, numextrabits_d; /*extra bits for length and distance*/
-      size_t start, forward, backward, length;
+      size_t length, i;
+      unsigned char* dest;
+      const unsigned char* src;
 
       /*part 1: get length base*/
       length = LENGTHBASE[code_ll - FIRST_LENGTH_CODE_INDEX];
 
       /*part 2: get extra bits and add the value of that to length*/
       numextrabits_l = LENGTHEXTRA[code_ll - FIRST_LENGTH_CODE_INDEX];
-      if(*bp >= inbitlength) ERROR_BREAK(51); /*error, bit pointer will jump past memory*/
-      length += readBitsFromStream(bp, in, numextrabits_l);
+      if(bitpos >= inbitlength) ERROR_BREAK(51); /*error, bit pointer will jump past memory*/
+      length += readBitsFromStreamFast(&bitpos, in, numextrabits_l, inbitlength);
 
       /*part 3: get distance code*/
-      code_d = huffmanDecodeSymbol(in, bp, &tree_d, inbitlength);
+      code_d = huffmanDecodeSymbol(in, &bitpos, &tree_d, inbitlength);
       if(code_d > 29)
       {
-        if(code_ll == (unsigned)(-1)) /*huffmanDecodeSymbol returns (unsigned)(-1) in case of error*/
+        if(code_d == (unsigned)(-1)) /*huffmanDecodeSymbol returns (unsigned)(-1) in case of error*/
         {
           /*return error code 10 or 11 depending on the situation that happened in huffmanDecodeSymbol
           (10=no endcode, 11=wrong jump outside of tree)*/
-          error = (*bp) > inlength * 8 ? 10 : 11;
+          error = bitpos > inbitlength ? 10 : 11;
         }
         else error = 18; /*error: invalid distance code (30-31 are never used)*/
         break;
@@ -1216,27 +1299,23 @@ static unsigned inflateHuffmanBlock(ucvector* out, const unsigned char* in, size
 
       /*part 4: get extra bits from distance*/
       numextrabits_d = DISTANCEEXTRA[code_d];
-      if(*bp >= inbitlength) ERROR_BREAK(51); /*error, bit pointer will jump past memory*/
+      if(bitpos >= inbitlength) ERROR_BREAK(51); /*error, bit pointer will jump past memory*/
 
-      distance += readBitsFromStream(bp, in, numextrabits_d);
+      distance += readBitsFromStreamFast(&bitpos, in, numextrabits_d, inbitlength);
 
       /*part 5: fill in all the out[n] values based on the length and dist*/
-      start = (*pos);
-      if(distance > start) ERROR_BREAK(52); /*too long backward distance*/
-      backward = start - distance;
-      if((*pos) + length >= out->size)
+      if(distance > outpos) ERROR_BREAK(52); /*too long backward distance*/
+      if(outpos + length >= out->size)
       {
         /*reserve more room at once*/
-        if(!ucvector_resize(out, ((*pos) + length) * 2)) ERROR_BREAK(83 /*alloc fail*/);
+        if(!ucvector_resize(out, (outpos + length) * 2)) ERROR_BREAK(83 /*alloc fail*/);
       }
 
-      for(forward = 0; forward < length; forward++)
-      {
-        out->data[(*pos)] = out->data[backward];
-        (*pos)++;
-        backward++;
-        if(backward >= start) backward = start - distance;
-      }
+      /*copying forwards one byte at a time repeats the last distance bytes when length > distance*/
+      dest = &out->data[outpos];
+      src = dest - distance;
+      for(i = 0; i < length; i++) dest[i] = src[i];
+      outpos += length;
     }
     else if(code_ll == 256)
     {
@@ -1246,10 +1325,12 @@ static unsigned inflateHuffmanBlock(ucvector* out, const unsigned char* in, size
     {
       /*return error code 10 or 11 depending on the situation that happened in huffmanDecodeSymbol
       (10=no endcode, 11=wrong jump outside of tree)*/
-      error = (*bp) > inlength * 8 ? 10 : 11;
+      error = bitpos > inbitlength ? 10 : 11;
       break;
     }
   }
+  *bp = bitpos;
+  *pos = outpos;
 
   HuffmanTree_cleanup(&tree_ll);
   HuffmanTree_cleanup(&tree_d);
@@ -2100,6 +2181,14 @@ static unsigned update_adler32(unsigned adler, const unsigned char* data, unsign
     /*at least 5550 sums can be done before the sums overflow, saving a lot of module divisions*/
     unsigned amount = len > 5550 ? 5550 : len;
     len -= amount;
+    /*4 bytes at a time: s2 gains s1 4 times, and each byte as many times as s1 includes it*/
+    while(amount >= 4)
+    {
+      s2 += 4 * s1 + 4 * data[0] + 3 * data[1] + 2 * data[2] + data[3];
+      s1 += data[0] + data[1] + data[2] + data[3];
+      data += 4;
+      amount -= 4;
+    }
     while(amount > 0)
     {
       s1 += (*data++);
@@ -2317,7 +2406,9 @@ const LodePNGDecompressSettings lodepng_default_decompress_settings = {0, 0, 0,
 /* ////////////////////////////////////////////////////////////////////////// */
 
 static unsigned Crc32_crc_table_computed = 0;
-static unsigned Crc32_crc_table[256];
+/*Crc32_crc_table[0] is the usual table; Crc32_crc_table[k][n] is the CRC of byte n followed by k zero
+bytes, which lets 4 bytes at a time be looked up independently ("slicing by 4")*/
+static unsigned Crc32_crc_table[4][256];
 
 /*Make the table for a fast CRC.*/
 static void Crc32_make_crc_table(void)
@@ -2331,7 +2422,16 @@ static void Crc32_make_crc_table(void)
       if(c & 1) c = 0xedb88320L ^ (c >> 1);
       else c = c >> 1;
     }
-    Crc32_crc_table[n] = c;
+    Crc32_crc_table[0][n] = c;
+  }
+  for(n = 0; n < 256; n++)
+  {
+    c = Crc32_crc_table[0][n];
+    for(k = 1; k < 4; k++)
+    {
+      c = Crc32_crc_table[0][c & 0xff] ^ (c >> 8);
+      Crc32_crc_table[k][n] = c;
+    }
   }
   Crc32_crc_table_computed = 1;
 }
@@ -2342,12 +2442,18 @@ final running CRC (see the crc() routine below).*/
 static unsigned Crc32_update_crc(const unsigned char* buf, unsigned crc, size_t len)
 {
   unsigned c = crc;
-  size_t n;
+  size_t n = 0;
 
   if(!Crc32_crc_table_computed) Crc32_make_crc_table();
-  for(n = 0; n < len; n++)
+  for(; n + 4 <= len; n += 4)
+  {
+    c ^= (unsigned)buf[n] | ((unsigned)buf[n + 1] << 8) | ((unsigned)buf[n + 2] << 16) | ((unsigned)buf[n + 3] << 24);
+    c = Crc32_crc_table[3][c & 0xff] ^ Crc32_crc_table[2][(c >> 8) & 0xff]
+      ^ Crc32_crc_table[1][(c >> 16) & 0xff] ^ Crc32_crc_table[0][c >> 24];
+  }
+  for(; n < len; n++)
   {
-    c = Crc32_crc_table[(c ^ buf[n]) & 0xff] ^ (c >> 8);
+    c = Crc32_crc_table[0][(c ^ buf[n]) & 0xff] ^ (c >> 8);
   }
   return c;
 }
@@ -2689,12 +2795,12 @@ unsigned lodepng_can_have_alpha(const LodePNGColorMode* info)
 
 size_t lodepng_get_raw_size(unsigned w, unsigned h, const LodePNGColorMode* color)
 {
-  return (w * h * lodepng_get_bpp(color) + 7) / 8;
+  return ((size_t)w * h * lodepng_get_bpp(color) + 7) / 8;
 }
 
 size_t lodepng_get_raw_size_lct(unsigned w, unsigned h, LodePNGColorType colortype, unsigned bitdepth)
 {
-  return (w * h * lodepng_get_bpp_lct(colortype, bitdepth) + 7) / 8;
+  return ((size_t)w * h * lodepng_get_bpp_lct(colortype, bitdepth) + 7) / 8;
 }
 
 #ifdef LODEPNG_COMPILE_ANCILLARY_CHUNKS
@@ -3977,7 +4083,7 @@ unsigned lodepng_inspect(unsigned* w, unsigned* h, LodePNGState* state,
   {
     CERROR_RETURN_ERROR(state->error, 48); /*error: the given data is empty*/
   }
-  if(insize < 29)
+  if(insize < 33)
   {
     CERROR_RETURN_ERROR(state->error, 27); /*error: the data length is smaller than the length of a PNG header*/
   }
@@ -4026,6 +4132,51 @@ unsigned lodepng_inspect(unsigned* w, unsigned* h, LodePNGState* state,
   return state->error;
 }
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__aarch64__))
+/*GCC vector types, used as libeg/blend.c uses them for pixels: 16 bytes of a scanline at any address, and
+the (up to) 4 bytes of a pixel, each widened to an int*/
+#define LODEPNG_VECTORS
+typedef unsigned char lodepng_v16u8 __attribute__((vector_size(16), may_alias, aligned(1)));
+typedef int lodepng_v4i32 __attribute__((vector_size(16)));
+
+/*bytes 0..bytewidth-1 (bytewidth is 3 or 4) of p, each widened to an int*/
+#define LODEPNG_PIXEL_V4I32(p, bytewidth) \
+  ((lodepng_v4i32){ (p)[0], (p)[1], (p)[2], (bytewidth) == 4 ? (p)[3] : 0 })
+
+/*the Paeth filter for pixels of 3 or 4 bytes, with the choice of predictor made for all of a pixel's
+bytes at once, by masks instead of branches*/
+static void unfilterPaethVector(unsigned char* recon, const unsigned char* scanline, const unsigned char* precon,
+                                size_t bytewidth, size_t length)
+{
+  lodepng_v4i32 a = LODEPNG_PIXEL_V4I32(recon, bytewidth); /*pixels to the left, above, and above left*/
+  lodepng_v4i32 b, c = LODEPNG_PIXEL_V4I32(precon, bytewidth);
+  lodepng_v4i32 pa, pb, pc, mask, predictor;
+  size_t i;
+
+  for(i = bytewidth; i < length; i += bytewidth)
+  {
+    b = LODEPNG_PIXEL_V4I32(&precon[i], bytewidth);
+    pa = b - c;
+    pb = a - c;
+    pc = pa + pb;
+    pa = (pa ^ (pa >> 31)) - (pa >> 31);
+    pb = (pb ^ (pb >> 31)) - (pb >> 31);
+    pc = (pc ^ (pc >> 31)) - (pc >> 31);
+    /*the same choice as paethPredictor()*/
+    mask = pb < pa;
+    predictor = (b & mask) | (a & ~mask);
+    mask = (pc < pa) & (pc < pb);
+    predictor = (c & mask) | (predictor & ~mask);
+    a = (predictor + LODEPNG_PIXEL_V4I32(&scanline[i], bytewidth)) & 255;
+    recon[i + 0] = (unsigned char)a[0];
+    recon[i + 1] = (unsigned char)a[1];
+    recon[i + 2] = (unsigned char)a[2];
+    if(bytewidth == 4) recon[i + 3] = (unsigned char)a[3];
+    c = b;
+  }
+}
+#endif /*defined(__GNUC__) && (defined(__x86_64__) || defined(__aarch64__))*/
+
 static unsigned unfilterScanline(unsigned char* recon, const unsigned char* scanline, const unsigned char* precon,
                                  size_t bytewidth, unsigned char filterType, size_t length)
 {
@@ -4036,33 +4187,71 @@ static unsigned unfilterScanline(unsigned char* recon, const unsigned char* scan
   precon is the previous unfiltered scanline, recon the result, scanline the current one
   the incoming scanlines do NOT include the filtertype byte, that one is given in the parameter filterType instead
   recon and scanline MAY be the same memory address! precon must be disjoint.
+  The Sub and Average filters depend on the pixel to the left, so for 3 and 4 byte pixels (8-bit RGB and
+  RGBA) that pixel is kept in variables rather than read back from recon, which lets the bytes of each
+  pixel be done in parallel; the Up filter, which has no such dependency, does 16 bytes at a time.
   */
 
   size_t i;
   switch(filterType)
   {
     case 0:
-      for(i = 0; i < length; i++) recon[i] = scanline[i];
+      if(recon != scanline) for(i = 0; i < length; i++) recon[i] = scanline[i];
       break;
     case 1:
       for(i = 0; i < bytewidth; i++) recon[i] = scanline[i];
-      for(i = bytewidth; i < length; i++) recon[i] = scanline[i] + recon[i - bytewidth];
+      if(bytewidth == 3 || bytewidth == 4)
+      {
+        unsigned char a0 = recon[0], a1 = recon[1], a2 = recon[2], a3 = recon[bytewidth - 1];
+        for(i = bytewidth; i < length; i += bytewidth)
+        {
+          recon[i + 0] = a0 = (unsigned char)(scanline[i + 0] + a0);
+          recon[i + 1] = a1 = (unsigned char)(scanline[i + 1] + a1);
+          recon[i + 2] = a2 = (unsigned char)(scanline[i + 2] + a2);
+          if(bytewidth == 4) recon[i + 3] = a3 = (unsigned char)(scanline[i + 3] + a3);
+        }
+      }
+      else
+      {
+        for(i = bytewidth; i < length; i++) recon[i] = scanline[i] + recon[i - bytewidth];
+      }
       break;
     case 2:
       if(precon)
       {
-        for(i = 0; i < length; i++) recon[i] = scanline[i] + precon[i];
+        i = 0;
+#ifdef LODEPNG_VECTORS
+        for(; i + 16 <= length; i += 16)
+        {
+          *(lodepng_v16u8*)&recon[i] = *(const lodepng_v16u8*)&scanline[i] + *(const lodepng_v16u8*)&precon[i];
+        }
+#endif /*LODEPNG_VECTORS*/
+        for(; i < length; i++) recon[i] = scanline[i] + precon[i];
       }
       else
       {
-        for(i = 0; i < length; i++) recon[i] = scanline[i];
+        if(recon != scanline) for(i = 0; i < length; i++) recon[i] = scanline[i];
       }
       break;
     case 3:
       if(precon)
       {
         for(i = 0; i < bytewidth; i++) recon[i] = scanline[i] + precon[i] / 2;
-        for(i = bytewidth; i < length; i++) recon[i] = scanline[i] + ((recon[i - bytewidth] + precon[i]) / 2);
+        if(bytewidth == 3 || bytewidth == 4)
+        {
+          unsigned a0 = recon[0], a1 = recon[1], a2 = recon[2], a3 = recon[bytewidth - 1];
+          for(i = bytewidth; i < length; i += bytewidth)
+          {
+            recon[i + 0] = a0 = (unsigned char)(scanline[i + 0] + ((a0 + precon[i + 0]) >> 1));
+            recon[i + 1] = a1 = (unsigned char)(scanline[i + 1] + ((a1 + precon[i + 1]) >> 1));
+            recon[i + 2] = a2 = (unsigned char)(scanline[i + 2] + ((a2 + precon[i + 2]) >> 1));
+            if(bytewidth == 4) recon[i + 3] = a3 = (unsigned char)(scanline[i + 3] + ((a3 + precon[i + 3]) >> 1));
+          }
+        }
+        else
+        {
+          for(i = bytewidth; i < length; i++) recon[i] = scanline[i] + ((recon[i - bytewidth] + precon[i]) / 2);
+        }
       }
       else
       {
@@ -4077,6 +4266,13 @@ static unsigned unfilterScanline(unsigned char* recon, const unsigned char* scan
         {
           recon[i] = (scanline[i] + precon[i]); /*paethPredictor(0, precon[i], 0) is always precon[i]*/
         }
+#ifdef LODEPNG_VECTORS
+        if(bytewidth == 3 || bytewidth == 4)
+        {
+          unfilterPaethVector(recon, scanline, precon, bytewidth, length);
+          break;
+        }
+#endif /*LODEPNG_VECTORS*/
         for(i = bytewidth; i < length; i++)
         {
           recon[i] = (scanline[i] + paethPredictor(recon[i - bytewidth], precon[i], precon[i - bytewidth]));
@@ -4580,14 +4776,34 @@ static unsigned readChunk_pHYs(LodePNGInfo* info, const unsigned char* data, siz
 #endif /*LODEPNG_COMPILE_ANCILLARY_CHUNKS*/
 
 /*read a PNG, the result will be in the same color type as the PNG (hence "generic")*/
-static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
-                          LodePNGState* state,
-                          const unsigned char* in, size_t insize)
+/*the size of the decompressed image data: all scanlines (of all 7 reduced images if interlaced), each
+with its filter type byte*/
+static size_t getFilteredSize(unsigned w, unsigned h, const LodePNGInfo* info_png)
+{
+  unsigned bpp = lodepng_get_bpp(&info_png->color);
+  if(info_png->interlace_method == 0)
+  {
+    return (size_t)h * (1 + (w * bpp + 7) / 8);
+  }
+  else
+  {
+    unsigned passw[7], passh[7]; size_t filter_passstart[8], padded_passstart[8], passstart[8];
+    Adam7_getpassvalues(passw, passh, filter_passstart, padded_passstart, passstart, w, h, bpp);
+    return filter_passstart[7];
+  }
+}
+
+/*reads the chunks of the PNG in "in" and decompresses the data of its IDAT chunks into scanlines, which
+then holds the filtered (and possibly interlaced) scanlines, each with its filter type byte in front.
+The error, if any, is in state->error*/
+static void decodeScanlines(ucvector* scanlines, unsigned* w, unsigned* h,
+                            LodePNGState* state,
+                            const unsigned char* in, size_t insize)
 {
   unsigned char IEND = 0;
   const unsigned char* chunk;
-  size_t i;
   ucvector idat; /*the data from idat chunks*/
+  size_t filteredsize;
 
   /*for unknown chunk order*/
   unsigned unknown = 0;
@@ -4595,11 +4811,14 @@ static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
   unsigned critical_pos = 1; /*1 = after IHDR, 2 = after PLTE, 3 = after IDAT*/
 #endif /*LODEPNG_COMPILE_ANCILLARY_CHUNKS*/
 
-  /*provide some proper output values if error will happen*/
-  *out = 0;
-
   state->error = lodepng_inspect(w, h, state, in, insize); /*reads header and resets other parameters in state->info_png*/
   if(state->error) return;
+  /*error: image too big for its size in bytes (at up to 8 bytes per pixel, plus filter bytes) to be computed*/
+  if(*w > 0x3FFFFFF || (*h != 0 && *w > ((size_t)(-1) / 16) / *h))
+  {
+    state->error = 92;
+    return;
+  }
 
   ucvector_init(&idat);
   chunk = &in[33]; /*first byte of the first chunk after the header*/
@@ -4631,7 +4850,7 @@ static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
     {
       size_t oldsize = idat.size;
       if(!ucvector_resize(&idat, oldsize + chunkLength)) CERROR_BREAK(state->error, 83 /*alloc fail*/);
-      for(i = 0; i < chunkLength; i++) idat.data[oldsize + i] = data[i];
+      CopyMem(&idat.data[oldsize], data, chunkLength);
 #ifdef LODEPNG_COMPILE_ANCILLARY_CHUNKS
       critical_pos = 3;
 #endif /*LODEPNG_COMPILE_ANCILLARY_CHUNKS*/
@@ -4727,36 +4946,46 @@ static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
 
   if(!state->error)
   {
-    ucvector scanlines;
-    ucvector_init(&scanlines);
-
-    /*maximum final image length is already reserved in the vector's length - this is not really necessary*/
-    if(!ucvector_resize(&scanlines, lodepng_get_raw_size(*w, *h, &state->info_png.color) + *h))
-    {
-      state->error = 83; /*alloc fail*/
-    }
+    /*the final length is known, so reserve exactly that, rather than twice it as ucvector_resize would*/
+    filteredsize = getFilteredSize(*w, *h, &state->info_png);
+    scanlines->data = (unsigned char*)mymalloc(filteredsize);
+    if(!scanlines->data) state->error = 83; /*alloc fail*/
+    else scanlines->size = scanlines->allocsize = filteredsize;
     if(!state->error)
     {
       /*decompress with the Zlib decompressor*/
-      state->error = zlib_decompress(&scanlines.data, &scanlines.size, idat.data,
+      state->error = zlib_decompress(&scanlines->data, &scanlines->size, idat.data,
                                      idat.size, &state->decoder.zlibsettings);
     }
-
-    if(!state->error)
-    {
-      ucvector outv;
-      ucvector_init(&outv);
-      if(!ucvector_resizev(&outv,
-          lodepng_get_raw_size(*w, *h, &state->info_png.color), 0)) state->error = 83; /*alloc fail*/
-      if(!state->error) state->error = postProcessScanlines(outv.data, scanlines.data, *w, *h, &state->info_png);
-      *out = outv.data;
-    }
-    ucvector_cleanup(&scanlines);
+    if(!state->error && scanlines->size < filteredsize) state->error = 90; /*image data too short*/
   }
 
   ucvector_cleanup(&idat);
 }
 
+static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
+                          LodePNGState* state,
+                          const unsigned char* in, size_t insize)
+{
+  ucvector scanlines;
+  ucvector_init(&scanlines);
+
+  /*provide some proper output values if error will happen*/
+  *out = 0;
+
+  decodeScanlines(&scanlines, w, h, state, in, insize);
+  if(!state->error)
+  {
+    ucvector outv;
+    ucvector_init(&outv);
+    if(!ucvector_resizev(&outv,
+        lodepng_get_raw_size(*w, *h, &state->info_png.color), 0)) state->error = 83; /*alloc fail*/
+    if(!state->error) state->error = postProcessScanlines(outv.data, scanlines.data, *w, *h, &state->info_png);
+    *out = outv.data;
+  }
+  ucvector_cleanup(&scanlines);
+}
+
 unsigned lodepng_decode(unsigned char** out, unsigned* w, unsigned* h,
                         LodePNGState* state,
                         const unsigned char* in, size_t insize)
@@ -6041,6 +6270,8 @@ const CHAR16* lodepng_error_text(unsigned code)
     case 87: return L"must provide custom zlib function pointer if LODEPNG_COMPILE_ZLIB is not defined";
     case 88: return L"invalid filter strategy given for LodePNGEncoderSettings.filter_strategy";
     case 89: return L"text chunk keyword too short or long: must have size 1-79";
+    case 90: return L"decompressed image data too small to contain all scanlines";
+    case 92: return L"image too big; its size in bytes can't be computed";
   }
   return L"unknown error code";
 }
@@ -6280,41 +6511,750 @@ unsigned encode(const std::string& filename,
 #endif /*LODEPNG_COMPILE_CPP*/
 
 
-typedef struct _lode_color {
-   UINT8 red;
-   UINT8 green;
-   UINT8 blue;
-   UINT8 alpha;
-} lode_color;
+// Convert Count pixels of decoded PNG data, in the PNG's own color mode, to
+// rEFInd's BGRA pixels, with an alpha of 0 if !WantAlpha (as rEFInd's other
+// decoders do). 8-bit RGB and RGBA data, by far the most common, are
+// converted directly; anything else goes through lodepng's RGBA conversion,
+// in place, first. Returns a lodepng error code.
+static unsigned egConvertPixels(OUT EG_PIXEL *Pixels, IN const unsigned char *In, IN size_t Count,
+                                IN const LodePNGColorMode *Mode, IN BOOLEAN WantAlpha) {
+   UINT32   *PixelWords = (UINT32 *) Pixels;
+   UINT32   Word, AlphaMask = WantAlpha ? 0xFFFFFFFF : 0x00FFFFFF;
+   size_t   i;
+   unsigned Error;
+
+   if ((Mode->colortype == LCT_RGBA) && (Mode->bitdepth == 8)) {
+      for (i = 0; i < Count; i++, In += 4)
+         PixelWords[i] = ((UINT32) In[2] | ((UINT32) In[1] << 8) | ((UINT32) In[0] << 16) |
+                          ((UINT32) In[3] << 24)) & AlphaMask;
+   } else if ((Mode->colortype == LCT_RGB) && (Mode->bitdepth == 8) && !Mode->key_defined) {
+      for (i = 0; i < Count; i++, In += 3)
+         PixelWords[i] = ((UINT32) In[2] | ((UINT32) In[1] << 8) | ((UINT32) In[0] << 16) |
+                          0xFF000000) & AlphaMask;
+   } else {
+      Error = getPixelColorsRGBA8((unsigned char *) Pixels, Count, 1, In, Mode);
+      if (Error)
+         return Error;
+      // swap red and blue
+      for (i = 0; i < Count; i++) {
+         Word = PixelWords[i];
+         PixelWords[i] = ((Word & 0xFF00FF00) | ((Word >> 16) & 0xFF) | ((Word & 0xFF) << 16)) & AlphaMask;
+      }
+   }
+   return 0;
+} // static unsigned egConvertPixels()
 
+// Decode a PNG straight into a new image: each scanline is unfiltered in
+// place, in the buffer that the image data was decompressed into, and then
+// converted into the image, so there's no full-size intermediate RGBA
+// buffer. Interlaced images are first reassembled by lodepng.
 EG_IMAGE * egDecodePNG(IN UINT8 *FileData, IN UINTN FileDataLength, IN UINTN IconSize, IN BOOLEAN WantAlpha) {
-   EG_IMAGE *NewImage = NULL;
-   unsigned Error, Width, Height;
-   EG_PIXEL *PixelData;
-   lode_color *LodeData;
-   UINTN i;
+   EG_IMAGE       *NewImage = NULL;
+   LodePNGState   State;
+   ucvector       Scanlines;
+   unsigned       Width = 0, Height = 0, Bpp, Error;
+   size_t         LineBytes, y;
+   unsigned char  *Line, *PrevLine = NULL, *Raw;
+
+   lodepng_state_init(&State);
+   ucvector_init(&Scanlines);
+   decodeScanlines(&Scanlines, &Width, &Height, &State, (unsigned char *) FileData, (size_t) FileDataLength);
+   Error = State.error;
+   if (!Error) {
+      NewImage = egCreateImage(Width, Height, WantAlpha);
+      if (NewImage == NULL)
+         Error = 83; // alloc fail
+   }
 
-   Error = lodepng_decode_memory((unsigned char **) &PixelData, &Width, &Height, (unsigned char*) FileData,
-                                 (size_t) FileDataLength, LCT_RGBA, 8);
+   if (!Error && (State.info_png.interlace_method == 0)) {
+      Bpp = lodepng_get_bpp(&State.info_png.color);
+      LineBytes = (Width * Bpp + 7) / 8;
+      for (y = 0; (y < Height) && !Error; y++) {
+         Line = Scanlines.data + y * (LineBytes + 1) + 1; // after the filter type byte
+         Error = unfilterScanline(Line, Line, PrevLine, (Bpp + 7) / 8, Line[-1], LineBytes);
+         if (!Error)
+            Error = egConvertPixels(NewImage->PixelData + y * Width, Line, Width, &State.info_png.color, WantAlpha);
+         PrevLine = Line;
+      }
+   } else if (!Error) {
+      Raw = (unsigned char *) mymalloc(lodepng_get_raw_size(Width, Height, &State.info_png.color));
+      if (Raw == NULL) {
+         Error = 83; // alloc fail
+      } else {
+         Error = postProcessScanlines(Raw, Scanlines.data, Width, Height, &State.info_png);
+         if (!Error)
+            Error = egConvertPixels(NewImage->PixelData, Raw, (size_t) Width * Height, &State.info_png.color,
+                                    WantAlpha);
+         myfree(Raw);
+      }
+   }
+   ucvector_cleanup(&Scanlines);
+   lodepng_state_cleanup(&State);
 
    if (Error) {
+      if (NewImage != NULL)
+         egFreeImage(NewImage);
       return NULL;
    }
+   egPremultiplyImage(NewImage);
+   return NewImage;
+} // EG_IMAGE * egDecodePNG()
+
+//
+// Decoding a PNG as it's read
+//
+
+// egDecodePNGStream() decodes a PNG file a block at a time as it reads it,
+// so that neither the file nor its decompressed image data is ever in memory
+// in full. Its inflater pulls the IDAT chunks' data through a 64-bit bit
+// buffer, checking each chunk's CRC as it goes, and pushes its output into a
+// window that keeps the last 32 KiB (as far back as deflate may copy from)
+// plus room for a couple of scanlines. Each scanline is unfiltered as soon as
+// it's complete, and converted straight into the new image, or passed to a
+// row scaler (see scale.c) if the image must be shrunk to fit the screen.
+// Peak memory is thus one output image plus a window of a few hundred KiB at
+// most, rather than the whole file, its scanlines, and the image.
+
+#define EG_PNG_READ_SIZE   32768    // bytes read from the file at a time
+#define EG_PNG_WINDOW_SIZE 32768    // the farthest back that deflate copies from
+#define EG_PNG_MAX_MATCH   258      // the most bytes that one deflate symbol makes
+
+typedef struct {
+   // the file
+   EG_READ_FUNC   Read;
+   VOID           *Context;
+   UINT8          *Buffer;             // EG_PNG_READ_SIZE bytes of the file
+   UINTN          BufferPos, BufferLength;
+   UINT8          Chunk[8];            // the length and type of the latest chunk
+
+   // the IDAT data, and the bits of it that have been read but not decoded
+   const UINT8    *InPtr, *InEnd;      // IDAT data in Buffer not yet moved into Bits
+   UINTN          IdatLeft;            // bytes of the current IDAT chunk after InEnd
+   unsigned       Crc;                 // of the current IDAT chunk, so far
+   BOOLEAN        IdatDone;            // TRUE once a chunk other than IDAT follows them
+   UINT64         Bits;
+   UINTN          BitCount;
+   UINTN          PadBits;             // zero bits put in Bits past the end of the IDAT data
+
+   // the inflated data
+   UINT8          *Out;
+   UINTN          OutPos, OutSize;
+   UINTN          OutTotal;            // bytes slid out of the start of Out
+   UINTN          Consumed;            // bytes of Out passed on as scanlines
+   UINTN          AdlerPos;            // bytes of Out added to Adler
+   unsigned       Adler;
+
+   // the scanlines, taken a pass (of an interlaced image) at a time
+   LodePNGState   State;
+   unsigned       Width, Height, Bpp;
+   BOOLEAN        Interlaced, LinesDone, WantAlpha;
+   UINTN          Pass, PassY, PassWidth, PassHeight, PassLineBytes;
+   unsigned char  *Recon, *PrevRecon;  // the current and previous unfiltered scanlines
+   EG_PIXEL       *RowPixels;          // for scanlines that don't go straight into Image
+   EG_IMAGE       *Image;
+   EG_ROW_SCALER  *Scaler;
+
+   unsigned       Error;               // a lodepng error code; the first one sticks
+} EG_PNG_STREAM;
+
+static VOID egPNGSetError(IN OUT EG_PNG_STREAM *Stream, IN unsigned Error) {
+   if (Stream->Error == 0)
+      Stream->Error = Error;
+} // static VOID egPNGSetError()
+
+// Read the next block of the file into the buffer, if the last one is used
+// up. Returns FALSE at the end of the file.
+static BOOLEAN egPNGFillBuffer(IN OUT EG_PNG_STREAM *Stream) {
+   if (Stream->BufferPos < Stream->BufferLength)
+      return TRUE;
+   Stream->BufferPos = 0;
+   Stream->BufferLength = Stream->Read(Stream->Context, Stream->Buffer, EG_PNG_READ_SIZE);
+   return (Stream->BufferLength > 0);
+} // static BOOLEAN egPNGFillBuffer()
+
+// Copy the next Count bytes of the file to Dest, or skip them if Dest is
+// NULL. Returns FALSE if the file ends first.
+static BOOLEAN egPNGReadBytes(IN OUT EG_PNG_STREAM *Stream, OUT UINT8 *Dest, IN UINTN Count) {
+   UINTN Part;
+
+   while (Count > 0) {
+      if (!egPNGFillBuffer(Stream))
+         return FALSE;
+      Part = Stream->BufferLength - Stream->BufferPos;
+      if (Part > Count)
+         Part = Count;
+      if (Dest != NULL) {
+         CopyMem(Dest, Stream->Buffer + Stream->BufferPos, Part);
+         Dest += Part;
+      }
+      Stream->BufferPos += Part;
+      Count -= Part;
+   } // while
+   return TRUE;
+} // static BOOLEAN egPNGReadBytes()
+
+// Read the length and type of the next chunk into Stream->Chunk. Returns
+// FALSE, with an error, if the file ends first or the length is invalid.
+static BOOLEAN egPNGReadChunkHeader(IN OUT EG_PNG_STREAM *Stream) {
+   if (!egPNGReadBytes(Stream, Stream->Chunk, 8)) {
+      egPNGSetError(Stream, 30); // the file ends without IEND
+      return FALSE;
+   }
+   if (lodepng_chunk_length(Stream->Chunk) > 2147483647) {
+      egPNGSetError(Stream, 63); // chunk too long
+      return FALSE;
+   }
+   return TRUE;
+} // static BOOLEAN egPNGReadChunkHeader()
+
+// Make InPtr and InEnd span the next run of IDAT data in the buffer, reading
+// more of the file and moving on to the next IDAT chunk as needed, and
+// checking the CRC of each IDAT chunk as it ends. Returns FALSE once the
+// IDAT chunks are used up, leaving the header of the chunk after them in
+// Stream->Chunk.
+static BOOLEAN egPNGNextIdatSpan(IN OUT EG_PNG_STREAM *Stream) {
+   UINT8 CrcBytes[4];
+   UINTN Span;
+
+   while (!Stream->IdatDone) {
+      if (Stream->IdatLeft == 0) {
+         if (!egPNGReadBytes(Stream, CrcBytes, 4))
+            egPNGSetError(Stream, 30); // the file ends without IEND
+         else if (lodepng_read32bitInt(CrcBytes) != (Stream->Crc ^ 0xffffffff))
+            egPNGSetError(Stream, 57); // invalid CRC
+         if (Stream->Error || !egPNGReadChunkHeader(Stream) || !lodepng_chunk_type_equals(Stream->Chunk, "IDAT")) {
+            Stream->IdatDone = TRUE;
+            break;
+         }
+         Stream->IdatLeft = lodepng_chunk_length(Stream->Chunk);
+         Stream->Crc = Crc32_update_crc(Stream->Chunk + 4, 0xffffffff, 4);
+         continue;
+      }
+      if (!egPNGFillBuffer(Stream)) {
+         egPNGSetError(Stream, 30); // the file ends in the middle of a chunk
+         Stream->IdatDone = TRUE;
+         break;
+      }
+      Span = Stream->BufferLength - Stream->BufferPos;
+      if (Span > Stream->IdatLeft)
+         Span = Stream->IdatLeft;
+      Stream->InPtr = Stream->Buffer + Stream->BufferPos;
+      Stream->InEnd = Stream->InPtr + Span;
+      Stream->Crc = Crc32_update_crc(Stream->InPtr, Stream->Crc, Span);
+      Stream->BufferPos += Span;
+      Stream->IdatLeft -= Span;
+      return TRUE;
+   } // while
+   return FALSE;
+} // static BOOLEAN egPNGNextIdatSpan()
+
+// Fill Bits with at least 57 bits. Past the end of the IDAT data, zero bits
+// are added, and counted in PadBits, so that the decoder needn't check for
+// the end at every step; decoding any of them is an error.
+static VOID egPNGFillBits(IN OUT EG_PNG_STREAM *Stream) {
+   while (Stream->BitCount <= 56) {
+      if ((Stream->InPtr < Stream->InEnd) || egPNGNextIdatSpan(Stream)) {
+         Stream->Bits |= (UINT64) *Stream->InPtr++ << Stream->BitCount;
+      } else {
+         Stream->PadBits += 8;
+         if (Stream->PadBits > 64)
+            egPNGSetError(Stream, 10); // the data ends without an end code
+      }
+      Stream->BitCount += 8;
+   } // while
+} // static VOID egPNGFillBits()
+
+// Returns the next Count (up to 32) bits of the compressed data.
+static unsigned egPNGGetBits(IN OUT EG_PNG_STREAM *Stream, IN UINTN Count) {
+   unsigned Value;
+
+   if (Stream->BitCount < Count)
+      egPNGFillBits(Stream);
+   Value = (unsigned) (Stream->Bits & (((UINT64) 1 << Count) - 1));
+   Stream->Bits >>= Count;
+   Stream->BitCount -= Count;
+   return Value;
+} // static unsigned egPNGGetBits()
+
+// Returns the next symbol coded with Tree in *Bits, which must hold at least
+// 15 bits, or (unsigned)(-1) if they're not a valid code, as
+// huffmanDecodeSymbol() does.
+static inline unsigned egPNGDecodeSymbol(IN const HuffmanTree *Tree, IN OUT UINT64 *Bits, IN OUT UINTN *BitCount) {
+   unsigned Entry, Code, TreePos;
+
+   Entry = Tree->table[*Bits & ((1u << FIRSTBITS) - 1)];
+   if (Entry == 0)
+      return (unsigned)(-1);
+   *Bits >>= Entry >> 16;
+   *BitCount -= Entry >> 16;
+   Code = Entry & 0xFFFF;
+   while (Code >= Tree->numcodes) {
+      // a code longer than FIRSTBITS bits: walk the rest of the tree
+      TreePos = Code - Tree->numcodes;
+      if (TreePos >= Tree->numcodes)
+         return (unsigned)(-1);
+      Code = Tree->tree2d[(TreePos << 1) + (unsigned) (*Bits & 1)];
+      *Bits >>= 1;
+      (*BitCount)--;
+   }
+   return Code;
+} // static unsigned egPNGDecodeSymbol()
+
+// Read the code trees of a block with dynamic Huffman codes, as
+// getTreeInflateDynamic() does. Returns a lodepng error code.
+static unsigned egPNGReadDynamicTrees(IN OUT EG_PNG_STREAM *Stream, OUT HuffmanTree *TreeLL, OUT HuffmanTree *TreeD) {
+   HuffmanTree TreeCL;
+   unsigned    LengthsCL[NUM_CODE_LENGTH_CODES], LengthsLL[NUM_DEFLATE_CODE_SYMBOLS], LengthsD[NUM_DISTANCE_SYMBOLS];
+   unsigned    HLIT, HDIST, HCLEN, Code, Value, Repeat, i, Error;
+
+   HLIT = egPNGGetBits(Stream, 5) + 257;
+   HDIST = egPNGGetBits(Stream, 5) + 1;
+   HCLEN = egPNGGetBits(Stream, 4) + 4;
+   for (i = 0; i < NUM_CODE_LENGTH_CODES; i++)
+      LengthsCL[CLCL_ORDER[i]] = (i < HCLEN) ? egPNGGetBits(Stream, 3) : 0;
+   for (i = 0; i < NUM_DEFLATE_CODE_SYMBOLS; i++)
+      LengthsLL[i] = 0;
+   for (i = 0; i < NUM_DISTANCE_SYMBOLS; i++)
+      LengthsD[i] = 0;
+
+   HuffmanTree_init(&TreeCL);
+   Error = HuffmanTree_makeFromLengths(&TreeCL, LengthsCL, NUM_CODE_LENGTH_CODES, 7);
+   i = 0;
+   while (!Error && (i < HLIT + HDIST)) {
+      if (Stream->BitCount < 32)
+         egPNGFillBits(Stream);
+      Code = egPNGDecodeSymbol(&TreeCL, &Stream->Bits, &Stream->BitCount);
+      if (Code <= 15) {
+         // a length
+         Value = Code;
+         Repeat = 1;
+      } else if (Code == 16) {
+         // repeat the previous length 3 to 6 times
+         if (i == 0) {
+            Error = 54;
+            break;
+         }
+         Value = (i - 1 < HLIT) ? LengthsLL[i - 1] : LengthsD[i - 1 - HLIT];
+         Repeat = 3 + egPNGGetBits(Stream, 2);
+      } else if (Code == 17) {
+         // repeat 0 3 to 10 times
+         Value = 0;
+         Repeat = 3 + egPNGGetBits(Stream, 3);
+      } else if (Code == 18) {
+         // repeat 0 11 to 138 times
+         Value = 0;
+         Repeat = 11 + egPNGGetBits(Stream, 7);
+      } else {
+         Error = (Code == (unsigned)(-1)) ? 11 : 16;
+         break;
+      }
+      if (i + Repeat > HLIT + HDIST) {
+         Error = (Code == 16) ? 13 : ((Code == 17) ? 14 : 15); // more lengths than codes
+         break;
+      }
+      for (; Repeat > 0; Repeat--, i++) {
+         if (i < HLIT)
+            LengthsLL[i] = Value;
+         else
+            LengthsD[i - HLIT] = Value;
+      }
+   } // while
+   HuffmanTree_cleanup(&TreeCL);
+
+   if (!Error && (LengthsLL[256] == 0))
+      Error = 64; // no end code
+   if (!Error)
+      Error = HuffmanTree_makeFromLengths(TreeLL, LengthsLL, NUM_DEFLATE_CODE_SYMBOLS, 15);
+   if (!Error)
+      Error = HuffmanTree_makeFromLengths(TreeD, LengthsD, NUM_DISTANCE_SYMBOLS, 15);
+   return Error;
+} // static unsigned egPNGReadDynamicTrees()
+
+// Pass on the complete scanlines in Out, and slide the bytes that are no
+// longer needed, as scanlines or for back-references, out of its start.
+static VOID egPNGFlushOutput(IN OUT EG_PNG_STREAM *Stream);
+
+// Decode the symbols of a block with Huffman codes, up to its end code. The
+// bit buffer and output position are kept in local variables, which the
+// compiler can't keep in registers if they're in Stream, since writes to
+// Out might change them.
+static VOID egPNGInflateCodes(IN OUT EG_PNG_STREAM *Stream, IN const HuffmanTree *TreeLL, IN const HuffmanTree *TreeD) {
+   UINT64         Bits = Stream->Bits;
+   UINTN          BitCount = Stream->BitCount, OutPos = Stream->OutPos, Length, i;
+   const UINT8    *InPtr = Stream->InPtr, *InEnd = Stream->InEnd;
+   UINT8          *Out = Stream->Out;
+   unsigned       Code, Distance, Extra;
+
+   while (Stream->Error == 0) {
+      // get enough bits for a length and distance (up to 48 bits) ...
+      if (BitCount < 48) {
+         if (InEnd - InPtr >= 8) {
+            while (BitCount <= 56) {
+               Bits |= (UINT64) *InPtr++ << BitCount;
+               BitCount += 8;
+            }
+         } else {
+            Stream->Bits = Bits;
+            Stream->BitCount = BitCount;
+            Stream->InPtr = InPtr;
+            egPNGFillBits(Stream);
+            Bits = Stream->Bits;
+            BitCount = Stream->BitCount;
+            InPtr = Stream->InPtr;
+            InEnd = Stream->InEnd;
+         }
+      } // if
+      // ... and room for the bytes they make
+      if (OutPos + EG_PNG_MAX_MATCH > Stream->OutSize) {
+         Stream->OutPos = OutPos;
+         egPNGFlushOutput(Stream);
+         OutPos = Stream->OutPos;
+      }
 
-   // allocate image structure and buffer
-   NewImage = egCreateImage(Width, Height, WantAlpha);
-   if ((NewImage == NULL) || (NewImage->Width != Width) || (NewImage->Height != Height))
-      return NULL;
+      Code = egPNGDecodeSymbol(TreeLL, &Bits, &BitCount);
+      if (Code <= 255) {
+         Out[OutPos++] = (UINT8) Code;
+      } else if ((Code >= FIRST_LENGTH_CODE_INDEX) && (Code <= LAST_LENGTH_CODE_INDEX)) {
+         Extra = LENGTHEXTRA[Code - FIRST_LENGTH_CODE_INDEX];
+         Length = LENGTHBASE[Code - FIRST_LENGTH_CODE_INDEX] + (UINTN) (Bits & ((1u << Extra) - 1));
+         Bits >>= Extra;
+         BitCount -= Extra;
+         Code = egPNGDecodeSymbol(TreeD, &Bits, &BitCount);
+         if (Code > 29) {
+            egPNGSetError(Stream, (Code == (unsigned)(-1)) ? 11 : 18); // invalid distance code
+            break;
+         }
+         Extra = DISTANCEEXTRA[Code];
+         Distance = DISTANCEBASE[Code] + (unsigned) (Bits & ((1u << Extra) - 1));
+         Bits >>= Extra;
+         BitCount -= Extra;
+         if (Distance > Stream->OutTotal + OutPos) {
+            egPNGSetError(Stream, 52); // too long backward distance
+            break;
+         }
+         // copying forwards one byte at a time repeats the last Distance bytes when Length > Distance
+         for (i = 0; i < Length; i++)
+            Out[OutPos + i] = Out[OutPos - Distance + i];
+         OutPos += Length;
+      } else if (Code == 256) {
+         break; // end code
+      } else {
+         egPNGSetError(Stream, 11); // invalid code
+         break;
+      }
+   } // while
+
+   Stream->Bits = Bits;
+   Stream->BitCount = BitCount;
+   Stream->InPtr = InPtr;
+   Stream->OutPos = OutPos;
+} // static VOID egPNGInflateCodes()
+
+// Copy a block of uncompressed data.
+static VOID egPNGInflateStored(IN OUT EG_PNG_STREAM *Stream) {
+   unsigned Length, NLength;
+
+   egPNGGetBits(Stream, Stream->BitCount & 7); // skip to a byte boundary
+   Length = egPNGGetBits(Stream, 16);
+   NLength = egPNGGetBits(Stream, 16);
+   if (Length + NLength != 65535) {
+      egPNGSetError(Stream, 21); // NLEN is not the one's complement of LEN
+      return;
+   }
+   for (; (Length > 0) && (Stream->Error == 0); Length--) {
+      if (Stream->OutPos == Stream->OutSize)
+         egPNGFlushOutput(Stream);
+      Stream->Out[Stream->OutPos++] = (UINT8) egPNGGetBits(Stream, 8);
+   }
+} // static VOID egPNGInflateStored()
+
+// Inflate the zlib stream in the IDAT chunks, checking its Adler-32 checksum.
+static VOID egPNGInflate(IN OUT EG_PNG_STREAM *Stream) {
+   HuffmanTree TreeLL, TreeD;
+   unsigned    CMF, FLG, Final = 0, Type, Adler32, Error, i;
+
+   CMF = egPNGGetBits(Stream, 8);
+   FLG = egPNGGetBits(Stream, 8);
+   if ((CMF * 256 + FLG) % 31 != 0)
+      egPNGSetError(Stream, 24); // invalid FCHECK
+   else if (((CMF & 15) != 8) || ((CMF >> 4) > 7))
+      egPNGSetError(Stream, 25); // not deflate with a window of up to 32 KiB
+   else if (FLG & 32)
+      egPNGSetError(Stream, 26); // preset dictionary
+   Stream->Adler = 1;
+
+   while (!Final && (Stream->Error == 0)) {
+      Final = egPNGGetBits(Stream, 1);
+      Type = egPNGGetBits(Stream, 2);
+      if (Type == 3) {
+         egPNGSetError(Stream, 20); // invalid BTYPE
+      } else if (Type == 0) {
+         egPNGInflateStored(Stream);
+      } else {
+         HuffmanTree_init(&TreeLL);
+         HuffmanTree_init(&TreeD);
+         Error = (Type == 1) ? getTreeInflateFixed(&TreeLL, &TreeD) : egPNGReadDynamicTrees(Stream, &TreeLL, &TreeD);
+         if (Error)
+            egPNGSetError(Stream, Error);
+         else
+            egPNGInflateCodes(Stream, &TreeLL, &TreeD);
+         HuffmanTree_cleanup(&TreeLL);
+         HuffmanTree_cleanup(&TreeD);
+      }
+   } // while
+   egPNGFlushOutput(Stream);
+
+   if (Stream->Error == 0) {
+      // the checksum is big-endian, at the next byte boundary
+      egPNGGetBits(Stream, Stream->BitCount & 7);
+      for (i = 0, Adler32 = 0; i < 4; i++)
+         Adler32 = (Adler32 << 8) | egPNGGetBits(Stream, 8);
+      if (Stream->BitCount < Stream->PadBits)
+         egPNGSetError(Stream, 10); // the data ends too soon
+      else if (!Stream->State.decoder.zlibsettings.ignore_adler32 && (Adler32 != Stream->Adler))
+         egPNGSetError(Stream, 58); // Adler-32 checksum not correct
+   }
+} // static VOID egPNGInflate()
+
+// Get ready for the scanlines of pass Pass of an interlaced image, or of the
+// first pass after it that has any; a non-interlaced image has just the one
+// pass, 0.
+static VOID egPNGStartPass(IN OUT EG_PNG_STREAM *Stream, IN UINTN Pass) {
+   Stream->PassY = 0;
+   if (!Stream->Interlaced) {
+      Stream->PassWidth = Stream->Width;
+      Stream->PassHeight = (Pass == 0) ? Stream->Height : 0;
+   } else {
+      Stream->PassWidth = Stream->PassHeight = 0;
+      for (; Pass < 7; Pass++) {
+         Stream->PassWidth = (Stream->Width + ADAM7_DX[Pass] - ADAM7_IX[Pass] - 1) / ADAM7_DX[Pass];
+         Stream->PassHeight = (Stream->Height + ADAM7_DY[Pass] - ADAM7_IY[Pass] - 1) / ADAM7_DY[Pass];
+         if ((Stream->PassWidth > 0) && (Stream->PassHeight > 0))
+            break;
+      }
+   } // if/else
+   Stream->Pass = Pass;
+   Stream->PassLineBytes = (Stream->PassWidth * Stream->Bpp + 7) / 8;
+   if ((Stream->PassWidth == 0) || (Stream->PassHeight == 0))
+      Stream->LinesDone = TRUE;
+} // static VOID egPNGStartPass()
+
+// Unfilter one scanline, Line, which starts with its filter type byte, and
+// put its pixels into the image, or pass them on to the scaler.
+static VOID egPNGProcessLine(IN OUT EG_PNG_STREAM *Stream, IN UINT8 *Line) {
+   EG_PIXEL       *Pixels, *DstPtr;
+   unsigned char  *Temp;
+   UINTN          x;
+   unsigned       Error;
+
+   Error = unfilterScanline(Stream->Recon, Line + 1, (Stream->PassY > 0) ? Stream->PrevRecon : NULL,
+                            (Stream->Bpp + 7) / 8, Line[0], Stream->PassLineBytes);
+   Pixels = Stream->RowPixels ? Stream->RowPixels : Stream->Image->PixelData + Stream->PassY * Stream->Width;
+   if (!Error)
+      Error = egConvertPixels(Pixels, Stream->Recon, Stream->PassWidth, &Stream->State.info_png.color,
+                              Stream->WantAlpha);
+   if (Error) {
+      egPNGSetError(Stream, Error);
+      return;
+   }
 
-   LodeData = (lode_color *) PixelData;
-   for (i = 0; i < (NewImage->Height * NewImage->Width); i++) {
-      NewImage->PixelData[i].r = LodeData[i].red;
-      NewImage->PixelData[i].g = LodeData[i].green;
-      NewImage->PixelData[i].b = LodeData[i].blue;
-      if (WantAlpha)
-         NewImage->PixelData[i].a = LodeData[i].alpha;
+   if (Stream->Interlaced) {
+      DstPtr = Stream->Image->PixelData + (ADAM7_IY[Stream->Pass] + Stream->PassY * ADAM7_DY[Stream->Pass]) *
+               Stream->Width + ADAM7_IX[Stream->Pass];
+      for (x = 0; x < Stream->PassWidth; x++)
+         DstPtr[x * ADAM7_DX[Stream->Pass]] = Pixels[x];
+   } else {
+      if (Stream->WantAlpha)
+         egPremultiplyPixels(Pixels, Stream->PassWidth);
+      if (Stream->Scaler)
+         egScaleRow(Stream->Scaler, Pixels);
    }
-   myfree(PixelData);
 
+   Temp = Stream->PrevRecon;
+   Stream->PrevRecon = Stream->Recon;
+   Stream->Recon = Temp;
+   if (++Stream->PassY == Stream->PassHeight)
+      egPNGStartPass(Stream, Stream->Pass + 1);
+} // static VOID egPNGProcessLine()
+
+static VOID egPNGFlushOutput(IN OUT EG_PNG_STREAM *Stream) {
+   UINTN LineSize, Start;
+
+   Stream->Adler = update_adler32(Stream->Adler, Stream->Out + Stream->AdlerPos,
+                                  (unsigned) (Stream->OutPos - Stream->AdlerPos));
+   Stream->AdlerPos = Stream->OutPos;
+   while (!Stream->LinesDone && (Stream->Error == 0)) {
+      LineSize = Stream->PassLineBytes + 1;
+      if (Stream->OutPos - Stream->Consumed < LineSize)
+         break;
+      egPNGProcessLine(Stream, Stream->Out + Stream->Consumed);
+      Stream->Consumed += LineSize;
+   }
+   if (Stream->LinesDone)
+      Stream->Consumed = Stream->OutPos; // anything more is ignored
+
+   // keep the unused part of the last scanline and the last EG_PNG_WINDOW_SIZE bytes
+   Start = (Stream->OutPos > EG_PNG_WINDOW_SIZE) ? Stream->OutPos - EG_PNG_WINDOW_SIZE : 0;
+   if (Start > Stream->Consumed)
+      Start = Stream->Consumed;
+   if (Start > 0) {
+      CopyMem(Stream->Out, Stream->Out + Start, Stream->OutPos - Start);
+      Stream->OutPos -= Start;
+      Stream->Consumed -= Start;
+      Stream->AdlerPos -= Start;
+      Stream->OutTotal += Start;
+   }
+} // static VOID egPNGFlushOutput()
+
+// Read the chunks from the one before the image data up to the first IDAT
+// chunk, taking in the palette and transparency information. Returns FALSE
+// if there's an error.
+static BOOLEAN egPNGReadStartChunks(IN OUT EG_PNG_STREAM *Stream) {
+   UINT8    Data[4 + 3 * 256 + 4];   // a PLTE or tRNS chunk's type, data, and CRC
+   unsigned Length;
+
+   while (egPNGReadChunkHeader(Stream)) {
+      Length = lodepng_chunk_length(Stream->Chunk);
+      if (lodepng_chunk_type_equals(Stream->Chunk, "IDAT")) {
+         return TRUE;
+      } else if (lodepng_chunk_type_equals(Stream->Chunk, "PLTE") ||
+                 lodepng_chunk_type_equals(Stream->Chunk, "tRNS")) {
+         if (Length > 3 * 256) {
+            egPNGSetError(Stream, 38); // palette too big
+            break;
+         }
+         CopyMem(Data, Stream->Chunk + 4, 4);
+         if (!egPNGReadBytes(Stream, Data + 4, Length + 4)) {
+            egPNGSetError(Stream, 30); // the file ends in the middle of a chunk
+            break;
+         }
+         if (lodepng_read32bitInt(Data + 4 + Length) != lodepng_crc32(Data, 4 + Length)) {
+            egPNGSetError(Stream, 57); // invalid CRC
+            break;
+         }
+         if (Data[0] == 'P')
+            egPNGSetError(Stream, readChunk_PLTE(&Stream->State.info_png.color, Data + 4, Length));
+         else
+            egPNGSetError(Stream, readChunk_tRNS(&Stream->State.info_png.color, Data + 4, Length));
+      } else if (lodepng_chunk_type_equals(Stream->Chunk, "IEND")) {
+         egPNGSetError(Stream, 53); // no image data
+      } else if (!lodepng_chunk_ancillary(Stream->Chunk)) {
+         egPNGSetError(Stream, 69); // unknown critical chunk
+      } else if (!egPNGReadBytes(Stream, NULL, (UINTN) Length + 4)) {
+         egPNGSetError(Stream, 30); // the file ends in the middle of a chunk
+      }
+      if (Stream->Error)
+         break;
+   } // while
+   return FALSE;
+} // static BOOLEAN egPNGReadStartChunks()
+
+// Read the rest of the IDAT chunks (which may hold data after the end of the
+// zlib stream) and the chunks after them, up to IEND, as lodepng would.
+static VOID egPNGReadEndChunks(IN OUT EG_PNG_STREAM *Stream) {
+   while (egPNGNextIdatSpan(Stream))
+      ;
+   while ((Stream->Error == 0) && !lodepng_chunk_type_equals(Stream->Chunk, "IEND")) {
+      if (!lodepng_chunk_ancillary(Stream->Chunk) && !lodepng_chunk_type_equals(Stream->Chunk, "IDAT") &&
+          !lodepng_chunk_type_equals(Stream->Chunk, "PLTE"))
+         egPNGSetError(Stream, 69); // unknown critical chunk
+      else if (!egPNGReadBytes(Stream, NULL, (UINTN) lodepng_chunk_length(Stream->Chunk) + 4))
+         egPNGSetError(Stream, 30); // the file ends in the middle of a chunk
+      else
+         egPNGReadChunkHeader(Stream);
+   } // while
+} // static VOID egPNGReadEndChunks()
+
+// Decode a PNG file, which Read reads from Context, as it's read, shrinking
+// it (keeping its proportions) to fit MaxWidth x MaxHeight if it's bigger;
+// either may be 0 for no limit. Interlaced images are decoded in full, and
+// then shrunk if need be. Returns NULL if the file isn't a PNG, or if it
+// can't be decoded.
+EG_IMAGE * egDecodePNGStream(IN EG_READ_FUNC Read, IN VOID *Context, IN UINTN MaxWidth, IN UINTN MaxHeight,
+                             IN BOOLEAN WantAlpha) {
+   EG_PNG_STREAM  Stream;
+   EG_IMAGE       *NewImage;
+   UINT8          Header[33];   // the signature and IHDR chunk
+   UINTN          NewWidth = 0, NewHeight = 0, MaxLineBytes;
+
+   SetMem(&Stream, sizeof(Stream), 0);
+   Stream.Read = Read;
+   Stream.Context = Context;
+   Stream.WantAlpha = WantAlpha;
+   lodepng_state_init(&Stream.State);
+   Stream.Buffer = (UINT8 *) mymalloc(EG_PNG_READ_SIZE);
+   if (Stream.Buffer == NULL)
+      Stream.Error = 83; // alloc fail
+   else if (!egPNGReadBytes(&Stream, Header, sizeof(Header)))
+      Stream.Error = 27; // smaller than a PNG header
+   else
+      Stream.Error = lodepng_inspect(&Stream.Width, &Stream.Height, &Stream.State, Header, sizeof(Header));
+   if (!Stream.Error && ((Stream.Width == 0) || (Stream.Height == 0) || (Stream.Width > 0x3FFFFFF) ||
+                         (Stream.Width > ((size_t)(-1) / 16) / Stream.Height)))
+      Stream.Error = 92; // image too big (or empty)
+
+   if (!Stream.Error && egPNGReadStartChunks(&Stream)) {
+      Stream.IdatLeft = lodepng_chunk_length(Stream.Chunk);
+      Stream.Crc = Crc32_update_crc(Stream.Chunk + 4, 0xffffffff, 4);
+      Stream.Bpp = lodepng_get_bpp(&Stream.State.info_png.color);
+      Stream.Interlaced = (Stream.State.info_png.interlace_method != 0);
+      MaxLineBytes = ((UINTN) Stream.Width * Stream.Bpp + 7) / 8;
+      Stream.OutSize = 2 * EG_PNG_WINDOW_SIZE + 2 * (MaxLineBytes + 1) + EG_PNG_MAX_MATCH;
+      Stream.Out = (UINT8 *) mymalloc(Stream.OutSize);
+      Stream.Recon = (unsigned char *) mymalloc(MaxLineBytes);
+      Stream.PrevRecon = (unsigned char *) mymalloc(MaxLineBytes);
+
+      egGetFitSize(Stream.Width, Stream.Height, MaxWidth, MaxHeight, &NewWidth, &NewHeight);
+      if (((NewWidth == Stream.Width) && (NewHeight == Stream.Height)) || Stream.Interlaced) {
+         Stream.Image = egCreateImage(Stream.Width, Stream.Height, WantAlpha);
+      } else {
+         // rows are premultiplied before they're scaled, as egScaleImage() expects of a decoded image
+         Stream.Image = egCreateImage(NewWidth, NewHeight, WantAlpha);
+         if (Stream.Image != NULL) {
+            Stream.Image->Premultiplied = WantAlpha;
+            Stream.Scaler = egCreateRowScaler(Stream.Image, Stream.Width, Stream.Height);
+         }
+      }
+      if (Stream.Interlaced || (Stream.Scaler != NULL))
+         Stream.RowPixels = (EG_PIXEL *) mymalloc(Stream.Width * sizeof(EG_PIXEL));
+
+      if ((Stream.Out == NULL) || (Stream.Recon == NULL) || (Stream.PrevRecon == NULL) || (Stream.Image == NULL) ||
+          ((Stream.Image->Width != Stream.Width) && (Stream.Scaler == NULL)) ||
+          ((Stream.RowPixels == NULL) && (Stream.Interlaced || (Stream.Scaler != NULL)))) {
+         Stream.Error = 83; // alloc fail
+      } else {
+         egPNGStartPass(&Stream, 0);
+         egPNGInflate(&Stream);
+         if (!Stream.Error && !Stream.LinesDone)
+            Stream.Error = 90; // image data too short
+         if (!Stream.Error)
+            egPNGReadEndChunks(&Stream);
+      }
+   } // if
+
+   NewImage = Stream.Image;
+   egFreeRowScaler(Stream.Scaler);
+   myfree(Stream.Buffer);
+   myfree(Stream.Out);
+   myfree(Stream.Recon);
+   myfree(Stream.PrevRecon);
+   myfree(Stream.RowPixels);
+   lodepng_state_cleanup(&Stream.State);
+   if (Stream.Error) {
+      if (NewImage != NULL)
+         egFreeImage(NewImage);
+      return NULL;
+   }
+
+   if (Stream.Interlaced) {
+      egPremultiplyImage(NewImage);
+      if ((NewWidth != Stream.Width) || (NewHeight != Stream.Height)) {
+         Stream.Image = egScaleImage(NewImage, NewWidth, NewHeight);
+         egFreeImage(NewImage);
+         NewImage = Stream.Image;
+      }
+   } else {
+      NewImage->Premultiplied = WantAlpha; // each row was premultiplied as it was decoded
+   }
    return NewImage;
-} // EG_IMAGE * egDecodePNG()
+} // EG_IMAGE * egDecodePNGStream()
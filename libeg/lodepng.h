@@ -39,7 +39,11 @@ freely, subject to the following restrictions:
 
 //#include <string.h> /*for size_t*/
 
+#ifdef HOST_POSIX
+#include "test/host_libeg.h"
+#else
 #include "global.h"
+#endif
 #define size_t UINTN
 
 #ifdef __cplusplus
@@ -884,6 +888,12 @@ unsigned compress(std::vector<unsigned char>& out, const std::vector<unsigned ch
 #endif /*LODEPNG_COMPILE_CPP*/
 EG_IMAGE * egDecodePNG(IN UINT8 *FileData, IN UINTN FileDataLength, IN UINTN IconSize, IN BOOLEAN WantAlpha);
 
+// Reads up to Size bytes of a file into Buffer; returns the number read, which
+// is 0 at the end of the file or on an error.
+typedef UINTN (*EG_READ_FUNC)(IN VOID *Context, OUT UINT8 *Buffer, IN UINTN Size);
+EG_IMAGE * egDecodePNGStream(IN EG_READ_FUNC Read, IN VOID *Context, IN UINTN MaxWidth, IN UINTN MaxHeight,
+                             IN BOOLEAN WantAlpha);
+
 /*
 TODO:
 [.] test if there are no memory leaks or security exploits - done a lot but needs to be checked often
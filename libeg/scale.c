@@ -0,0 +1,439 @@
+/*
+ * libeg/scale.c
+ * Image scaling
+ *
+ * Copyright (c) 2013 Roderick W. Smith
+ * All rights reserved.
+ *
+ * This program is distributed under the terms of the GNU General Public
+ * License (GPL) version 3 (GPLv3), a copy of which must be distributed
+ * with this source code or binaries made from it.
+ *
+ */
+
+// egScaleImage() resizes an image in two separable passes, first along its
+// rows and then along its columns, each driven by a table of fixed-point
+// filter weights that's computed once per pass. Shrinking uses a box
+// filter, which averages exactly the source pixels that each new pixel
+// covers, so no detail is dropped at any ratio. Enlarging uses a Lanczos-2
+// filter, which stays much sharper than bilinear interpolation. Filtering
+// premultiplied pixels (as decoded images are) keeps the colors of
+// transparent areas from bleeding into the edges of the opaque ones.
+//
+// The column pass accumulates whole rows at a time, so that both passes
+// read memory sequentially. All arithmetic is in 32-bit integers, with
+// weights of 14 fractional bits, so no floating point is needed.
+//
+// egCreateRowScaler() and egScaleRow() do the same shrinking as rows of the
+// source image arrive, so that a decoder can shrink a large image without
+// ever holding it in full.
+//
+// egEnlargeImage() instead repeats pixels, by a whole number of times.
+//
+// This file depends only on basic EFI types and egCreateImage(), so that it
+// can also be built for the host by test/scalebench.c.
+
+#ifdef HOST_POSIX
+#include "test/host_libeg.h"
+#else
+#include "libegint.h"
+#endif
+
+#define WEIGHT_BITS     14
+#define WEIGHT_ONE      (1 << WEIGHT_BITS)
+
+// The Lanczos-2 kernel, sinc(x) * sinc(x / 2), at x = i / 32 for i = 0 to 64,
+// times WEIGHT_ONE
+static const INT16 Lanczos2[65] = {
+   16384, 16351, 16253, 16090, 15864, 15576, 15230, 14829, 14375, 13872, 13325, 12739, 12118,
+   11468, 10793, 10098,  9391,  8675,  7955,  7239,  6529,  5832,  5151,  4491,  3856,  3249,
+    2674,  2133,  1628,  1161,   733,   346,     0,  -306,  -571,  -797,  -985, -1136, -1252,
+   -1335, -1388, -1413, -1413, -1391, -1349, -1290, -1218, -1135, -1043,  -946,  -846,  -745,
+    -645,  -549,  -457,  -371,  -293,  -224,  -163,  -112,   -71,   -39,   -17,    -4,     0
+};
+
+// The source pixels and weights that make up each of DstSize new pixels
+typedef struct {
+   UINTN    Taps;     // weights per new pixel
+   UINTN    *Index;   // DstSize * Taps source pixel numbers
+   INT32    *Weight;  // DstSize * Taps weights, each pixel's summing to WEIGHT_ONE
+} EG_SCALE_WEIGHTS;
+
+// A new pixel's weighted sums, one per channel
+typedef struct {
+   INT32    b, g, r, a;
+} EG_SUMS;
+
+static VOID egFreeWeights(IN OUT EG_SCALE_WEIGHTS *Weights) {
+   if (Weights->Index != NULL)
+      FreePool(Weights->Index);
+   if (Weights->Weight != NULL)
+      FreePool(Weights->Weight);
+   Weights->Index = NULL;
+   Weights->Weight = NULL;
+} // static VOID egFreeWeights()
+
+// Returns the Lanczos-2 weight for a pixel Distance / 256 pixels away,
+// interpolated from the table.
+static INT32 egLanczosWeight(IN UINTN Distance) {
+   UINTN i = Distance >> 3, Fraction = Distance & 7;
+
+   if (i >= 64)
+      return 0;
+   return Lanczos2[i] + (((INT32) Lanczos2[i + 1] - (INT32) Lanczos2[i]) * (INT32) Fraction) / 8;
+} // static INT32 egLanczosWeight()
+
+// Fill in Weights for scaling SrcSize pixels to DstSize pixels. Returns
+// FALSE if memory runs out.
+static BOOLEAN egMakeWeights(OUT EG_SCALE_WEIGHTS *Weights, IN UINTN SrcSize, IN UINTN DstSize) {
+   UINTN    i, j, k, Start, End, Biggest;
+   INTN     Center, Base, Tap;
+   INT32    *Weight, Sum, Total;
+   UINTN    *Index;
+
+   Weights->Taps = (SrcSize > DstSize) ? (SrcSize + DstSize - 1) / DstSize + 1 : 4;
+   Weights->Index = AllocatePool(DstSize * Weights->Taps * sizeof(UINTN));
+   Weights->Weight = AllocateZeroPool(DstSize * Weights->Taps * sizeof(INT32));
+   if ((Weights->Index == NULL) || (Weights->Weight == NULL)) {
+      egFreeWeights(Weights);
+      return FALSE;
+   }
+
+   for (i = 0; i < DstSize; i++) {
+      Index = Weights->Index + i * Weights->Taps;
+      Weight = Weights->Weight + i * Weights->Taps;
+      if (SrcSize > DstSize) {
+         // box: in units of 1/DstSize source pixels, new pixel i covers
+         // [i * SrcSize, (i + 1) * SrcSize)
+         Start = i * SrcSize;
+         End = Start + SrcSize;
+         for (k = 0, j = Start / DstSize; k < Weights->Taps; k++, j++) {
+            Index[k] = (j < SrcSize) ? j : SrcSize - 1;
+            if (j * DstSize < End) {
+               Weight[k] = (INT32) (((((j + 1) * DstSize < End) ? (j + 1) * DstSize : End) -
+                                     ((j * DstSize > Start) ? j * DstSize : Start)) * WEIGHT_ONE / SrcSize);
+            }
+         } // for
+      } else {
+         // Lanczos-2: the new pixel's center, in 1/256 source pixels, and the
+         // two source pixels to either side of it
+         Center = (INTN) (((2 * i + 1) * SrcSize * 256) / (2 * DstSize)) - 128;
+         Base = (Center >= 0) ? (Center >> 8) : -1;
+         for (k = 0; k < 4; k++) {
+            Tap = Base - 1 + (INTN) k;
+            Index[k] = (Tap < 0) ? 0 : (((UINTN) Tap >= SrcSize) ? SrcSize - 1 : (UINTN) Tap);
+            Weight[k] = egLanczosWeight((UINTN) ((Tap * 256 > Center) ? Tap * 256 - Center : Center - Tap * 256));
+         } // for
+      } // if/else
+
+      // make the weights sum to exactly WEIGHT_ONE, so that flat areas stay flat
+      Sum = 0;
+      for (k = 0; k < Weights->Taps; k++)
+         Sum += Weight[k];
+      if (Sum == 0) {
+         // shrinking so far that every weight rounded to 0; take one pixel
+         Weight[0] = Sum = WEIGHT_ONE;
+      }
+      Total = 0;
+      Biggest = 0;
+      for (k = 0; k < Weights->Taps; k++) {
+         Weight[k] = (Weight[k] * WEIGHT_ONE + Sum / 2) / Sum;
+         Total += Weight[k];
+         if (Weight[k] > Weight[Biggest])
+            Biggest = k;
+      }
+      Weight[Biggest] += WEIGHT_ONE - Total;
+   } // for
+   return TRUE;
+} // static BOOLEAN egMakeWeights()
+
+// Add Weight times Pixel's channels to Sums.
+static inline VOID egAddWeighted(IN OUT EG_SUMS *Sums, IN EG_PIXEL *Pixel, IN INT32 Weight) {
+   Sums->b += Weight * Pixel->b;
+   Sums->g += Weight * Pixel->g;
+   Sums->r += Weight * Pixel->r;
+   Sums->a += Weight * Pixel->a;
+} // static VOID egAddWeighted()
+
+// Returns a weighted sum, rounded and limited to the range of a UINT8.
+static inline UINT8 egClampChannel(IN INT32 Sum) {
+   Sum = (Sum + (WEIGHT_ONE >> 1)) >> WEIGHT_BITS;
+   return (UINT8) ((Sum < 0) ? 0 : ((Sum > 255) ? 255 : Sum));
+} // static UINT8 egClampChannel()
+
+// Store Sums in Pixel, rounded and limited to the range of a UINT8, and (if
+// Premultiplied) with no color brighter than the pixel's alpha, which
+// Lanczos ringing could otherwise leave behind.
+static inline VOID egStoreSums(OUT EG_PIXEL *Pixel, IN EG_SUMS *Sums, IN BOOLEAN Premultiplied) {
+   Pixel->b = egClampChannel(Sums->b);
+   Pixel->g = egClampChannel(Sums->g);
+   Pixel->r = egClampChannel(Sums->r);
+   Pixel->a = egClampChannel(Sums->a);
+   if (Premultiplied) {
+      if (Pixel->b > Pixel->a)
+         Pixel->b = Pixel->a;
+      if (Pixel->g > Pixel->a)
+         Pixel->g = Pixel->a;
+      if (Pixel->r > Pixel->a)
+         Pixel->r = Pixel->a;
+   }
+} // static VOID egStoreSums()
+
+// Scale one row of pixels, Src, along its length into Dst, as Columns directs.
+static VOID egScaleAlongRow(OUT EG_PIXEL *Dst, IN EG_PIXEL *Src, IN EG_SCALE_WEIGHTS *Columns, IN UINTN NewWidth) {
+   EG_SUMS  Sum;
+   INT32    *Weight = Columns->Weight;
+   UINTN    *Index = Columns->Index;
+   UINTN    x, k;
+
+   for (x = 0; x < NewWidth; x++, Dst++) {
+      SetMem(&Sum, sizeof(EG_SUMS), 0);
+      for (k = 0; k < Columns->Taps; k++, Index++, Weight++)
+         egAddWeighted(&Sum, Src + *Index, *Weight);
+      egStoreSums(Dst, &Sum, FALSE);
+   }
+} // static VOID egScaleAlongRow()
+
+// Returns a copy of Image scaled to NewWidth x NewHeight, or NULL if memory
+// runs out. The new image keeps Image's HasAlpha and Premultiplied flags.
+EG_IMAGE * egScaleImage(IN EG_IMAGE *Image, IN UINTN NewWidth, IN UINTN NewHeight)
+{
+   EG_SCALE_WEIGHTS  Columns, Rows;
+   EG_IMAGE          *NewImage = NULL, *Temp = NULL;
+   EG_PIXEL          *SrcPtr, *DstPtr;
+   EG_SUMS           *Sums = NULL, Zero;
+   INT32             *Weight;
+   UINTN             *Index;
+   UINTN             x, y, k;
+
+   if ((Image == NULL) || (NewWidth == 0) || (NewHeight == 0) || (Image->Width == 0) || (Image->Height == 0))
+      return NULL;
+   if ((NewWidth == Image->Width) && (NewHeight == Image->Height))
+      return egCopyImage(Image);
+
+   if (!egMakeWeights(&Columns, Image->Width, NewWidth))
+      return NULL;
+   if (!egMakeWeights(&Rows, Image->Height, NewHeight)) {
+      egFreeWeights(&Columns);
+      return NULL;
+   }
+   Temp = egCreateImage(NewWidth, Image->Height, Image->HasAlpha);
+   NewImage = egCreateImage(NewWidth, NewHeight, Image->HasAlpha);
+   Sums = AllocatePool(NewWidth * sizeof(EG_SUMS));
+   if ((Temp == NULL) || (NewImage == NULL) || (Sums == NULL)) {
+      if (NewImage != NULL)
+         egFreeImage(NewImage);
+      NewImage = NULL;
+      goto Done;
+   }
+   NewImage->Premultiplied = Image->Premultiplied;
+   SetMem(&Zero, sizeof(EG_SUMS), 0);
+
+   // scale each row
+   for (y = 0; y < Image->Height; y++)
+      egScaleAlongRow(Temp->PixelData + y * NewWidth, Image->PixelData + y * Image->Width, &Columns, NewWidth);
+
+   // scale each column, a whole row at a time
+   DstPtr = NewImage->PixelData;
+   for (y = 0; y < NewHeight; y++) {
+      for (x = 0; x < NewWidth; x++)
+         Sums[x] = Zero;
+      Index = Rows.Index + y * Rows.Taps;
+      Weight = Rows.Weight + y * Rows.Taps;
+      for (k = 0; k < Rows.Taps; k++) {
+         if (Weight[k] == 0)
+            continue;
+         SrcPtr = Temp->PixelData + Index[k] * NewWidth;
+         for (x = 0; x < NewWidth; x++)
+            egAddWeighted(&Sums[x], &SrcPtr[x], Weight[k]);
+      } // for
+      for (x = 0; x < NewWidth; x++, DstPtr++)
+         egStoreSums(DstPtr, &Sums[x], NewImage->Premultiplied);
+   } // for
+
+Done:
+   if (Temp != NULL)
+      egFreeImage(Temp);
+   if (Sums != NULL)
+      FreePool(Sums);
+   egFreeWeights(&Columns);
+   egFreeWeights(&Rows);
+   return NewImage;
+} // EG_IMAGE * egScaleImage()
+
+// Get the size, in *NewWidth and *NewHeight, to which a Width x Height image
+// must be shrunk, keeping its proportions, to fit within MaxWidth x MaxHeight
+// (either of which may be 0, for no limit). That's its own size if it
+// already fits.
+VOID egGetFitSize(IN UINTN Width, IN UINTN Height, IN UINTN MaxWidth, IN UINTN MaxHeight,
+                  OUT UINTN *NewWidth, OUT UINTN *NewHeight)
+{
+   *NewWidth = Width;
+   *NewHeight = Height;
+   if (((MaxWidth == 0) || (Width <= MaxWidth)) && ((MaxHeight == 0) || (Height <= MaxHeight)))
+      return;
+
+   // keep the products below within 32 bits; the proportions barely change
+   while ((Width > 0xFFFF) || (Height > 0xFFFF)) {
+      Width = (Width >> 1) | 1;
+      Height = (Height >> 1) | 1;
+   }
+   if (MaxWidth > 0xFFFF)
+      MaxWidth = 0xFFFF;
+   if (MaxHeight > 0xFFFF)
+      MaxHeight = 0xFFFF;
+
+   if ((MaxHeight == 0) || ((MaxWidth != 0) && (Width * MaxHeight > Height * MaxWidth))) {
+      // the width is what limits the size
+      *NewWidth = MaxWidth;
+      *NewHeight = (Height * MaxWidth + Width / 2) / Width;
+   } else {
+      *NewHeight = MaxHeight;
+      *NewWidth = (Width * MaxHeight + Height / 2) / Height;
+   }
+   if (*NewWidth == 0)
+      *NewWidth = 1;
+   if (*NewHeight == 0)
+      *NewHeight = 1;
+} // VOID egGetFitSize()
+
+//
+// Shrinking an image as its rows arrive
+//
+
+struct EG_ROW_SCALER {
+   EG_IMAGE          *Image;     // the new image
+   EG_SCALE_WEIGHTS  Columns, Rows;
+   EG_PIXEL          *Row;       // the latest source row, scaled along its length
+   EG_SUMS           *Sums[2];   // the next two new rows' weighted sums
+   UINTN             SrcHeight;
+   UINTN             SrcY;       // the next source row
+   UINTN             DstY;       // the next new row to be finished
+};
+
+VOID egFreeRowScaler(IN EG_ROW_SCALER *Scaler)
+{
+   if (Scaler == NULL)
+      return;
+   egFreeWeights(&Scaler->Columns);
+   egFreeWeights(&Scaler->Rows);
+   if (Scaler->Row != NULL)
+      FreePool(Scaler->Row);
+   if (Scaler->Sums[0] != NULL)
+      FreePool(Scaler->Sums[0]);
+   if (Scaler->Sums[1] != NULL)
+      FreePool(Scaler->Sums[1]);
+   FreePool(Scaler);
+} // VOID egFreeRowScaler()
+
+// Start shrinking a SrcWidth x SrcHeight image into Image, which must be no
+// bigger in either dimension, a row at a time: each of the image's rows is
+// then passed, in order, to egScaleRow(). The result is the same as
+// egScaleImage()'s (with Image's Premultiplied flag), but the full-size image
+// never has to be in memory. Returns NULL if memory runs out.
+EG_ROW_SCALER * egCreateRowScaler(IN EG_IMAGE *Image, IN UINTN SrcWidth, IN UINTN SrcHeight)
+{
+   EG_ROW_SCALER  *Scaler;
+
+   if ((Image == NULL) || (Image->Width == 0) || (Image->Height == 0) ||
+       (SrcWidth < Image->Width) || (SrcHeight < Image->Height))
+      return NULL;
+   Scaler = AllocateZeroPool(sizeof(EG_ROW_SCALER));
+   if (Scaler == NULL)
+      return NULL;
+   Scaler->Image = Image;
+   Scaler->SrcHeight = SrcHeight;
+   Scaler->Row = AllocatePool(Image->Width * sizeof(EG_PIXEL));
+   Scaler->Sums[0] = AllocateZeroPool(Image->Width * sizeof(EG_SUMS));
+   Scaler->Sums[1] = AllocateZeroPool(Image->Width * sizeof(EG_SUMS));
+   if ((Scaler->Row == NULL) || (Scaler->Sums[0] == NULL) || (Scaler->Sums[1] == NULL) ||
+       !egMakeWeights(&Scaler->Columns, SrcWidth, Image->Width) ||
+       !egMakeWeights(&Scaler->Rows, SrcHeight, Image->Height)) {
+      egFreeRowScaler(Scaler);
+      return NULL;
+   }
+   return Scaler;
+} // EG_ROW_SCALER * egCreateRowScaler()
+
+// Returns the last source row that contributes to new row y.
+static UINTN egLastSourceRow(IN EG_SCALE_WEIGHTS *Rows, IN UINTN y) {
+   UINTN k, Last = 0;
+
+   for (k = 0; k < Rows->Taps; k++) {
+      if ((Rows->Weight[y * Rows->Taps + k] != 0) && (Rows->Index[y * Rows->Taps + k] > Last))
+         Last = Rows->Index[y * Rows->Taps + k];
+   }
+   return Last;
+} // static UINTN egLastSourceRow()
+
+// Add the next source row, Row, to the new image, and store each new row to
+// which no later source row contributes. When shrinking, each source row
+// contributes to at most two new rows: the next one to be finished and the
+// one after it.
+VOID egScaleRow(IN OUT EG_ROW_SCALER *Scaler, IN EG_PIXEL *Row)
+{
+   EG_IMAGE *Image = Scaler->Image;
+   EG_SUMS  *Sums;
+   EG_PIXEL *DstPtr;
+   UINTN    i, k, x, y;
+
+   if (Scaler->SrcY >= Scaler->SrcHeight)
+      return;
+   egScaleAlongRow(Scaler->Row, Row, &Scaler->Columns, Image->Width);
+   for (i = 0; (i < 2) && (Scaler->DstY + i < Image->Height); i++) {
+      y = Scaler->DstY + i;
+      for (k = 0; k < Scaler->Rows.Taps; k++) {
+         if ((Scaler->Rows.Index[y * Scaler->Rows.Taps + k] != Scaler->SrcY) ||
+             (Scaler->Rows.Weight[y * Scaler->Rows.Taps + k] == 0))
+            continue;
+         for (x = 0; x < Image->Width; x++)
+            egAddWeighted(&Scaler->Sums[i][x], &Scaler->Row[x], Scaler->Rows.Weight[y * Scaler->Rows.Taps + k]);
+      } // for
+   } // for
+
+   while ((Scaler->DstY < Image->Height) &&
+          ((Scaler->SrcY + 1 == Scaler->SrcHeight) || (egLastSourceRow(&Scaler->Rows, Scaler->DstY) <= Scaler->SrcY))) {
+      DstPtr = Image->PixelData + Scaler->DstY * Image->Width;
+      for (x = 0; x < Image->Width; x++)
+         egStoreSums(&DstPtr[x], &Scaler->Sums[0][x], Image->Premultiplied);
+      Sums = Scaler->Sums[0];
+      SetMem(Sums, Image->Width * sizeof(EG_SUMS), 0);
+      Scaler->Sums[0] = Scaler->Sums[1];
+      Scaler->Sums[1] = Sums;
+      Scaler->DstY++;
+   } // while
+   Scaler->SrcY++;
+} // VOID egScaleRow()
+
+// Returns a copy of Image enlarged Factor times by repeating each pixel, as
+// suits bitmap fonts, which should stay crisp, or NULL if memory runs out.
+EG_IMAGE * egEnlargeImage(IN EG_IMAGE *Image, IN UINTN Factor)
+{
+   EG_IMAGE *NewImage;
+   EG_PIXEL *SrcPtr, *DstPtr;
+   UINTN    x, y, i;
+
+   if ((Image == NULL) || (Factor == 0))
+      return NULL;
+   if (Factor == 1)
+      return egCopyImage(Image);
+   NewImage = egCreateImage(Image->Width * Factor, Image->Height * Factor, Image->HasAlpha);
+   if (NewImage == NULL)
+      return NULL;
+   NewImage->Premultiplied = Image->Premultiplied;
+
+   DstPtr = NewImage->PixelData;
+   for (y = 0; y < Image->Height; y++) {
+      SrcPtr = Image->PixelData + y * Image->Width;
+      for (x = 0; x < Image->Width; x++) {
+         for (i = 0; i < Factor; i++)
+            *DstPtr++ = SrcPtr[x];
+      }
+      // the rest of the new rows are copies of the first
+      for (i = 1; i < Factor; i++, DstPtr += NewImage->Width)
+         CopyMem(DstPtr, DstPtr - NewImage->Width, NewImage->Width * sizeof(EG_PIXEL));
+   } // for
+   return NewImage;
+} // EG_IMAGE * egEnlargeImage()
+
+/* EOF */
@@ -317,12 +317,180 @@ VOID egSetGraphicsModeEnabled(IN BOOLEAN Enable)
         if (CurrentMode != NewMode)
            refit_call2_wrapper(ConsoleControl->SetMode, ConsoleControl, NewMode);
     }
+    if (!Enable)
+        egInvalidateShadow();
 }
 
+//
+// Shadow frame buffer
+//
+
+// Everything is drawn into egShadow, a copy of the screen kept in memory,
+// and the rectangles that differ from what's on the screen are recorded in
+// egDamage[]. egFlush() copies just those rectangles to the screen. The
+// screen itself is read only when egShadowStale says that it may show
+// something the shadow buffer lacks (console text, or another program's
+// output), since reading video memory is very slow on many GOP
+// implementations.
+
+#define EG_MAX_DAMAGE 16
+
+typedef struct {
+   UINTN XPos, YPos, Width, Height;
+} EG_RECT;
+
+static EG_IMAGE *egShadow = NULL;
+static EG_RECT  egDamage[EG_MAX_DAMAGE];
+static UINTN    egDamageCount = 0;
+static BOOLEAN  egShadowStale = TRUE;
+
+// Returns the shadow frame buffer, (re)allocating it if it doesn't exist yet
+// or if the screen size has changed. A new buffer is black and undamaged,
+// and stale until the next egClearScreen().
+// Returns NULL if there's no graphics or the buffer can't be allocated.
+static EG_IMAGE * egGetShadow(VOID) {
+   EG_PIXEL Black = { 0, 0, 0, 0 };
+
+   if (!egHasGraphics)
+      return NULL;
+   if ((egShadow != NULL) && ((egShadow->Width != egScreenWidth) || (egShadow->Height != egScreenHeight))) {
+      egFreeImage(egShadow);
+      egShadow = NULL;
+   }
+   if (egShadow == NULL) {
+      egShadow = egCreateImage(egScreenWidth, egScreenHeight, FALSE);
+      if (egShadow != NULL)
+         egFillImage(egShadow, &Black);
+      egDamageCount = 0;
+      egShadowStale = TRUE;
+   }
+   return egShadow;
+} // static EG_IMAGE * egGetShadow()
+
+static UINTN egRectArea(IN EG_RECT *Rect) {
+   return Rect->Width * Rect->Height;
+} // static UINTN egRectArea()
+
+// Store in *Union the smallest rectangle that holds both *Rect1 and *Rect2.
+static VOID egRectUnion(IN EG_RECT *Rect1, IN EG_RECT *Rect2, OUT EG_RECT *Union) {
+   UINTN Right, Bottom;
+
+   Right = (Rect1->XPos + Rect1->Width > Rect2->XPos + Rect2->Width) ? Rect1->XPos + Rect1->Width : Rect2->XPos + Rect2->Width;
+   Bottom = (Rect1->YPos + Rect1->Height > Rect2->YPos + Rect2->Height) ? Rect1->YPos + Rect1->Height : Rect2->YPos + Rect2->Height;
+   Union->XPos = (Rect1->XPos < Rect2->XPos) ? Rect1->XPos : Rect2->XPos;
+   Union->YPos = (Rect1->YPos < Rect2->YPos) ? Rect1->YPos : Rect2->YPos;
+   Union->Width = Right - Union->XPos;
+   Union->Height = Bottom - Union->YPos;
+} // static VOID egRectUnion()
+
+// Record that the given area of the shadow buffer must be copied to the
+// screen. A new rectangle is merged with any recorded one when the merged
+// rectangle is no bigger than the two separately (as when they overlap
+// heavily or sit side by side); when the list is full, it's merged with
+// whichever rectangle grows least.
+static VOID egAddDamage(IN UINTN XPos, IN UINTN YPos, IN UINTN Width, IN UINTN Height) {
+   EG_RECT  Rect, Union;
+   UINTN    i, Best = 0, Growth, BestGrowth = 0;
+   BOOLEAN  Merged;
+
+   if ((egShadow == NULL) || (XPos >= egShadow->Width) || (YPos >= egShadow->Height))
+      return;
+   egRestrictImageArea(egShadow, XPos, YPos, &Width, &Height);
+   if ((Width == 0) || (Height == 0))
+      return;
+   Rect.XPos = XPos;
+   Rect.YPos = YPos;
+   Rect.Width = Width;
+   Rect.Height = Height;
+
+   // merging can make the new rectangle mergeable with others, so repeat
+   do {
+      Merged = FALSE;
+      for (i = 0; i < egDamageCount; i++) {
+         egRectUnion(&Rect, &egDamage[i], &Union);
+         if (egRectArea(&Union) <= egRectArea(&Rect) + egRectArea(&egDamage[i])) {
+            Rect = Union;
+            egDamage[i] = egDamage[--egDamageCount];
+            Merged = TRUE;
+            break;
+         } // if
+      } // for
+   } while (Merged);
+
+   if (egDamageCount == EG_MAX_DAMAGE) {
+      for (i = 0; i < egDamageCount; i++) {
+         egRectUnion(&Rect, &egDamage[i], &Union);
+         Growth = egRectArea(&Union) - egRectArea(&egDamage[i]);
+         if ((i == 0) || (Growth < BestGrowth)) {
+            Best = i;
+            BestGrowth = Growth;
+         }
+      } // for
+      egRectUnion(&Rect, &egDamage[Best], &Rect);
+      egDamage[Best] = egDamage[--egDamageCount];
+   } // if
+   egDamage[egDamageCount++] = Rect;
+} // static VOID egAddDamage()
+
+// Copy an area of Image to the screen. Image's rows are Image->Width pixels
+// apart.
+static VOID egBltToScreen(IN EG_IMAGE *Image, IN UINTN AreaPosX, IN UINTN AreaPosY,
+                          IN UINTN AreaWidth, IN UINTN AreaHeight, IN UINTN ScreenPosX, IN UINTN ScreenPosY) {
+   if (GraphicsOutput != NULL) {
+      refit_call10_wrapper(GraphicsOutput->Blt, GraphicsOutput, (EFI_GRAPHICS_OUTPUT_BLT_PIXEL *)Image->PixelData,
+                           EfiBltBufferToVideo, AreaPosX, AreaPosY, ScreenPosX, ScreenPosY, AreaWidth, AreaHeight,
+                           Image->Width * sizeof(EG_PIXEL));
+   } else if (UgaDraw != NULL) {
+      refit_call10_wrapper(UgaDraw->Blt, UgaDraw, (EFI_UGA_PIXEL *)Image->PixelData, EfiUgaBltBufferToVideo,
+                           AreaPosX, AreaPosY, ScreenPosX, ScreenPosY, AreaWidth, AreaHeight,
+                           Image->Width * sizeof(EG_PIXEL));
+   }
+} // static VOID egBltToScreen()
+
+// Copy the damaged parts of the shadow buffer to the screen. Call this once
+// drawing is done and before waiting for the user or handing over control.
+VOID egFlush(VOID) {
+   UINTN i;
+
+   if (egShadow == NULL)
+      return;
+   for (i = 0; i < egDamageCount; i++) {
+      egBltToScreen(egShadow, egDamage[i].XPos, egDamage[i].YPos, egDamage[i].Width, egDamage[i].Height,
+                    egDamage[i].XPos, egDamage[i].YPos);
+   }
+   egDamageCount = 0;
+} // VOID egFlush()
+
+// Note that the screen may now show something that isn't in the shadow
+// buffer, as after writing to the text console or before starting another
+// program. The next egClearScreen() brings the two back into step.
+VOID egInvalidateShadow(VOID) {
+   egShadowStale = TRUE;
+} // VOID egInvalidateShadow()
+
+// Copy the given area of GlobalConfig.ScreenBackground into the shadow
+// buffer, or fill it with black if there's no usable background.
+static VOID egRestoreBackground(IN UINTN XPos, IN UINTN YPos, IN UINTN Width, IN UINTN Height) {
+   EG_PIXEL Black = { 0, 0, 0, 0 };
+   EG_IMAGE *Background = GlobalConfig.ScreenBackground;
+
+   egRestrictImageArea(egShadow, XPos, YPos, &Width, &Height);
+   if (Width == 0)
+      return;
+   if ((Background != NULL) && (Background->Width == egShadow->Width) && (Background->Height == egShadow->Height)) {
+      egRawCopy(egShadow->PixelData + YPos * egShadow->Width + XPos, Background->PixelData + YPos * Background->Width + XPos,
+                Width, Height, egShadow->Width, Background->Width);
+   } else {
+      egFillImageArea(egShadow, XPos, YPos, Width, Height, &Black);
+   }
+} // static VOID egRestoreBackground()
+
 //
 // Drawing to the screen
 //
 
+// Clear the screen. This is done with a single fill on the screen itself,
+// so it discards any damage that hasn't been flushed yet.
 VOID egClearScreen(IN EG_PIXEL *Color)
 {
     EFI_UGA_PIXEL FillColor;
@@ -341,6 +509,12 @@ VOID egClearScreen(IN EG_PIXEL *Color)
     }
     FillColor.Reserved = 0;
 
+    if (egGetShadow() != NULL) {
+       egFillImage(egShadow, (EG_PIXEL *) &FillColor);
+       egDamageCount = 0;
+       egShadowStale = FALSE;
+    }
+
     if (GraphicsOutput != NULL) {
         // EFI_GRAPHICS_OUTPUT_BLT_PIXEL and EFI_UGA_PIXEL have the same
         // layout, and the header from TianoCore actually defines them
@@ -352,10 +526,11 @@ VOID egClearScreen(IN EG_PIXEL *Color)
     }
 }
 
+// Draw Image at the given position, over the background image (if any) where
+// Image is transparent. Drawing is done in the shadow buffer; the screen is
+// updated by egFlush().
 VOID egDrawImage(IN EG_IMAGE *Image, IN UINTN ScreenPosX, IN UINTN ScreenPosY)
 {
-    EG_IMAGE *CompImage = NULL;
-
     // NOTE: Weird seemingly redundant tests because some placement code can "wrap around" and
     // send "negative" values, which of course become very large unsigned ints that can then
     // wrap around AGAIN if values are added to them.....
@@ -363,41 +538,64 @@ VOID egDrawImage(IN EG_IMAGE *Image, IN UINTN ScreenPosX, IN UINTN ScreenPosY)
         (ScreenPosX > egScreenWidth) || (ScreenPosY > egScreenHeight))
         return;
 
-    if ((GlobalConfig.ScreenBackground == NULL) || ((Image->Width == egScreenWidth) && (Image->Height == egScreenHeight))) {
-       CompImage = Image;
-    } else if (GlobalConfig.ScreenBackground == Image) {
-       CompImage = GlobalConfig.ScreenBackground;
-    } else {
-       CompImage = egCropImage(GlobalConfig.ScreenBackground, ScreenPosX, ScreenPosY, Image->Width, Image->Height);
-       if (CompImage == NULL) {
-          Print(L"Error! Can't crop image in egDrawImage()!\n");
-          return;
-       }
-       egComposeImage(CompImage, Image, 0, 0);
+    if (egGetShadow() == NULL) {
+       // no memory for the shadow buffer; draw directly, without the background
+       egBltToScreen(Image, 0, 0, Image->Width, Image->Height, ScreenPosX, ScreenPosY);
+       return;
     }
 
-    if (GraphicsOutput != NULL) {
-       refit_call10_wrapper(GraphicsOutput->Blt, GraphicsOutput, (EFI_GRAPHICS_OUTPUT_BLT_PIXEL *)CompImage->PixelData,
-                            EfiBltBufferToVideo, 0, 0, ScreenPosX, ScreenPosY, CompImage->Width, CompImage->Height, 0);
-    } else if (UgaDraw != NULL) {
-       refit_call10_wrapper(UgaDraw->Blt, UgaDraw, (EFI_UGA_PIXEL *)CompImage->PixelData, EfiUgaBltBufferToVideo,
-                            0, 0, ScreenPosX, ScreenPosY, CompImage->Width, CompImage->Height, 0);
+    if (Image->HasAlpha && (GlobalConfig.ScreenBackground != NULL) && (GlobalConfig.ScreenBackground != Image) &&
+        ((Image->Width != egScreenWidth) || (Image->Height != egScreenHeight))) {
+       egRestoreBackground(ScreenPosX, ScreenPosY, Image->Width, Image->Height);
+       egComposeImage(egShadow, Image, ScreenPosX, ScreenPosY);
+    } else {
+       egRawCopy(egShadow->PixelData + ScreenPosY * egShadow->Width + ScreenPosX, Image->PixelData,
+                 Image->Width, Image->Height, egShadow->Width, Image->Width);
     }
-    if ((CompImage != GlobalConfig.ScreenBackground) && (CompImage != Image))
-       egFreeImage(CompImage);
+    egAddDamage(ScreenPosX, ScreenPosY, Image->Width, Image->Height);
 } /* VOID egDrawImage() */
 
 // Display an unselected icon on the screen, so that the background image shows
 // through the transparency areas. The BadgeImage may be NULL, in which case
-// it's not composited in.
+// it's not composited in. Image is centered in the Width x Height area, and
+// the badge goes in the lower-right corner of Image, as in
+// BltImageCompositeBadge(); but everything is composed directly in the shadow
+// buffer, with no temporary images.
 VOID egDrawImageWithTransparency(EG_IMAGE *Image, EG_IMAGE *BadgeImage, UINTN XPos, UINTN YPos, UINTN Width, UINTN Height) {
-   EG_IMAGE *Background;
+   UINTN CompWidth, CompHeight, OffsetX, OffsetY;
+
+   if (!egHasGraphics || (Image == NULL) || ((XPos + Width) > egScreenWidth) || ((YPos + Height) > egScreenHeight) ||
+       (XPos > egScreenWidth) || (YPos > egScreenHeight))
+      return;
+   if (egGetShadow() == NULL) {
+      egDrawImage(Image, XPos, YPos);
+      return;
+   }
+
+   egRestoreBackground(XPos, YPos, Width, Height);
+
+   CompWidth = (Image->Width > Width) ? Width : Image->Width;
+   CompHeight = (Image->Height > Height) ? Height : Image->Height;
+   OffsetX = (Width - CompWidth) >> 1;
+   OffsetY = (Height - CompHeight) >> 1;
+   if (Image->HasAlpha && Image->Premultiplied) {
+      egRawComposePremultiplied(egShadow->PixelData + (YPos + OffsetY) * egShadow->Width + XPos + OffsetX,
+                                Image->PixelData, CompWidth, CompHeight, egShadow->Width, Image->Width);
+   } else if (Image->HasAlpha) {
+      egRawCompose(egShadow->PixelData + (YPos + OffsetY) * egShadow->Width + XPos + OffsetX, Image->PixelData,
+                   CompWidth, CompHeight, egShadow->Width, Image->Width);
+   } else {
+      egRawCopy(egShadow->PixelData + (YPos + OffsetY) * egShadow->Width + XPos + OffsetX, Image->PixelData,
+                CompWidth, CompHeight, egShadow->Width, Image->Width);
+   }
 
-   Background = egCropImage(GlobalConfig.ScreenBackground, XPos, YPos, Width, Height);
-   if (Background != NULL) {
-      BltImageCompositeBadge(Background, Image, BadgeImage, XPos, YPos);
-      egFreeImage(Background);
+   if ((BadgeImage != NULL) && ((BadgeImage->Width + 8 * GlobalConfig.Scale) < CompWidth) &&
+       ((BadgeImage->Height + 8 * GlobalConfig.Scale) < CompHeight)) {
+      OffsetX += CompWidth - 8 * GlobalConfig.Scale - BadgeImage->Width;
+      OffsetY += CompHeight - 8 * GlobalConfig.Scale - BadgeImage->Height;
+      egComposeImage(egShadow, BadgeImage, XPos + OffsetX, YPos + OffsetY);
    }
+   egAddDamage(XPos, YPos, Width, Height);
 } // VOID DrawImageWithTransparency()
 
 VOID egDrawImageArea(IN EG_IMAGE *Image,
@@ -412,19 +610,24 @@ VOID egDrawImageArea(IN EG_IMAGE *Image,
     if (AreaWidth == 0)
         return;
 
-    if (GraphicsOutput != NULL) {
-        refit_call10_wrapper(GraphicsOutput->Blt, GraphicsOutput, (EFI_GRAPHICS_OUTPUT_BLT_PIXEL *)Image->PixelData,
-                             EfiBltBufferToVideo, AreaPosX, AreaPosY, ScreenPosX, ScreenPosY, AreaWidth, AreaHeight,
-                             Image->Width * 4);
-    } else if (UgaDraw != NULL) {
-        refit_call10_wrapper(UgaDraw->Blt, UgaDraw, (EFI_UGA_PIXEL *)Image->PixelData, EfiUgaBltBufferToVideo,
-                             AreaPosX, AreaPosY, ScreenPosX, ScreenPosY, AreaWidth, AreaHeight, Image->Width * 4);
+    if (egGetShadow() == NULL) {
+        egBltToScreen(Image, AreaPosX, AreaPosY, AreaWidth, AreaHeight, ScreenPosX, ScreenPosY);
+        return;
     }
+    egRestrictImageArea(egShadow, ScreenPosX, ScreenPosY, &AreaWidth, &AreaHeight);
+    if (AreaWidth == 0)
+        return;
+    egRawCopy(egShadow->PixelData + ScreenPosY * egShadow->Width + ScreenPosX,
+              Image->PixelData + AreaPosY * Image->Width + AreaPosX,
+              AreaWidth, AreaHeight, egShadow->Width, Image->Width);
+    egAddDamage(ScreenPosX, ScreenPosY, AreaWidth, AreaHeight);
 }
 
 // Display a message in the center of the screen, surrounded by a box of the
 // specified color. For the moment, uses graphics calls only. (It still works
-// in text mode on GOP/UEFI systems, but not on UGA/EFI 1.x systems.)
+// in text mode on GOP/UEFI systems, but not on UGA/EFI 1.x systems.) The
+// message is flushed to the screen right away, since it's normally shown
+// just before a lengthy operation.
 VOID egDisplayMessage(IN CHAR16 *Text, EG_PIXEL *BGColor) {
    UINTN BoxWidth, BoxHeight;
    EG_IMAGE *Box;
@@ -438,10 +641,15 @@ VOID egDisplayMessage(IN CHAR16 *Text, EG_PIXEL *BGColor) {
       Box = egCreateFilledImage(BoxWidth, BoxHeight, FALSE, BGColor);
       egRenderText(Text, Box, 7, BoxHeight / 4, (BGColor->r + BGColor->g + BGColor->b) / 3);
       egDrawImage(Box, (egScreenWidth - BoxWidth) / 2, (egScreenHeight - BoxHeight) / 2);
+      egFreeImage(Box);
+      egFlush();
    } // if non-NULL inputs
 } // VOID egDisplayMessage()
 
 // Copy the current contents of the display into an EG_IMAGE....
+// The copy comes from the shadow buffer when that matches the screen;
+// otherwise (as in text mode), pending damage is flushed and the screen
+// itself is read.
 // Returns pointer if successful, NULL if not.
 EG_IMAGE * egCopyScreen(VOID) {
    EG_IMAGE *Image = NULL;
@@ -449,6 +657,9 @@ EG_IMAGE * egCopyScreen(VOID) {
    if (!egHasGraphics)
       return NULL;
 
+   if (!egShadowStale && (egGetShadow() != NULL))
+      return egCopyImage(egShadow);
+
    // allocate a buffer for the whole screen
    Image = egCreateImage(egScreenWidth, egScreenHeight, FALSE);
    if (Image == NULL) {
@@ -456,6 +667,7 @@ EG_IMAGE * egCopyScreen(VOID) {
    }
 
    // get full screen image
+   egFlush();
    if (GraphicsOutput != NULL) {
       refit_call10_wrapper(GraphicsOutput->Blt, GraphicsOutput, (EFI_GRAPHICS_OUTPUT_BLT_PIXEL *)Image->PixelData,
                            EfiBltVideoToBltBuffer, 0, 0, 0, 0, Image->Width, Image->Height, 0);
@@ -0,0 +1,365 @@
+/*
+ * libeg/test/blendbench.c
+ * Host-side check and microbenchmark of libeg's compositing functions
+ *
+ * Copyright (c) 2013 Roderick W. Smith
+ * All rights reserved.
+ *
+ * This program is distributed under the terms of the GNU General Public
+ * License (GPL) version 3 (GPLv3), a copy of which must be distributed
+ * with this source code or binaries made from it.
+ *
+ */
+
+// Checks that blend.c's egRawCompose(), egRawCopy(), egFillImageArea(), and
+// plane functions produce exactly what the original scalar loops (copied
+// below) do, and that egPremultiplyImage() and egRawComposePremultiplied()
+// match straightforward per-pixel versions, for random images, areas, and
+// alignments, then times them on a 1920x1080 image.
+
+#include <stdio.h>
+#include <time.h>
+#include "host_libeg.h"
+
+#define SCREEN_WIDTH    1920
+#define SCREEN_HEIGHT   1080
+#define NUM_CHECKS      2000
+#define NUM_PASSES      20
+#define NUM_FUNCS       8
+
+static UINT32 RandomState = 12345;
+
+static UINT32 Random(VOID) {
+   RandomState ^= RandomState << 13;
+   RandomState ^= RandomState >> 17;
+   RandomState ^= RandomState << 5;
+   return RandomState;
+}
+
+// Fill Image with 128x128 "icons": opaque disks with soft edges, surrounded
+// by transparency.
+static VOID IconImage(EG_IMAGE *Image) {
+   UINTN x, y, dx, dy, Distance;
+   EG_PIXEL *Pixel = Image->PixelData;
+
+   for (y = 0; y < Image->Height; y++) {
+      for (x = 0; x < Image->Width; x++, Pixel++) {
+         dx = ((x % 128) > 64) ? (x % 128) - 64 : 64 - (x % 128);
+         dy = ((y % 128) > 64) ? (y % 128) - 64 : 64 - (y % 128);
+         Distance = dx * dx + dy * dy;
+         Pixel->b = (UINT8) x;
+         Pixel->g = (UINT8) y;
+         Pixel->r = (UINT8) (x + y);
+         Pixel->a = (Distance < 2304) ? 255 : (Distance > 2809) ? 0 : (UINT8) ((2809 - Distance) / 2);
+      } // for
+   } // for
+}
+
+// Fill Image with random pixels, with alpha values weighted towards the
+// extremes, as they are in real icons.
+static VOID RandomImage(EG_IMAGE *Image) {
+   UINTN i;
+   UINT32 Value;
+
+   for (i = 0; i < Image->Width * Image->Height; i++) {
+      Value = Random();
+      Image->PixelData[i].b = (UINT8) Value;
+      Image->PixelData[i].g = (UINT8) (Value >> 8);
+      Image->PixelData[i].r = (UINT8) (Value >> 16);
+      switch (Random() % 4) {
+         case 0:  Image->PixelData[i].a = 0;                     break;
+         case 1:  Image->PixelData[i].a = 255;                   break;
+         default: Image->PixelData[i].a = (UINT8) (Value >> 24); break;
+      }
+   } // for
+}
+
+static EG_IMAGE * NewImage(UINTN Width, UINTN Height) {
+   EG_IMAGE *Image = malloc(sizeof(EG_IMAGE));
+
+   Image->Width = Width;
+   Image->Height = Height;
+   Image->HasAlpha = TRUE;
+   Image->Premultiplied = FALSE;
+   Image->PixelData = malloc(Width * Height * sizeof(EG_PIXEL) + 1);
+   return Image;
+}
+
+//
+// The original scalar versions
+//
+
+static VOID RefRawCopy(EG_PIXEL *CompBasePtr, EG_PIXEL *TopBasePtr, UINTN Width, UINTN Height,
+                       UINTN CompLineOffset, UINTN TopLineOffset) {
+   UINTN x, y;
+
+   for (y = 0; y < Height; y++) {
+      for (x = 0; x < Width; x++)
+         CompBasePtr[x] = TopBasePtr[x];
+      TopBasePtr += TopLineOffset;
+      CompBasePtr += CompLineOffset;
+   }
+}
+
+static VOID RefRawCompose(EG_PIXEL *CompBasePtr, EG_PIXEL *TopBasePtr, UINTN Width, UINTN Height,
+                          UINTN CompLineOffset, UINTN TopLineOffset) {
+   UINTN x, y, Alpha, RevAlpha, Temp;
+   EG_PIXEL *TopPtr, *CompPtr;
+
+   for (y = 0; y < Height; y++) {
+      TopPtr = TopBasePtr;
+      CompPtr = CompBasePtr;
+      for (x = 0; x < Width; x++, TopPtr++, CompPtr++) {
+         Alpha = TopPtr->a;
+         RevAlpha = 255 - Alpha;
+         Temp = (UINTN)CompPtr->b * RevAlpha + (UINTN)TopPtr->b * Alpha + 0x80;
+         CompPtr->b = (Temp + (Temp >> 8)) >> 8;
+         Temp = (UINTN)CompPtr->g * RevAlpha + (UINTN)TopPtr->g * Alpha + 0x80;
+         CompPtr->g = (Temp + (Temp >> 8)) >> 8;
+         Temp = (UINTN)CompPtr->r * RevAlpha + (UINTN)TopPtr->r * Alpha + 0x80;
+         CompPtr->r = (Temp + (Temp >> 8)) >> 8;
+      }
+      TopBasePtr += TopLineOffset;
+      CompBasePtr += CompLineOffset;
+   }
+}
+
+// Porter-Duff "over" for a premultiplied TopPtr, with no shortcuts.
+static VOID RefRawComposePremultiplied(EG_PIXEL *CompBasePtr, EG_PIXEL *TopBasePtr, UINTN Width, UINTN Height,
+                                       UINTN CompLineOffset, UINTN TopLineOffset) {
+   UINTN x, y, RevAlpha, Temp;
+   EG_PIXEL *TopPtr, *CompPtr;
+
+   for (y = 0; y < Height; y++) {
+      TopPtr = TopBasePtr;
+      CompPtr = CompBasePtr;
+      for (x = 0; x < Width; x++, TopPtr++, CompPtr++) {
+         RevAlpha = 255 - TopPtr->a;
+         Temp = (UINTN)CompPtr->b * RevAlpha + 0x80;
+         CompPtr->b = TopPtr->b + ((Temp + (Temp >> 8)) >> 8);
+         Temp = (UINTN)CompPtr->g * RevAlpha + 0x80;
+         CompPtr->g = TopPtr->g + ((Temp + (Temp >> 8)) >> 8);
+         Temp = (UINTN)CompPtr->r * RevAlpha + 0x80;
+         CompPtr->r = TopPtr->r + ((Temp + (Temp >> 8)) >> 8);
+         Temp = (UINTN)CompPtr->a * RevAlpha + 0x80;
+         CompPtr->a = TopPtr->a + ((Temp + (Temp >> 8)) >> 8);
+      }
+      TopBasePtr += TopLineOffset;
+      CompBasePtr += CompLineOffset;
+   }
+}
+
+static VOID RefPremultiply(EG_IMAGE *Image) {
+   UINTN i;
+   EG_PIXEL *Pixel = Image->PixelData;
+
+   for (i = 0; i < Image->Width * Image->Height; i++, Pixel++) {
+      Pixel->b = (Pixel->b * Pixel->a + 127) / 255;
+      Pixel->g = (Pixel->g * Pixel->a + 127) / 255;
+      Pixel->r = (Pixel->r * Pixel->a + 127) / 255;
+   }
+}
+
+static VOID RefFillImageArea(EG_IMAGE *CompImage, UINTN AreaPosX, UINTN AreaPosY,
+                             UINTN AreaWidth, UINTN AreaHeight, EG_PIXEL *Color) {
+   UINTN x, y;
+   EG_PIXEL FillColor = *Color;
+
+   egRestrictImageArea(CompImage, AreaPosX, AreaPosY, &AreaWidth, &AreaHeight);
+   if (!CompImage->HasAlpha)
+      FillColor.a = 0;
+   for (y = 0; y < AreaHeight; y++)
+      for (x = 0; x < AreaWidth; x++)
+         CompImage->PixelData[(AreaPosY + y) * CompImage->Width + AreaPosX + x] = FillColor;
+}
+
+static VOID RefInsertPlane(UINT8 *SrcDataPtr, UINT8 *DestPlanePtr, UINTN PixelCount) {
+   UINTN i;
+
+   for (i = 0; i < PixelCount; i++, DestPlanePtr += 4)
+      *DestPlanePtr = *SrcDataPtr++;
+}
+
+static VOID RefSetPlane(UINT8 *DestPlanePtr, UINT8 Value, UINTN PixelCount) {
+   UINTN i;
+
+   for (i = 0; i < PixelCount; i++, DestPlanePtr += 4)
+      *DestPlanePtr = Value;
+}
+
+static VOID RefCopyPlane(UINT8 *SrcPlanePtr, UINT8 *DestPlanePtr, UINTN PixelCount) {
+   UINTN i;
+
+   for (i = 0; i < PixelCount; i++, DestPlanePtr += 4, SrcPlanePtr += 4)
+      *DestPlanePtr = *SrcPlanePtr;
+}
+
+//
+// Checks
+//
+
+static BOOLEAN SameImage(EG_IMAGE *Image1, EG_IMAGE *Image2) {
+   return (memcmp(Image1->PixelData, Image2->PixelData, Image1->Width * Image1->Height * sizeof(EG_PIXEL)) == 0);
+}
+
+// Run one random check of each function, using the images given (which
+// must be 64x64). Returns the number of mismatches.
+static UINTN RunChecks(EG_IMAGE *Top, EG_IMAGE *Comp, EG_IMAGE *Expected, UINT8 *Plane) {
+   UINTN     Failures = 0, PosX, PosY, Width, Height, TopX, TopY, Count, Planes, Extra;
+   EG_PIXEL  Color;
+   UINT32    Value;
+
+   RandomImage(Top);
+   RandomImage(Comp);
+   memcpy(Expected->PixelData, Comp->PixelData, 64 * 64 * sizeof(EG_PIXEL));
+   PosX = Random() % 64;
+   PosY = Random() % 64;
+   TopX = Random() % 64;
+   TopY = Random() % 64;
+   Width = Random() % (64 - ((PosX > TopX) ? PosX : TopX) + 1);
+   Height = Random() % (64 - ((PosY > TopY) ? PosY : TopY) + 1);
+   if (Random() % 4 == 0) {
+      // whole rows, to exercise the contiguous cases
+      PosX = TopX = 0;
+      Width = 64;
+   }
+
+   egRawCompose(Comp->PixelData + PosY * 64 + PosX, Top->PixelData + TopY * 64 + TopX, Width, Height, 64, 64);
+   RefRawCompose(Expected->PixelData + PosY * 64 + PosX, Top->PixelData + TopY * 64 + TopX, Width, Height, 64, 64);
+   Failures += !SameImage(Comp, Expected);
+
+   // premultiply a copy of Top, then compose it (including all-transparent
+   // and all-opaque runs) in both ways
+   memcpy(Expected->PixelData, Top->PixelData, 64 * 64 * sizeof(EG_PIXEL));
+   RefPremultiply(Expected);
+   Top->Premultiplied = FALSE;
+   egPremultiplyImage(Top);
+   Failures += !SameImage(Top, Expected) || !Top->Premultiplied;
+   memcpy(Expected->PixelData, Comp->PixelData, 64 * 64 * sizeof(EG_PIXEL));
+   egRawComposePremultiplied(Comp->PixelData + PosY * 64 + PosX, Top->PixelData + TopY * 64 + TopX, Width, Height, 64, 64);
+   RefRawComposePremultiplied(Expected->PixelData + PosY * 64 + PosX, Top->PixelData + TopY * 64 + TopX, Width, Height, 64, 64);
+   Failures += !SameImage(Comp, Expected);
+
+   egRawCopy(Comp->PixelData + PosY * 64 + PosX, Top->PixelData + TopY * 64 + TopX, Width, Height, 64, 64);
+   RefRawCopy(Expected->PixelData + PosY * 64 + PosX, Top->PixelData + TopY * 64 + TopX, Width, Height, 64, 64);
+   Failures += !SameImage(Comp, Expected);
+
+   Value = Random();
+   memcpy(&Color, &Value, sizeof(Color));
+   Comp->HasAlpha = Expected->HasAlpha = (Random() % 2);
+   Extra = Random() % 8;   // may extend past the image's edge
+   egFillImageArea(Comp, PosX, PosY, Width + Extra, Height, &Color);
+   RefFillImageArea(Expected, PosX, PosY, Width + Extra, Height, &Color);
+   Failures += !SameImage(Comp, Expected);
+
+   // the planes may start at any byte of the first pixel
+   Count = Random() % (64 * 64 - 1);
+   Planes = Random();
+   egInsertPlane(Plane, (UINT8 *) Comp->PixelData + (Planes % 4), Count);
+   RefInsertPlane(Plane, (UINT8 *) Expected->PixelData + (Planes % 4), Count);
+   Failures += !SameImage(Comp, Expected);
+   egSetPlane((UINT8 *) Comp->PixelData + ((Planes >> 2) % 4), (UINT8) Value, Count);
+   RefSetPlane((UINT8 *) Expected->PixelData + ((Planes >> 2) % 4), (UINT8) Value, Count);
+   Failures += !SameImage(Comp, Expected);
+   egCopyPlane((UINT8 *) Top->PixelData + ((Planes >> 4) % 4), (UINT8 *) Comp->PixelData + ((Planes >> 6) % 4), Count);
+   RefCopyPlane((UINT8 *) Top->PixelData + ((Planes >> 4) % 4), (UINT8 *) Expected->PixelData + ((Planes >> 6) % 4), Count);
+   Failures += !SameImage(Comp, Expected);
+
+   return Failures;
+}
+
+//
+// Timing
+//
+
+static double Now(void) {
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+typedef VOID (*RAW_FUNC)(EG_PIXEL *, EG_PIXEL *, UINTN, UINTN, UINTN, UINTN);
+
+// Returns the time per pixel, in ns, to apply Func to the whole of Comp.
+static double TimeRaw(RAW_FUNC Func, EG_IMAGE *Comp, EG_IMAGE *Top) {
+   double Start = Now();
+   UINTN  i;
+
+   for (i = 0; i < NUM_PASSES; i++)
+      Func(Comp->PixelData, Top->PixelData, Comp->Width, Comp->Height, Comp->Width, Top->Width);
+   return (Now() - Start) / (NUM_PASSES * Comp->Width * Comp->Height);
+}
+
+static VOID TimeAreaFill(EG_IMAGE *Comp, BOOLEAN Reference, double *Time) {
+   EG_PIXEL Color = { 10, 20, 30, 40 };
+   double   Start = Now();
+   UINTN    i;
+
+   // a 1,000-pixel-wide area, so that the rows aren't contiguous
+   for (i = 0; i < NUM_PASSES; i++) {
+      if (Reference)
+         RefFillImageArea(Comp, 1, 0, 1000, Comp->Height, &Color);
+      else
+         egFillImageArea(Comp, 1, 0, 1000, Comp->Height, &Color);
+   }
+   *Time = (Now() - Start) / (NUM_PASSES * 1000 * Comp->Height);
+}
+
+static double TimeSetPlane(EG_IMAGE *Comp, BOOLEAN Reference) {
+   double Start = Now();
+   UINTN  i;
+
+   for (i = 0; i < NUM_PASSES; i++) {
+      if (Reference)
+         RefSetPlane(PLPTR(Comp, a), 255, Comp->Width * Comp->Height);
+      else
+         egSetPlane(PLPTR(Comp, a), 255, Comp->Width * Comp->Height);
+   }
+   return (Now() - Start) / (NUM_PASSES * Comp->Width * Comp->Height);
+}
+
+int main(void) {
+   EG_IMAGE  *Top, *Comp, *Expected, *Screen, *Layer;
+   UINT8     Plane[64 * 64];
+   UINTN     i, Failures = 0;
+   double    Fill, RefFill;
+
+   Top = NewImage(64, 64);
+   Comp = NewImage(64, 64);
+   Expected = NewImage(64, 64);
+   for (i = 0; i < sizeof(Plane); i++)
+      Plane[i] = (UINT8) Random();
+   for (i = 0; i < NUM_CHECKS; i++)
+      Failures += RunChecks(Top, Comp, Expected, Plane);
+   printf("%d of %d checks passed\n", (int) (NUM_CHECKS * NUM_FUNCS - Failures), NUM_CHECKS * NUM_FUNCS);
+
+   Screen = NewImage(SCREEN_WIDTH, SCREEN_HEIGHT);
+   Layer = NewImage(SCREEN_WIDTH, SCREEN_HEIGHT);
+   RandomImage(Screen);
+   RandomImage(Layer);
+   printf("%dx%d image, ns per pixel:   libeg  original\n", SCREEN_WIDTH, SCREEN_HEIGHT);
+   printf("egRawCompose()                %6.2f    %6.2f\n",
+          TimeRaw(egRawCompose, Screen, Layer), TimeRaw(RefRawCompose, Screen, Layer));
+   Layer->Premultiplied = FALSE;
+   egPremultiplyImage(Layer);
+   printf("egRawComposePremultiplied()   %6.2f    %6.2f\n",
+          TimeRaw(egRawComposePremultiplied, Screen, Layer), TimeRaw(RefRawComposePremultiplied, Screen, Layer));
+   IconImage(Layer);
+   printf("  icons, egRawCompose()       %6.2f    %6.2f\n",
+          TimeRaw(egRawCompose, Screen, Layer), TimeRaw(RefRawCompose, Screen, Layer));
+   Layer->Premultiplied = FALSE;
+   egPremultiplyImage(Layer);
+   printf("  icons, premultiplied        %6.2f    %6.2f\n",
+          TimeRaw(egRawComposePremultiplied, Screen, Layer), TimeRaw(RefRawComposePremultiplied, Screen, Layer));
+   printf("egRawCopy()                   %6.2f    %6.2f\n",
+          TimeRaw(egRawCopy, Screen, Layer), TimeRaw(RefRawCopy, Screen, Layer));
+   TimeAreaFill(Screen, FALSE, &Fill);
+   TimeAreaFill(Screen, TRUE, &RefFill);
+   printf("egFillImageArea()             %6.2f    %6.2f\n", Fill, RefFill);
+   printf("egSetPlane()                  %6.2f    %6.2f\n", TimeSetPlane(Screen, FALSE), TimeSetPlane(Screen, TRUE));
+
+   return (Failures > 0);
+}
+
+/* EOF */
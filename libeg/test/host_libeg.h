@@ -0,0 +1,75 @@
+/*
+ * libeg/test/host_libeg.h
+ * Minimal libeg definitions for building libeg code on the host
+ *
+ * Copyright (c) 2013 Roderick W. Smith
+ * All rights reserved.
+ *
+ * This program is distributed under the terms of the GNU General Public
+ * License (GPL) version 3 (GPLv3), a copy of which must be distributed
+ * with this source code or binaries made from it.
+ *
+ */
+
+#ifndef __HOST_LIBEG_H_
+#define __HOST_LIBEG_H_
+
+#include "../../refind/test/host_efi.h"
+
+// These must match libeg.h.
+
+typedef struct {
+    UINT8 b, g, r, a;
+} EG_PIXEL;
+
+typedef struct {
+    UINTN       Width;
+    UINTN       Height;
+    BOOLEAN     HasAlpha;
+    BOOLEAN     Premultiplied;  // color channels are pre-multiplied by alpha
+    EG_PIXEL    *PixelData;
+} EG_IMAGE;
+
+typedef struct EG_ROW_SCALER EG_ROW_SCALER;
+
+#define PLPTR(imagevar, colorname) ((UINT8 *) &((imagevar)->PixelData->colorname))
+
+// provided by the test program, standing in for image.c
+EG_IMAGE * egCreateImage(IN UINTN Width, IN UINTN Height, IN BOOLEAN HasAlpha);
+EG_IMAGE * egCopyImage(IN EG_IMAGE *Image);
+VOID egFreeImage(IN EG_IMAGE *Image);
+
+EG_IMAGE * egScaleImage(IN EG_IMAGE *Image, IN UINTN NewWidth, IN UINTN NewHeight);
+EG_IMAGE * egEnlargeImage(IN EG_IMAGE *Image, IN UINTN Factor);
+VOID egGetFitSize(IN UINTN Width, IN UINTN Height, IN UINTN MaxWidth, IN UINTN MaxHeight,
+                  OUT UINTN *NewWidth, OUT UINTN *NewHeight);
+EG_ROW_SCALER * egCreateRowScaler(IN EG_IMAGE *Image, IN UINTN SrcWidth, IN UINTN SrcHeight);
+VOID egScaleRow(IN OUT EG_ROW_SCALER *Scaler, IN EG_PIXEL *Row);
+VOID egFreeRowScaler(IN EG_ROW_SCALER *Scaler);
+VOID egRestrictImageArea(IN EG_IMAGE *Image,
+                         IN UINTN AreaPosX, IN UINTN AreaPosY,
+                         IN OUT UINTN *AreaWidth, IN OUT UINTN *AreaHeight);
+VOID egFillImage(IN OUT EG_IMAGE *CompImage, IN EG_PIXEL *Color);
+VOID egFillImageArea(IN OUT EG_IMAGE *CompImage,
+                     IN UINTN AreaPosX, IN UINTN AreaPosY,
+                     IN UINTN AreaWidth, IN UINTN AreaHeight,
+                     IN EG_PIXEL *Color);
+VOID egRawCopy(IN OUT EG_PIXEL *CompBasePtr, IN EG_PIXEL *TopBasePtr,
+               IN UINTN Width, IN UINTN Height,
+               IN UINTN CompLineOffset, IN UINTN TopLineOffset);
+VOID egRawCompose(IN OUT EG_PIXEL *CompBasePtr, IN EG_PIXEL *TopBasePtr,
+                  IN UINTN Width, IN UINTN Height,
+                  IN UINTN CompLineOffset, IN UINTN TopLineOffset);
+VOID egRawComposePremultiplied(IN OUT EG_PIXEL *CompBasePtr, IN EG_PIXEL *TopBasePtr,
+                               IN UINTN Width, IN UINTN Height,
+                               IN UINTN CompLineOffset, IN UINTN TopLineOffset);
+VOID egPremultiplyPixels(IN OUT EG_PIXEL *PixelPtr, IN UINTN Count);
+VOID egPremultiplyImage(IN OUT EG_IMAGE *Image);
+VOID egComposeImage(IN OUT EG_IMAGE *CompImage, IN EG_IMAGE *TopImage, IN UINTN PosX, IN UINTN PosY);
+VOID egInsertPlane(IN UINT8 *SrcDataPtr, IN UINT8 *DestPlanePtr, IN UINTN PixelCount);
+VOID egSetPlane(IN UINT8 *DestPlanePtr, IN UINT8 Value, IN UINTN PixelCount);
+VOID egCopyPlane(IN UINT8 *SrcPlanePtr, IN UINT8 *DestPlanePtr, IN UINTN PixelCount);
+
+#endif
+
+/* EOF */
@@ -0,0 +1,264 @@
+/*
+ * libeg/test/pngbench.c
+ * Host-side check and benchmark of libeg's PNG decoder
+ *
+ * Copyright (c) 2013 Roderick W. Smith
+ * All rights reserved.
+ *
+ * This program is distributed under the terms of the GNU General Public
+ * License (GPL) version 3 (GPLv3), a copy of which must be distributed
+ * with this source code or binaries made from it.
+ *
+ */
+
+// Decodes the PNG files named on the command line (or, by default, the
+// bundled images, fonts, and documentation screenshots) with egDecodePNG(),
+// checks each result against lodepng's plain RGBA output, swizzled and
+// premultiplied pixel by pixel, and times egDecodePNG() on each file. Each
+// file is also decoded as it's read, in small and uneven pieces, with
+// egDecodePNGStream(), whose result must match egDecodePNG()'s, and
+// shrunk to fit half its size, which must match egScaleImage()'s result.
+
+#include <stdio.h>
+#include <glob.h>
+#include <time.h>
+#include "lodepng.h"
+
+static const char *DefaultPatterns[] = {
+   "../../images/*.png", "../../fonts/*.png", "../../docs/refind/*.png", NULL
+};
+
+// The most bytes that ReadMemory() returns at a time while checking; an odd
+// size, so that reads end at every possible place in the PNG chunks
+#define CHECK_READ_SIZE 1021
+
+//
+// Stand-ins for image.c
+//
+
+EG_IMAGE * egCreateImage(IN UINTN Width, IN UINTN Height, IN BOOLEAN HasAlpha) {
+   EG_IMAGE *Image = malloc(sizeof(EG_IMAGE));
+
+   Image->Width = Width;
+   Image->Height = Height;
+   Image->HasAlpha = HasAlpha;
+   Image->Premultiplied = FALSE;
+   Image->PixelData = malloc(Width * Height * sizeof(EG_PIXEL));
+   return Image;
+}
+
+EG_IMAGE * egCopyImage(IN EG_IMAGE *Image) {
+   EG_IMAGE *NewImage = egCreateImage(Image->Width, Image->Height, Image->HasAlpha);
+
+   memcpy(NewImage->PixelData, Image->PixelData, Image->Width * Image->Height * sizeof(EG_PIXEL));
+   NewImage->Premultiplied = Image->Premultiplied;
+   return NewImage;
+}
+
+VOID egFreeImage(IN EG_IMAGE *Image) {
+   free(Image->PixelData);
+   free(Image);
+}
+
+static UINT8 *ReadFile(const char *FileName, UINTN *Length) {
+   FILE  *File = fopen(FileName, "rb");
+   UINT8 *Data;
+   long  Size;
+
+   if (File == NULL)
+      return NULL;
+   fseek(File, 0, SEEK_END);
+   Size = ftell(File);
+   fseek(File, 0, SEEK_SET);
+   Data = malloc(Size);
+   if ((Data != NULL) && (fread(Data, 1, Size, File) != (size_t) Size)) {
+      free(Data);
+      Data = NULL;
+   }
+   fclose(File);
+   *Length = Size;
+   return Data;
+}
+
+// A file in memory, read by ReadMemory() for egDecodePNGStream()
+typedef struct {
+   UINT8    *Data;
+   UINTN    Length, Pos, MaxRead;
+} MEMORY_FILE;
+
+static UINTN ReadMemory(VOID *Context, UINT8 *Buffer, UINTN Size) {
+   MEMORY_FILE *File = Context;
+
+   if (Size > File->MaxRead)
+      Size = File->MaxRead;
+   if (Size > File->Length - File->Pos)
+      Size = File->Length - File->Pos;
+   memcpy(Buffer, File->Data + File->Pos, Size);
+   File->Pos += Size;
+   return Size;
+}
+
+static EG_IMAGE *DecodeStream(UINT8 *FileData, UINTN FileDataLength, UINTN MaxRead,
+                              UINTN MaxWidth, UINTN MaxHeight, BOOLEAN WantAlpha) {
+   MEMORY_FILE File = { FileData, FileDataLength, 0, MaxRead };
+
+   return egDecodePNGStream(ReadMemory, &File, MaxWidth, MaxHeight, WantAlpha);
+}
+
+//
+// Checks
+//
+
+// Returns the number of pixels of Image that differ from lodepng's RGBA
+// output for the same file; with WantAlpha FALSE, alpha must be 0 and the
+// colors unpremultiplied.
+static UINTN CountBadPixels(EG_IMAGE *Image, UINT8 *FileData, UINTN FileDataLength, BOOLEAN WantAlpha) {
+   unsigned char  *Rgba;
+   unsigned       Width, Height;
+   UINTN          i, Bad = 0;
+   UINT8          Alpha, Expected[4];
+
+   if (lodepng_decode32(&Rgba, &Width, &Height, FileData, FileDataLength) != 0)
+      return 1;
+   if ((Image->Width != Width) || (Image->Height != Height) || (Image->HasAlpha != WantAlpha))
+      Bad = 1;
+   for (i = 0; (Bad == 0) && (i < (UINTN) Width * Height); i++) {
+      Alpha = WantAlpha ? Rgba[i * 4 + 3] : 255;
+      Expected[0] = (UINT8) ((Rgba[i * 4 + 2] * Alpha + 127) / 255);
+      Expected[1] = (UINT8) ((Rgba[i * 4 + 1] * Alpha + 127) / 255);
+      Expected[2] = (UINT8) ((Rgba[i * 4 + 0] * Alpha + 127) / 255);
+      Expected[3] = WantAlpha ? Alpha : 0;
+      if (memcmp(&Image->PixelData[i], Expected, 4) != 0)
+         Bad++;
+   }
+   // lodepng's buffers carry their size in front of them; see mymalloc()
+   free(((size_t *) Rgba) - 1);
+   return Bad;
+}
+
+// Returns TRUE if Image and Expected are the same size, with the same flags
+// and pixels.
+static BOOLEAN SameImage(EG_IMAGE *Image, EG_IMAGE *Expected) {
+   return (Image != NULL) && (Expected != NULL) && (Image->Width == Expected->Width) &&
+          (Image->Height == Expected->Height) && (Image->HasAlpha == Expected->HasAlpha) &&
+          (Image->Premultiplied == Expected->Premultiplied) &&
+          (memcmp(Image->PixelData, Expected->PixelData, Image->Width * Image->Height * sizeof(EG_PIXEL)) == 0);
+}
+
+// Returns the number of failed checks of egDecodePNGStream(): with no size
+// limit, it must match egDecodePNG(), and shrinking the image to fit half its
+// size must match egScaleImage() on egDecodePNG()'s result.
+static UINTN CheckStream(UINT8 *FileData, UINTN FileDataLength, BOOLEAN WantAlpha) {
+   EG_IMAGE *Image, *Expected, *Scaled;
+   UINTN    MaxWidth, MaxHeight, NewWidth, NewHeight, Failures = 0;
+
+   Expected = egDecodePNG(FileData, FileDataLength, 128, WantAlpha);
+   if (Expected == NULL)
+      return 2;
+   Image = DecodeStream(FileData, FileDataLength, CHECK_READ_SIZE, 0, 0, WantAlpha);
+   if (!SameImage(Image, Expected))
+      Failures++;
+   if (Image != NULL)
+      egFreeImage(Image);
+
+   MaxWidth = (Expected->Width + 1) / 2;
+   MaxHeight = (Expected->Height + 1) / 2;
+   egGetFitSize(Expected->Width, Expected->Height, MaxWidth, MaxHeight, &NewWidth, &NewHeight);
+   Scaled = egScaleImage(Expected, NewWidth, NewHeight);
+   Image = DecodeStream(FileData, FileDataLength, CHECK_READ_SIZE, MaxWidth, MaxHeight, WantAlpha);
+   if (!SameImage(Image, Scaled) || (Image->Width > MaxWidth) || (Image->Height > MaxHeight))
+      Failures++;
+   if (Image != NULL)
+      egFreeImage(Image);
+   if (Scaled != NULL)
+      egFreeImage(Scaled);
+   egFreeImage(Expected);
+   return Failures;
+}
+
+//
+// Timing
+//
+
+static double Now(void) {
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Checks and times the decoding of one file; returns the number of failed
+// checks.
+static UINTN RunFile(const char *FileName, double *TotalTime, double *TotalStreamTime) {
+   EG_IMAGE *Image;
+   UINT8    *FileData;
+   UINTN    FileDataLength, i, Passes, Failures = 0;
+   double   Start, Time, StreamTime;
+
+   FileData = ReadFile(FileName, &FileDataLength);
+   if (FileData == NULL) {
+      printf("%s: can't read file\n", FileName);
+      return 1;
+   }
+   for (i = 0; i < 2; i++) {
+      Image = egDecodePNG(FileData, FileDataLength, 128, (BOOLEAN) (i == 0));
+      if ((Image == NULL) || (CountBadPixels(Image, FileData, FileDataLength, (BOOLEAN) (i == 0)) > 0))
+         Failures++;
+      if (Image != NULL)
+         egFreeImage(Image);
+   }
+   if (Failures > 0) {
+      printf("%s: decoded image differs from lodepng's\n", FileName);
+      free(FileData);
+      return Failures;
+   }
+   for (i = 0; i < 2; i++)
+      Failures += CheckStream(FileData, FileDataLength, (BOOLEAN) (i == 0));
+   if (Failures > 0) {
+      printf("%s: image decoded as it's read differs from egDecodePNG()'s\n", FileName);
+      free(FileData);
+      return Failures;
+   }
+
+   Image = egDecodePNG(FileData, FileDataLength, 128, TRUE);
+   Passes = 20000000 / (Image->Width * Image->Height) + 1;
+   printf("%-44s %4dx%-4d ", FileName, (int) Image->Width, (int) Image->Height);
+   egFreeImage(Image);
+   Start = Now();
+   for (i = 0; i < Passes; i++)
+      egFreeImage(egDecodePNG(FileData, FileDataLength, 128, TRUE));
+   Time = (Now() - Start) / Passes / 1000;
+   Start = Now();
+   for (i = 0; i < Passes; i++)
+      egFreeImage(DecodeStream(FileData, FileDataLength, FileDataLength, 0, 0, TRUE));
+   StreamTime = (Now() - Start) / Passes / 1000;
+   printf("%9.1f us %9.1f us\n", Time, StreamTime);
+   *TotalTime += Time;
+   *TotalStreamTime += StreamTime;
+   free(FileData);
+   return 0;
+}
+
+int main(int argc, char *argv[]) {
+   glob_t   Files;
+   UINTN    i, Checks = 0, Failures = 0;
+   double   TotalTime = 0, TotalStreamTime = 0;
+
+   printf("%-44s %9s    %12s %12s\n", "", "", "egDecodePNG", "...Stream");
+   if (argc > 1) {
+      for (i = 1; i < (UINTN) argc; i++, Checks += 6)
+         Failures += RunFile(argv[i], &TotalTime, &TotalStreamTime);
+   } else {
+      for (i = 0; DefaultPatterns[i] != NULL; i++)
+         glob(DefaultPatterns[i], (i > 0) ? GLOB_APPEND : 0, NULL, &Files);
+      for (i = 0; i < Files.gl_pathc; i++, Checks += 6)
+         Failures += RunFile(Files.gl_pathv[i], &TotalTime, &TotalStreamTime);
+      globfree(&Files);
+   }
+   printf("%d of %d checks passed; total decoding time %.1f us (%.1f us as read)\n",
+          (int) (Checks - Failures), (int) Checks, TotalTime, TotalStreamTime);
+
+   return (Failures > 0);
+}
+
+/* EOF */
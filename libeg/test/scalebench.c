@@ -0,0 +1,315 @@
+/*
+ * libeg/test/scalebench.c
+ * Host-side check and microbenchmark of libeg's image scaler
+ *
+ * Copyright (c) 2013 Roderick W. Smith
+ * All rights reserved.
+ *
+ * This program is distributed under the terms of the GNU General Public
+ * License (GPL) version 3 (GPLv3), a copy of which must be distributed
+ * with this source code or binaries made from it.
+ *
+ */
+
+// Checks egScaleImage() against a floating-point version of the same box
+// and Lanczos-2 filters, for random images and sizes, and checks that flat
+// images stay flat and that premultiplied images stay valid; checks
+// egEnlargeImage() likewise; then times egScaleImage() on typical icon and
+// banner sizes.
+
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+#include "host_libeg.h"
+
+#define NUM_CHECKS      300
+#define MAX_ERROR       3
+
+static UINT32 RandomState = 12345;
+
+static UINT32 Random(VOID) {
+   RandomState ^= RandomState << 13;
+   RandomState ^= RandomState >> 17;
+   RandomState ^= RandomState << 5;
+   return RandomState;
+}
+
+//
+// Stand-ins for image.c
+//
+
+EG_IMAGE * egCreateImage(IN UINTN Width, IN UINTN Height, IN BOOLEAN HasAlpha) {
+   EG_IMAGE *Image = malloc(sizeof(EG_IMAGE));
+
+   Image->Width = Width;
+   Image->Height = Height;
+   Image->HasAlpha = HasAlpha;
+   Image->Premultiplied = FALSE;
+   Image->PixelData = malloc(Width * Height * sizeof(EG_PIXEL));
+   return Image;
+}
+
+EG_IMAGE * egCopyImage(IN EG_IMAGE *Image) {
+   EG_IMAGE *NewImage = egCreateImage(Image->Width, Image->Height, Image->HasAlpha);
+
+   memcpy(NewImage->PixelData, Image->PixelData, Image->Width * Image->Height * sizeof(EG_PIXEL));
+   NewImage->Premultiplied = Image->Premultiplied;
+   return NewImage;
+}
+
+VOID egFreeImage(IN EG_IMAGE *Image) {
+   free(Image->PixelData);
+   free(Image);
+}
+
+// Fill Image with random premultiplied pixels; if Smooth, make them vary
+// gradually, as in real images, rather than independently.
+static VOID RandomImage(EG_IMAGE *Image, BOOLEAN Smooth) {
+   UINTN i, c;
+   UINT8 *Channels = (UINT8 *) Image->PixelData;
+
+   for (i = 0; i < Image->Width * Image->Height * 4; i++) {
+      if (Smooth && (i >= 4))
+         Channels[i] = (UINT8) (Channels[i - 4] + (Random() % 9) - 4);
+      else
+         Channels[i] = (UINT8) Random();
+   }
+   for (i = 0; i < Image->Width * Image->Height; i++) {
+      for (c = 0; c < 3; c++) {
+         if (Channels[i * 4 + c] > Channels[i * 4 + 3])
+            Channels[i * 4 + c] = Channels[i * 4 + 3];
+      }
+   }
+   Image->HasAlpha = Image->Premultiplied = TRUE;
+}
+
+//
+// Floating-point reference
+//
+
+static double Lanczos2(double x) {
+   if (x < 0)
+      x = -x;
+   if (x == 0)
+      return 1.0;
+   if (x >= 2)
+      return 0.0;
+   return sin(M_PI * x) * sin(M_PI * x / 2) / (M_PI * M_PI * x * x / 2);
+}
+
+// Fill Weights (DstSize x SrcSize) with the filter for scaling SrcSize pixels
+// to DstSize pixels, with edge pixels repeated beyond the edges.
+static VOID RefWeights(double *Weights, UINTN SrcSize, UINTN DstSize) {
+   UINTN  i, j;
+   INTN   Tap, Clamped;
+   double Center, Start, End, Overlap, Sum;
+
+   memset(Weights, 0, DstSize * SrcSize * sizeof(double));
+   for (i = 0; i < DstSize; i++) {
+      if (SrcSize > DstSize) {
+         Start = (double) i * SrcSize / DstSize;
+         End = (double) (i + 1) * SrcSize / DstSize;
+         for (j = 0; j < SrcSize; j++) {
+            Overlap = ((j + 1 < End) ? j + 1 : End) - ((j > Start) ? j : Start);
+            if (Overlap > 0)
+               Weights[i * SrcSize + j] = Overlap * DstSize / SrcSize;
+         }
+      } else {
+         Center = (i + 0.5) * SrcSize / DstSize - 0.5;
+         Sum = 0;
+         for (Tap = (INTN) floor(Center) - 1; Tap <= (INTN) floor(Center) + 2; Tap++) {
+            Clamped = (Tap < 0) ? 0 : ((Tap >= (INTN) SrcSize) ? (INTN) SrcSize - 1 : Tap);
+            Weights[i * SrcSize + Clamped] += Lanczos2(Tap - Center);
+            Sum += Lanczos2(Tap - Center);
+         }
+         for (j = 0; j < SrcSize; j++)
+            Weights[i * SrcSize + j] /= Sum;
+      }
+   } // for
+}
+
+static UINT8 Clamp(double Value) {
+   return (Value < 0) ? 0 : ((Value > 255) ? 255 : (UINT8) (Value + 0.5));
+}
+
+static EG_IMAGE * RefScaleImage(EG_IMAGE *Image, UINTN NewWidth, UINTN NewHeight) {
+   EG_IMAGE *Temp = egCreateImage(NewWidth, Image->Height, TRUE), *NewImage = egCreateImage(NewWidth, NewHeight, TRUE);
+   double   *Columns = malloc(NewWidth * Image->Width * sizeof(double));
+   double   *Rows = malloc(NewHeight * Image->Height * sizeof(double));
+   double   Sum;
+   UINTN    x, y, j, c;
+
+   RefWeights(Columns, Image->Width, NewWidth);
+   RefWeights(Rows, Image->Height, NewHeight);
+   for (y = 0; y < Image->Height; y++) {
+      for (x = 0; x < NewWidth; x++) {
+         for (c = 0; c < 4; c++) {
+            Sum = 0;
+            for (j = 0; j < Image->Width; j++)
+               Sum += Columns[x * Image->Width + j] * ((UINT8 *) &Image->PixelData[y * Image->Width + j])[c];
+            ((UINT8 *) &Temp->PixelData[y * NewWidth + x])[c] = Clamp(Sum);
+         }
+      }
+   }
+   for (y = 0; y < NewHeight; y++) {
+      for (x = 0; x < NewWidth; x++) {
+         for (c = 0; c < 4; c++) {
+            Sum = 0;
+            for (j = 0; j < Image->Height; j++)
+               Sum += Rows[y * Image->Height + j] * ((UINT8 *) &Temp->PixelData[j * NewWidth + x])[c];
+            ((UINT8 *) &NewImage->PixelData[y * NewWidth + x])[c] = Clamp(Sum);
+         }
+         for (c = 0; c < 3; c++) {
+            if (((UINT8 *) &NewImage->PixelData[y * NewWidth + x])[c] > NewImage->PixelData[y * NewWidth + x].a)
+               ((UINT8 *) &NewImage->PixelData[y * NewWidth + x])[c] = NewImage->PixelData[y * NewWidth + x].a;
+         }
+      }
+   }
+   free(Columns);
+   free(Rows);
+   egFreeImage(Temp);
+   return NewImage;
+}
+
+//
+// Checks
+//
+
+// Returns the largest difference between any channel of the two images.
+static UINTN MaxDifference(EG_IMAGE *Image1, EG_IMAGE *Image2) {
+   UINTN i, Max = 0, Difference;
+   UINT8 *p1 = (UINT8 *) Image1->PixelData, *p2 = (UINT8 *) Image2->PixelData;
+
+   for (i = 0; i < Image1->Width * Image1->Height * 4; i++) {
+      Difference = (p1[i] > p2[i]) ? p1[i] - p2[i] : p2[i] - p1[i];
+      if (Difference > Max)
+         Max = Difference;
+   }
+   return Max;
+}
+
+static BOOLEAN IsPremultiplied(EG_IMAGE *Image) {
+   UINTN i;
+
+   for (i = 0; i < Image->Width * Image->Height; i++) {
+      if ((Image->PixelData[i].b > Image->PixelData[i].a) || (Image->PixelData[i].g > Image->PixelData[i].a) ||
+          (Image->PixelData[i].r > Image->PixelData[i].a))
+         return FALSE;
+   }
+   return TRUE;
+}
+
+static BOOLEAN IsFlat(EG_IMAGE *Image, UINT32 Value) {
+   UINTN i;
+
+   for (i = 0; i < Image->Width * Image->Height; i++) {
+      if (memcmp(&Image->PixelData[i], &Value, sizeof(Value)) != 0)
+         return FALSE;
+   }
+   return TRUE;
+}
+
+// Run one random check: scale a random image to a random size and compare
+// it with the reference, then do the same with a flat image. Returns the
+// number of failures.
+static UINTN RunCheck(UINTN *WorstError) {
+   EG_IMAGE *Image, *Scaled, *Expected;
+   UINTN    Width = Random() % 100 + 1, Height = Random() % 100 + 1, NewWidth, NewHeight, Error, Failures = 0;
+   UINT32   Value;
+
+   NewWidth = (Random() % 2) ? Random() % 200 + 1 : Width * (Random() % 3 + 1);
+   NewHeight = (Random() % 2) ? Random() % 200 + 1 : Height;
+   Image = egCreateImage(Width, Height, TRUE);
+   RandomImage(Image, (Random() % 2));
+   Scaled = egScaleImage(Image, NewWidth, NewHeight);
+   Expected = RefScaleImage(Image, NewWidth, NewHeight);
+   Error = MaxDifference(Scaled, Expected);
+   if (Error > *WorstError)
+      *WorstError = Error;
+   Failures += (Error > MAX_ERROR) || !IsPremultiplied(Scaled) || !Scaled->Premultiplied ||
+               (Scaled->Width != NewWidth) || (Scaled->Height != NewHeight);
+   egFreeImage(Scaled);
+   egFreeImage(Expected);
+
+   Value = Random() | 0xFF000000;
+   memset(Image->PixelData, 0, Width * Height * sizeof(EG_PIXEL));
+   for (Error = 0; Error < Width * Height; Error++)
+      memcpy(&Image->PixelData[Error], &Value, sizeof(Value));
+   Scaled = egScaleImage(Image, NewWidth, NewHeight);
+   Failures += !IsFlat(Scaled, Value);
+   egFreeImage(Scaled);
+   egFreeImage(Image);
+   return Failures;
+}
+
+// Enlarge a random image by a random factor and check that each new pixel
+// is a copy of the right original pixel. Returns the number of failures.
+static UINTN RunEnlargeCheck(VOID) {
+   EG_IMAGE *Image, *Enlarged;
+   UINTN    Factor = Random() % 4 + 1, x, y, Failures = 0;
+
+   Image = egCreateImage(Random() % 40 + 1, Random() % 40 + 1, TRUE);
+   RandomImage(Image, FALSE);
+   Enlarged = egEnlargeImage(Image, Factor);
+   if ((Enlarged->Width != Image->Width * Factor) || (Enlarged->Height != Image->Height * Factor))
+      Failures++;
+   for (y = 0; (y < Enlarged->Height) && (Failures == 0); y++) {
+      for (x = 0; x < Enlarged->Width; x++) {
+         if (memcmp(&Enlarged->PixelData[y * Enlarged->Width + x],
+                    &Image->PixelData[(y / Factor) * Image->Width + x / Factor], sizeof(EG_PIXEL)) != 0) {
+            Failures++;
+            break;
+         }
+      }
+   } // for
+   egFreeImage(Enlarged);
+   egFreeImage(Image);
+   return Failures;
+}
+
+//
+// Timing
+//
+
+static double Now(void) {
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Prints the time to scale a Width x Height image to NewWidth x NewHeight.
+static VOID TimeScale(UINTN Width, UINTN Height, UINTN NewWidth, UINTN NewHeight) {
+   EG_IMAGE *Image = egCreateImage(Width, Height, TRUE), *Scaled;
+   UINTN    i, Passes = 20000000 / (Width * Height + NewWidth * NewHeight) + 1;
+   double   Start;
+
+   RandomImage(Image, TRUE);
+   Start = Now();
+   for (i = 0; i < Passes; i++) {
+      Scaled = egScaleImage(Image, NewWidth, NewHeight);
+      egFreeImage(Scaled);
+   }
+   printf("%4dx%-4d -> %4dx%-4d  %9.1f us\n", (int) Width, (int) Height, (int) NewWidth, (int) NewHeight,
+          (Now() - Start) / Passes / 1000);
+   egFreeImage(Image);
+}
+
+int main(void) {
+   UINTN i, Failures = 0, WorstError = 0;
+
+   for (i = 0; i < NUM_CHECKS; i++)
+      Failures += RunCheck(&WorstError) + RunEnlargeCheck();
+   printf("%d of %d checks passed (largest difference from reference: %d)\n",
+          (int) (NUM_CHECKS * 3 - Failures), NUM_CHECKS * 3, (int) WorstError);
+
+   TimeScale(128, 128, 48, 48);
+   TimeScale(128, 128, 32, 32);
+   TimeScale(128, 128, 256, 256);
+   TimeScale(48, 48, 96, 96);
+   TimeScale(800, 200, 1600, 400);
+
+   return (Failures > 0);
+}
+
+/* EOF */
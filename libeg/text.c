@@ -40,30 +40,76 @@
 #include "egemb_font.h"
 #define FONT_NUM_CHARS 96
 
+#define FONT_DARK      0
+#define FONT_LIGHT     1
+#define FONT_COLORS    2
+
+// Rendered text runs kept by egRenderTextRun()
+#define TEXT_RUN_CACHE_SIZE 16
+
+typedef struct {
+   CHAR16      *Text;
+   UINT32      BackgroundHash;
+   UINTN       Width, Height, TextPosX, TextPosY;
+   UINTN       LastUse;
+   EG_IMAGE    *Image;
+} EG_TEXT_RUN;
+
 static EG_IMAGE *BaseFontImage = NULL;
-static EG_IMAGE *DarkFontImage = NULL;
-static EG_IMAGE *LightFontImage = NULL;
+// a PSF2 font, used instead of BaseFontImage when the font token names one
+static EG_BITMAP_FONT *BitmapFont = NULL;
+// copies of BaseFontImage in each foreground color, made when first needed
+static EG_IMAGE *FontImages[FONT_COLORS] = { NULL, NULL };
+
+static EG_TEXT_RUN TextRuns[TEXT_RUN_CACHE_SIZE];
+static UINTN       TextRunClock = 0;
 
 static UINTN FontCellWidth = 7;
+// the ui_scale (GlobalConfig.Scale) that FontImages and BitmapFont's glyphs are enlarged by
+static UINTN FontScale = 1;
+
+static VOID egFlushTextRuns(VOID);
 
 //
 // Text rendering
 //
 
+// Free the font's copies in each color, and the text drawn with them.
+static VOID egFreeFontImages(VOID) {
+   UINTN i;
+
+   for (i = 0; i < FONT_COLORS; i++) {
+      if (FontImages[i] != NULL)
+         egFreeImage(FontImages[i]);
+      FontImages[i] = NULL;
+   }
+   egFlushTextRuns();
+} // static VOID egFreeFontImages()
+
 static VOID egPrepareFont() {
+   if (FontScale != GlobalConfig.Scale) {
+      egFreeFontImages();
+      FontScale = GlobalConfig.Scale;
+   }
+   if (BitmapFont != NULL) {
+      egSetBitmapFontScale(BitmapFont, FontScale);
+      FontCellWidth = BitmapFont->Width * FontScale;
+      return;
+   }
    if (BaseFontImage == NULL) {
       BaseFontImage = egPrepareEmbeddedImage(&egemb_font, TRUE);
    }
    if (BaseFontImage != NULL)
-      FontCellWidth = BaseFontImage->Width / FONT_NUM_CHARS;
+      FontCellWidth = (BaseFontImage->Width / FONT_NUM_CHARS) * FontScale;
 } // VOID egPrepareFont();
 
 UINTN egGetFontHeight(VOID) {
    egPrepareFont();
-   return BaseFontImage->Height;
+   return ((BitmapFont != NULL) ? BitmapFont->Height : BaseFontImage->Height) * FontScale;
 } // UINTN egGetFontHeight()
 
 UINTN egGetFontCellWidth(VOID) {
+   egPrepareFont();
    return FontCellWidth;
 }
 
@@ -83,9 +129,32 @@ VOID egMeasureText(IN CHAR16 *Text, OUT UINTN *Width, OUT UINTN *Height)
     if (Width != NULL)
         *Width = StrLen(Text) * FontCellWidth;
     if (Height != NULL)
-        *Height = BaseFontImage->Height;
+        *Height = egGetFontHeight();
 }
 
+// Returns the font in dark (black) or light (inverted) characters, enlarged
+// by FontScale, creating it from BaseFontImage on first use.
+static EG_IMAGE * egGetFontImage(IN UINTN Color) {
+   EG_IMAGE *FontImage;
+   UINTN    i;
+   UINT8    White;
+
+   if (FontImages[Color] == NULL) {
+      FontImage = egEnlargeImage(BaseFontImage, FontScale);
+      if ((FontImage != NULL) && (Color == FONT_LIGHT)) {
+         // invert the colors; premultiplied colors run from 0 to alpha, not 255
+         for (i = 0; i < (FontImage->Width * FontImage->Height); i++) {
+            White = FontImage->Premultiplied ? FontImage->PixelData[i].a : 255;
+            FontImage->PixelData[i].r = White - FontImage->PixelData[i].r;
+            FontImage->PixelData[i].g = White - FontImage->PixelData[i].g;
+            FontImage->PixelData[i].b = White - FontImage->PixelData[i].b;
+         } // for
+      } // if
+      FontImages[Color] = FontImage;
+   } // if
+   return FontImages[Color];
+} // static EG_IMAGE * egGetFontImage()
+
 VOID egRenderText(IN CHAR16 *Text, IN OUT EG_IMAGE *CompImage, IN UINTN PosX, IN UINTN PosY, IN UINT8 BGBrightness)
 {
     EG_IMAGE        *FontImage;
@@ -106,30 +175,27 @@ VOID egRenderText(IN CHAR16 *Text, IN OUT EG_IMAGE *CompImage, IN UINTN PosX, IN
     if (TextLength * FontCellWidth + PosX > CompImage->Width)
         TextLength = (CompImage->Width - PosX) / FontCellWidth;
 
-    if (BGBrightness < 128) {
-       if (LightFontImage == NULL) {
-          LightFontImage = egCopyImage(BaseFontImage);
-          if (LightFontImage == NULL)
-             return;
-          for (i = 0; i < (LightFontImage->Width * LightFontImage->Height); i++) {
-             LightFontImage->PixelData[i].r = 255 - LightFontImage->PixelData[i].r;
-             LightFontImage->PixelData[i].g = 255 - LightFontImage->PixelData[i].g;
-             LightFontImage->PixelData[i].b = 255 - LightFontImage->PixelData[i].b;
-          } // for
-       } // if
-       FontImage = LightFontImage;
-    } else {
-       if (DarkFontImage == NULL)
-          DarkFontImage = egCopyImage(BaseFontImage);
-       if (DarkFontImage == NULL)
-          return;
-       FontImage = DarkFontImage;
-    } // if/else
-
-    // render it
     BufferPtr = CompImage->PixelData;
     BufferLineOffset = CompImage->Width;
     BufferPtr += PosX + PosY * BufferLineOffset;
+
+    // a bitmap font covers any characters it has glyphs for
+    if (BitmapFont != NULL) {
+        for (i = 0; i < TextLength; i++) {
+            FontPixelData = egGetGlyphPixels(BitmapFont, Text[i], (BGBrightness < 128));
+            if (FontPixelData != NULL)
+                egRawComposePremultiplied(BufferPtr, FontPixelData, FontCellWidth, BitmapFont->Height * FontScale,
+                                          BufferLineOffset, FontCellWidth);
+            BufferPtr += FontCellWidth;
+        }
+        return;
+    }
+
+    FontImage = egGetFontImage((BGBrightness < 128) ? FONT_LIGHT : FONT_DARK);
+    if (FontImage == NULL)
+       return;
+
+    // render it
     FontPixelData = FontImage->PixelData;
     FontLineOffset = FontImage->Width;
     for (i = 0; i < TextLength; i++) {
@@ -138,22 +204,162 @@ VOID egRenderText(IN CHAR16 *Text, IN OUT EG_IMAGE *CompImage, IN UINTN PosX, IN
             c = 95;
         else
             c -= 32;
-        egRawCompose(BufferPtr, FontPixelData + c * FontCellWidth,
-                     FontCellWidth, FontImage->Height,
-                     BufferLineOffset, FontLineOffset);
+        if (FontImage->Premultiplied)
+            egRawComposePremultiplied(BufferPtr, FontPixelData + c * FontCellWidth,
+                                      FontCellWidth, FontImage->Height,
+                                      BufferLineOffset, FontLineOffset);
+        else
+            egRawCompose(BufferPtr, FontPixelData + c * FontCellWidth,
+                         FontCellWidth, FontImage->Height,
+                         BufferLineOffset, FontLineOffset);
         BufferPtr += FontCellWidth;
     }
 }
 
+//
+// Text run cache
+//
+
+// Returns a hash of the Width x Height area of Image at (PosX, PosY).
+static UINT32 egHashImageArea(IN EG_IMAGE *Image, IN UINTN PosX, IN UINTN PosY, IN UINTN Width, IN UINTN Height) {
+   UINT32   Hash = 0x811c9dc5;
+   UINT32   *PixelPtr;
+   UINTN    x, y;
+
+   for (y = 0; y < Height; y++) {
+      PixelPtr = (UINT32 *) (Image->PixelData + (PosY + y) * Image->Width + PosX);
+      for (x = 0; x < Width; x++)
+         Hash = (Hash ^ *PixelPtr++) * 0x01000193;
+   }
+   return Hash;
+} // static UINT32 egHashImageArea()
+
+// Returns the average brightness of Image.
+static UINT8 egAverageBrightness(IN EG_IMAGE *Image) {
+   UINTN i;
+   UINTN Sum = 0;
+
+   for (i = 0; i < (Image->Width * Image->Height); i++)
+      Sum += (Image->PixelData[i].r + Image->PixelData[i].g + Image->PixelData[i].b);
+   return (UINT8) (Sum / (Image->Width * Image->Height * 3));
+} // static UINT8 egAverageBrightness()
+
+// Free all the cached text runs, as when the font changes.
+static VOID egFlushTextRuns(VOID) {
+   UINTN i;
+
+   for (i = 0; i < TEXT_RUN_CACHE_SIZE; i++) {
+      if (TextRuns[i].Image != NULL) {
+         egFreeImage(TextRuns[i].Image);
+         FreePool(TextRuns[i].Text);
+      }
+      TextRuns[i].Image = NULL;
+      TextRuns[i].Text = NULL;
+   } // for
+} // static VOID egFlushTextRuns()
+
+// Returns an image of Text rendered at (TextPosX, TextPosY) within a Width x
+// Height background, in dark or light characters depending on that
+// background's brightness. The background is the area of Background at
+// (AreaPosX, AreaPosY) or, if Background is NULL, a solid Color. Since menus
+// redraw the same labels, hints, and entries over and over, the most
+// recently used runs are kept, keyed by their text, placement, and a hash of
+// their background, and a repeated run is returned without being rendered
+// again. The image belongs to the cache and is valid only until the next
+// call, so it must be drawn right away and never freed. Returns NULL if the
+// area doesn't fit in Background or if memory runs out.
+EG_IMAGE * egRenderTextRun(IN CHAR16 *Text, IN EG_IMAGE *Background OPTIONAL, IN EG_PIXEL *Color OPTIONAL,
+                           IN UINTN AreaPosX, IN UINTN AreaPosY, IN UINTN Width, IN UINTN Height,
+                           IN UINTN TextPosX, IN UINTN TextPosY)
+{
+   EG_TEXT_RUN *Run = NULL;
+   EG_IMAGE    *Image;
+   UINT32      Hash;
+   UINTN       i;
+
+   if (((Background == NULL) && (Color == NULL)) || (Width == 0) || (Height == 0))
+      return NULL;
+   if (Text == NULL)
+      Text = L"";
+   if ((Background != NULL) &&
+       (((AreaPosX + Width) > Background->Width) || ((AreaPosY + Height) > Background->Height)))
+      return NULL;
+
+   if (Background != NULL)
+      Hash = egHashImageArea(Background, AreaPosX, AreaPosY, Width, Height);
+   else
+      Hash = (0x811c9dc5 ^ *((UINT32 *) Color)) * 0x01000193;
+
+   TextRunClock++;
+   for (i = 0; i < TEXT_RUN_CACHE_SIZE; i++) {
+      if ((TextRuns[i].Image != NULL) && (TextRuns[i].BackgroundHash == Hash) && (TextRuns[i].Width == Width) &&
+          (TextRuns[i].Height == Height) && (TextRuns[i].TextPosX == TextPosX) &&
+          (TextRuns[i].TextPosY == TextPosY) && (StrCmp(TextRuns[i].Text, Text) == 0)) {
+         TextRuns[i].LastUse = TextRunClock;
+         return TextRuns[i].Image;
+      }
+      // remember an empty slot or, failing that, the least recently used one
+      if ((Run == NULL) || ((Run->Image != NULL) && ((TextRuns[i].Image == NULL) || (TextRuns[i].LastUse < Run->LastUse))))
+         Run = &TextRuns[i];
+   } // for
+
+   if (Background != NULL) {
+      Image = egCropImage(Background, AreaPosX, AreaPosY, Width, Height);
+   } else {
+      Image = egCreateImage(Width, Height, FALSE);
+      if (Image != NULL)
+         egFillImage(Image, Color);
+   }
+   if (Image == NULL)
+      return NULL;
+   egRenderText(Text, Image, TextPosX, TextPosY,
+                (Background != NULL) ? egAverageBrightness(Image) : (Color->r + Color->g + Color->b) / 3);
+
+   if (Run->Image != NULL) {
+      egFreeImage(Run->Image);
+      FreePool(Run->Text);
+   }
+   Run->Text = StrDuplicate(Text);
+   if (Run->Text == NULL) {
+      Run->Image = NULL;
+      egFreeImage(Image);
+      return NULL;
+   }
+   Run->Image = Image;
+   Run->BackgroundHash = Hash;
+   Run->Width = Width;
+   Run->Height = Height;
+   Run->TextPosX = TextPosX;
+   Run->TextPosY = TextPosY;
+   Run->LastUse = TextRunClock;
+   return Image;
+} // EG_IMAGE * egRenderTextRun()
+
 // Load a font bitmap from the specified file
 VOID egLoadFont(IN CHAR16 *Filename) {
+   EFI_STATUS  Status;
+   UINT8       *FileData;
+   UINTN       FileDataLength;
+
    if (BaseFontImage)
       egFreeImage(BaseFontImage);
+   BaseFontImage = NULL;
+   egFreeBitmapFont(BitmapFont);
+   BitmapFont = NULL;
+   egFreeFontImages();
 
-   BaseFontImage = egLoadImage(SelfDir, Filename, TRUE);
-   if (BaseFontImage == NULL)
-      Print(L"Note: Font image file %s is invalid! Using default font!\n");
-    egPrepareFont();
+   // a PSF2 font is used directly; anything else should be an image of the glyphs
+   Status = egLoadFile(SelfDir, Filename, &FileData, &FileDataLength);
+   if (!EFI_ERROR(Status)) {
+      BitmapFont = egDecodePSF(FileData, FileDataLength);
+      if (BitmapFont == NULL) {
+         BaseFontImage = egDecodeAny(FileData, FileDataLength, 128, TRUE);
+         FreePool(FileData);
+      }
+   }
+   if ((BitmapFont == NULL) && (BaseFontImage == NULL))
+      Print(L"Note: Font file %s is invalid! Using default font!\n", Filename);
+   egPrepareFont();
 } // BOOLEAN egLoadFont()
 
 /* EOF */
@@ -333,6 +333,117 @@ static VOID HandleStrings(IN CHAR16 **TokenList, IN UINTN TokenCount, OUT CHAR16
    }
 } // static VOID HandleStrings()
 
+// Handle a parameter with a series of OS type names (osx, linux, elilo, grub,
+// and windows). Returns the corresponding GRAPHICS_FOR_* flags.
+static UINTN HandleOSTypes(IN CHAR16 **TokenList, IN UINTN TokenCount) {
+   UINTN i, Flags = 0;
+
+   for (i = 1; i < TokenCount; i++) {
+      if (StriCmp(TokenList[i], L"osx") == 0) {
+         Flags |= GRAPHICS_FOR_OSX;
+      } else if (StriCmp(TokenList[i], L"linux") == 0) {
+         Flags |= GRAPHICS_FOR_LINUX;
+      } else if (StriCmp(TokenList[i], L"elilo") == 0) {
+         Flags |= GRAPHICS_FOR_ELILO;
+      } else if (StriCmp(TokenList[i], L"grub") == 0) {
+         Flags |= GRAPHICS_FOR_GRUB;
+      } else if (StriCmp(TokenList[i], L"windows") == 0) {
+         Flags |= GRAPHICS_FOR_WINDOWS;
+      }
+   } // for
+   return Flags;
+} // static UINTN HandleOSTypes()
+
+// Free the elements of Paths, leaving it empty.
+static VOID FreeScanPaths(IN OUT SCAN_PATH_LIST *Paths) {
+   UINTN i;
+
+   for (i = 0; i < Paths->Count; i++) {
+      MyFreePool(Paths->Paths[i].VolName);
+      MyFreePool(Paths->Paths[i].Path);
+   } // for
+   MyFreePool(Paths->Paths);
+   Paths->Paths = NULL;
+   Paths->Count = 0;
+} // static VOID FreeScanPaths()
+
+// Split the comma-delimited list of [volume:]path elements in List into
+// Paths, replacing its previous contents. Elements with empty paths are
+// dropped.
+static VOID SplitScanPaths(IN CHAR16 *List, IN OUT SCAN_PATH_LIST *Paths) {
+   CHAR16     *Path, *VolName = NULL;
+   SCAN_PATH  *ScanPath;
+   UINTN      i = 0, Count = 0;
+
+   FreeScanPaths(Paths);
+   while ((Path = FindCommaDelimited(List, Count)) != NULL) {
+      Count++;
+      FreePool(Path);
+   }
+   if ((Count == 0) || ((Paths->Paths = AllocateZeroPool(Count * sizeof(SCAN_PATH))) == NULL))
+      return;
+
+   while ((Path = FindCommaDelimited(List, i++)) != NULL) {
+      SplitVolumeAndFilename(&Path, &VolName);
+      CleanUpPathNameSlashes(Path);
+      if (StrLen(Path) == 0) {
+         MyFreePool(Path);
+         MyFreePool(VolName);
+         VolName = NULL;
+         continue;
+      }
+      ScanPath = &(Paths->Paths[Paths->Count++]);
+      ScanPath->Path = Path;
+      ScanPath->Hash = FoldedHash(Path);
+      ScanPath->VolName = VolName;
+      ScanPath->VolNumber = VOL_DONTSCAN;
+      if (VolName && (StrLen(VolName) > 2) && (VolName[0] == L'f') && (VolName[1] == L's') &&
+          (VolName[2] >= L'0') && (VolName[2] <= L'9'))
+         ScanPath->VolNumber = Atoi(VolName + 2);
+      VolName = NULL; // now owned by ScanPath
+   } // while
+} // static VOID SplitScanPaths()
+
+// Split the scan-control lists that are consulted for each volume,
+// directory, and file during a scan, so that scans needn't parse them.
+static VOID SplitScanLists(VOID) {
+   SplitScanPaths(GlobalConfig.AlsoScan, &(GlobalConfig.AlsoScanPaths));
+   SplitScanPaths(GlobalConfig.DontScanDirs, &(GlobalConfig.DontScanPaths));
+   FreePatternList(&(GlobalConfig.DontScanVolumeNames));
+   AddPatterns(&(GlobalConfig.DontScanVolumeNames), GlobalConfig.DontScanVolumes, TRUE);
+   FreePatternList(&(GlobalConfig.DontScanFileNames));
+   AddPatterns(&(GlobalConfig.DontScanFileNames), GlobalConfig.DontScanFiles, TRUE);
+} // static VOID SplitScanLists()
+
+// Returns TRUE if ScanPath applies to Volume -- that is, if ScanPath names
+// no volume, or if it names Volume by label or by "fsN" number.
+BOOLEAN ScanPathIsOnVolume(IN SCAN_PATH *ScanPath, IN REFIT_VOLUME *Volume) {
+   if (ScanPath->VolName == NULL)
+      return TRUE;
+   if (Volume == NULL)
+      return FALSE;
+   return (((Volume->VolName != NULL) && (StriCmp(ScanPath->VolName, Volume->VolName) == 0)) ||
+           (ScanPath->VolNumber == Volume->VolNumber));
+} // BOOLEAN ScanPathIsOnVolume()
+
+// Returns TRUE if Path on Volume is in Paths. If Volume is NULL, only
+// elements that name no volume are considered. Path must already be cleaned
+// up, as by CleanUpPathNameSlashes(). Comparisons are case-insensitive.
+BOOLEAN IsInScanPaths(IN SCAN_PATH_LIST *Paths, IN REFIT_VOLUME *Volume OPTIONAL, IN CHAR16 *Path) {
+   UINT32  Hash;
+   UINTN   i;
+
+   if ((Paths->Count == 0) || (Path == NULL))
+      return FALSE;
+   Hash = FoldedHash(Path);
+   for (i = 0; i < Paths->Count; i++) {
+      if ((Paths->Paths[i].Hash == Hash) && ScanPathIsOnVolume(&(Paths->Paths[i]), Volume) &&
+          (StriCmp(Paths->Paths[i].Path, Path) == 0))
+         return TRUE;
+   } // for
+   return FALSE;
+} // BOOLEAN IsInScanPaths()
+
 // read config file
 VOID ReadConfig(CHAR16 *FileName)
 {
@@ -361,16 +472,21 @@ VOID ReadConfig(CHAR16 *FileName)
        GlobalConfig.DontScanDirs = SelfPath;
        MyFreePool(GlobalConfig.DontScanFiles);
        GlobalConfig.DontScanFiles = StrDuplicate(DONT_SCAN_FILES);
+       MyFreePool(GlobalConfig.DontScanPartTypes);
+       GlobalConfig.DontScanPartTypes = StrDuplicate(DONT_SCAN_PART_TYPES);
     } // if
 
     if (!FileExists(SelfDir, FileName)) {
         Print(L"Configuration file '%s' missing!\n", FileName);
+        SplitScanLists();
         return;
     }
 
     Status = ReadFile(SelfDir, FileName, &File, &i);
-    if (EFI_ERROR(Status))
+    if (EFI_ERROR(Status)) {
+        SplitScanLists();
         return;
+    }
 
     for (;;) {
         TokenCount = ReadTokenLine(&File, &TokenList);
@@ -420,6 +536,9 @@ VOID ReadConfig(CHAR16 *FileName)
         } else if ((StriCmp(TokenList[0], L"scan_delay") == 0) && (TokenCount == 2)) {
            HandleInt(TokenList, TokenCount, &(GlobalConfig.ScanDelay));
 
+        } else if (StriCmp(TokenList[0], L"wait_for_volumes") == 0) {
+            HandleStrings(TokenList, TokenCount, &(GlobalConfig.WaitForVolumes));
+
         } else if (StriCmp(TokenList[0], L"also_scan_dirs") == 0) {
             HandleStrings(TokenList, TokenCount, &(GlobalConfig.AlsoScan));
 
@@ -438,6 +557,13 @@ VOID ReadConfig(CHAR16 *FileName)
         } else if ((StriCmp(TokenList[0], L"don't_scan_files") == 0) || (StriCmp(TokenList[0], L"dont_scan_files") == 0)) {
            HandleStrings(TokenList, TokenCount, &(GlobalConfig.DontScanFiles));
 
+        } else if ((StriCmp(TokenList[0], L"don't_scan_part_types") == 0) || (StriCmp(TokenList[0], L"dont_scan_part_types") == 0)) {
+           MyFreePool(GlobalConfig.DontScanPartTypes);
+           GlobalConfig.DontScanPartTypes = NULL;
+           for (i = 1; i < TokenCount; i++) {
+              MergeStrings(&GlobalConfig.DontScanPartTypes, TokenList[i], L',');
+           }
+
         } else if (StriCmp(TokenList[0], L"scan_driver_dirs") == 0) {
             HandleStrings(TokenList, TokenCount, &(GlobalConfig.DriverDirs));
 
@@ -496,24 +622,21 @@ VOID ReadConfig(CHAR16 *FileName)
               GlobalConfig.RequestedScreenHeight = 0;
 
         } else if (StriCmp(TokenList[0], L"use_graphics_for") == 0) {
-           GlobalConfig.GraphicsFor = 0;
-           for (i = 1; i < TokenCount; i++) {
-              if (StriCmp(TokenList[i], L"osx") == 0) {
-                 GlobalConfig.GraphicsFor |= GRAPHICS_FOR_OSX;
-              } else if (StriCmp(TokenList[i], L"linux") == 0) {
-                 GlobalConfig.GraphicsFor |= GRAPHICS_FOR_LINUX;
-              } else if (StriCmp(TokenList[i], L"elilo") == 0) {
-                 GlobalConfig.GraphicsFor |= GRAPHICS_FOR_ELILO;
-              } else if (StriCmp(TokenList[i], L"grub") == 0) {
-                 GlobalConfig.GraphicsFor |= GRAPHICS_FOR_GRUB;
-              } else if (StriCmp(TokenList[i], L"windows") == 0) {
-                 GlobalConfig.GraphicsFor |= GRAPHICS_FOR_WINDOWS;
-              }
-           } // for (graphics_on tokens)
+           GlobalConfig.GraphicsFor = HandleOSTypes(TokenList, TokenCount);
+
+        } else if (StriCmp(TokenList[0], L"memory_load_for") == 0) {
+           GlobalConfig.MemoryLoadFor = HandleOSTypes(TokenList, TokenCount);
 
         } else if ((StriCmp(TokenList[0], L"font") == 0) && (TokenCount == 2)) {
            egLoadFont(TokenList[1]);
 
+        } else if ((StriCmp(TokenList[0], L"ui_scale") == 0) && (TokenCount == 2)) {
+           HandleInt(TokenList, TokenCount, &(GlobalConfig.Scale));
+           if (GlobalConfig.Scale < 1)
+              GlobalConfig.Scale = 1;
+           if (GlobalConfig.Scale > MAX_UI_SCALE)
+              GlobalConfig.Scale = MAX_UI_SCALE;
+
         } else if (StriCmp(TokenList[0], L"scan_all_linux_kernels") == 0) {
            if ((TokenCount >= 2) && (StriCmp(TokenList[1], L"0") == 0)) {
               GlobalConfig.ScanAllLinux = FALSE;
@@ -521,6 +644,27 @@ VOID ReadConfig(CHAR16 *FileName)
               GlobalConfig.ScanAllLinux = TRUE;
            }
 
+        } else if (StriCmp(TokenList[0], L"scan_cache") == 0) {
+           if ((TokenCount >= 2) && (StriCmp(TokenList[1], L"0") == 0)) {
+              GlobalConfig.UseScanCache = FALSE;
+           } else {
+              GlobalConfig.UseScanCache = TRUE;
+           }
+
+        } else if (StriCmp(TokenList[0], L"express_boot") == 0) {
+           if ((TokenCount >= 2) && (StriCmp(TokenList[1], L"0") == 0)) {
+              GlobalConfig.ExpressBoot = FALSE;
+           } else {
+              GlobalConfig.ExpressBoot = TRUE;
+           }
+
+        } else if (StriCmp(TokenList[0], L"log_timing") == 0) {
+           if ((TokenCount >= 2) && (StriCmp(TokenList[1], L"0") == 0)) {
+              GlobalConfig.LogTiming = FALSE;
+           } else {
+              GlobalConfig.LogTiming = TRUE;
+           }
+
         } else if (StriCmp(TokenList[0], L"max_tags") == 0) {
            HandleInt(TokenList, TokenCount, &(GlobalConfig.MaxTags));
 
@@ -534,6 +678,7 @@ VOID ReadConfig(CHAR16 *FileName)
         FreeTokenLine(&TokenList, &TokenCount);
     }
     MyFreePool(File.Buffer);
+    SplitScanLists();
 } /* VOID ReadConfig() */
 
 // Finds a volume with the specified Identifier (a volume label or a number
@@ -559,7 +704,7 @@ static BOOLEAN FindVolume(REFIT_VOLUME **Volume, CHAR16 *Identifier) {
             CountedVolumes++;
          } // if
       } else { // User specified a volume by label
-         if (StriCmp(Identifier, Volumes[i]->VolName) == 0) {
+         if ((Volumes[i]->VolName != NULL) && (StriCmp(Identifier, Volumes[i]->VolName) == 0)) {
             *Volume = Volumes[i];
             Found = TRUE;
          } // if
@@ -596,7 +741,7 @@ static VOID AddSubmenu(LOADER_ENTRY *Entry, REFIT_FILE *File, REFIT_VOLUME *Volu
             MyFreePool(SubEntry->me.Title);
             SubEntry->me.Title        = AllocateZeroPool(256 * sizeof(CHAR16));
             SPrint(SubEntry->me.Title, 255, L"Boot %s from %s", (Title != NULL) ? Title : L"Unknown", Volume->VolName);
-            SubEntry->me.BadgeImage   = Volume->VolBadgeImage;
+            SubEntry->Volume          = Volume;
             SubEntry->VolName         = Volume->VolName;
          } // if match found
 
@@ -658,7 +803,8 @@ static LOADER_ENTRY * AddStanzaEntries(REFIT_FILE *File, REFIT_VOLUME *Volume, C
    Entry->me.Title        = AllocateZeroPool(256 * sizeof(CHAR16));
    SPrint(Entry->me.Title, 255, L"Boot %s from %s", (Title != NULL) ? Title : L"Unknown", CurrentVolume->VolName);
    Entry->me.Row          = 0;
-   Entry->me.BadgeImage   = CurrentVolume->VolBadgeImage;
+   Entry->me.LoadImages   = LoadLoaderImages;
+   Entry->Volume          = CurrentVolume;
    Entry->VolName         = CurrentVolume->VolName;
 
    // Parse the config file to add options for a single stanza, terminating when the token
@@ -677,7 +823,7 @@ static LOADER_ENTRY * AddStanzaEntries(REFIT_FILE *File, REFIT_VOLUME *Volume, C
             MyFreePool(Entry->me.Title);
             Entry->me.Title        = AllocateZeroPool(256 * sizeof(CHAR16));
             SPrint(Entry->me.Title, 255, L"Boot %s from %s", (Title != NULL) ? Title : L"Unknown", CurrentVolume->VolName);
-            Entry->me.BadgeImage   = CurrentVolume->VolBadgeImage;
+            Entry->Volume          = CurrentVolume;
             Entry->VolName         = CurrentVolume->VolName;
          } // if match found
 
@@ -81,9 +81,13 @@ typedef struct {
 #define CONFIG_FILE_NAME         L"refind.conf"
 #define DONT_SCAN_FILES L"shim.efi,MokManager.efi,TextMode.efi,ebounce.efi,GraphicsConsole.efi"
 #define ALSO_SCAN_DIRS L"boot"
+// GPT type codes for Linux swap, Linux LVM, Linux RAID, and Microsoft reserved
+#define DONT_SCAN_PART_TYPES L"0657fd6d-a4ab-43c4-84e5-0933c84b4f4f,e6d6d379-f507-44c2-a23c-238f2a3df928,a19d880f-05fc-4d3b-a006-743f0f84911e,e3c9e316-0b5c-4db8-817d-f92df00215ae"
 
 EFI_STATUS ReadFile(IN EFI_FILE_HANDLE BaseDir, CHAR16 *FileName, REFIT_FILE *File, UINTN *size);
 VOID ReadConfig(CHAR16 *FileName);
+BOOLEAN ScanPathIsOnVolume(IN SCAN_PATH *ScanPath, IN REFIT_VOLUME *Volume);
+BOOLEAN IsInScanPaths(IN SCAN_PATH_LIST *Paths, IN REFIT_VOLUME *Volume OPTIONAL, IN CHAR16 *Path);
 VOID ScanUserConfigured(CHAR16 *FileName);
 UINTN ReadTokenLine(IN REFIT_FILE *File, OUT CHAR16 ***TokenList);
 VOID FreeTokenLine(IN OUT CHAR16 ***TokenList, IN OUT UINTN *TokenCount);
@@ -54,6 +54,7 @@
 #endif
 
 #include "libeg.h"
+#include "pattern.h"
 
 #define REFIT_DEBUG (0)
 
@@ -76,7 +77,11 @@
 
 #define DEFAULT_ICONS_DIR L"icons"
 
+// Largest value of ui_scale (GlobalConfig.Scale)
+#define MAX_UI_SCALE 4
+
 // OS bit codes; used in GlobalConfig.GraphicsOn
+// OS types for use_graphics_for and memory_load_for
 #define GRAPHICS_FOR_OSX        1
 #define GRAPHICS_FOR_LINUX      2
 #define GRAPHICS_FOR_ELILO      4
@@ -119,6 +124,10 @@
 #define FS_TYPE_HFSPLUS        5
 #define FS_TYPE_REISERFS       6
 #define FS_TYPE_ISO9660        7
+#define FS_TYPE_XFS            8
+#define FS_TYPE_BTRFS          9
+#define FS_TYPE_NTFS           10
+#define FS_TYPE_EXFAT          11
 
 //
 // global definitions
@@ -145,8 +154,9 @@ typedef struct {
    EFI_FILE            *RootDir;
    CHAR16              *VolName;
    UINTN               VolNumber;
-   EG_IMAGE            *VolIconImage;
-   EG_IMAGE            *VolBadgeImage;
+   EG_IMAGE            *VolIconImage;  // custom icon; see GetVolumeIcon()
+   EG_IMAGE            *VolBadgeImage; // see GetVolumeBadge()
+   BOOLEAN             IconsLoaded;    // TRUE once the above have been loaded
    UINTN               DiskKind;
    BOOLEAN             IsAppleLegacy;
    BOOLEAN             HasBootCode;
@@ -161,6 +171,11 @@ typedef struct {
    MBR_PARTITION_INFO  *MbrPartitionTable;
    BOOLEAN             IsReadable;
    UINT32              FSType;
+   EFI_GUID            PartTypeGuid; // GPT partition type GUID; all 0s if not on a GPT disk
+   EFI_GUID            PartGuid;     // GPT unique partition GUID
+   CHAR16              *PartName;    // GPT partition name, or NULL
+   UINT8               *ProbeBuffer; // start of volume, valid only during ScanVolumes()
+   UINTN               ProbeBufferSize;
 } REFIT_VOLUME;
 
 typedef struct _refit_menu_entry {
@@ -172,6 +187,7 @@ typedef struct _refit_menu_entry {
    EG_IMAGE    *Image;
    EG_IMAGE    *BadgeImage;
    struct _refit_menu_screen *SubScreen;
+   VOID        (*LoadImages)(IN OUT struct _refit_menu_entry *Entry); // sets Image & BadgeImage when first drawn
 } REFIT_MENU_ENTRY;
 
 typedef struct _refit_menu_screen {
@@ -185,6 +201,7 @@ typedef struct _refit_menu_screen {
    CHAR16      *TimeoutText;
    CHAR16      *Hint1;
    CHAR16      *Hint2;
+   BOOLEAN     (*IdleFunc)(IN REFIT_MENU_ENTRY *Entry); // background work during timeout countdown
 } REFIT_MENU_SCREEN;
 
 typedef struct {
@@ -198,6 +215,8 @@ typedef struct {
    CHAR16           *LoadOptions;
    CHAR16           *InitrdPath; // Linux stub loader only
    CHAR8            OSType;
+   CHAR16           *IconHints;  // comma-delimited OS icon names
+   REFIT_VOLUME     *Volume;     // source of custom icon & badge, or NULL
 } LOADER_ENTRY;
 
 typedef struct {
@@ -210,9 +229,26 @@ typedef struct {
    BOOLEAN           Enabled;
 } LEGACY_ENTRY;
 
+// One element of a [volume:]path list, such as "also_scan_dirs" or
+// "dont_scan_dirs", as split apart by ReadConfig()
+typedef struct {
+   CHAR16      *VolName;    // NULL if the element names no volume
+   UINTN       VolNumber;   // N if VolName is "fsN"; otherwise VOL_DONTSCAN
+   CHAR16      *Path;       // cleaned up by CleanUpPathNameSlashes()
+   UINT32      Hash;        // FoldedHash() of Path
+} SCAN_PATH;
+
+typedef struct {
+   UINTN       Count;
+   SCAN_PATH   *Paths;
+} SCAN_PATH_LIST;
+
 typedef struct {
    BOOLEAN     TextOnly;
    BOOLEAN     ScanAllLinux;
+   BOOLEAN     UseScanCache;
+   BOOLEAN     ExpressBoot;
+   BOOLEAN     LogTiming;
    UINTN       RequestedScreenWidth;
    UINTN       RequestedScreenHeight;
    UINTN       BannerBottomEdge;
@@ -221,8 +257,10 @@ typedef struct {
    UINTN       HideUIFlags;
    UINTN       MaxTags;     // max. number of OS entries to show simultaneously in graphics mode
    UINTN       GraphicsFor;
+   UINTN       MemoryLoadFor;
    UINTN       LegacyType;
    UINTN       ScanDelay;
+   UINTN       Scale;       // factor by which icons, images, and fonts are enlarged (1 to MAX_UI_SCALE)
    CHAR16      *BannerFileName;
    EG_IMAGE    *ScreenBackground;
    CHAR16      *SelectionSmallFileName;
@@ -234,8 +272,16 @@ typedef struct {
    CHAR16      *DontScanFiles;
    CHAR16      *DriverDirs;
    CHAR16      *IconsDir;
+   CHAR16      *DontScanPartTypes;
+   CHAR16      *WaitForVolumes;
    UINTN       ShowTools[NUM_TOOLS];
    CHAR8       ScanFor[NUM_SCAN_OPTIONS]; // codes of types of loaders for which to scan
+   // AlsoScan, DontScanDirs, DontScanVolumes, and DontScanFiles, split apart
+   // by ReadConfig() so that scans needn't parse them again
+   SCAN_PATH_LIST AlsoScanPaths;
+   SCAN_PATH_LIST DontScanPaths;
+   PATTERN_LIST   DontScanVolumeNames;
+   PATTERN_LIST   DontScanFileNames;
 } REFIT_CONFIG;
 
 // Global variables
@@ -250,8 +296,13 @@ extern REFIT_VOLUME     *SelfVolume;
 extern REFIT_VOLUME     **Volumes;
 extern UINTN            VolumesCount;
 
+extern CHAR16           **TimingLog;
+extern UINTN            TimingLogCount;
+
 extern REFIT_CONFIG     GlobalConfig;
 
+extern EFI_GUID         RefindGuid;
+
 extern EFI_GUID gEfiLegacyBootProtocolGuid;
 extern EFI_GUID gEfiGlobalVariableGuid;
 
@@ -261,6 +312,7 @@ VOID GenerateSubScreen(LOADER_ENTRY *Entry, IN REFIT_VOLUME *Volume);
 LOADER_ENTRY * MakeGenericLoaderEntry(VOID);
 LOADER_ENTRY * AddLoaderEntry(IN CHAR16 *LoaderPath, IN CHAR16 *LoaderTitle, IN REFIT_VOLUME *Volume);
 VOID SetLoaderDefaults(LOADER_ENTRY *Entry, CHAR16 *LoaderPath, IN REFIT_VOLUME *Volume);
+VOID LoadLoaderImages(IN OUT REFIT_MENU_ENTRY *MenuEntry);
 LOADER_ENTRY * AddPreparedLoaderEntry(LOADER_ENTRY *Entry);
 
 #endif
@@ -0,0 +1,139 @@
+/*
+ * refind/gpt.c
+ * Functions related to GPT data structures
+ *
+ * Copyright (c) 2013 Roderick W. Smith
+ * All rights reserved.
+ *
+ * This program is distributed under the terms of the GNU General Public
+ * License (GPL) version 3 (GPLv3), a copy of which must be distributed
+ * with this source code or binaries made from it.
+ *
+ */
+
+#include "gpt.h"
+#include "lib.h"
+#include "../include/refit_call_wrapper.h"
+
+// Linked list of GPT data read so far, one entry per whole disk. Cleared
+// by ForgetGptData() at the start of each volume scan, since BlockIO
+// pointers aren't guaranteed to survive driver reconnections.
+static GPT_DATA *gGptData = NULL;
+
+// Returns TRUE if the CRC32 of Size bytes at Buffer matches Expected.
+static BOOLEAN GptCrcIsValid(IN VOID *Buffer, IN UINTN Size, IN UINT32 Expected) {
+   EFI_STATUS  Status;
+   UINT32      Crc = 0;
+
+   Status = refit_call3_wrapper(BS->CalculateCrc32, Buffer, Size, &Crc);
+   return (!EFI_ERROR(Status) && (Crc == Expected));
+} // static BOOLEAN GptCrcIsValid()
+
+// Read the primary GPT header and partition entries from the whole disk
+// identified by BlockIO. Returns a new GPT_DATA structure whose Header and
+// Entries fields are NULL if the disk lacks a valid GPT, or NULL if memory
+// could not be allocated.
+static GPT_DATA * ReadGptData(IN EFI_BLOCK_IO *BlockIO) {
+   EFI_STATUS  Status;
+   GPT_DATA    *Data;
+   GPT_HEADER  *Header;
+   UINT8       *Sector, *Entries = NULL;
+   UINT32      BlockSize, SavedCrc;
+   UINTN       EntriesSize, ReadSize;
+
+   Data = AllocateZeroPool(sizeof(GPT_DATA));
+   if (Data == NULL)
+      return NULL;
+   Data->BlockIO = BlockIO;
+
+   BlockSize = BlockIO->Media->BlockSize;
+   if ((BlockSize < 512) || !BlockIO->Media->MediaPresent)
+      return Data;
+
+   Sector = AllocatePool(BlockSize);
+   if (Sector == NULL)
+      return Data;
+
+   Status = refit_call5_wrapper(BlockIO->ReadBlocks, BlockIO, BlockIO->Media->MediaId, 1, BlockSize, Sector);
+   Header = (GPT_HEADER *) Sector;
+   if (!EFI_ERROR(Status) && (Header->Signature == GPT_SIGNATURE) &&
+       (Header->HeaderSize >= GPT_HEADER_MIN_SIZE) && (Header->HeaderSize <= BlockSize) &&
+       (Header->EntrySize >= GPT_ENTRY_MIN_SIZE) &&
+       ((UINT64) Header->NumEntries * Header->EntrySize <= GPT_MAX_ENTRIES_SIZE)) {
+      SavedCrc = Header->HeaderCrc32;
+      Header->HeaderCrc32 = 0;
+      if (GptCrcIsValid(Sector, Header->HeaderSize, SavedCrc)) {
+         Header->HeaderCrc32 = SavedCrc;
+         EntriesSize = (UINTN) Header->NumEntries * Header->EntrySize;
+         ReadSize = ((EntriesSize + BlockSize - 1) / BlockSize) * BlockSize;
+         Entries = AllocatePool(ReadSize);
+         if (Entries != NULL) {
+            Status = refit_call5_wrapper(BlockIO->ReadBlocks, BlockIO, BlockIO->Media->MediaId,
+                                         Header->EntriesLba, ReadSize, Entries);
+            if (!EFI_ERROR(Status) && GptCrcIsValid(Entries, EntriesSize, Header->EntriesCrc32)) {
+               Data->Header = Header;
+               Data->Entries = Entries;
+            } // if
+         } // if
+      } // if header CRC OK
+   } // if GPT signature found
+
+   if (Data->Header == NULL) {
+      MyFreePool(Entries);
+      MyFreePool(Sector);
+   }
+   return Data;
+} // static GPT_DATA * ReadGptData()
+
+// Return a pointer to the GPT entry describing the partition identified by
+// HdNode on the disk whose BlockIO protocol is WholeDiskBlockIO, or NULL if
+// no such entry exists. The disk's GPT is read at most once per scan. The
+// returned pointer refers to cached data and must NOT be freed.
+GPT_ENTRY * FindGptEntry(IN EFI_BLOCK_IO *WholeDiskBlockIO, IN HARDDRIVE_DEVICE_PATH *HdNode) {
+   GPT_DATA   *Data;
+   GPT_ENTRY  *Entry;
+   UINTN      i;
+
+   if ((WholeDiskBlockIO == NULL) || (HdNode == NULL) || (HdNode->MBRType != MBR_TYPE_EFI_PARTITION_TABLE_HEADER))
+      return NULL;
+
+   Data = gGptData;
+   while ((Data != NULL) && (Data->BlockIO != WholeDiskBlockIO))
+      Data = Data->NextEntry;
+   if (Data == NULL) {
+      Data = ReadGptData(WholeDiskBlockIO);
+      if (Data == NULL)
+         return NULL;
+      Data->NextEntry = gGptData;
+      gGptData = Data;
+   } // if
+
+   if (Data->Header == NULL)
+      return NULL;
+
+   for (i = 0; i < Data->Header->NumEntries; i++) {
+      Entry = (GPT_ENTRY *) (Data->Entries + i * Data->Header->EntrySize);
+      if (HdNode->SignatureType == SIGNATURE_TYPE_GUID) {
+         if (CompareMem(&(Entry->PartGuid), HdNode->Signature, sizeof(EFI_GUID)) == 0)
+            return Entry;
+      } else if ((HdNode->PartitionNumber == i + 1) && (HdNode->PartitionStart == Entry->StartLba)) {
+         return Entry;
+      } // if/else
+   } // for
+   return NULL;
+} // GPT_ENTRY * FindGptEntry()
+
+// Free all cached GPT data.
+VOID ForgetGptData(VOID) {
+   GPT_DATA *Next;
+
+   while (gGptData != NULL) {
+      Next = gGptData->NextEntry;
+      MyFreePool(gGptData->Header);
+      MyFreePool(gGptData->Entries);
+      FreePool(gGptData);
+      gGptData = Next;
+   } // while
+} // VOID ForgetGptData()
+
+/* EOF */
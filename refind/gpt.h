@@ -0,0 +1,75 @@
+/*
+ * refind/gpt.h
+ * Functions related to GPT data structures
+ *
+ * Copyright (c) 2013 Roderick W. Smith
+ * All rights reserved.
+ *
+ * This program is distributed under the terms of the GNU General Public
+ * License (GPL) version 3 (GPLv3), a copy of which must be distributed
+ * with this source code or binaries made from it.
+ *
+ */
+
+#ifndef __GPT_H_
+#define __GPT_H_
+
+#ifdef __MAKEWITH_GNUEFI
+#include "efi.h"
+#include "efilib.h"
+#else
+#include "../include/tiano_includes.h"
+#endif
+
+#include "global.h"
+
+#define GPT_SIGNATURE         0x5452415020494645ULL /* "EFI PART" */
+#define GPT_HEADER_MIN_SIZE   92
+#define GPT_ENTRY_MIN_SIZE    128
+#define GPT_MAX_ENTRIES_SIZE  (1024 * 1024) /* sanity limit on partition array size */
+#define GPT_NAME_LENGTH       36
+
+// On-disk GPT header; only the fields defined by the UEFI spec (92 bytes) are
+// included, since the rest of the sector is reserved.
+typedef struct {
+   UINT64   Signature;
+   UINT32   Revision;
+   UINT32   HeaderSize;
+   UINT32   HeaderCrc32;
+   UINT32   Reserved;
+   UINT64   MyLba;
+   UINT64   AlternateLba;
+   UINT64   FirstUsableLba;
+   UINT64   LastUsableLba;
+   EFI_GUID DiskGuid;
+   UINT64   EntriesLba;
+   UINT32   NumEntries;
+   UINT32   EntrySize;
+   UINT32   EntriesCrc32;
+} GPT_HEADER;
+
+// On-disk GPT partition entry
+typedef struct {
+   EFI_GUID TypeGuid;
+   EFI_GUID PartGuid;
+   UINT64   StartLba;
+   UINT64   EndLba;
+   UINT64   Attributes;
+   CHAR16   Name[GPT_NAME_LENGTH];
+} GPT_ENTRY;
+
+// Cached GPT data for one whole disk. Header and Entries are both NULL
+// if the disk has no valid GPT, so that such disks are not re-read.
+typedef struct _gpt_data {
+   EFI_BLOCK_IO      *BlockIO;
+   GPT_HEADER        *Header;
+   UINT8             *Entries;
+   struct _gpt_data  *NextEntry;
+} GPT_DATA;
+
+GPT_ENTRY * FindGptEntry(IN EFI_BLOCK_IO *WholeDiskBlockIO, IN HARDDRIVE_DEVICE_PATH *HdNode);
+VOID ForgetGptData(VOID);
+
+#endif
+
+/* EOF */
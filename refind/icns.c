@@ -65,18 +65,24 @@ BUILTIN_ICON BuiltinIconTable[BUILTIN_ICON_COUNT] = {
    { NULL, L"vol_optical", 32 },
 };
 
+// Returns a built-in icon. Icon files are shared through egFindIcon()'s
+// cache, which counts each call as a new reference; the table holds only
+// the dummy images used when no icon file exists.
 EG_IMAGE * BuiltinIcon(IN UINTN Id)
 {
+    EG_IMAGE *Image;
+
     if (Id >= BUILTIN_ICON_COUNT)
         return NULL;
 
-    if (BuiltinIconTable[Id].Image == NULL) {
-       BuiltinIconTable[Id].Image = egFindIcon(BuiltinIconTable[Id].FileName, BuiltinIconTable[Id].PixelSize);
+    Image = egFindIcon(BuiltinIconTable[Id].FileName, BuiltinIconTable[Id].PixelSize);
+    if (Image == NULL) {
        if (BuiltinIconTable[Id].Image == NULL)
           BuiltinIconTable[Id].Image = DummyImage(BuiltinIconTable[Id].PixelSize);
+       Image = BuiltinIconTable[Id].Image;
     } // if
 
-    return BuiltinIconTable[Id].Image;
+    return Image;
 }
 
 //
@@ -145,18 +151,20 @@ static EG_PIXEL BlackPixel  = { 0x00, 0x00, 0x00, 0 };
 EG_IMAGE * DummyImage(IN UINTN PixelSize)
 {
     EG_IMAGE        *Image;
-    UINTN           x, y, LineOffset;
+    UINTN           x, y, LineOffset, PatternSize;
     CHAR8           *Ptr, *YPtr;
 
+    PixelSize *= GlobalConfig.Scale;
+    PatternSize = 32 * GlobalConfig.Scale;
     Image = egCreateFilledImage(PixelSize, PixelSize, TRUE, &BlackPixel);
 
     LineOffset = PixelSize * 4;
 
-    YPtr = (CHAR8 *)Image->PixelData + ((PixelSize - 32) >> 1) * (LineOffset + 4);
-    for (y = 0; y < 32; y++) {
+    YPtr = (CHAR8 *)Image->PixelData + ((PixelSize - PatternSize) >> 1) * (LineOffset + 4);
+    for (y = 0; y < PatternSize; y++) {
         Ptr = YPtr;
-        for (x = 0; x < 32; x++) {
-            if (((x + y) % 12) < 6) {
+        for (x = 0; x < PatternSize; x++) {
+            if (((x + y) % (12 * GlobalConfig.Scale)) < (6 * GlobalConfig.Scale)) {
                 *Ptr++ = 0;
                 *Ptr++ = 0;
                 *Ptr++ = 0;
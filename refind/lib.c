@@ -46,6 +46,7 @@
 #include "lib.h"
 #include "icns.h"
 #include "screen.h"
+#include "gpt.h"
 #include "../include/refit_call_wrapper.h"
 #include "../include/RemovableMedia.h"
 
@@ -72,6 +73,11 @@ EFI_DEVICE_PATH EndDevicePath[] = {
 #define REISERFS_SUPER_MAGIC_STRING      "ReIsErFs"
 #define REISER2FS_SUPER_MAGIC_STRING     "ReIsEr2Fs"
 #define REISER2FS_JR_SUPER_MAGIC_STRING  "ReIsEr3Fs"
+#define BTRFS_SIGNATURE                  "_BHRfS_M"
+#define XFS_MAGIC_STRING                 "XFSB"
+#define NTFS_MAGIC_STRING                "NTFS    "
+#define EXFAT_MAGIC_STRING               "EXFAT   "
+#define ISO9660_MAGIC_STRING             "CD001"
 
 // variables
 
@@ -85,12 +91,22 @@ REFIT_VOLUME     *SelfVolume = NULL;
 REFIT_VOLUME     **Volumes = NULL;
 UINTN            VolumesCount = 0;
 
+CHAR16           **TimingLog = NULL;
+UINTN            TimingLogCount = 0;
+
+// Vendor GUID for rEFInd's own NVRAM variables
+EFI_GUID         RefindGuid = { 0x36d08fa7, 0xcf0b, 0x42f5, { 0x8f, 0x14, 0x68, 0xdf, 0x73, 0xed, 0x37, 0x40 } };
+
+// Vendor GUID of the Boot Loader Interface variables used by systemd-boot
+static EFI_GUID  LoaderInterfaceGuid = { 0x4a67b082, 0x0a4c, 0x41cf, { 0xb6, 0xc7, 0x44, 0x0b, 0x29, 0xbb, 0x8c, 0x4f } };
+
 // Maximum size for disk sectors
 #define SECTOR_SIZE 4096
 
 // Number of bytes to read from a partition to determine its filesystem type
-// and identify its boot loader, and hence probable BIOS-mode OS installation
-#define SAMPLE_SIZE 69632 /* 68 KiB -- ReiserFS superblock begins at 64 KiB */
+// and identify its boot loader, and hence probable BIOS-mode OS installation.
+// Must cover the MinSize of every entry in FilesystemDetectors[].
+#define PROBE_SIZE 69632 /* 68 KiB -- ReiserFS & Btrfs superblocks begin at 64 KiB */
 
 // Default names for volume badges (mini-icon to define disk type) and icons
 #define VOLUME_BADGE_NAMES L".VolumeBadge.icns,.VolumeBadge.png"
@@ -412,6 +428,18 @@ static CHAR16 *FSTypeName(IN UINT32 TypeCode) {
       case FS_TYPE_ISO9660:
          retval = L" ISO-9660";
          break;
+      case FS_TYPE_XFS:
+         retval = L" XFS";
+         break;
+      case FS_TYPE_BTRFS:
+         retval = L" Btrfs";
+         break;
+      case FS_TYPE_NTFS:
+         retval = L" NTFS";
+         break;
+      case FS_TYPE_EXFAT:
+         retval = L" exFAT";
+         break;
       default:
          retval = L"";
          break;
@@ -419,62 +447,185 @@ static CHAR16 *FSTypeName(IN UINT32 TypeCode) {
    return retval;
 } // CHAR16 *FSTypeName()
 
-// Identify the filesystem type, if possible. Expects a Buffer containing
-// the first few (normally 4096) bytes of the filesystem, and outputs a
-// code representing the identified filesystem type.
-static UINT32 IdentifyFilesystemType(IN UINT8 *Buffer, IN UINTN BufferSize) {
-   UINT32       FoundType = FS_TYPE_UNKNOWN;
+// Filesystem detectors. Each one examines the start of a volume, as held in
+// the volume's probe buffer, and returns an FS_TYPE_* code, or FS_TYPE_UNKNOWN
+// if it doesn't recognize the data. Detectors are only called when the
+// buffer holds at least the number of bytes listed for them in
+// FilesystemDetectors[], so they need not check BufferSize themselves.
+
+static UINT32 DetectNtfs(IN UINT8 *Buffer, IN UINTN BufferSize) {
+   if (CompareMem(Buffer + 3, NTFS_MAGIC_STRING, 8) == 0)
+      return FS_TYPE_NTFS;
+   return FS_TYPE_UNKNOWN;
+} // static UINT32 DetectNtfs()
+
+static UINT32 DetectExFat(IN UINT8 *Buffer, IN UINTN BufferSize) {
+   if (CompareMem(Buffer + 3, EXFAT_MAGIC_STRING, 8) == 0)
+      return FS_TYPE_EXFAT;
+   return FS_TYPE_UNKNOWN;
+} // static UINT32 DetectExFat()
+
+static UINT32 DetectXfs(IN UINT8 *Buffer, IN UINTN BufferSize) {
+   if (CompareMem(Buffer, XFS_MAGIC_STRING, 4) == 0)
+      return FS_TYPE_XFS;
+   return FS_TYPE_UNKNOWN;
+} // static UINT32 DetectXfs()
+
+static UINT32 DetectExt(IN UINT8 *Buffer, IN UINTN BufferSize) {
    UINT32       *Ext2Incompat, *Ext2Compat;
+
+   if (*((UINT16*) (Buffer + 1024 + 56)) != EXT2_SUPER_MAGIC)
+      return FS_TYPE_UNKNOWN;
+
+   Ext2Compat = (UINT32*) (Buffer + 1024 + 92);
+   Ext2Incompat = (UINT32*) (Buffer + 1024 + 96);
+   if ((*Ext2Incompat & 0x0040) || (*Ext2Incompat & 0x0200)) { // check for extents or flex_bg
+      return FS_TYPE_EXT4;
+   } else if (*Ext2Compat & 0x0004) { // check for journal
+      return FS_TYPE_EXT3;
+   } else { // none of these features; presume it's ext2...
+      return FS_TYPE_EXT2;
+   }
+} // static UINT32 DetectExt()
+
+static UINT32 DetectHfsPlus(IN UINT8 *Buffer, IN UINTN BufferSize) {
    UINT16       *Magic16;
+
+   Magic16 = (UINT16*) (Buffer + 1024);
+   if ((*Magic16 == HFSPLUS_MAGIC1) || (*Magic16 == HFSPLUS_MAGIC2))
+      return FS_TYPE_HFSPLUS;
+   return FS_TYPE_UNKNOWN;
+} // static UINT32 DetectHfsPlus()
+
+static UINT32 DetectIso9660(IN UINT8 *Buffer, IN UINTN BufferSize) {
+   if (CompareMem(Buffer + 32768 + 1, ISO9660_MAGIC_STRING, 5) == 0)
+      return FS_TYPE_ISO9660;
+   return FS_TYPE_UNKNOWN;
+} // static UINT32 DetectIso9660()
+
+static UINT32 DetectReiserFs(IN UINT8 *Buffer, IN UINTN BufferSize) {
    char         *MagicString;
 
-   if (Buffer != NULL) {
+   MagicString = (char*) (Buffer + 65536 + 52);
+   if ((CompareMem(MagicString, REISERFS_SUPER_MAGIC_STRING, 8) == 0) ||
+       (CompareMem(MagicString, REISER2FS_SUPER_MAGIC_STRING, 9) == 0) ||
+       (CompareMem(MagicString, REISER2FS_JR_SUPER_MAGIC_STRING, 9) == 0)) {
+      return FS_TYPE_REISERFS;
+   } // if
+   return FS_TYPE_UNKNOWN;
+} // static UINT32 DetectReiserFs()
+
+static UINT32 DetectBtrfs(IN UINT8 *Buffer, IN UINTN BufferSize) {
+   if (CompareMem(Buffer + 65536 + 64, BTRFS_SIGNATURE, 8) == 0)
+      return FS_TYPE_BTRFS;
+   return FS_TYPE_UNKNOWN;
+} // static UINT32 DetectBtrfs()
+
+// The FAT test only looks for a boot sector signature, which NTFS, exFAT,
+// and filesystems holding a BIOS boot loader also carry, so it comes last.
+static UINT32 DetectFat(IN UINT8 *Buffer, IN UINTN BufferSize) {
+   if (*((UINT16*) (Buffer + 510)) == FAT_MAGIC)
+      return FS_TYPE_FAT;
+   return FS_TYPE_UNKNOWN;
+} // static UINT32 DetectFat()
+
+typedef struct {
+   UINTN   MinSize;     // bytes from start of volume that Detect() examines
+   UINT32  (*Detect)(IN UINT8 *Buffer, IN UINTN BufferSize);
+} FS_DETECTOR;
+
+// Detectors in the order in which they're tried. To support a new
+// filesystem, add its function here; PROBE_SIZE must cover its MinSize.
+static FS_DETECTOR FilesystemDetectors[] = {
+   { 3 + 8,             DetectNtfs },
+   { 3 + 8,             DetectExFat },
+   { 4,                 DetectXfs },
+   { 1024 + 100,        DetectExt },
+   { 1024 + 2,          DetectHfsPlus },
+   { 32768 + 1 + 5,     DetectIso9660 },
+   { 65536 + 52 + 9,    DetectReiserFs },
+   { 65536 + 64 + 8,    DetectBtrfs },
+   { 512,               DetectFat },
+   { 0,                 NULL }
+};
 
-      if (BufferSize >= 512) {
-         Magic16 = (UINT16*) (Buffer + 510);
-         if (*Magic16 == FAT_MAGIC)
-            return FS_TYPE_FAT;
-      } // search for FAT magic
-
-      if (BufferSize >= (1024 + 100)) {
-         Magic16 = (UINT16*) (Buffer + 1024 + 56);
-         if (*Magic16 == EXT2_SUPER_MAGIC) { // ext2/3/4
-            Ext2Compat = (UINT32*) (Buffer + 1024 + 92);
-            Ext2Incompat = (UINT32*) (Buffer + 1024 + 96);
-            if ((*Ext2Incompat & 0x0040) || (*Ext2Incompat & 0x0200)) { // check for extents or flex_bg
-               return FS_TYPE_EXT4;
-            } else if (*Ext2Compat & 0x0004) { // check for journal
-               return FS_TYPE_EXT3;
-            } else { // none of these features; presume it's ext2...
-               return FS_TYPE_EXT2;
-            }
-         }
-      } // search for ext2/3/4 magic
-
-      if (BufferSize >= (65536 + 62)) {
-         MagicString = (char*) (Buffer + 65536 + 52);
-         if ((CompareMem(MagicString, REISERFS_SUPER_MAGIC_STRING, 8) == 0) ||
-             (CompareMem(MagicString, REISER2FS_SUPER_MAGIC_STRING, 9) == 0) ||
-             (CompareMem(MagicString, REISER2FS_JR_SUPER_MAGIC_STRING, 9) == 0)) {
-            return FS_TYPE_REISERFS;
-         } // if
-      } // search for ReiserFS magic
-
-      if (BufferSize >= (1024 + 2)) {
-         Magic16 = (UINT16*) (Buffer + 1024);
-         if ((*Magic16 == HFSPLUS_MAGIC1) || (*Magic16 == HFSPLUS_MAGIC2)) {
-            return FS_TYPE_HFSPLUS;
-         }
-      } // search for HFS+ magic
+// Identify the filesystem type, if possible. Expects a Buffer containing
+// the first BufferSize bytes of the filesystem (normally PROBE_SIZE), and
+// outputs a code representing the identified filesystem type.
+static UINT32 IdentifyFilesystemType(IN UINT8 *Buffer, IN UINTN BufferSize) {
+   UINT32       FoundType = FS_TYPE_UNKNOWN;
+   UINTN        i;
+
+   if (Buffer != NULL) {
+      for (i = 0; (FoundType == FS_TYPE_UNKNOWN) && (FilesystemDetectors[i].Detect != NULL); i++) {
+         if (BufferSize >= FilesystemDetectors[i].MinSize)
+            FoundType = FilesystemDetectors[i].Detect(Buffer, BufferSize);
+      } // for
    } // if (Buffer != NULL)
 
    return FoundType;
-}
+} // static UINT32 IdentifyFilesystemType()
+
+// Read the start of Volume into Volume->ProbeBuffer with a single
+// ReadBlocks() call, unless that's already been done during this scan.
+// The buffer covers everything the filesystem detectors and boot code
+// checks need, trimmed to the volume's size; it's released by
+// FreeVolumeProbeBuffers() at the end of ScanVolumes().
+static EFI_STATUS ReadVolumeProbe(IN OUT REFIT_VOLUME *Volume) {
+   EFI_STATUS   Status;
+   UINT32       BlockSize;
+   UINT64       VolumeSize;
+   UINTN        ReadSize;
+
+   if (Volume->ProbeBuffer != NULL)
+      return EFI_SUCCESS;
+   if ((Volume->BlockIO == NULL) || !Volume->BlockIO->Media->MediaPresent)
+      return EFI_NOT_READY;
+
+   BlockSize = Volume->BlockIO->Media->BlockSize;
+   if ((BlockSize == 0) || (BlockSize > PROBE_SIZE))
+      return EFI_UNSUPPORTED;   // our buffer is too small...
+
+   ReadSize = ((PROBE_SIZE + BlockSize - 1) / BlockSize) * BlockSize;
+   if (Volume->BlockIO->Media->LastBlock >= Volume->BlockIOOffset) {
+      VolumeSize = (Volume->BlockIO->Media->LastBlock - Volume->BlockIOOffset + 1) * BlockSize;
+      if (VolumeSize < ReadSize)
+         ReadSize = (UINTN) VolumeSize;
+   } // if
+   if (ReadSize < SECTOR_SIZE)
+      return EFI_UNSUPPORTED;   // too small to hold anything we can use
+
+   Volume->ProbeBuffer = AllocatePool(ReadSize);
+   if (Volume->ProbeBuffer == NULL)
+      return EFI_OUT_OF_RESOURCES;
+
+   Status = refit_call5_wrapper(Volume->BlockIO->ReadBlocks,
+                                Volume->BlockIO, Volume->BlockIO->Media->MediaId,
+                                Volume->BlockIOOffset, ReadSize, Volume->ProbeBuffer);
+   if (EFI_ERROR(Status)) {
+      MyFreePool(Volume->ProbeBuffer);
+      Volume->ProbeBuffer = NULL;
+   } else {
+      Volume->ProbeBufferSize = ReadSize;
+   }
+   return Status;
+} // static EFI_STATUS ReadVolumeProbe()
+
+// Release the probe buffers of all known volumes.
+static VOID FreeVolumeProbeBuffers(VOID) {
+   UINTN        VolumeIndex;
+
+   for (VolumeIndex = 0; VolumeIndex < VolumesCount; VolumeIndex++) {
+      MyFreePool(Volumes[VolumeIndex]->ProbeBuffer);
+      Volumes[VolumeIndex]->ProbeBuffer = NULL;
+      Volumes[VolumeIndex]->ProbeBufferSize = 0;
+   } // for
+} // static VOID FreeVolumeProbeBuffers()
 
 static VOID ScanVolumeBootcode(REFIT_VOLUME *Volume, BOOLEAN *Bootable)
 {
     EFI_STATUS              Status;
-    UINT8                   Buffer[SAMPLE_SIZE];
+    UINT8                   *Buffer;
     UINTN                   i;
     MBR_PARTITION_INFO      *MbrTable;
     BOOLEAN                 MbrTableFound;
@@ -486,16 +637,13 @@ static VOID ScanVolumeBootcode(REFIT_VOLUME *Volume, BOOLEAN *Bootable)
 
     if (Volume->BlockIO == NULL)
         return;
-    if (Volume->BlockIO->Media->BlockSize > SAMPLE_SIZE)
-        return;   // our buffer is too small...
 
     // look at the boot sector (this is used for both hard disks and El Torito images!)
-    Status = refit_call5_wrapper(Volume->BlockIO->ReadBlocks,
-                                 Volume->BlockIO, Volume->BlockIO->Media->MediaId,
-                                 Volume->BlockIOOffset, SAMPLE_SIZE, Buffer);
+    Status = ReadVolumeProbe(Volume);
     if (!EFI_ERROR(Status)) {
 
-        Volume->FSType = IdentifyFilesystemType(Buffer, SAMPLE_SIZE);
+        Buffer = Volume->ProbeBuffer;
+        Volume->FSType = IdentifyFilesystemType(Buffer, Volume->ProbeBufferSize);
         if (*((UINT16 *)(Buffer + 510)) == 0xaa55 && Buffer[0] != 0) {
             *Bootable = TRUE;
             Volume->HasBootCode = TRUE;
@@ -682,7 +830,7 @@ static CHAR16 *GetVolumeName(IN REFIT_VOLUME *Volume) {
    CHAR16                  *FoundName = NULL;
    CHAR16                  *SISize, *TypeName;
 
-   FileSystemInfoPtr = LibFileSystemInfo(Volume->RootDir);
+   FileSystemInfoPtr = (Volume->RootDir != NULL) ? LibFileSystemInfo(Volume->RootDir) : NULL;
    if (FileSystemInfoPtr != NULL) { // we have filesystem information (size, label)....
        if ((FileSystemInfoPtr->VolumeLabel != NULL) && (StrLen(FileSystemInfoPtr->VolumeLabel) > 0)) {
           FoundName = StrDuplicate(FileSystemInfoPtr->VolumeLabel);
@@ -695,6 +843,9 @@ static CHAR16 *GetVolumeName(IN REFIT_VOLUME *Volume) {
           FoundName = NULL;
        } // if rEFInd HFS+ driver suspected
 
+       if ((FoundName == NULL) && (Volume->PartName != NULL)) // use GPT partition name, if available
+          FoundName = StrDuplicate(Volume->PartName);
+
        if (FoundName == NULL) { // filesystem has no name, so use fs type and size
           FoundName = AllocateZeroPool(sizeof(CHAR16) * 256);
           if (FoundName != NULL) {
@@ -706,7 +857,9 @@ static CHAR16 *GetVolumeName(IN REFIT_VOLUME *Volume) {
 
        FreePool(FileSystemInfoPtr);
 
-   } else { // fs driver not returning info; fall back on our own information....
+   } else if (Volume->PartName != NULL) { // fs driver not returning info; use GPT partition name....
+      FoundName = StrDuplicate(Volume->PartName);
+   } else { // no GPT name, either; fall back on our own information....
       FoundName = AllocateZeroPool(sizeof(CHAR16) * 256);
       if (FoundName != NULL) {
          TypeName = FSTypeName(Volume->FSType); // NOTE: Don't free TypeName; function returns constant
@@ -719,7 +872,6 @@ static CHAR16 *GetVolumeName(IN REFIT_VOLUME *Volume) {
 
    // TODO: Above could be improved/extended, in case filesystem name is not found,
    // such as:
-   //  - use partition label
    //  - use or add disk/partition number (e.g., "(hd0,2)")
 
    // Desperate fallback name....
@@ -729,14 +881,49 @@ static CHAR16 *GetVolumeName(IN REFIT_VOLUME *Volume) {
    return FoundName;
 } // static CHAR16 *GetVolumeName()
 
+// Copy the GPT type GUID, unique GUID, and name for the partition described
+// by HdNode into Volume, if the volume lies on a GPT disk.
+static VOID ScanVolumeGptData(IN OUT REFIT_VOLUME *Volume, IN HARDDRIVE_DEVICE_PATH *HdNode) {
+   GPT_ENTRY  *Entry;
+   CHAR16     Name[GPT_NAME_LENGTH + 1];
+
+   Entry = FindGptEntry(Volume->WholeDiskBlockIO, HdNode);
+   if (Entry != NULL) {
+      CopyMem(&(Volume->PartTypeGuid), &(Entry->TypeGuid), sizeof(EFI_GUID));
+      CopyMem(&(Volume->PartGuid), &(Entry->PartGuid), sizeof(EFI_GUID));
+      CopyMem(Name, Entry->Name, GPT_NAME_LENGTH * sizeof(CHAR16));
+      Name[GPT_NAME_LENGTH] = 0;
+      if (StrLen(Name) > 0)
+         Volume->PartName = StrDuplicate(Name);
+   } // if
+} // static VOID ScanVolumeGptData()
+
+// Returns TRUE if Volume's GPT type code is in the "dont_scan_part_types"
+// list, meaning that it can't hold anything we could boot.
+static BOOLEAN IsSkippedPartType(IN REFIT_VOLUME *Volume) {
+   EFI_GUID  NullGuid;
+   CHAR16    *TypeString;
+   BOOLEAN   Skip = FALSE;
+
+   ZeroMem(&NullGuid, sizeof(EFI_GUID));
+   if ((GlobalConfig.DontScanPartTypes != NULL) &&
+       (CompareMem(&(Volume->PartTypeGuid), &NullGuid, sizeof(EFI_GUID)) != 0)) {
+      TypeString = GuidAsString(&(Volume->PartTypeGuid));
+      Skip = IsIn(TypeString, GlobalConfig.DontScanPartTypes);
+      MyFreePool(TypeString);
+   } // if
+   return Skip;
+} // static BOOLEAN IsSkippedPartType()
+
 VOID ScanVolume(REFIT_VOLUME *Volume)
 {
     EFI_STATUS              Status;
     EFI_DEVICE_PATH         *DevicePath, *NextDevicePath;
     EFI_DEVICE_PATH         *DiskDevicePath, *RemainingDevicePath;
     EFI_HANDLE              WholeDiskHandle;
+    HARDDRIVE_DEVICE_PATH   *HdNode = NULL;
     UINTN                   PartialLength;
-    BOOLEAN                 Bootable;
+    BOOLEAN                 Bootable, IsElTorito = FALSE;
 
     // get device path
     Volume->DevicePath = DuplicateDevicePath(DevicePathFromHandle(Volume->DeviceHandle));
@@ -761,10 +948,6 @@ VOID ScanVolume(REFIT_VOLUME *Volume)
             Volume->DiskKind = DISK_KIND_OPTICAL;
     }
 
-    // scan for bootcode and MBR table
-    Bootable = FALSE;
-    ScanVolumeBootcode(Volume, &Bootable);
-
     // detect device type
     DevicePath = Volume->DevicePath;
     while (DevicePath != NULL && !IsDevicePathEndType(DevicePath)) {
@@ -779,15 +962,17 @@ VOID ScanVolume(REFIT_VOLUME *Volume)
         if (DevicePathType(DevicePath) == MEDIA_DEVICE_PATH &&
             DevicePathSubType(DevicePath) == MEDIA_CDROM_DP) {
             Volume->DiskKind = DISK_KIND_OPTICAL;     // El Torito entry -> optical disk
-            Bootable = TRUE;
+            IsElTorito = TRUE;
         }
 
         if (DevicePathType(DevicePath) == MEDIA_DEVICE_PATH && DevicePathSubType(DevicePath) == MEDIA_VENDOR_DP) {
             Volume->IsAppleLegacy = TRUE;             // legacy BIOS device entry
             // TODO: also check for Boot Camp GUID
-            Bootable = FALSE;   // this handle's BlockIO is just an alias for the whole device
         }
 
+        if (DevicePathType(DevicePath) == MEDIA_DEVICE_PATH && DevicePathSubType(DevicePath) == MEDIA_HARDDRIVE_DP)
+            HdNode = (HARDDRIVE_DEVICE_PATH *) DevicePath;
+
         if (DevicePathType(DevicePath) == MESSAGING_DEVICE_PATH) {
             // make a device path for the whole device
             PartialLength = (UINT8 *)NextDevicePath - (UINT8 *)(Volume->DevicePath);
@@ -828,6 +1013,25 @@ VOID ScanVolume(REFIT_VOLUME *Volume)
         DevicePath = NextDevicePath;
     } // while
 
+    // Check the partition's GPT type code, if any, before touching the
+    // partition itself; swap, LVM, RAID, etc. partitions are skipped
+    // without reading their contents.
+    ScanVolumeGptData(Volume, HdNode);
+    if (IsSkippedPartType(Volume)) {
+        Volume->VolNumber = VOL_DONTSCAN;
+        Volume->IsReadable = FALSE;
+        Volume->VolName = GetVolumeName(Volume);   // GPT name or fallback, for "volume" matches
+        return;
+    }
+
+    // scan for bootcode and MBR table
+    Bootable = FALSE;
+    ScanVolumeBootcode(Volume, &Bootable);
+    if (IsElTorito)
+        Bootable = TRUE;
+    if (Volume->IsAppleLegacy)
+        Bootable = FALSE;   // this handle's BlockIO is just an alias for the whole device
+
     if (!Bootable) {
 #if REFIT_DEBUG > 0
         if (Volume->HasBootCode)
@@ -836,9 +1040,6 @@ VOID ScanVolume(REFIT_VOLUME *Volume)
         Volume->HasBootCode = FALSE;
     }
 
-    // default volume icon based on disk kind
-    ScanVolumeDefaultIcon(Volume);
-
     // open the root directory of the volume
     Volume->RootDir = LibOpenRoot(Volume->DeviceHandle);
     if (Volume->RootDir == NULL) {
@@ -849,14 +1050,42 @@ VOID ScanVolume(REFIT_VOLUME *Volume)
     }
 
     Volume->VolName = GetVolumeName(Volume);
-
-    // get custom volume icon if present
-    if (!Volume->VolBadgeImage)
-       Volume->VolBadgeImage = LoadIcns(Volume->RootDir, VOLUME_BADGE_NAMES, 32);
-    if (!Volume->VolIconImage)
-       Volume->VolIconImage = LoadIcns(Volume->RootDir, VOLUME_ICON_NAMES, 128);
 } // ScanVolume()
 
+// Load the volume's badge (its default badge based on disk kind, or, for
+// volumes of unknown kind, a custom badge file) and its custom icon, if
+// it has one. Done only when a menu entry for the volume is first drawn,
+// rather than during the volume scan.
+static VOID LoadVolumeIcons(IN OUT REFIT_VOLUME *Volume) {
+   if (Volume->IconsLoaded)
+      return;
+   Volume->IconsLoaded = TRUE;
+   ScanVolumeDefaultIcon(Volume);
+   if (Volume->RootDir != NULL) {
+      if (!Volume->VolBadgeImage)
+         Volume->VolBadgeImage = LoadIcns(Volume->RootDir, VOLUME_BADGE_NAMES, 32);
+      if (!Volume->VolIconImage)
+         Volume->VolIconImage = LoadIcns(Volume->RootDir, VOLUME_ICON_NAMES, 128);
+   } // if
+} // static VOID LoadVolumeIcons()
+
+// Returns the volume's custom icon, or NULL if it has none.
+EG_IMAGE * GetVolumeIcon(IN OUT REFIT_VOLUME *Volume) {
+   if (Volume == NULL)
+      return NULL;
+   LoadVolumeIcons(Volume);
+   return Volume->VolIconImage;
+} // EG_IMAGE * GetVolumeIcon()
+
+// Returns the volume's badge, or NULL if it has none. The caller gets its
+// own reference to the badge, to be dropped with egReleaseIcon().
+EG_IMAGE * GetVolumeBadge(IN OUT REFIT_VOLUME *Volume) {
+   if (Volume == NULL)
+      return NULL;
+   LoadVolumeIcons(Volume);
+   return egRetainIcon(Volume->VolBadgeImage);
+} // EG_IMAGE * GetVolumeBadge()
+
 static VOID ScanExtendedPartition(REFIT_VOLUME *WholeDiskVolume, MBR_PARTITION_INFO *MbrEntry)
 {
     EFI_STATUS              Status;
@@ -910,8 +1139,6 @@ static VOID ScanExtendedPartition(REFIT_VOLUME *WholeDiskVolume, MBR_PARTITION_I
                 if (!Bootable)
                     Volume->HasBootCode = FALSE;
 
-                ScanVolumeDefaultIcon(Volume);
-
                 AddListElement((VOID ***) &Volumes, &VolumesCount, Volume);
 
             }
@@ -932,9 +1159,16 @@ VOID ScanVolumes(VOID)
     UINTN                   SectorSum, i, VolNumber = 0;
     UINT8                   *SectorBuffer1, *SectorBuffer2;
 
+    // the old volumes may still be in use, but their badges are no longer
+    // drawn, so let egFlushIconCache() free those
+    for (VolumeIndex = 0; VolumeIndex < VolumesCount; VolumeIndex++) {
+        egReleaseIcon(Volumes[VolumeIndex]->VolBadgeImage);
+        Volumes[VolumeIndex]->VolBadgeImage = NULL;
+    }
     MyFreePool(Volumes);
     Volumes = NULL;
     VolumesCount = 0;
+    ForgetGptData();
 
     // get all filesystem handles
     Status = LibLocateHandle(ByProtocol, &BlockIoProtocol, NULL, &HandleCount, &Handles);
@@ -952,7 +1186,7 @@ VOID ScanVolumes(VOID)
         ScanVolume(Volume);
         if (Volume->IsReadable)
            Volume->VolNumber = VolNumber++;
-        else
+        else if (Volume->VolNumber != VOL_DONTSCAN)
            Volume->VolNumber = VOL_UNREADABLE;
 
         AddListElement((VOID ***) &Volumes, &VolumesCount, Volume);
@@ -968,6 +1202,8 @@ VOID ScanVolumes(VOID)
     // second pass: relate partitions and whole disk devices
     for (VolumeIndex = 0; VolumeIndex < VolumesCount; VolumeIndex++) {
         Volume = Volumes[VolumeIndex];
+        if (Volume->VolNumber == VOL_DONTSCAN)
+            continue;   // skipped because of its GPT type code
         // check MBR partition table for extended partitions
         if (Volume->BlockIO != NULL && Volume->WholeDiskBlockIO != NULL &&
             Volume->BlockIO == Volume->WholeDiskBlockIO && Volume->BlockIOOffset == 0 &&
@@ -1001,12 +1237,17 @@ VOID ScanVolumes(VOID)
                 if ((UINT64)(MbrTable[PartitionIndex].Size) != Volume->BlockIO->Media->LastBlock + 1)
                     continue;
 
-                // compare boot sector read through offset vs. directly
-                Status = refit_call5_wrapper(Volume->BlockIO->ReadBlocks,
-                                             Volume->BlockIO, Volume->BlockIO->Media->MediaId,
-                                             Volume->BlockIOOffset, 512, SectorBuffer1);
-                if (EFI_ERROR(Status))
-                    break;
+                // compare boot sector read through offset vs. directly; the
+                // former is normally already in the volume's probe buffer
+                if (Volume->ProbeBuffer != NULL) {
+                    CopyMem(SectorBuffer1, Volume->ProbeBuffer, 512);
+                } else {
+                    Status = refit_call5_wrapper(Volume->BlockIO->ReadBlocks,
+                                                 Volume->BlockIO, Volume->BlockIO->Media->MediaId,
+                                                 Volume->BlockIOOffset, 512, SectorBuffer1);
+                    if (EFI_ERROR(Status))
+                        break;
+                }
                 Status = refit_call5_wrapper(Volume->WholeDiskBlockIO->ReadBlocks,
                                              Volume->WholeDiskBlockIO, Volume->WholeDiskBlockIO->Media->MediaId,
                                              MbrTable[PartitionIndex].StartLBA, 512, SectorBuffer2);
@@ -1037,6 +1278,8 @@ VOID ScanVolumes(VOID)
         }
 
     } // for
+
+    FreeVolumeProbeBuffers();
 } /* VOID ScanVolumes() */
 
 static VOID UninitVolumes(VOID)
@@ -1058,6 +1301,25 @@ static VOID UninitVolumes(VOID)
     }
 }
 
+// Free a volume filled in by ScanVolume(), closing its root directory. Its
+// icon and badge images are left alone, since they're shared with other
+// users, apart from dropping its reference to a cached badge.
+VOID FreeVolume(IN REFIT_VOLUME *Volume)
+{
+   if (Volume == NULL)
+      return;
+   egReleaseIcon(Volume->VolBadgeImage);
+   if (Volume->RootDir != NULL)
+      refit_call1_wrapper(Volume->RootDir->Close, Volume->RootDir);
+   MyFreePool(Volume->DevicePath);
+   MyFreePool(Volume->WholeDiskDevicePath);
+   MyFreePool(Volume->VolName);
+   MyFreePool(Volume->PartName);
+   MyFreePool(Volume->MbrPartitionTable);
+   MyFreePool(Volume->ProbeBuffer);
+   MyFreePool(Volume);
+} // VOID FreeVolume()
+
 VOID ReinitVolumes(VOID)
 {
     EFI_STATUS              Status;
@@ -1077,8 +1339,9 @@ VOID ReinitVolumes(VOID)
             if (!EFI_ERROR(Status)) {
                 Volume->DeviceHandle = DeviceHandle;
 
-                // get the root directory
-                Volume->RootDir = LibOpenRoot(Volume->DeviceHandle);
+                // get the root directory, unless the volume was skipped by type code
+                if (Volume->VolNumber != VOL_DONTSCAN)
+                    Volume->RootDir = LibOpenRoot(Volume->DeviceHandle);
 
             } else
                 CheckError(Status, L"from LocateDevicePath");
@@ -1106,10 +1369,113 @@ VOID ReinitVolumes(VOID)
 // file and dir functions
 //
 
+// Directory listings read since EnableDirCache() was called. While the
+// cache is enabled, directory iteration and FileExists() are answered from
+// these listings, so that a directory that's examined repeatedly during a
+// scan (for kernels, initrds, refind_linux.conf, and icons) is read from
+// disk only once.
+static REFIT_DIR_LISTING *DirCache = NULL;
+static BOOLEAN           DirCacheEnabled = FALSE;
+
+// Start caching directory listings.
+VOID EnableDirCache(VOID) {
+   DirCacheEnabled = TRUE;
+} // VOID EnableDirCache()
+
+// Stop caching directory listings and free all cached listings.
+VOID FlushDirCache(VOID) {
+   REFIT_DIR_LISTING *Next;
+
+   DirCacheEnabled = FALSE;
+   while (DirCache != NULL) {
+      Next = DirCache->Next;
+      FreeList((VOID ***) &(DirCache->Entries), &(DirCache->EntryCount));
+      MyFreePool(DirCache->Path);
+      FreePool(DirCache);
+      DirCache = Next;
+   } // while
+} // VOID FlushDirCache()
+
+// Return the cached listing of the RelativePath directory of BaseDir,
+// reading it first if necessary. Returns NULL if the cache is disabled or
+// memory couldn't be allocated. A listing for a nonexistent directory is
+// returned (and cached) with an error in its Status field.
+static REFIT_DIR_LISTING * GetDirListing(IN EFI_FILE *BaseDir, IN CHAR16 *RelativePath) {
+   REFIT_DIR_LISTING  *Listing;
+   EFI_FILE_HANDLE    DirHandle;
+   EFI_FILE_INFO      *DirEntry = NULL;
+   CHAR16             *Path;
+
+   if (!DirCacheEnabled || (BaseDir == NULL) || (RelativePath == NULL))
+      return NULL;
+   Path = StrDuplicate(RelativePath);
+   if (Path == NULL)
+      return NULL;
+   CleanUpPathNameSlashes(Path);
+   for (Listing = DirCache; Listing != NULL; Listing = Listing->Next) {
+      // exact comparison, since the filesystem may be case-sensitive
+      if ((Listing->BaseDir == BaseDir) && (StrCmp(Listing->Path, Path) == 0)) {
+         FreePool(Path);
+         return Listing;
+      }
+   } // for
+
+   Listing = AllocateZeroPool(sizeof(REFIT_DIR_LISTING));
+   if (Listing == NULL) {
+      FreePool(Path);
+      return NULL;
+   }
+   Listing->BaseDir = BaseDir;
+   Listing->Path = Path;
+   Listing->Status = refit_call5_wrapper(BaseDir->Open, BaseDir, &DirHandle, Path, EFI_FILE_MODE_READ, 0);
+   if (!EFI_ERROR(Listing->Status)) {
+      while (!EFI_ERROR(Listing->Status = DirNextEntry(DirHandle, &DirEntry, 0)) && (DirEntry != NULL)) {
+         AddListElement((VOID ***) &(Listing->Entries), &(Listing->EntryCount), DirEntry);
+         DirEntry = NULL; // keep DirNextEntry() from freeing it
+      } // while
+      refit_call1_wrapper(DirHandle->Close, DirHandle);
+   } // if
+   Listing->Next = DirCache;
+   DirCache = Listing;
+   return Listing;
+} // static REFIT_DIR_LISTING * GetDirListing()
+
 BOOLEAN FileExists(IN EFI_FILE *BaseDir, IN CHAR16 *RelativePath)
 {
     EFI_STATUS         Status;
     EFI_FILE_HANDLE    TestFile;
+    REFIT_DIR_LISTING  *Listing;
+    CHAR16             *DirName, *FileName;
+    UINTN              i;
+    BOOLEAN            Found = FALSE, FoundOtherCase = FALSE;
+
+    // answer from the directory listing cache, if it's enabled. A name that
+    // matches only in a different case is checked by opening it, since only
+    // the filesystem knows whether it ignores case.
+    if (DirCacheEnabled && (RelativePath != NULL) && ((DirName = StrDuplicate(RelativePath)) != NULL)) {
+        CleanUpPathNameSlashes(DirName);
+        FileName = DirName;
+        for (i = 0; DirName[i] != 0; i++) {
+            if (DirName[i] == L'\\')
+                FileName = DirName + i + 1;
+        }
+        if (FileName > DirName)
+            FileName[-1] = 0;
+        Listing = GetDirListing(BaseDir, (FileName > DirName) ? DirName : L"\\");
+        if ((Listing != NULL) && (*FileName != 0)) {
+            for (i = 0; !Found && (i < Listing->EntryCount); i++) {
+                if (StrCmp(Listing->Entries[i]->FileName, FileName) == 0)
+                    Found = TRUE;
+                else if (StriCmp(Listing->Entries[i]->FileName, FileName) == 0)
+                    FoundOtherCase = TRUE;
+            } // for
+            FreePool(DirName);
+            if (Found || !FoundOtherCase)
+                return Found;
+        } else {
+            FreePool(DirName);
+        } // if/else
+    } // if
 
     Status = refit_call5_wrapper(BaseDir->Open, BaseDir, &TestFile, RelativePath, EFI_FILE_MODE_READ, 0);
     if (Status == EFI_SUCCESS) {
@@ -1182,7 +1548,13 @@ EFI_STATUS DirNextEntry(IN EFI_FILE *Directory, IN OUT EFI_FILE_INFO **DirEntry,
 
 VOID DirIterOpen(IN EFI_FILE *BaseDir, IN CHAR16 *RelativePath OPTIONAL, OUT REFIT_DIR_ITER *DirIter)
 {
-    if (RelativePath == NULL) {
+    DirIter->Listing = GetDirListing(BaseDir, RelativePath);
+    DirIter->NextIndex = 0;
+    if (DirIter->Listing != NULL) {
+        DirIter->LastStatus = DirIter->Listing->Status;
+        DirIter->DirHandle = NULL;
+        DirIter->CloseDirHandle = FALSE;
+    } else if (RelativePath == NULL) {
         DirIter->LastStatus = EFI_SUCCESS;
         DirIter->DirHandle = BaseDir;
         DirIter->CloseDirHandle = FALSE;
@@ -1191,6 +1563,8 @@ VOID DirIterOpen(IN EFI_FILE *BaseDir, IN CHAR16 *RelativePath OPTIONAL, OUT REF
         DirIter->CloseDirHandle = EFI_ERROR(DirIter->LastStatus) ? FALSE : TRUE;
     }
     DirIter->LastFileInfo = NULL;
+    DirIter->PatternSource = NULL;
+    ZeroMem(&(DirIter->Patterns), sizeof(PATTERN_LIST));
 }
 
 #ifndef __MAKEWITH_GNUEFI
@@ -1226,17 +1600,6 @@ InitializeUnicodeCollationProtocol (VOID)
    return Status;
 }
 
-static BOOLEAN
-MetaiMatch (IN CHAR16 *String, IN CHAR16 *Pattern)
-{
-   if (!mUnicodeCollation) {
-      InitializeUnicodeCollationProtocol();
-   }
-   if (mUnicodeCollation)
-      return mUnicodeCollation->MetaiMatch (mUnicodeCollation, String, Pattern);
-   return FALSE; // Shouldn't happen
-}
-
 static VOID StrLwr (IN OUT CHAR16 *Str) {
    if (!mUnicodeCollation) {
       InitializeUnicodeCollationProtocol();
@@ -1247,12 +1610,23 @@ static VOID StrLwr (IN OUT CHAR16 *Str) {
 
 #endif
 
-BOOLEAN DirIterNext(IN OUT REFIT_DIR_ITER *DirIter, IN UINTN FilterMode, IN CHAR16 *FilePattern OPTIONAL,
-                    OUT EFI_FILE_INFO **DirEntry)
+// Returns TRUE if the directory entry FileInfo matches Patterns. Directories
+// always match, as does everything if Patterns is NULL.
+static BOOLEAN DirEntryMatches(IN EFI_FILE_INFO *FileInfo, IN PATTERN_LIST *Patterns OPTIONAL)
 {
-    BOOLEAN KeepGoing = TRUE;
-    UINTN   i;
-    CHAR16  *OnePattern;
+    if ((Patterns == NULL) || (FileInfo->Attribute & EFI_FILE_DIRECTORY))
+        return TRUE;
+    return MatchesPatternList(FileInfo->FileName, Patterns);
+} // static BOOLEAN DirEntryMatches()
+
+// Return the next entry from DirIter that passes FilterMode (0 = all, 1 =
+// directories only, 2 = files only) and the precompiled Patterns. The
+// returned entry belongs to DirIter and must not be freed or kept after the
+// next call.
+BOOLEAN DirIterNextMatch(IN OUT REFIT_DIR_ITER *DirIter, IN UINTN FilterMode, IN PATTERN_LIST *Patterns OPTIONAL,
+                         OUT EFI_FILE_INFO **DirEntry)
+{
+    EFI_FILE_INFO *FileInfo;
 
     if (DirIter->LastFileInfo != NULL) {
        FreePool(DirIter->LastFileInfo);
@@ -1262,29 +1636,48 @@ BOOLEAN DirIterNext(IN OUT REFIT_DIR_ITER *DirIter, IN UINTN FilterMode, IN CHAR
     if (EFI_ERROR(DirIter->LastStatus))
         return FALSE;   // stop iteration
 
+    // iterate over a cached listing
+    if (DirIter->Listing != NULL) {
+        while (DirIter->NextIndex < DirIter->Listing->EntryCount) {
+            FileInfo = DirIter->Listing->Entries[DirIter->NextIndex++];
+            if (((FilterMode == 1) && !(FileInfo->Attribute & EFI_FILE_DIRECTORY)) ||
+                ((FilterMode == 2) && (FileInfo->Attribute & EFI_FILE_DIRECTORY)))
+                continue;
+            if (DirEntryMatches(FileInfo, Patterns)) {
+                *DirEntry = FileInfo;
+                return TRUE;
+            }
+        } // while
+        return FALSE;
+    } // if
+
     do {
         DirIter->LastStatus = DirNextEntry(DirIter->DirHandle, &(DirIter->LastFileInfo), FilterMode);
         if (EFI_ERROR(DirIter->LastStatus))
            return FALSE;
         if (DirIter->LastFileInfo == NULL)  // end of listing
             return FALSE;
-        if (FilePattern != NULL) {
-            if ((DirIter->LastFileInfo->Attribute & EFI_FILE_DIRECTORY))
-                KeepGoing = FALSE;
-            i = 0;
-            while (KeepGoing && (OnePattern = FindCommaDelimited(FilePattern, i++)) != NULL) {
-               if (MetaiMatch(DirIter->LastFileInfo->FileName, OnePattern))
-                   KeepGoing = FALSE;
-//               Print(L"%s did%s match %s\n", DirIter->LastFileInfo->FileName, KeepGoing ? L" not" : L"", OnePattern);
-            } // while
-            // else continue loop
-        } else
-            break;
-   } while (KeepGoing && FilePattern);
+    } while (!DirEntryMatches(DirIter->LastFileInfo, Patterns));
 
     *DirEntry = DirIter->LastFileInfo;
     return TRUE;
-}
+} // BOOLEAN DirIterNextMatch()
+
+// As DirIterNext(), but takes FilePattern as a comma-delimited list of
+// patterns. The list is compiled on the first call and kept in DirIter for
+// as long as the same FilePattern is passed.
+BOOLEAN DirIterNext(IN OUT REFIT_DIR_ITER *DirIter, IN UINTN FilterMode, IN CHAR16 *FilePattern OPTIONAL,
+                    OUT EFI_FILE_INFO **DirEntry)
+{
+    if (FilePattern == NULL)
+        return DirIterNextMatch(DirIter, FilterMode, NULL, DirEntry);
+    if (FilePattern != DirIter->PatternSource) {
+        FreePatternList(&(DirIter->Patterns));
+        AddPatterns(&(DirIter->Patterns), FilePattern, FALSE);
+        DirIter->PatternSource = FilePattern;
+    }
+    return DirIterNextMatch(DirIter, FilterMode, &(DirIter->Patterns), DirEntry);
+} // BOOLEAN DirIterNext()
 
 EFI_STATUS DirIterClose(IN OUT REFIT_DIR_ITER *DirIter)
 {
@@ -1292,6 +1685,8 @@ EFI_STATUS DirIterClose(IN OUT REFIT_DIR_ITER *DirIter)
       FreePool(DirIter->LastFileInfo);
       DirIter->LastFileInfo = NULL;
    }
+   FreePatternList(&(DirIter->Patterns));
+   DirIter->PatternSource = NULL;
    if (DirIter->CloseDirHandle)
       refit_call1_wrapper(DirIter->DirHandle->Close, DirIter->DirHandle);
    return DirIter->LastStatus;
@@ -1700,3 +2095,124 @@ CHAR16 * GuidAsString(EFI_GUID *GuidData) {
    }
    return TheString;
 } // GuidAsString(EFI_GUID *GuidData)
+
+// CPU time stamp counter ticks per microsecond, as measured by
+// InitTimeStamps(); 0 if time stamps come from the firmware's clock.
+static UINT64 TscPerUSec = 0;
+
+#if defined(EFIX64) || defined(EFI32)
+static UINT64 ReadTsc(VOID) {
+   UINT32 Low, High;
+
+   __asm__ __volatile__ ("rdtsc" : "=a" (Low), "=d" (High));
+   return (((UINT64) High) << 32) | Low;
+} // static UINT64 ReadTsc()
+#endif
+
+// Measure the CPU's time stamp counter rate against the firmware's Stall()
+// function so that GetTimeStampUSec() can use it. This takes
+// TSC_CALIBRATION_USEC microseconds and should be done once, first thing.
+// Without a usable time stamp counter, the firmware's clock is used.
+VOID InitTimeStamps(VOID) {
+#if defined(EFIX64) || defined(EFI32)
+   UINT64 Start;
+
+   Start = ReadTsc();
+   refit_call1_wrapper(BS->Stall, TSC_CALIBRATION_USEC);
+   TscPerUSec = (ReadTsc() - Start) / TSC_CALIBRATION_USEC;
+#endif
+} // VOID InitTimeStamps()
+
+// Return a time stamp in microseconds, for measuring how long various
+// operations take. When the CPU's time stamp counter is used, this is the
+// time since the CPU was reset. Otherwise, only differences between two
+// time stamps are meaningful; the value wraps at the end of each month, and
+// it's 0 if the firmware's clock can't be read.
+UINT64 GetTimeStampUSec(VOID) {
+   EFI_STATUS  Status;
+   EFI_TIME    Now;
+
+#if defined(EFIX64) || defined(EFI32)
+   if (TscPerUSec > 0)
+      return ReadTsc() / TscPerUSec;
+#endif
+   Status = refit_call2_wrapper(RT->GetTime, &Now, NULL);
+   if (EFI_ERROR(Status))
+      return 0;
+   return ((((UINT64) Now.Day * 24 + Now.Hour) * 60 + Now.Minute) * 60 + Now.Second) * 1000000 +
+          Now.Nanosecond / 1000;
+} // UINT64 GetTimeStampUSec()
+
+// Store the current time stamp in the NVRAM variable VarName, as used by
+// systemd-boot (LoaderTimeInitUSec or LoaderTimeExecUSec), so that tools
+// such as systemd-analyze can report the boot manager's share of boot time.
+// Does nothing unless time stamps are relative to CPU reset.
+VOID ExportLoaderTime(IN CHAR16 *VarName) {
+   CHAR16 Value[32];
+
+   if (TscPerUSec == 0)
+      return;
+   SPrint(Value, 31, L"%ld", GetTimeStampUSec());
+   refit_call5_wrapper(RT->SetVariable, VarName, &LoaderInterfaceGuid,
+                       EFI_VARIABLE_BOOTSERVICE_ACCESS | EFI_VARIABLE_RUNTIME_ACCESS, StrSize(Value), Value);
+} // VOID ExportLoaderTime()
+
+// Write the timing log to TIMING_LOG_FILE_NAME in rEFInd's directory, as
+// ASCII text with one entry per line, replacing any earlier log.
+VOID SaveTimingLog(VOID) {
+   EFI_STATUS       Status;
+   EFI_FILE_HANDLE  FileHandle;
+   CHAR8            *Text;
+   UINTN            i, j, Size = 0, Position = 0;
+
+   if ((SelfDir == NULL) || (TimingLogCount == 0))
+      return;
+   for (i = 0; i < TimingLogCount; i++)
+      Size += StrLen(TimingLog[i]) + 2;
+   Text = AllocatePool(Size);
+   if (Text == NULL)
+      return;
+   for (i = 0; i < TimingLogCount; i++) {
+      for (j = 0; TimingLog[i][j] != 0; j++)
+         Text[Position++] = (TimingLog[i][j] < 128) ? (CHAR8) TimingLog[i][j] : '?';
+      Text[Position++] = '\r';
+      Text[Position++] = '\n';
+   } // for
+
+   // egSaveFile() doesn't truncate, so delete any old log first
+   Status = refit_call5_wrapper(SelfDir->Open, SelfDir, &FileHandle, TIMING_LOG_FILE_NAME,
+                                EFI_FILE_MODE_READ | EFI_FILE_MODE_WRITE, 0);
+   if (!EFI_ERROR(Status))
+      refit_call1_wrapper(FileHandle->Delete, FileHandle);
+   Status = egSaveFile(SelfDir, TIMING_LOG_FILE_NAME, (UINT8 *) Text, Size);
+   CheckError(Status, L"while saving the timing log");
+   FreePool(Text);
+} // VOID SaveTimingLog()
+
+// Empty the timing log, as when the user asks for a rescan, so that it
+// describes only the latest scan (and the boot that follows it).
+VOID ResetTimingLog(VOID) {
+   FreeList((VOID ***) &TimingLog, &TimingLogCount);
+   TimingLog = NULL;
+   TimingLogCount = 0;
+} // VOID ResetTimingLog()
+
+// Add an entry to the timing log, noting that the operation described by
+// Description took the time since StartTime (a value returned earlier by
+// GetTimeStampUSec()).
+VOID RecordTiming(IN CHAR16 *Description, IN UINT64 StartTime) {
+   CHAR16  *Entry;
+   UINT64  Elapsed;
+
+   if (TimingLogCount >= MAX_TIMING_LOG_ENTRIES)
+      return;
+   Elapsed = GetTimeStampUSec() - StartTime;
+   Entry = AllocateZeroPool(256 * sizeof(CHAR16));
+   if (Entry != NULL) {
+      SPrint(Entry, 255, L"%s: %ld us", Description, Elapsed);
+      AddListElement((VOID ***) &TimingLog, &TimingLogCount, Entry);
+   }
+#if REFIT_DEBUG > 0
+   Print(L"%s: %ld us\n", Description, Elapsed);
+#endif
+} // VOID RecordTiming()
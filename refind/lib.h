@@ -55,6 +55,7 @@
 #include "global.h"
 
 #include "libeg.h"
+#include "pattern.h"
 
 //
 // lib module
@@ -62,11 +63,25 @@
 
 // types
 
+// A directory's complete contents, as held by the directory listing cache
+typedef struct _refit_dir_listing {
+    EFI_FILE            *BaseDir;
+    CHAR16              *Path;         // relative to BaseDir; cleaned up by CleanUpPathNameSlashes()
+    EFI_STATUS          Status;        // result of opening or reading the directory
+    UINTN               EntryCount;
+    EFI_FILE_INFO       **Entries;
+    struct _refit_dir_listing *Next;
+} REFIT_DIR_LISTING;
+
 typedef struct {
     EFI_STATUS          LastStatus;
     EFI_FILE_HANDLE     DirHandle;
     BOOLEAN             CloseDirHandle;
     EFI_FILE_INFO       *LastFileInfo;
+    REFIT_DIR_LISTING   *Listing;      // non-NULL if iterating over a cached listing
+    UINTN               NextIndex;
+    CHAR16              *PatternSource; // FilePattern that Patterns was compiled from
+    PATTERN_LIST        Patterns;
 } REFIT_DIR_ITER;
 
 #define DISK_KIND_INTERNAL  (0)
@@ -78,6 +93,10 @@ typedef struct {
 
 #define IS_EXTENDED_PART_TYPE(type) ((type) == 0x05 || (type) == 0x0f || (type) == 0x85)
 
+#define TSC_CALIBRATION_USEC   2000
+#define TIMING_LOG_FILE_NAME   L"timing.log"
+#define MAX_TIMING_LOG_ENTRIES 512
+
 EFI_STATUS InitRefitLib(IN EFI_HANDLE ImageHandle);
 VOID UninitRefitLib(VOID);
 EFI_STATUS ReinitRefitLib(VOID);
@@ -89,15 +108,23 @@ VOID FreeList(IN OUT VOID ***ListPtr, IN OUT UINTN *ElementCount);
 
 VOID ExtractLegacyLoaderPaths(EFI_DEVICE_PATH **PathList, UINTN MaxPaths, EFI_DEVICE_PATH **HardcodedPathList);
 
+VOID ScanVolume(REFIT_VOLUME *Volume);
+EG_IMAGE * GetVolumeIcon(IN OUT REFIT_VOLUME *Volume);
+EG_IMAGE * GetVolumeBadge(IN OUT REFIT_VOLUME *Volume);
 VOID ScanVolumes(VOID);
+VOID FreeVolume(IN REFIT_VOLUME *Volume);
 
 BOOLEAN FileExists(IN EFI_FILE *BaseDir, IN CHAR16 *RelativePath);
 BOOLEAN DirectoryExists(IN EFI_FILE *BaseDir, IN CHAR16 *RelativePath);
 
 EFI_STATUS DirNextEntry(IN EFI_FILE *Directory, IN OUT EFI_FILE_INFO **DirEntry, IN UINTN FilterMode);
 
+VOID EnableDirCache(VOID);
+VOID FlushDirCache(VOID);
 VOID DirIterOpen(IN EFI_FILE *BaseDir, IN CHAR16 *RelativePath OPTIONAL, OUT REFIT_DIR_ITER *DirIter);
 BOOLEAN DirIterNext(IN OUT REFIT_DIR_ITER *DirIter, IN UINTN FilterMode, IN CHAR16 *FilePattern OPTIONAL, OUT EFI_FILE_INFO **DirEntry);
+BOOLEAN DirIterNextMatch(IN OUT REFIT_DIR_ITER *DirIter, IN UINTN FilterMode, IN PATTERN_LIST *Patterns OPTIONAL,
+                         OUT EFI_FILE_INFO **DirEntry);
 EFI_STATUS DirIterClose(IN OUT REFIT_DIR_ITER *DirIter);
 
 CHAR16 * Basename(IN CHAR16 *Path);
@@ -121,5 +148,11 @@ VOID MyFreePool(IN OUT VOID *Pointer);
 BOOLEAN EjectMedia(VOID);
 
 CHAR16 * GuidAsString(EFI_GUID *GuidData);
+VOID InitTimeStamps(VOID);
+UINT64 GetTimeStampUSec(VOID);
+VOID ExportLoaderTime(IN CHAR16 *VarName);
+VOID RecordTiming(IN CHAR16 *Description, IN UINT64 StartTime);
+VOID SaveTimingLog(VOID);
+VOID ResetTimingLog(VOID);
 
 #endif
\ No newline at end of file
@@ -53,12 +53,18 @@
 #include "../include/Handle.h"
 #include "../include/refit_call_wrapper.h"
 #include "driver_support.h"
+#include "scancache.h"
 #include "../include/syslinux_mbr.h"
 
 #ifdef __MAKEWITH_GNUEFI
 #define EFI_SECURITY_VIOLATION    EFIERR (26)
 #else
 #include "../EfiLib/BdsHelper.h"
+#define BlockIoProtocol gEfiBlockIoProtocolGuid
+#define DiskIoProtocol gEfiDiskIoProtocolGuid
+#define FileSystemProtocol gEfiSimpleFileSystemProtocolGuid
+#define LibOpenRoot EfiLibOpenRoot
+#define DevicePathSize GetDevicePathSize
 #endif // __MAKEWITH_GNUEFI
 
 //
@@ -112,8 +118,8 @@ static REFIT_MENU_SCREEN MainMenu       = { L"Main Menu", NULL, 0, NULL, 0, NULL
                                             L"Insert or F2 for more options; Esc to refresh" };
 static REFIT_MENU_SCREEN AboutMenu      = { L"About", NULL, 0, NULL, 0, NULL, 0, NULL, L"Press Enter to return to main menu", L"" };
 
-REFIT_CONFIG GlobalConfig = { FALSE, FALSE, 0, 0, 0, DONT_CHANGE_TEXT_MODE, 20, 0, 0, GRAPHICS_FOR_OSX, LEGACY_TYPE_MAC, 0,
-                              NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+REFIT_CONFIG GlobalConfig = { FALSE, FALSE, FALSE, FALSE, FALSE, 0, 0, 0, DONT_CHANGE_TEXT_MODE, 20, 0, 0, GRAPHICS_FOR_OSX, 0, LEGACY_TYPE_MAC, 0, 1,
+                              NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
                               {TAG_SHELL, TAG_APPLE_RECOVERY, TAG_MOK_TOOL, TAG_ABOUT, TAG_SHUTDOWN, TAG_REBOOT, 0, 0, 0, 0, 0 }};
 
 // Structure used to hold boot loader filenames and time stamps in
@@ -176,8 +182,174 @@ static VOID AboutrEFInd(VOID)
     RunMenu(&AboutMenu, NULL);
 } /* VOID AboutrEFInd() */
 
-// Launch an EFI binary.
-static EFI_STATUS StartEFIImageList(IN EFI_DEVICE_PATH **DevicePaths,
+// Open the boot loader file LoaderPath on the filesystem identified by the
+// loader's DevicePath (which should end in a file path node), without
+// relying on the list of scanned volumes. Returns NULL on failure.
+static EFI_FILE * OpenLoaderFile(IN EFI_DEVICE_PATH *DevicePath, IN CHAR16 *LoaderPath) {
+   EFI_STATUS        Status;
+   EFI_DEVICE_PATH   *RemainingDevicePath = DevicePath;
+   EFI_HANDLE        DeviceHandle;
+   EFI_FILE          *RootDir, *FileHandle = NULL;
+
+   if ((DevicePath == NULL) || (LoaderPath == NULL))
+      return NULL;
+   Status = refit_call3_wrapper(BS->LocateDevicePath, &FileSystemProtocol, &RemainingDevicePath, &DeviceHandle);
+   if (EFI_ERROR(Status) || (DevicePathType(RemainingDevicePath) != MEDIA_DEVICE_PATH) ||
+       (DevicePathSubType(RemainingDevicePath) != MEDIA_FILEPATH_DP))
+      return NULL;
+   RootDir = LibOpenRoot(DeviceHandle);
+   if (RootDir == NULL)
+      return NULL;
+   Status = refit_call5_wrapper(RootDir->Open, RootDir, &FileHandle, LoaderPath, EFI_FILE_MODE_READ, 0);
+   refit_call1_wrapper(RootDir->Close, RootDir);
+   return (EFI_ERROR(Status) ? NULL : FileHandle);
+} // static EFI_FILE * OpenLoaderFile()
+
+//
+// Preloading of the default boot loader during the menu's timeout countdown
+//
+
+#define PRELOAD_CHUNK_SIZE (512 * 1024)
+
+typedef struct {
+   EFI_DEVICE_PATH  *DevicePath;  // loader being preloaded (a copy)
+   EFI_FILE         *FileHandle;  // open until the whole file has been read
+   UINT8            *Buffer;      // NULL if preloading failed
+   UINTN            Size;
+   UINTN            BytesRead;
+} PRELOADED_IMAGE;
+
+static PRELOADED_IMAGE Preload = { NULL, NULL, NULL, 0, 0 };
+
+// Forget about any preloaded boot loader and release its memory.
+static VOID DiscardPreload(VOID) {
+   if (Preload.FileHandle != NULL)
+      refit_call1_wrapper(Preload.FileHandle->Close, Preload.FileHandle);
+   MyFreePool(Preload.Buffer);
+   MyFreePool(Preload.DevicePath);
+   ZeroMem(&Preload, sizeof(PRELOADED_IMAGE));
+} // static VOID DiscardPreload()
+
+// Returns TRUE if the two device paths are identical.
+static BOOLEAN SameDevicePath(IN EFI_DEVICE_PATH *DevicePath1, IN EFI_DEVICE_PATH *DevicePath2) {
+   UINTN Size = DevicePathSize(DevicePath1);
+
+   return ((Size == DevicePathSize(DevicePath2)) && (CompareMem(DevicePath1, DevicePath2, Size) == 0));
+} // static BOOLEAN SameDevicePath()
+
+// Returns the GlobalConfig.MemoryLoadFor (and GraphicsFor) flag that
+// corresponds to a loader's OSType code, or 0 if there's none.
+static UINTN OSTypeFlag(IN CHAR8 OSType) {
+   switch (OSType) {
+      case 'M':
+         return GRAPHICS_FOR_OSX;
+      case 'L':
+         return GRAPHICS_FOR_LINUX;
+      case 'E':
+         return GRAPHICS_FOR_ELILO;
+      case 'G':
+         return GRAPHICS_FOR_GRUB;
+      case 'W': case 'X':
+         return GRAPHICS_FOR_WINDOWS;
+   } // switch
+   return 0;
+} // static UINTN OSTypeFlag()
+
+// Returns TRUE if Entry's loader should be read by rEFInd and handed to
+// LoadImage() from memory, FALSE if the firmware should read it. Only OS
+// types listed in memory_load_for are loaded from memory, since some loaders
+// (such as shim) depend on the firmware having read them from their file.
+static BOOLEAN LoadFromBuffer(IN LOADER_ENTRY *Entry) {
+   return ((Entry->DevicePath != NULL) && (GlobalConfig.MemoryLoadFor & OSTypeFlag(Entry->OSType)));
+} // static BOOLEAN LoadFromBuffer()
+
+// Read the next chunk, of at most MaxChunkSize bytes (or the rest of the file
+// if MaxChunkSize is 0), of the boot loader file for MenuEntry into memory,
+// discarding any other loader that was being preloaded. The first call for
+// a given loader only opens the file and allocates memory. Returns TRUE if
+// it did any disk I/O, FALSE if there was nothing (more) to do.
+static BOOLEAN ReadLoaderImage(IN REFIT_MENU_ENTRY *MenuEntry, IN UINTN MaxChunkSize) {
+   EFI_STATUS     Status;
+   LOADER_ENTRY   *Entry = (LOADER_ENTRY *) MenuEntry;
+   EFI_FILE_INFO  *FileInfo;
+   UINTN          ChunkSize;
+
+   if ((MenuEntry->Tag != TAG_LOADER) || !LoadFromBuffer(Entry))
+      return FALSE;
+   if ((Preload.DevicePath != NULL) && !SameDevicePath(Preload.DevicePath, Entry->DevicePath))
+      DiscardPreload();
+
+   if (Preload.DevicePath == NULL) { // start preloading this entry
+      Preload.DevicePath = DuplicateDevicePath(Entry->DevicePath);
+      Preload.FileHandle = OpenLoaderFile(Entry->DevicePath, Entry->LoaderPath);
+      if (Preload.FileHandle != NULL) {
+         FileInfo = LibFileInfo(Preload.FileHandle);
+         if ((FileInfo != NULL) && !(FileInfo->Attribute & EFI_FILE_DIRECTORY) && (FileInfo->FileSize > 0)) {
+            Preload.Size = (UINTN) FileInfo->FileSize;
+            Preload.Buffer = AllocatePool(Preload.Size);
+         }
+         MyFreePool(FileInfo);
+         if (Preload.Buffer == NULL) {
+            refit_call1_wrapper(Preload.FileHandle->Close, Preload.FileHandle);
+            Preload.FileHandle = NULL;
+         }
+      } // if
+      return TRUE;
+   } // if
+
+   if (Preload.FileHandle == NULL) // finished or failed
+      return FALSE;
+
+   ChunkSize = Preload.Size - Preload.BytesRead;
+   if ((MaxChunkSize > 0) && (ChunkSize > MaxChunkSize))
+      ChunkSize = MaxChunkSize;
+   Status = refit_call3_wrapper(Preload.FileHandle->Read, Preload.FileHandle, &ChunkSize, Preload.Buffer + Preload.BytesRead);
+   if (EFI_ERROR(Status) || (ChunkSize == 0)) {
+      MyFreePool(Preload.Buffer);
+      Preload.Buffer = NULL;
+   } else {
+      Preload.BytesRead += ChunkSize;
+   }
+   if ((Preload.Buffer == NULL) || (Preload.BytesRead >= Preload.Size)) {
+      refit_call1_wrapper(Preload.FileHandle->Close, Preload.FileHandle);
+      Preload.FileHandle = NULL;
+   }
+   return TRUE;
+} // static BOOLEAN ReadLoaderImage()
+
+// The main menu's idle function: called repeatedly while the timeout counts
+// down, it reads the selected boot loader into memory a piece at a time.
+static BOOLEAN PreloadLoaderImage(IN REFIT_MENU_ENTRY *MenuEntry) {
+   return ReadLoaderImage(MenuEntry, PRELOAD_CHUNK_SIZE);
+} // static BOOLEAN PreloadLoaderImage()
+
+// Some firmware leaves LoadedImage->DeviceHandle unset for images loaded
+// from a memory buffer, which keeps Linux's EFI stub loader from reading
+// its initrd ("Failed to handle fs_proto"). Fill in the device handle and
+// file path from the image's DevicePath in that case. Returns the file path
+// that was filled in, if any, which the caller must take back out of
+// LoadedImage and free once the image returns.
+static EFI_DEVICE_PATH * FixLoadedImageDevice(IN EFI_LOADED_IMAGE *LoadedImage, IN EFI_DEVICE_PATH *DevicePath) {
+   EFI_STATUS        Status;
+   EFI_DEVICE_PATH   *RemainingDevicePath = DevicePath;
+   EFI_HANDLE        DeviceHandle;
+
+   if (LoadedImage->DeviceHandle != NULL)
+      return NULL;
+   Status = refit_call3_wrapper(BS->LocateDevicePath, &FileSystemProtocol, &RemainingDevicePath, &DeviceHandle);
+   if (EFI_ERROR(Status))
+      return NULL;
+   LoadedImage->DeviceHandle = DeviceHandle;
+   if (LoadedImage->FilePath != NULL)
+      return NULL;
+   LoadedImage->FilePath = DuplicateDevicePath(RemainingDevicePath);
+   return LoadedImage->FilePath;
+} // static EFI_DEVICE_PATH * FixLoadedImageDevice()
+
+// Launch an EFI binary. If ImageData is not NULL, it holds the ImageSize-byte
+// contents of the file identified by DevicePaths[0], which is then loaded
+// from memory rather than read again by the firmware.
+static EFI_STATUS StartEFIImageList(IN EFI_DEVICE_PATH **DevicePaths, IN VOID *ImageData, IN UINTN ImageSize,
                                     IN CHAR16 *LoadOptions, IN CHAR16 *LoadOptionsPrefix,
                                     IN CHAR16 *ImageTitle, IN CHAR8 OSType,
                                     OUT UINTN *ErrorInStep,
@@ -186,9 +358,11 @@ static EFI_STATUS StartEFIImageList(IN EFI_DEVICE_PATH **DevicePaths,
     EFI_STATUS              Status, ReturnStatus;
     EFI_HANDLE              ChildImageHandle;
     EFI_LOADED_IMAGE        *ChildLoadedImage = NULL;
+    EFI_DEVICE_PATH         *FixedFilePath = NULL;
     UINTN                   DevicePathIndex;
     CHAR16                  ErrorInfo[256];
     CHAR16                  *FullLoadOptions = NULL;
+    UINT64                  LoadStart;
 
     if (ErrorInStep != NULL)
         *ErrorInStep = 0;
@@ -217,15 +391,21 @@ static EFI_STATUS StartEFIImageList(IN EFI_DEVICE_PATH **DevicePaths,
     // load the image into memory (and execute it, in the case of a shim/MOK image).
     ReturnStatus = Status = EFI_NOT_FOUND;  // in case the list is empty
     for (DevicePathIndex = 0; DevicePaths[DevicePathIndex] != NULL; DevicePathIndex++) {
-       // NOTE: Below commented-out line could be more efficient if file were read ahead of
-       // time and passed as a pre-loaded image to LoadImage(), but it doesn't work on my
-       // 32-bit Mac Mini or my 64-bit Intel box when launching a Linux kernel; the
-       // kernel returns a "Failed to handle fs_proto" error message.
-       // TODO: Track down the cause of this error and fix it, if possible.
-       // ReturnStatus = Status = refit_call6_wrapper(BS->LoadImage, FALSE, SelfImageHandle, DevicePaths[DevicePathIndex],
-       //                                            ImageData, ImageSize, &ChildImageHandle);
+       LoadStart = GetTimeStampUSec();
+       if ((ImageData != NULL) && (DevicePathIndex == 0)) {
+          ReturnStatus = Status = refit_call6_wrapper(BS->LoadImage, FALSE, SelfImageHandle, DevicePaths[DevicePathIndex],
+                                                      ImageData, ImageSize, &ChildImageHandle);
+          SPrint(ErrorInfo, 255, L"load %s from memory", ImageTitle);
+          RecordTiming(ErrorInfo, LoadStart);
+          if (!EFI_ERROR(Status) || (Status == EFI_SECURITY_VIOLATION))
+             break;
+          ImageData = NULL; // let the firmware try reading the file itself
+          LoadStart = GetTimeStampUSec();
+       } // if
        ReturnStatus = Status = refit_call6_wrapper(BS->LoadImage, FALSE, SelfImageHandle, DevicePaths[DevicePathIndex],
                                                    NULL, 0, &ChildImageHandle);
+       SPrint(ErrorInfo, 255, L"load %s via firmware", ImageTitle);
+       RecordTiming(ErrorInfo, LoadStart);
        if (ReturnStatus != EFI_NOT_FOUND) {
           break;
        }
@@ -244,16 +424,28 @@ static EFI_STATUS StartEFIImageList(IN EFI_DEVICE_PATH **DevicePaths,
           *ErrorInStep = 2;
        goto bailout_unload;
     }
+    if ((ImageData != NULL) && (DevicePathIndex == 0))
+       FixedFilePath = FixLoadedImageDevice(ChildLoadedImage, DevicePaths[0]);
     ChildLoadedImage->LoadOptions = (VOID *)FullLoadOptions;
     ChildLoadedImage->LoadOptionsSize = ((UINT32)StrLen(FullLoadOptions) + 1) * sizeof(CHAR16);
     // turn control over to the image
     // TODO: (optionally) re-enable the EFI watchdog timer!
 
+    // record the hand-off time and save the timing log while files are open
+    ExportLoaderTime(L"LoaderTimeExecUSec");
+    if (GlobalConfig.LogTiming)
+       SaveTimingLog();
+
     // close open file handles
     UninitRefitLib();
     ReturnStatus = Status = refit_call3_wrapper(BS->StartImage, ChildImageHandle, NULL, NULL);
 
     // control returns here when the child image calls Exit()
+    if (FixedFilePath != NULL) {
+       // take our copy back, so the firmware doesn't free it on unload
+       ChildLoadedImage->FilePath = NULL;
+       MyFreePool(FixedFilePath);
+    }
     SPrint(ErrorInfo, 255, L"returned from %s", ImageTitle);
     if (CheckError(Status, ErrorInfo)) {
         if (ErrorInStep != NULL)
@@ -272,7 +464,7 @@ bailout:
     return ReturnStatus;
 } /* static EFI_STATUS StartEFIImageList() */
 
-static EFI_STATUS StartEFIImage(IN EFI_DEVICE_PATH *DevicePath,
+static EFI_STATUS StartEFIImage(IN EFI_DEVICE_PATH *DevicePath, IN VOID *ImageData, IN UINTN ImageSize,
                                 IN CHAR16 *LoadOptions, IN CHAR16 *LoadOptionsPrefix,
                                 IN CHAR16 *ImageTitle, IN CHAR8 OSType,
                                 OUT UINTN *ErrorInStep,
@@ -282,7 +474,8 @@ static EFI_STATUS StartEFIImage(IN EFI_DEVICE_PATH *DevicePath,
 
     DevicePaths[0] = DevicePath;
     DevicePaths[1] = NULL;
-    return StartEFIImageList(DevicePaths, LoadOptions, LoadOptionsPrefix, ImageTitle, OSType, ErrorInStep, Verbose);
+    return StartEFIImageList(DevicePaths, ImageData, ImageSize, LoadOptions, LoadOptionsPrefix, ImageTitle, OSType,
+                             ErrorInStep, Verbose);
 } /* static EFI_STATUS StartEFIImage() */
 
 //
@@ -291,12 +484,29 @@ static EFI_STATUS StartEFIImage(IN EFI_DEVICE_PATH *DevicePath,
 
 static VOID StartLoader(IN LOADER_ENTRY *Entry)
 {
-    UINTN ErrorInStep = 0;
+    UINTN  ErrorInStep = 0;
+    VOID   *ImageData = NULL;
+    UINT64 ReadStart;
+    CHAR16 Message[256];
+
+    // For OS types listed in memory_load_for, read the loader with large
+    // reads of our own, continuing from what was read during the menu
+    // countdown, if that was this loader; otherwise the firmware reads it.
+    if (LoadFromBuffer(Entry)) {
+       ReadStart = GetTimeStampUSec();
+       while (ReadLoaderImage((REFIT_MENU_ENTRY *) Entry, 0))
+          ;
+       SPrint(Message, 255, L"read %s", Entry->LoaderPath);
+       RecordTiming(Message, ReadStart);
+       if ((Preload.Buffer != NULL) && (Preload.BytesRead == Preload.Size))
+          ImageData = Preload.Buffer;
+    } // if
 
     BeginExternalScreen(Entry->UseGraphicsMode, L"Booting OS");
-    StartEFIImage(Entry->DevicePath, Entry->LoadOptions, Basename(Entry->LoaderPath),
+    StartEFIImage(Entry->DevicePath, ImageData, Preload.Size, Entry->LoadOptions, Basename(Entry->LoaderPath),
                   Basename(Entry->LoaderPath), Entry->OSType, &ErrorInStep, !Entry->UseGraphicsMode);
     FinishExternalScreen();
+    DiscardPreload();
 }
 
 // Locate an initrd or initramfs file that matches the kernel specified by LoaderPath.
@@ -437,6 +647,7 @@ LOADER_ENTRY *InitializeLoaderEntry(IN LOADER_ENTRY *Entry) {
          NewEntry->LoaderPath      = (Entry->LoaderPath) ? StrDuplicate(Entry->LoaderPath) : NULL;
          NewEntry->VolName         = (Entry->VolName) ? StrDuplicate(Entry->VolName) : NULL;
          NewEntry->DevicePath      = Entry->DevicePath;
+         NewEntry->Volume          = Entry->Volume;
          NewEntry->UseGraphicsMode = Entry->UseGraphicsMode;
          NewEntry->LoadOptions     = (Entry->LoadOptions) ? StrDuplicate(Entry->LoadOptions) : NULL;
          NewEntry->InitrdPath      = (Entry->InitrdPath) ? StrDuplicate(Entry->InitrdPath) : NULL;
@@ -717,20 +928,17 @@ static CHAR16 * GetMainLinuxOptions(IN CHAR16 * LoaderPath, IN REFIT_VOLUME *Vol
 // code and shortcut letter. For Linux EFI stub loaders, also sets kernel options
 // that will (with luck) work fairly automatically.
 VOID SetLoaderDefaults(LOADER_ENTRY *Entry, CHAR16 *LoaderPath, REFIT_VOLUME *Volume) {
-   CHAR16      *FileName, *PathOnly, *NoExtension, *OSIconName = NULL, *Temp, *SubString;
+   CHAR16      *FileName, *PathOnly, *OSIconName = NULL, *Temp, *SubString;
    CHAR16      ShortcutLetter = 0;
    UINTN       i = 0, Length;
 
    FileName = Basename(LoaderPath);
    PathOnly = FindPath(LoaderPath);
-   NoExtension = StripEfiExtension(FileName);
 
-   // locate a custom icon for the loader
-   // Anything found here takes precedence over the "hints" in the OSIconName variable
-   if (!Entry->me.Image)
-      Entry->me.Image = egFindIcon(NoExtension, 128);
-   if (!Entry->me.Image)
-      Entry->me.Image = Volume->VolIconImage;
+   // The icon and badge are found by LoadLoaderImages() when the entry is
+   // first drawn, so that a scan decodes no images.
+   Entry->Volume = Volume;
+   Entry->me.LoadImages = LoadLoaderImages;
 
    // Begin creating icon "hints" by using last part of directory path leading
    // to the loader
@@ -775,9 +983,6 @@ VOID SetLoaderDefaults(LOADER_ENTRY *Entry, CHAR16 *LoaderPath, REFIT_VOLUME *Vo
       Entry->OSType = 'R';
       ShortcutLetter = 'R';
    } else if (StriCmp(LoaderPath, MACOSX_LOADER_PATH) == 0) {
-      if (Volume->VolIconImage != NULL) { // custom icon file found
-         Entry->me.Image = Volume->VolIconImage;
-      }
       MergeStrings(&OSIconName, L"mac", L',');
       Entry->OSType = 'M';
       ShortcutLetter = 'M';
@@ -812,11 +1017,37 @@ VOID SetLoaderDefaults(LOADER_ENTRY *Entry, CHAR16 *LoaderPath, REFIT_VOLUME *Vo
    if ((ShortcutLetter >= 'a') && (ShortcutLetter <= 'z'))
       ShortcutLetter = ShortcutLetter - 'a' + 'A'; // convert lowercase to uppercase
    Entry->me.ShortcutLetter = ShortcutLetter;
-   if (Entry->me.Image == NULL)
-      Entry->me.Image = LoadOSIcon(OSIconName, L"unknown", FALSE);
+   Entry->IconHints = OSIconName;
    MyFreePool(PathOnly);
 } // VOID SetLoaderDefaults()
 
+// Find and load the icon and badge for a loader entry, if they haven't been
+// set explicitly. In order, the icon is the one named after the loader file
+// (for instance, grubx64.png for grubx64.efi), the volume's custom icon, or
+// the first OS icon found from the hints set by SetLoaderDefaults(). For
+// Mac OS X, the volume's custom icon comes first.
+VOID LoadLoaderImages(IN OUT REFIT_MENU_ENTRY *MenuEntry) {
+   LOADER_ENTRY *Entry = (LOADER_ENTRY *) MenuEntry;
+   CHAR16       *NoExtension;
+
+   if (Entry->me.BadgeImage == NULL)
+      Entry->me.BadgeImage = GetVolumeBadge(Entry->Volume);
+   if (Entry->me.Image != NULL)
+      return;
+
+   if (Entry->OSType == 'M')
+      Entry->me.Image = GetVolumeIcon(Entry->Volume);
+   if ((Entry->me.Image == NULL) && (Entry->LoaderPath != NULL)) {
+      NoExtension = StripEfiExtension(Basename(Entry->LoaderPath));
+      Entry->me.Image = egFindIcon(NoExtension, 128);
+      MyFreePool(NoExtension);
+   } // if
+   if (Entry->me.Image == NULL)
+      Entry->me.Image = GetVolumeIcon(Entry->Volume);
+   if (Entry->me.Image == NULL)
+      Entry->me.Image = LoadOSIcon(Entry->IconHints, L"unknown", FALSE);
+} // VOID LoadLoaderImages()
+
 // Add a specified EFI boot loader to the list, using automatic settings
 // for icons, options, etc.
 LOADER_ENTRY * AddLoaderEntry(IN CHAR16 *LoaderPath, IN CHAR16 *LoaderTitle, IN REFIT_VOLUME *Volume) {
@@ -829,7 +1060,6 @@ LOADER_ENTRY * AddLoaderEntry(IN CHAR16 *LoaderPath, IN CHAR16 *LoaderTitle, IN
       Entry->me.Title = AllocateZeroPool(sizeof(CHAR16) * 256);
       SPrint(Entry->me.Title, 255, L"Boot %s from %s", (LoaderTitle != NULL) ? LoaderTitle : LoaderPath, Volume->VolName);
       Entry->me.Row = 0;
-      Entry->me.BadgeImage = Volume->VolBadgeImage;
       if ((LoaderPath != NULL) && (LoaderPath[0] != L'\\')) {
          Entry->LoaderPath = StrDuplicate(L"\\");
       } else {
@@ -903,50 +1133,194 @@ static VOID CleanUpLoaderList(struct LOADER_LIST *LoaderList) {
 } // static VOID CleanUpLoaderList()
 
 // Returns FALSE if the specified file/volume matches the GlobalConfig.DontScanDirs
-// or GlobalConfig.DontScanVolumes specification, or if Path points to a volume
-// other than the one specified by Volume. Returns TRUE if none of these conditions
-// is met -- that is, if the path is eligible for scanning. Also reduces *Path to a
-// path alone, with no volume specification.
+// or GlobalConfig.DontScanVolumes specification. Returns TRUE if neither
+// condition is met -- that is, if the path is eligible for scanning.
 static BOOLEAN ShouldScan(REFIT_VOLUME *Volume, CHAR16 *Path) {
-   CHAR16   *VolName = NULL, *DontScanDir;
-   UINTN    i = 0, VolNum;
-   BOOLEAN  ScanIt = TRUE;
-
-   if (IsIn(Volume->VolName, GlobalConfig.DontScanVolumes))
+   if (MatchesPatternList(Volume->VolName, &(GlobalConfig.DontScanVolumeNames)))
       return FALSE;
+   return !IsInScanPaths(&(GlobalConfig.DontScanPaths), Volume, Path);
+} // BOOLEAN ShouldScan()
 
-   while ((DontScanDir = FindCommaDelimited(GlobalConfig.DontScanDirs, i++)) && ScanIt) {
-      SplitVolumeAndFilename(&DontScanDir, &VolName);
-      CleanUpPathNameSlashes(DontScanDir);
-      if (VolName != NULL) {
-         if ((StriCmp(VolName, Volume->VolName) == 0) && (StriCmp(DontScanDir, Path) == 0))
-            ScanIt = FALSE;
-         if ((StrLen(VolName) > 2) && (VolName[0] == L'f') && (VolName[1] == L's') && (VolName[2] >= L'0') && (VolName[2] <= L'9')) {
-            VolNum = Atoi(VolName + 2);
-            if ((VolNum == Volume->VolNumber) && (StriCmp(DontScanDir, Path) == 0))
-               ScanIt = FALSE;
-         }
-      } else {
-         if (StriCmp(DontScanDir, Path) == 0)
-            ScanIt = FALSE;
+#define HASH_CHUNK_SIZE  (1024 * 1024)
+#define FNV64_OFFSET     0xcbf29ce484222325ULL
+#define FNV64_PRIME      0x100000001b3ULL
+
+// A file's content hash, remembered across rescans. A hash is reused only
+// if the file's volume, name, size, and modification time all match. Used
+// is set when the hash is computed or reused; PruneFileHashes() drops
+// hashes that weren't used during the latest scan.
+typedef struct _file_hash {
+   EFI_DEVICE_PATH     *VolumeDevicePath;
+   CHAR16              *FileName;
+   UINT64              FileSize;
+   EFI_TIME            ModificationTime;
+   UINT64              Hash;
+   BOOLEAN             Used;
+   struct _file_hash   *Next;
+} FILE_HASH;
+
+static FILE_HASH *FileHashes = NULL;
+
+// The fallback boot loader's file information for the volume being
+// scanned, read once per volume by GetFallbackInfo().
+static REFIT_VOLUME  *FallbackInfoVolume = NULL;
+static EFI_FILE_INFO *FallbackInfo = NULL;
+
+// Forget the fallback boot loader information; must be called before
+// scanning each volume, since REFIT_VOLUME pointers are reused after a
+// rescan.
+static VOID ForgetFallbackInfo(VOID) {
+   MyFreePool(FallbackInfo);
+   FallbackInfo = NULL;
+   FallbackInfoVolume = NULL;
+} // static VOID ForgetFallbackInfo()
+
+// Returns the fallback boot loader's file information for Volume, or NULL
+// if Volume has no fallback boot loader.
+static EFI_FILE_INFO * GetFallbackInfo(IN REFIT_VOLUME *Volume) {
+   EFI_STATUS       Status;
+   EFI_FILE_HANDLE  FallbackHandle;
+
+   if (FallbackInfoVolume != Volume) {
+      ForgetFallbackInfo();
+      FallbackInfoVolume = Volume;
+      Status = refit_call5_wrapper(Volume->RootDir->Open, Volume->RootDir, &FallbackHandle, FALLBACK_FULLNAME,
+                                   EFI_FILE_MODE_READ, 0);
+      if (Status == EFI_SUCCESS) {
+         FallbackInfo = LibFileInfo(FallbackHandle);
+         refit_call1_wrapper(FallbackHandle->Close, FallbackHandle);
       }
-      MyFreePool(DontScanDir);
-      DontScanDir = NULL;
-   }
-   return ScanIt;
-} // BOOLEAN ShouldScan()
+   } // if
+   return FallbackInfo;
+} // static EFI_FILE_INFO * GetFallbackInfo()
+
+// Compute a 64-bit FNV-1a hash of the contents of the file FileName on
+// Volume, reading it in large chunks, or return a previously computed hash
+// if the file is unchanged since then. Info is the file's information.
+// Returns FALSE if the file couldn't be read.
+static BOOLEAN GetFileHash(IN REFIT_VOLUME *Volume, IN CHAR16 *FileName, IN EFI_FILE_INFO *Info, OUT UINT64 *Hash) {
+   EFI_STATUS       Status;
+   EFI_FILE_HANDLE  FileHandle;
+   FILE_HASH        *Entry;
+   UINT8            *Buffer;
+   UINT64           Remaining;
+   UINTN            i, ChunkSize, PathSize;
+
+   PathSize = DevicePathSize(Volume->DevicePath);
+   for (Entry = FileHashes; Entry != NULL; Entry = Entry->Next) {
+      if ((Entry->FileSize == Info->FileSize) && (StriCmp(Entry->FileName, FileName) == 0) &&
+          (CompareMem(&(Entry->ModificationTime), &(Info->ModificationTime), sizeof(EFI_TIME)) == 0) &&
+          (DevicePathSize(Entry->VolumeDevicePath) == PathSize) &&
+          (CompareMem(Entry->VolumeDevicePath, Volume->DevicePath, PathSize) == 0)) {
+         *Hash = Entry->Hash;
+         Entry->Used = TRUE;
+         return TRUE;
+      } // if
+   } // for
+
+   Status = refit_call5_wrapper(Volume->RootDir->Open, Volume->RootDir, &FileHandle, FileName, EFI_FILE_MODE_READ, 0);
+   if (EFI_ERROR(Status))
+      return FALSE;
+   Buffer = AllocatePool(HASH_CHUNK_SIZE);
+   *Hash = FNV64_OFFSET;
+   Remaining = Info->FileSize;
+   while ((Buffer != NULL) && (Remaining > 0)) {
+      ChunkSize = (Remaining > HASH_CHUNK_SIZE) ? HASH_CHUNK_SIZE : (UINTN) Remaining;
+      Status = refit_call3_wrapper(FileHandle->Read, FileHandle, &ChunkSize, Buffer);
+      if (EFI_ERROR(Status) || (ChunkSize == 0))
+         break;
+      for (i = 0; i < ChunkSize; i++)
+         *Hash = (*Hash ^ Buffer[i]) * FNV64_PRIME;
+      Remaining -= ChunkSize;
+   } // while
+   refit_call1_wrapper(FileHandle->Close, FileHandle);
+   MyFreePool(Buffer);
+   if (Remaining > 0)
+      return FALSE;
 
-// Returns TRUE if the file is byte-for-byte identical with the fallback file
-// on the volume AND if the file is not itself the fallback file; returns
-// FALSE if the file is not identical to the fallback file OR if the file
-// IS the fallback file. Intended for use in excluding the fallback boot
-// loader when it's a duplicate of another boot loader.
+   Entry = AllocateZeroPool(sizeof(FILE_HASH));
+   if (Entry != NULL) {
+      Entry->VolumeDevicePath = DuplicateDevicePath(Volume->DevicePath);
+      Entry->FileName = StrDuplicate(FileName);
+      Entry->FileSize = Info->FileSize;
+      CopyMem(&(Entry->ModificationTime), &(Info->ModificationTime), sizeof(EFI_TIME));
+      Entry->Hash = *Hash;
+      Entry->Used = TRUE;
+      Entry->Next = FileHashes;
+      FileHashes = Entry;
+   } // if
+   return TRUE;
+} // static BOOLEAN GetFileHash()
+
+// Forget the hashes of files that weren't looked at since the last call,
+// such as files that have changed or been deleted, so that FileHashes holds
+// only the files seen by the latest scan.
+static VOID PruneFileHashes(VOID) {
+   FILE_HASH *Entry, **Link = &FileHashes;
+
+   while ((Entry = *Link) != NULL) {
+      if (Entry->Used) {
+         Entry->Used = FALSE;
+         Link = &(Entry->Next);
+      } else {
+         *Link = Entry->Next;
+         MyFreePool(Entry->VolumeDevicePath);
+         MyFreePool(Entry->FileName);
+         FreePool(Entry);
+      } // if/else
+   } // while
+} // static VOID PruneFileHashes()
+
+// Returns TRUE if the files FileName1 and FileName2 on Volume, each Size
+// bytes long, have identical contents; FALSE if they differ or either
+// couldn't be read.
+static BOOLEAN FilesMatch(IN REFIT_VOLUME *Volume, IN CHAR16 *FileName1, IN CHAR16 *FileName2, IN UINT64 Size) {
+   EFI_FILE_HANDLE  FileHandle1 = NULL, FileHandle2 = NULL;
+   UINT8            *Buffer1, *Buffer2;
+   UINTN            ChunkSize, ReadSize1, ReadSize2;
+   BOOLEAN          Match = FALSE;
+
+   Buffer1 = AllocatePool(HASH_CHUNK_SIZE);
+   Buffer2 = AllocatePool(HASH_CHUNK_SIZE);
+   if ((Buffer1 != NULL) && (Buffer2 != NULL) &&
+       (refit_call5_wrapper(Volume->RootDir->Open, Volume->RootDir, &FileHandle1, FileName1,
+                            EFI_FILE_MODE_READ, 0) == EFI_SUCCESS) &&
+       (refit_call5_wrapper(Volume->RootDir->Open, Volume->RootDir, &FileHandle2, FileName2,
+                            EFI_FILE_MODE_READ, 0) == EFI_SUCCESS)) {
+      Match = TRUE;
+      while (Match && (Size > 0)) {
+         ChunkSize = (Size > HASH_CHUNK_SIZE) ? HASH_CHUNK_SIZE : (UINTN) Size;
+         ReadSize1 = ReadSize2 = ChunkSize;
+         if (EFI_ERROR(refit_call3_wrapper(FileHandle1->Read, FileHandle1, &ReadSize1, Buffer1)) ||
+             EFI_ERROR(refit_call3_wrapper(FileHandle2->Read, FileHandle2, &ReadSize2, Buffer2)) ||
+             (ReadSize1 != ChunkSize) || (ReadSize2 != ChunkSize) || (CompareMem(Buffer1, Buffer2, ChunkSize) != 0))
+            Match = FALSE;
+         Size -= ChunkSize;
+      } // while
+   } // if
+   if (FileHandle1 != NULL)
+      refit_call1_wrapper(FileHandle1->Close, FileHandle1);
+   if (FileHandle2 != NULL)
+      refit_call1_wrapper(FileHandle2->Close, FileHandle2);
+   MyFreePool(Buffer1);
+   MyFreePool(Buffer2);
+   return Match;
+} // static BOOLEAN FilesMatch()
+
+// Returns TRUE if the file is identical with the fallback file on the
+// volume AND if the file is not itself the fallback file; returns FALSE if
+// the file is not identical to the fallback file OR if the file IS the
+// fallback file. Intended for use in excluding the fallback boot loader
+// when it's a duplicate of another boot loader. Files are compared by size,
+// then by content hash, and, only if the hashes match, byte for byte, so
+// that a hash collision can't hide a boot loader. The fallback's information
+// is read once per volume and hashes are cached, so files that differ are
+// read only when necessary.
 BOOLEAN DuplicatesFallback(IN REFIT_VOLUME *Volume, IN CHAR16 *FileName) {
-   CHAR8           *FileContents, *FallbackContents;
-   EFI_FILE_HANDLE FileHandle, FallbackHandle;
-   EFI_FILE_INFO   *FileInfo, *FallbackInfo;
-   UINTN           FileSize = 0, FallbackSize = 0;
+   EFI_FILE_HANDLE FileHandle;
+   EFI_FILE_INFO   *FileInfo, *FallbackFileInfo;
    EFI_STATUS      Status;
+   UINT64          FileHash, FallbackHash;
    BOOLEAN         AreIdentical = FALSE;
 
    CleanUpPathNameSlashes(FileName);
@@ -954,74 +1328,76 @@ BOOLEAN DuplicatesFallback(IN REFIT_VOLUME *Volume, IN CHAR16 *FileName) {
    if (StriCmp(FileName, FALLBACK_FULLNAME) == 0)
       return FALSE; // identical filenames, so not a duplicate....
 
-   Status = refit_call5_wrapper(Volume->RootDir->Open, Volume->RootDir, &FileHandle, FileName, EFI_FILE_MODE_READ, 0);
-   if (Status == EFI_SUCCESS) {
-      FileInfo = LibFileInfo(FileHandle);
-      FileSize = FileInfo->FileSize;
-   } else {
+   FallbackFileInfo = GetFallbackInfo(Volume);
+   if (FallbackFileInfo == NULL)
       return FALSE;
-   }
 
-   Status = refit_call5_wrapper(Volume->RootDir->Open, Volume->RootDir, &FallbackHandle, FALLBACK_FULLNAME, EFI_FILE_MODE_READ, 0);
-   if (Status == EFI_SUCCESS) {
-      FallbackInfo = LibFileInfo(FallbackHandle);
-      FallbackSize = FallbackInfo->FileSize;
-   } else {
-      refit_call1_wrapper(FileHandle->Close, FileHandle);
+   Status = refit_call5_wrapper(Volume->RootDir->Open, Volume->RootDir, &FileHandle, FileName, EFI_FILE_MODE_READ, 0);
+   if (Status != EFI_SUCCESS)
       return FALSE;
-   }
-
-   if (FallbackSize != FileSize) { // not same size, so can't be identical
-      AreIdentical = FALSE;
-   } else { // could be identical; do full check....
-      FileContents = AllocatePool(FileSize);
-      FallbackContents = AllocatePool(FallbackSize);
-      if (FileContents && FallbackContents) {
-         Status = refit_call3_wrapper(FileHandle->Read, FileHandle, &FileSize, FileContents);
-         if (Status == EFI_SUCCESS)
-            Status = refit_call3_wrapper(FallbackHandle->Read, FallbackHandle, &FallbackSize, FallbackContents);
-         if (Status == EFI_SUCCESS) {
-            AreIdentical = (CompareMem(FileContents, FallbackContents, FileSize) == 0);
-         } // if
-      } // if
-      MyFreePool(FileContents);
-      MyFreePool(FallbackContents);
-   } // if/else
-
+   FileInfo = LibFileInfo(FileHandle);
    refit_call1_wrapper(FileHandle->Close, FileHandle);
-   refit_call1_wrapper(FileHandle->Close, FallbackHandle);
-   return AreIdentical;
+   if (FileInfo == NULL)
+      return FALSE;
 
+   // different sizes can't be identical; otherwise, compare hashes, and
+   // then the contents of files whose hashes match
+   if ((FileInfo->FileSize == FallbackFileInfo->FileSize) &&
+       GetFileHash(Volume, FileName, FileInfo, &FileHash) &&
+       GetFileHash(Volume, FALLBACK_FULLNAME, FallbackFileInfo, &FallbackHash) &&
+       (FileHash == FallbackHash)) {
+      AreIdentical = FilesMatch(Volume, FileName, FALLBACK_FULLNAME, FileInfo->FileSize);
+   }
+   FreePool(FileInfo);
+   return AreIdentical;
 } // BOOLEAN DuplicatesFallback()
 
+// Patterns for the boot loader scan, compiled by CompileScanPatterns() and
+// freed at the end of ScanForBootloaders(): the names of files that may be
+// boot loaders, and the names of files to skip even if they match.
+static PATTERN_LIST LoaderPatterns = { 0, NULL };
+static PATTERN_LIST SkipPatterns = { 0, NULL };
+
+// Compile the boot loader scan patterns, if they haven't been compiled
+// already. Hidden files, icons, and shells are always skipped.
+static VOID CompileScanPatterns(VOID) {
+   if (LoaderPatterns.Count > 0)
+      return;
+   AddPatterns(&LoaderPatterns, LOADER_MATCH_PATTERNS, FALSE);
+   if (GlobalConfig.ScanAllLinux)
+      AddPatterns(&LoaderPatterns, LINUX_MATCH_PATTERNS, FALSE);
+   AddPatterns(&SkipPatterns, L".*,*.icns,*.png,*shell*", FALSE);
+} // static VOID CompileScanPatterns()
+
+// Free the boot loader scan patterns.
+static VOID FreeScanPatterns(VOID) {
+   FreePatternList(&LoaderPatterns);
+   FreePatternList(&SkipPatterns);
+} // static VOID FreeScanPatterns()
+
 // Scan an individual directory for EFI boot loader files and, if found,
 // add them to the list. Exception: Ignores FALLBACK_FULLNAME, which is picked
 // up in ScanEfiFiles(). Sorts the entries within the loader directory so that
 // the most recent one appears first in the list.
 // Returns TRUE if a duplicate for FALLBACK_FILENAME was found, FALSE if not.
-static BOOLEAN ScanLoaderDir(IN REFIT_VOLUME *Volume, IN CHAR16 *Path, IN CHAR16 *Pattern)
+static BOOLEAN ScanLoaderDir(IN REFIT_VOLUME *Volume, IN CHAR16 *Path, IN PATTERN_LIST *Patterns)
 {
     EFI_STATUS              Status;
     REFIT_DIR_ITER          DirIter;
     EFI_FILE_INFO           *DirEntry;
-    CHAR16                  FileName[256], *Extension;
+    CHAR16                  FileName[256];
     struct LOADER_LIST      *LoaderList = NULL, *NewLoader;
     BOOLEAN                 FoundFallbackDuplicate = FALSE;
 
-//    Print(L"Entering ScanLoaderDir(), scanning '%s' for pattern '%s'\n", Path, Pattern);
     if ((!SelfDirPath || !Path || ((StriCmp(Path, SelfDirPath) == 0) && (Volume->DeviceHandle != SelfVolume->DeviceHandle)) ||
            (StriCmp(Path, SelfDirPath) != 0)) &&
            (ShouldScan(Volume, Path))) {
        // look through contents of the directory
        DirIterOpen(Volume->RootDir, Path, &DirIter);
-       while (DirIterNext(&DirIter, 2, Pattern, &DirEntry)) {
-          Extension = FindExtension(DirEntry->FileName);
-          if (DirEntry->FileName[0] == '.' ||
-              StriCmp(Extension, L".icns") == 0 ||
-              StriCmp(Extension, L".png") == 0 ||
-              (StriCmp(DirEntry->FileName, FALLBACK_BASENAME) == 0 && (StriCmp(Path, L"EFI\\BOOT") == 0)) ||
-              StriSubCmp(L"shell", DirEntry->FileName) ||
-              IsIn(DirEntry->FileName, GlobalConfig.DontScanFiles))
+       while (DirIterNextMatch(&DirIter, 2, Patterns, &DirEntry)) {
+          if ((StriCmp(DirEntry->FileName, FALLBACK_BASENAME) == 0 && (StriCmp(Path, L"EFI\\BOOT") == 0)) ||
+              MatchesPatternList(DirEntry->FileName, &SkipPatterns) ||
+              MatchesPatternList(DirEntry->FileName, &(GlobalConfig.DontScanFileNames)))
                 continue;   // skip this
 
           if (Path)
@@ -1037,7 +1413,6 @@ static BOOLEAN ScanLoaderDir(IN REFIT_VOLUME *Volume, IN CHAR16 *Path, IN CHAR16
              if (DuplicatesFallback(Volume, FileName))
                 FoundFallbackDuplicate = TRUE;
           } // if
-          MyFreePool(Extension);
        } // while
        NewLoader = LoaderList;
        while (NewLoader != NULL) {
@@ -1062,21 +1437,21 @@ static VOID ScanEfiFiles(REFIT_VOLUME *Volume) {
    EFI_STATUS              Status;
    REFIT_DIR_ITER          EfiDirIter;
    EFI_FILE_INFO           *EfiDirEntry;
-   CHAR16                  FileName[256], *Directory, *MatchPatterns, *VolName = NULL;
-   UINTN                   i, Length, VolNum;
+   CHAR16                  FileName[256];
+   SCAN_PATH               *ScanPath;
+   UINTN                   i;
    BOOLEAN                 ScanFallbackLoader = TRUE;
+   UINT64                  StartTime = GetTimeStampUSec();
 
+   ForgetFallbackInfo();
 //   Print(L"Entering ScanEfiFiles(), GlobalConfig.ScanAllLinux = %s\n", GlobalConfig.ScanAllLinux ? L"TRUE" : L"FALSE");
-   MatchPatterns = StrDuplicate(LOADER_MATCH_PATTERNS);
-   if (GlobalConfig.ScanAllLinux)
-      MergeStrings(&MatchPatterns, LINUX_MATCH_PATTERNS, L',');
-//   Print(L"MatchPatterns = '%s'\n", MatchPatterns);
+   CompileScanPatterns();
 
    if ((Volume->RootDir != NULL) && (Volume->VolName != NULL)) {
       // check for Mac OS X boot loader
-      if (!IsIn(L"System\\Library\\CoreServices", GlobalConfig.DontScanDirs)) {
+      if (!IsInScanPaths(&(GlobalConfig.DontScanPaths), NULL, L"System\\Library\\CoreServices")) {
          StrCpy(FileName, MACOSX_LOADER_PATH);
-         if (FileExists(Volume->RootDir, FileName) && !IsIn(L"boot.efi", GlobalConfig.DontScanFiles)) {
+         if (FileExists(Volume->RootDir, FileName) && !MatchesPatternList(L"boot.efi", &(GlobalConfig.DontScanFileNames))) {
             AddLoaderEntry(FileName, L"Mac OS X", Volume);
             if (DuplicatesFallback(Volume, FileName))
                ScanFallbackLoader = FALSE;
@@ -1084,7 +1459,7 @@ static VOID ScanEfiFiles(REFIT_VOLUME *Volume) {
 
          // check for XOM
          StrCpy(FileName, L"System\\Library\\CoreServices\\xom.efi");
-         if (FileExists(Volume->RootDir, FileName) && !IsIn(L"boot.efi", GlobalConfig.DontScanFiles)) {
+         if (FileExists(Volume->RootDir, FileName) && !MatchesPatternList(L"boot.efi", &(GlobalConfig.DontScanFileNames))) {
             AddLoaderEntry(FileName, L"Windows XP (XoM)", Volume);
             if (DuplicatesFallback(Volume, FileName))
                ScanFallbackLoader = FALSE;
@@ -1093,15 +1468,15 @@ static VOID ScanEfiFiles(REFIT_VOLUME *Volume) {
 
       // check for Microsoft boot loader/menu
       StrCpy(FileName, L"EFI\\Microsoft\\Boot\\Bootmgfw.efi");
-      if (FileExists(Volume->RootDir, FileName) && !IsIn(L"EFI\\Microsoft\\Boot", GlobalConfig.DontScanDirs) &&
-          !IsIn(L"bootmgfw.efi", GlobalConfig.DontScanFiles)) {
+      if (FileExists(Volume->RootDir, FileName) && !IsInScanPaths(&(GlobalConfig.DontScanPaths), NULL, L"EFI\\Microsoft\\Boot") &&
+          !MatchesPatternList(L"bootmgfw.efi", &(GlobalConfig.DontScanFileNames))) {
          AddLoaderEntry(FileName, L"Microsoft EFI boot", Volume);
          if (DuplicatesFallback(Volume, FileName))
             ScanFallbackLoader = FALSE;
       }
 
       // scan the root directory for EFI executables
-      if (ScanLoaderDir(Volume, L"\\", MatchPatterns))
+      if (ScanLoaderDir(Volume, L"\\", &LoaderPatterns))
          ScanFallbackLoader = FALSE;
 
       // scan subdirectories of the EFI directory (as per the standard)
@@ -1110,7 +1485,7 @@ static VOID ScanEfiFiles(REFIT_VOLUME *Volume) {
          if (StriCmp(EfiDirEntry->FileName, L"tools") == 0 || EfiDirEntry->FileName[0] == '.')
             continue;   // skip this, doesn't contain boot loaders or is scanned later
          SPrint(FileName, 255, L"EFI\\%s", EfiDirEntry->FileName);
-         if (ScanLoaderDir(Volume, FileName, MatchPatterns))
+         if (ScanLoaderDir(Volume, FileName, &LoaderPatterns))
             ScanFallbackLoader = FALSE;
       } // while()
       Status = DirIterClose(&EfiDirIter);
@@ -1118,21 +1493,11 @@ static VOID ScanEfiFiles(REFIT_VOLUME *Volume) {
          CheckError(Status, L"while scanning the EFI directory");
 
       // Scan user-specified (or additional default) directories....
-      i = 0;
-      while ((Directory = FindCommaDelimited(GlobalConfig.AlsoScan, i++)) != NULL) {
-         VolNum = VOL_DONTSCAN;
-         SplitVolumeAndFilename(&Directory, &VolName);
-         CleanUpPathNameSlashes(Directory);
-         Length = StrLen(Directory);
-         if (VolName && (Length > 0) && (StrLen(VolName) > 2) && (VolName[0] == L'f') && (VolName[1] == L's') &&
-             (VolName[2] >= L'0') && (VolName[2] <= L'9'))
-            VolNum = Atoi(VolName + 2);
-         if ((Length > 0) && ((VolName == NULL) || (StriCmp(VolName, Volume->VolName) == 0) || (Volume->VolNumber == VolNum)))
-            if (ScanLoaderDir(Volume, Directory, MatchPatterns))
-               ScanFallbackLoader = FALSE;
-         MyFreePool(Directory);
-         MyFreePool(VolName);
-      } // while
+      for (i = 0; i < GlobalConfig.AlsoScanPaths.Count; i++) {
+         ScanPath = &(GlobalConfig.AlsoScanPaths.Paths[i]);
+         if (ScanPathIsOnVolume(ScanPath, Volume) && ScanLoaderDir(Volume, ScanPath->Path, &LoaderPatterns))
+            ScanFallbackLoader = FALSE;
+      } // for
 
       // If not a duplicate & if it exists & if it's not us, create an entry
       // for the fallback boot loader
@@ -1140,6 +1505,8 @@ static VOID ScanEfiFiles(REFIT_VOLUME *Volume) {
           ((StriCmp(SelfDirPath, L"EFI\\BOOT") != 0) || (Volume->DeviceHandle != SelfVolume->DeviceHandle))) {
          AddLoaderEntry(FALLBACK_FULLNAME, L"Fallback boot loader", Volume);
       }
+      SPrint(FileName, 255, L"scan volume %s", Volume->VolName);
+      RecordTiming(FileName, StartTime);
    } // if
 } // static VOID ScanEfiFiles()
 
@@ -1349,6 +1716,7 @@ static VOID StartLegacy(IN LEGACY_ENTRY *Entry)
                       (UGAWidth  - BootLogoImage->Width ) >> 1,
                       (UGAHeight - BootLogoImage->Height) >> 1,
                       &StdBackgroundPixel);
+    egFlush();
 
     if (Entry->Volume->IsMbrPartition) {
         ActivateMbrPartition(Entry->Volume->WholeDiskBlockIO, Entry->Volume->MbrPartitionIndex);
@@ -1356,7 +1724,7 @@ static VOID StartLegacy(IN LEGACY_ENTRY *Entry)
 
     ExtractLegacyLoaderPaths(DiscoveredPathList, MAX_DISCOVERED_PATHS, LegacyLoaderList);
 
-    Status = StartEFIImageList(DiscoveredPathList, Entry->LoadOptions, NULL, L"legacy loader", 0, &ErrorInStep, TRUE);
+    Status = StartEFIImageList(DiscoveredPathList, NULL, 0, Entry->LoadOptions, NULL, L"legacy loader", 0, &ErrorInStep, TRUE);
     if (Status == EFI_NOT_FOUND) {
         if (ErrorInStep == 1) {
             Print(L"\nPlease make sure that you have the latest firmware update installed.\n");
@@ -1384,6 +1752,17 @@ static VOID StartLegacyUEFI(IN LEGACY_ENTRY *Entry)
 } // static VOID StartLegacyUEFI()
 #endif // __MAKEWITH_TIANO
 
+// Find and load the icon and badge for a BIOS-mode boot entry; called when
+// the entry is first drawn.
+static VOID LoadLegacyImages(IN OUT REFIT_MENU_ENTRY *MenuEntry) {
+   LEGACY_ENTRY *Entry = (LEGACY_ENTRY *) MenuEntry;
+
+   if (Entry->me.Image == NULL)
+      Entry->me.Image = LoadOSIcon(Entry->Volume->OSIconName, L"legacy", FALSE);
+   if (Entry->me.BadgeImage == NULL)
+      Entry->me.BadgeImage = GetVolumeBadge(Entry->Volume);
+} // static VOID LoadLegacyImages()
+
 static LEGACY_ENTRY * AddLegacyEntry(IN CHAR16 *LoaderTitle, IN REFIT_VOLUME *Volume)
 {
     LEGACY_ENTRY            *Entry, *SubEntry;
@@ -1411,8 +1790,7 @@ static LEGACY_ENTRY * AddLegacyEntry(IN CHAR16 *LoaderTitle, IN REFIT_VOLUME *Vo
     Entry->me.Tag          = TAG_LEGACY;
     Entry->me.Row          = 0;
     Entry->me.ShortcutLetter = ShortcutLetter;
-    Entry->me.Image        = LoadOSIcon(Volume->OSIconName, L"legacy", FALSE);
-    Entry->me.BadgeImage   = Volume->VolBadgeImage;
+    Entry->me.LoadImages   = LoadLegacyImages;
     Entry->Volume          = Volume;
     Entry->LoadOptions     = (Volume->DiskKind == DISK_KIND_OPTICAL) ? L"CD" :
         ((Volume->DiskKind == DISK_KIND_EXTERNAL) ? L"USB" : L"HD");
@@ -1670,7 +2048,7 @@ static VOID ScanLegacyExternal(VOID)
 static VOID StartTool(IN LOADER_ENTRY *Entry)
 {
    BeginExternalScreen(Entry->UseGraphicsMode, Entry->me.Title + 6);  // assumes "Start <title>" as assigned below
-   StartEFIImage(Entry->DevicePath, Entry->LoadOptions, Basename(Entry->LoaderPath),
+   StartEFIImage(Entry->DevicePath, NULL, 0, Entry->LoadOptions, Basename(Entry->LoaderPath),
                  Basename(Entry->LoaderPath), Entry->OSType, NULL, TRUE);
    FinishExternalScreen();
 } /* static VOID StartTool() */
@@ -1702,13 +2080,49 @@ static LOADER_ENTRY * AddToolEntry(EFI_HANDLE DeviceHandle, IN CHAR16 *LoaderPat
 // pre-boot driver functions
 //
 
-static UINTN ScanDriverDir(IN CHAR16 *Path)
+// A driver that's been loaded into memory but not yet started
+typedef struct {
+    EFI_HANDLE  ImageHandle;
+    CHAR16      *FileName;
+} DRIVER_IMAGE;
+
+// Read the driver image file FileName on rEFInd's own volume into memory and
+// hand it to the firmware with LoadImage(), without starting it. Returns the
+// new image's handle in *DriverHandle.
+static EFI_STATUS LoadDriverImage(IN CHAR16 *FileName, OUT EFI_HANDLE *DriverHandle)
+{
+    EFI_STATUS              Status;
+    EFI_DEVICE_PATH         *DevicePath;
+    UINT8                   *ImageData = NULL;
+    UINTN                   ImageSize = 0;
+
+    Status = egLoadFile(SelfRootDir, FileName, &ImageData, &ImageSize);
+    if (EFI_ERROR(Status))
+        return Status;
+
+    // Pass the device path along with the buffer so that the driver's
+    // LoadedImage protocol still identifies the file it came from.
+    DevicePath = FileDevicePath(SelfLoadedImage->DeviceHandle, FileName);
+    Status = refit_call6_wrapper(BS->LoadImage, FALSE, SelfImageHandle, DevicePath,
+                                 ImageData, ImageSize, DriverHandle);
+    MyFreePool(DevicePath);
+    MyFreePool(ImageData);
+    return Status;
+} // static EFI_STATUS LoadDriverImage()
+
+// Load (but don't start) all the drivers in the directory Path on rEFInd's
+// own volume, adding them to the Drivers list. Each image is read in full
+// with one read call before being passed to the firmware.
+static UINTN ScanDriverDir(IN CHAR16 *Path, IN OUT DRIVER_IMAGE ***Drivers, IN OUT UINTN *DriverCount)
 {
     EFI_STATUS              Status;
     REFIT_DIR_ITER          DirIter;
     UINTN                   NumFound = 0;
     EFI_FILE_INFO           *DirEntry;
-    CHAR16                  FileName[256];
+    EFI_HANDLE              DriverHandle;
+    DRIVER_IMAGE            *Driver;
+    UINT64                  LoadStart;
+    CHAR16                  FileName[256], Message[256];
 
     CleanUpPathNameSlashes(Path);
     // look through contents of the directory
@@ -1718,9 +2132,20 @@ static UINTN ScanDriverDir(IN CHAR16 *Path)
             continue;   // skip this
 
         SPrint(FileName, 255, L"%s\\%s", Path, DirEntry->FileName);
-        NumFound++;
-        Status = StartEFIImage(FileDevicePath(SelfLoadedImage->DeviceHandle, FileName),
-                               L"", DirEntry->FileName, DirEntry->FileName, 0, NULL, FALSE);
+        LoadStart = GetTimeStampUSec();
+        Status = LoadDriverImage(FileName, &DriverHandle);
+        SPrint(Message, 255, L"while loading %s", DirEntry->FileName);
+        if (!CheckError(Status, Message)) {
+            NumFound++;
+            Driver = AllocateZeroPool(sizeof(DRIVER_IMAGE));
+            if (Driver != NULL) {
+                Driver->ImageHandle = DriverHandle;
+                Driver->FileName = StrDuplicate(DirEntry->FileName);
+                AddListElement((VOID ***) Drivers, DriverCount, Driver);
+            }
+            SPrint(Message, 255, L"load driver %s", DirEntry->FileName);
+            RecordTiming(Message, LoadStart);
+        } // if
     }
     Status = DirIterClose(&DirIter);
     if (Status != EFI_NOT_FOUND) {
@@ -1805,13 +2230,115 @@ static EFI_STATUS ConnectAllDriversToAllControllers(VOID) {
 }
 #endif
 
+// Returns TRUE if Handle appears in the HandleCount-element List.
+static BOOLEAN HandleIsInList(IN EFI_HANDLE Handle, IN EFI_HANDLE *List, IN UINTN HandleCount) {
+   UINTN i;
+
+   for (i = 0; i < HandleCount; i++) {
+      if (List[i] == Handle)
+         return TRUE;
+   } // for
+   return FALSE;
+} // static BOOLEAN HandleIsInList()
+
+// Connect drivers to the BlockIO and DiskIO handles that don't yet carry a
+// filesystem, which is all that newly-loaded filesystem drivers need. This
+// takes one snapshot of the relevant handles and classifies them once, so
+// it runs in time proportional to the number of storage handles, unlike
+// ConnectAllDriversToAllControllers(), which rescans the entire handle
+// database for every handle in the system.
+static EFI_STATUS ConnectFilesystemDrivers(VOID) {
+   EFI_STATUS  Status;
+   EFI_HANDLE  *BlockIoHandles = NULL, *DiskIoHandles = NULL, *FsHandles = NULL;
+   UINTN       BlockIoCount = 0, DiskIoCount = 0, FsCount = 0, i;
+
+   Status = refit_call5_wrapper(BS->LocateHandleBuffer, ByProtocol, &BlockIoProtocol, NULL,
+                                &BlockIoCount, &BlockIoHandles);
+   if (EFI_ERROR(Status))
+      BlockIoCount = 0;
+   Status = refit_call5_wrapper(BS->LocateHandleBuffer, ByProtocol, &DiskIoProtocol, NULL,
+                                &DiskIoCount, &DiskIoHandles);
+   if (EFI_ERROR(Status))
+      DiskIoCount = 0;
+   Status = refit_call5_wrapper(BS->LocateHandleBuffer, ByProtocol, &FileSystemProtocol, NULL,
+                                &FsCount, &FsHandles);
+   if (EFI_ERROR(Status))
+      FsCount = 0;
+
+   // Recursive connection picks up partitions exposed by a newly-loaded
+   // partition driver, too.
+   for (i = 0; i < BlockIoCount; i++) {
+      if (!HandleIsInList(BlockIoHandles[i], FsHandles, FsCount))
+         refit_call4_wrapper(BS->ConnectController, BlockIoHandles[i], NULL, NULL, TRUE);
+   } // for
+   // DiskIO normally shares a handle with BlockIO; catch any that don't
+   for (i = 0; i < DiskIoCount; i++) {
+      if (!HandleIsInList(DiskIoHandles[i], FsHandles, FsCount) &&
+          !HandleIsInList(DiskIoHandles[i], BlockIoHandles, BlockIoCount))
+         refit_call4_wrapper(BS->ConnectController, DiskIoHandles[i], NULL, NULL, TRUE);
+   } // for
+
+   MyFreePool(BlockIoHandles);
+   MyFreePool(DiskIoHandles);
+   MyFreePool(FsHandles);
+   return (BlockIoCount + DiskIoCount > 0) ? EFI_SUCCESS : EFI_NOT_FOUND;
+} // static EFI_STATUS ConnectFilesystemDrivers()
+
+// Returns TRUE if every one of the DriverCount images in Drivers has opened a
+// BlockIO or DiskIO protocol as a driver -- that is, if each is a filesystem
+// (or partition) driver that ConnectFilesystemDrivers() has bound to a disk.
+// Drivers for disk controllers (NVMe, SATA, USB, etc.), and filesystem
+// drivers that found nothing to mount, make this return FALSE.
+static BOOLEAN DriversBoundToStorage(IN EFI_HANDLE *Drivers, IN UINTN DriverCount) {
+   EFI_STATUS                           Status;
+   EFI_GUID                             *Protocols[2] = { &BlockIoProtocol, &DiskIoProtocol };
+   EFI_HANDLE                           *Handles;
+   EFI_OPEN_PROTOCOL_INFORMATION_ENTRY  *OpenInfo;
+   UINTN                                HandleCount, OpenCount, p, i, j, k;
+   BOOLEAN                              *Bound, AllBound = TRUE;
+
+   Bound = AllocateZeroPool(DriverCount * sizeof(BOOLEAN));
+   if (Bound == NULL)
+      return FALSE;
+   for (p = 0; p < 2; p++) {
+      Status = refit_call5_wrapper(BS->LocateHandleBuffer, ByProtocol, Protocols[p], NULL, &HandleCount, &Handles);
+      if (EFI_ERROR(Status))
+         continue;
+      for (i = 0; i < HandleCount; i++) {
+         Status = refit_call4_wrapper(BS->OpenProtocolInformation, Handles[i], Protocols[p], &OpenInfo, &OpenCount);
+         if (EFI_ERROR(Status))
+            continue;
+         for (j = 0; j < OpenCount; j++) {
+            if ((OpenInfo[j].Attributes & EFI_OPEN_PROTOCOL_BY_DRIVER) != EFI_OPEN_PROTOCOL_BY_DRIVER)
+               continue;
+            for (k = 0; k < DriverCount; k++) {
+               if (OpenInfo[j].AgentHandle == Drivers[k])
+                  Bound[k] = TRUE;
+            } // for k
+         } // for j
+         MyFreePool(OpenInfo);
+      } // for i
+      MyFreePool(Handles);
+   } // for p
+
+   for (k = 0; k < DriverCount; k++)
+      AllBound = AllBound && Bound[k];
+   MyFreePool(Bound);
+   return AllBound;
+} // static BOOLEAN DriversBoundToStorage()
+
 // Load all EFI drivers from rEFInd's "drivers" subdirectory and from the
 // directories specified by the user in the "scan_driver_dirs" configuration
 // file line.
 static VOID LoadDrivers(VOID)
 {
+    EFI_STATUS    Status;
     CHAR16        *Directory, *SelfDirectory;
-    UINTN         i = 0, Length, NumFound = 0;
+    DRIVER_IMAGE  **Drivers = NULL;
+    EFI_HANDLE    *Started = NULL;
+    UINTN         i = 0, Length, NumFound = 0, DriverCount = 0, StartedCount = 0;
+    UINT64        StartTime;
+    CHAR16        Message[256];
 
     // load drivers from the subdirectories of rEFInd's home directory specified
     // in the DRIVER_DIRS constant.
@@ -1819,7 +2346,7 @@ static VOID LoadDrivers(VOID)
        SelfDirectory = SelfDirPath ? StrDuplicate(SelfDirPath) : NULL;
        CleanUpPathNameSlashes(SelfDirectory);
        MergeStrings(&SelfDirectory, Directory, L'\\');
-       NumFound += ScanDriverDir(SelfDirectory);
+       NumFound += ScanDriverDir(SelfDirectory, &Drivers, &DriverCount);
        MyFreePool(Directory);
        MyFreePool(SelfDirectory);
     }
@@ -1830,14 +2357,39 @@ static VOID LoadDrivers(VOID)
        CleanUpPathNameSlashes(Directory);
        Length = StrLen(Directory);
        if (Length > 0) {
-          NumFound += ScanDriverDir(Directory);
+          NumFound += ScanDriverDir(Directory, &Drivers, &DriverCount);
        } // if
        MyFreePool(Directory);
     } // while
 
-    // connect all devices
-    if (NumFound > 0)
-       ConnectAllDriversToAllControllers();
+    // All the images are now in memory, so start them back to back. A driver
+    // that returns an error is unloaded by the firmware.
+    if (DriverCount > 0)
+       Started = AllocatePool(DriverCount * sizeof(EFI_HANDLE));
+    for (i = 0; i < DriverCount; i++) {
+       StartTime = GetTimeStampUSec();
+       Status = refit_call3_wrapper(BS->StartImage, Drivers[i]->ImageHandle, NULL, NULL);
+       SPrint(Message, 255, L"while starting %s", Drivers[i]->FileName);
+       if (!CheckError(Status, Message) && (Started != NULL))
+          Started[StartedCount++] = Drivers[i]->ImageHandle;
+       SPrint(Message, 255, L"start driver %s", Drivers[i]->FileName);
+       RecordTiming(Message, StartTime);
+       MyFreePool(Drivers[i]->FileName);
+    } // for
+    FreeList((VOID ***) &Drivers, &DriverCount);
+
+    // Connect the new drivers to the storage devices that need them. That's
+    // enough for filesystem drivers; if any driver didn't bind to a disk (as
+    // with a disk controller driver), connect everything, so that the disks
+    // behind its controllers appear.
+    if (NumFound > 0) {
+       StartTime = GetTimeStampUSec();
+       ConnectFilesystemDrivers();
+       if ((Started == NULL) || !DriversBoundToStorage(Started, StartedCount))
+          ConnectAllDriversToAllControllers();
+       RecordTiming(L"connect drivers", StartTime);
+    }
+    MyFreePool(Started);
 } /* static VOID LoadDrivers() */
 
 // Determine what (if any) type of legacy (BIOS) boot support is available
@@ -1895,14 +2447,30 @@ static VOID WarnIfLegacyProblems() {
    } // if no legacy support
 } // static VOID WarnIfLegacyProblems()
 
+// Assign shortcut keys 1-9 to the first nine boot loader entries
+static VOID AssignShortcutDigits(VOID) {
+   UINTN i;
+
+   for (i = 0; i < MainMenu.EntryCount && MainMenu.Entries[i]->Row == 0 && i < 9; i++)
+      MainMenu.Entries[i]->ShortcutDigit = (CHAR16)('1' + i);
+} // static VOID AssignShortcutDigits()
+
 // Locates boot loaders. NOTE: This assumes that GlobalConfig.LegacyType is set correctly.
 static VOID ScanForBootloaders(VOID) {
    UINTN                     i;
+   UINT64                    StartTime;
+   CHAR16                    Message[32];
 
+   StartTime = GetTimeStampUSec();
    ScanVolumes();
+   RecordTiming(L"ScanVolumes", StartTime);
+   // Volume root handles are stable from here on, so directory listings can
+   // be shared by the scan passes and icon lookups that follow.
+   EnableDirCache();
 
    // scan for loaders and tools, add them to the menu
    for (i = 0; i < NUM_SCAN_OPTIONS; i++) {
+      StartTime = GetTimeStampUSec();
       switch(GlobalConfig.ScanFor[i]) {
          case 'c': case 'C':
             ScanLegacyDisc();
@@ -1926,116 +2494,369 @@ static VOID ScanForBootloaders(VOID) {
             ScanOptical();
             break;
       } // switch()
+      if (GlobalConfig.ScanFor[i] != ' ') {
+         SPrint(Message, 31, L"scan pass '%c'", GlobalConfig.ScanFor[i]);
+         RecordTiming(Message, StartTime);
+      }
    } // for
 
-   // assign shortcut keys
-   for (i = 0; i < MainMenu.EntryCount && MainMenu.Entries[i]->Row == 0 && i < 9; i++)
-      MainMenu.Entries[i]->ShortcutDigit = (CHAR16)('1' + i);
+   AssignShortcutDigits();
+   FlushDirCache();
+   FreeScanPatterns();
+   PruneFileHashes();
 
    // wait for user ACK when there were errors
    FinishTextScreen(FALSE);
 } // static VOID ScanForBootloaders()
 
-// Add the second-row tags containing built-in and external tools (EFI shell,
-// reboot, etc.)
-static VOID ScanForTools(VOID) {
+// Add the second-row tag(s) for one "showtools" item, Tool (TAG_SHELL,
+// TAG_REBOOT, etc.)
+static VOID ScanForTool(IN UINTN Tool) {
    CHAR16 *FileName = NULL, Description[256];
    REFIT_MENU_ENTRY *TempMenuEntry;
-   UINTN i, j, VolumeIndex;
+   UINTN j, VolumeIndex;
 
-   for (i = 0; i < NUM_TOOLS; i++) {
-      switch(GlobalConfig.ShowTools[i]) {
-         case TAG_SHUTDOWN:
-            TempMenuEntry = CopyMenuEntry(&MenuEntryShutdown);
-            TempMenuEntry->Image = BuiltinIcon(BUILTIN_ICON_FUNC_SHUTDOWN);
-            AddMenuEntry(&MainMenu, TempMenuEntry);
-            break;
-         case TAG_REBOOT:
-            TempMenuEntry = CopyMenuEntry(&MenuEntryReset);
-            TempMenuEntry->Image = BuiltinIcon(BUILTIN_ICON_FUNC_RESET);
-            AddMenuEntry(&MainMenu, TempMenuEntry);
-            break;
-         case TAG_ABOUT:
-            TempMenuEntry = CopyMenuEntry(&MenuEntryAbout);
-            TempMenuEntry->Image = BuiltinIcon(BUILTIN_ICON_FUNC_ABOUT);
-            AddMenuEntry(&MainMenu, TempMenuEntry);
-            break;
-         case TAG_EXIT:
-            TempMenuEntry = CopyMenuEntry(&MenuEntryExit);
-            TempMenuEntry->Image = BuiltinIcon(BUILTIN_ICON_FUNC_EXIT);
-            AddMenuEntry(&MainMenu, TempMenuEntry);
-            break;
-         case TAG_SHELL:
-            j = 0;
-            MyFreePool(FileName);
-            while ((FileName = FindCommaDelimited(SHELL_NAMES, j++)) != NULL) {
-               if (FileExists(SelfRootDir, FileName)) {
-                  AddToolEntry(SelfLoadedImage->DeviceHandle, FileName, L"EFI Shell", BuiltinIcon(BUILTIN_ICON_TOOL_SHELL),
-                               'S', FALSE);
-               }
-            } // while
-            break;
-         case TAG_GPTSYNC:
-            MyFreePool(FileName);
-            FileName = StrDuplicate(L"\\efi\\tools\\gptsync.efi");
+   switch(Tool) {
+      case TAG_SHUTDOWN:
+         TempMenuEntry = CopyMenuEntry(&MenuEntryShutdown);
+         TempMenuEntry->Image = BuiltinIcon(BUILTIN_ICON_FUNC_SHUTDOWN);
+         AddMenuEntry(&MainMenu, TempMenuEntry);
+         break;
+      case TAG_REBOOT:
+         TempMenuEntry = CopyMenuEntry(&MenuEntryReset);
+         TempMenuEntry->Image = BuiltinIcon(BUILTIN_ICON_FUNC_RESET);
+         AddMenuEntry(&MainMenu, TempMenuEntry);
+         break;
+      case TAG_ABOUT:
+         TempMenuEntry = CopyMenuEntry(&MenuEntryAbout);
+         TempMenuEntry->Image = BuiltinIcon(BUILTIN_ICON_FUNC_ABOUT);
+         AddMenuEntry(&MainMenu, TempMenuEntry);
+         break;
+      case TAG_EXIT:
+         TempMenuEntry = CopyMenuEntry(&MenuEntryExit);
+         TempMenuEntry->Image = BuiltinIcon(BUILTIN_ICON_FUNC_EXIT);
+         AddMenuEntry(&MainMenu, TempMenuEntry);
+         break;
+      case TAG_SHELL:
+         j = 0;
+         MyFreePool(FileName);
+         while ((FileName = FindCommaDelimited(SHELL_NAMES, j++)) != NULL) {
             if (FileExists(SelfRootDir, FileName)) {
-               AddToolEntry(SelfLoadedImage->DeviceHandle, FileName, L"Make Hybrid MBR", BuiltinIcon(BUILTIN_ICON_TOOL_PART), 'P', FALSE);
+               AddToolEntry(SelfLoadedImage->DeviceHandle, FileName, L"EFI Shell", BuiltinIcon(BUILTIN_ICON_TOOL_SHELL),
+                            'S', FALSE);
             }
-            break;
-         case TAG_APPLE_RECOVERY:
-            MyFreePool(FileName);
-            FileName = StrDuplicate(L"\\com.apple.recovery.boot\\boot.efi");
-            for (VolumeIndex = 0; VolumeIndex < VolumesCount; VolumeIndex++) {
-               if ((Volumes[VolumeIndex]->RootDir != NULL) && (FileExists(Volumes[VolumeIndex]->RootDir, FileName))) {
-                  SPrint(Description, 255, L"Apple Recovery on %s", Volumes[VolumeIndex]->VolName);
-                  AddToolEntry(Volumes[VolumeIndex]->DeviceHandle, FileName, Description,
-                               BuiltinIcon(BUILTIN_ICON_TOOL_APPLE_RESCUE), 'R', TRUE);
-               }
-            } // for
-            break;
-         case TAG_MOK_TOOL:
-            j = 0;
-            MyFreePool(FileName);
-            while ((FileName = FindCommaDelimited(MOK_NAMES, j++)) != NULL) {
-               if (FileExists(SelfRootDir, FileName)) {
-                  SPrint(Description, 255, L"MOK Key Manager at %s", FileName);
-                  AddToolEntry(SelfLoadedImage->DeviceHandle, FileName, Description,
-                               BuiltinIcon(BUILTIN_ICON_TOOL_MOK_TOOL), 'S', FALSE);
-               }
-            } // while
-            if (FileExists(SelfDir, L"MokManager.efi")) {
-               MyFreePool(FileName);
-               FileName = SelfDirPath ? StrDuplicate(SelfDirPath) : NULL;
-               MergeStrings(&FileName, L"\\MokManager.efi", 0);
+         } // while
+         break;
+      case TAG_GPTSYNC:
+         MyFreePool(FileName);
+         FileName = StrDuplicate(L"\\efi\\tools\\gptsync.efi");
+         if (FileExists(SelfRootDir, FileName)) {
+            AddToolEntry(SelfLoadedImage->DeviceHandle, FileName, L"Make Hybrid MBR", BuiltinIcon(BUILTIN_ICON_TOOL_PART), 'P', FALSE);
+         }
+         break;
+      case TAG_APPLE_RECOVERY:
+         MyFreePool(FileName);
+         FileName = StrDuplicate(L"\\com.apple.recovery.boot\\boot.efi");
+         for (VolumeIndex = 0; VolumeIndex < VolumesCount; VolumeIndex++) {
+            if ((Volumes[VolumeIndex]->RootDir != NULL) && (FileExists(Volumes[VolumeIndex]->RootDir, FileName))) {
+               SPrint(Description, 255, L"Apple Recovery on %s", Volumes[VolumeIndex]->VolName);
+               AddToolEntry(Volumes[VolumeIndex]->DeviceHandle, FileName, Description,
+                            BuiltinIcon(BUILTIN_ICON_TOOL_APPLE_RESCUE), 'R', TRUE);
+            }
+         } // for
+         break;
+      case TAG_MOK_TOOL:
+         j = 0;
+         MyFreePool(FileName);
+         while ((FileName = FindCommaDelimited(MOK_NAMES, j++)) != NULL) {
+            if (FileExists(SelfRootDir, FileName)) {
                SPrint(Description, 255, L"MOK Key Manager at %s", FileName);
                AddToolEntry(SelfLoadedImage->DeviceHandle, FileName, Description,
                             BuiltinIcon(BUILTIN_ICON_TOOL_MOK_TOOL), 'S', FALSE);
             }
-            break;
-      } // switch()
-      MyFreePool(FileName);
-      FileName = NULL;
+         } // while
+         if (FileExists(SelfDir, L"MokManager.efi")) {
+            MyFreePool(FileName);
+            FileName = SelfDirPath ? StrDuplicate(SelfDirPath) : NULL;
+            MergeStrings(&FileName, L"\\MokManager.efi", 0);
+            SPrint(Description, 255, L"MOK Key Manager at %s", FileName);
+            AddToolEntry(SelfLoadedImage->DeviceHandle, FileName, Description,
+                         BuiltinIcon(BUILTIN_ICON_TOOL_MOK_TOOL), 'S', FALSE);
+         }
+         break;
+   } // switch()
+   MyFreePool(FileName);
+} // static VOID ScanForTool()
+
+// Tool entries from the preview of the cached menu, and how many of them
+// each "showtools" item added; see KeepToolEntries().
+static REFIT_MENU_ENTRY **KeptTools = NULL;
+static UINTN            KeptToolCount = 0;
+static UINTN            ToolEntryCounts[NUM_TOOLS];
+
+// Add the second-row tags containing built-in and external tools (EFI shell,
+// reboot, etc.). Tools kept from the preview are reused, apart from Apple
+// Recovery entries, which depend on the volumes found by the latest scan.
+static VOID ScanForTools(VOID) {
+   UINTN i, j, Kept = 0, Before;
+
+   for (i = 0; i < NUM_TOOLS; i++) {
+      if ((KeptTools != NULL) && (GlobalConfig.ShowTools[i] != TAG_APPLE_RECOVERY)) {
+         for (j = 0; j < ToolEntryCounts[i]; j++)
+            AddMenuEntry(&MainMenu, KeptTools[Kept++]);
+      } else {
+         for (j = 0; (KeptTools != NULL) && (j < ToolEntryCounts[i]); j++) {
+            egReleaseIcon(KeptTools[Kept]->Image);
+            MyFreePool(KeptTools[Kept++]);
+         } // for
+         Before = MainMenu.EntryCount;
+         ScanForTool(GlobalConfig.ShowTools[i]);
+         ToolEntryCounts[i] = MainMenu.EntryCount - Before;
+      } // if/else
+   } // for
+   MyFreePool(KeptTools);
+   KeptTools = NULL;
+   KeptToolCount = 0;
+} // static VOID ScanForTools()
+
+// Take the tool entries, which follow the first FirstTool entries of the
+// main menu, out of the menu, so that ScanForTools() can reuse them.
+static VOID KeepToolEntries(IN UINTN FirstTool) {
+   UINTN i;
+
+   for (i = FirstTool; i < MainMenu.EntryCount; i++)
+      AddListElement((VOID ***) &KeptTools, &KeptToolCount, MainMenu.Entries[i]);
+   MainMenu.EntryCount = FirstTool;
+} // static VOID KeepToolEntries()
+
+// Returns TRUE if Volume's name or GPT unique partition GUID matches Name.
+static BOOLEAN VolumeHasName(IN REFIT_VOLUME *Volume, IN CHAR16 *Name) {
+   CHAR16   *GuidString;
+   BOOLEAN  Found = FALSE;
+
+   if ((Volume == NULL) || (Name == NULL))
+      return FALSE;
+   if ((Volume->VolName != NULL) && (StriCmp(Volume->VolName, Name) == 0))
+      return TRUE;
+   GuidString = GuidAsString(&(Volume->PartGuid));
+   if (GuidString != NULL) {
+      Found = (StriCmp(GuidString, Name) == 0);
+      MyFreePool(GuidString);
+   }
+   return Found;
+} // static BOOLEAN VolumeHasName()
+
+// Returns TRUE if every volume named in the "wait_for_volumes" list is
+// present in either Volumes or the NewCount-element NewVolumes list. If
+// the list is empty, returns FALSE, since then there's no way to know when
+// all the expected volumes are present.
+static BOOLEAN ExpectedVolumesPresent(IN REFIT_VOLUME **NewVolumes, IN UINTN NewCount) {
+   CHAR16   *Name;
+   UINTN    i = 0, j;
+   BOOLEAN  Found, AllFound = TRUE;
+
+   if ((GlobalConfig.WaitForVolumes == NULL) || (GlobalConfig.WaitForVolumes[0] == L'\0'))
+      return FALSE;
+
+   while (AllFound && ((Name = FindCommaDelimited(GlobalConfig.WaitForVolumes, i++)) != NULL)) {
+      Found = FALSE;
+      for (j = 0; !Found && (j < VolumesCount); j++)
+         Found = VolumeHasName(Volumes[j], Name);
+      for (j = 0; !Found && (j < NewCount); j++)
+         Found = VolumeHasName(NewVolumes[j], Name);
+      AllFound = Found;
+      MyFreePool(Name);
+   } // while
+   return AllFound;
+} // static BOOLEAN ExpectedVolumesPresent()
+
+// Wait up to GlobalConfig.ScanDelay seconds for slow disks to appear. This
+// watches for new BlockIO and filesystem handles, connects drivers to new
+// disks and probes new filesystems as they arrive, and stops as soon as all
+// the volumes in the "wait_for_volumes" list are present. The probes serve
+// only to check names: nothing is scanned for boot loaders here, and with
+// no "wait_for_volumes" list the wait always lasts the full period. Volumes
+// may also have appeared before the watch began, or need a full driver
+// connection to be seen, so the caller should always rescan afterwards.
+static VOID WaitForVolumes(VOID) {
+   EFI_STATUS    Status;
+   EFI_EVENT     Events[3] = { NULL, NULL, NULL };
+   VOID          *BlockIoRegistration = NULL, *FsRegistration = NULL;
+   EFI_HANDLE    Handle;
+   UINTN         Index, HandleSize, NewCount = 0;
+   REFIT_VOLUME  **NewVolumes = NULL, *Volume;
+   UINT64        StartTime;
+   BOOLEAN       Done = FALSE;
+
+   if (ExpectedVolumesPresent(NULL, 0))
+      return;
+
+   StartTime = GetTimeStampUSec();
+   // Events[0] is the deadline; Events[1] and Events[2] are signalled when
+   // BlockIO and SimpleFileSystem protocols (respectively) are installed.
+   Status = refit_call5_wrapper(BS->CreateEvent, EVT_TIMER, TPL_CALLBACK, NULL, NULL, &Events[0]);
+   if (!EFI_ERROR(Status))
+      Status = refit_call5_wrapper(BS->CreateEvent, 0, TPL_CALLBACK, NULL, NULL, &Events[1]);
+   if (!EFI_ERROR(Status))
+      Status = refit_call5_wrapper(BS->CreateEvent, 0, TPL_CALLBACK, NULL, NULL, &Events[2]);
+   if (!EFI_ERROR(Status))
+      Status = refit_call3_wrapper(BS->RegisterProtocolNotify, &BlockIoProtocol, Events[1], &BlockIoRegistration);
+   if (!EFI_ERROR(Status))
+      Status = refit_call3_wrapper(BS->RegisterProtocolNotify, &FileSystemProtocol, Events[2], &FsRegistration);
+   if (!EFI_ERROR(Status))
+      Status = refit_call3_wrapper(BS->SetTimer, Events[0], TimerRelative, (UINT64) GlobalConfig.ScanDelay * 10000000);
+
+   if (EFI_ERROR(Status)) { // fall back on a plain delay
+      for (Index = 0; Index < GlobalConfig.ScanDelay; Index++)
+         refit_call1_wrapper(BS->Stall, 1000000);
+      Done = TRUE;
+   } // if
+
+   while (!Done) {
+      Status = refit_call3_wrapper(BS->WaitForEvent, 3, Events, &Index);
+      if (EFI_ERROR(Status) || (Index == 0))
+         break; // deadline reached
+
+      // Connect drivers to new disks; this may in turn install new
+      // filesystems, so check for those afterwards....
+      HandleSize = sizeof(EFI_HANDLE);
+      while (refit_call5_wrapper(BS->LocateHandle, ByRegisterNotify, NULL, BlockIoRegistration,
+                                 &HandleSize, &Handle) == EFI_SUCCESS) {
+         refit_call4_wrapper(BS->ConnectController, Handle, NULL, NULL, TRUE);
+      } // while
+
+      HandleSize = sizeof(EFI_HANDLE);
+      while (refit_call5_wrapper(BS->LocateHandle, ByRegisterNotify, NULL, FsRegistration,
+                                 &HandleSize, &Handle) == EFI_SUCCESS) {
+         Volume = AllocateZeroPool(sizeof(REFIT_VOLUME));
+         if (Volume != NULL) {
+            Volume->DeviceHandle = Handle;
+            ScanVolume(Volume);
+            MyFreePool(Volume->ProbeBuffer);
+            Volume->ProbeBuffer = NULL;
+            AddListElement((VOID ***) &NewVolumes, &NewCount, Volume);
+         } // if
+      } // while
+      Done = ExpectedVolumesPresent(NewVolumes, NewCount);
+   } // while
+
+   for (Index = 0; Index < 3; Index++) {
+      if (Events[Index] != NULL)
+         refit_call1_wrapper(BS->CloseEvent, Events[Index]);
    } // for
-} // static VOID ScanForTools
+   RecordTiming(L"wait for volumes", StartTime);
+
+   // the volumes were probed only to check their names; the rescan finds them again
+   for (Index = 0; Index < NewCount; Index++)
+      FreeVolume(NewVolumes[Index]);
+   MyFreePool(NewVolumes);
+} // static VOID WaitForVolumes()
+
+// Returns TRUE if Entry is the main menu entry that's booted when the menu
+// times out.
+static BOOLEAN IsDefaultEntry(IN REFIT_MENU_ENTRY *Entry) {
+   INTN Index = -1;
+
+   if (GlobalConfig.DefaultSelection != NULL)
+      Index = FindMenuShortcutEntry(&MainMenu, GlobalConfig.DefaultSelection);
+   if (Index < 0)
+      Index = 0;
+   return ((Index < MainMenu.EntryCount) && (MainMenu.Entries[Index] == Entry));
+} // static BOOLEAN IsDefaultEntry()
+
+// Returns TRUE if Entry's boot loader file still exists on the filesystem
+// identified by its device path.
+static BOOLEAN LoaderFileExists(IN LOADER_ENTRY *Entry) {
+   EFI_FILE          *FileHandle;
+   EFI_FILE_INFO     *FileInfo;
+   BOOLEAN           Found = FALSE;
+
+   FileHandle = OpenLoaderFile(Entry->DevicePath, Entry->LoaderPath);
+   if (FileHandle != NULL) {
+      FileInfo = LibFileInfo(FileHandle);
+      Found = ((FileInfo != NULL) && !(FileInfo->Attribute & EFI_FILE_DIRECTORY));
+      MyFreePool(FileInfo);
+      refit_call1_wrapper(FileHandle->Close, FileHandle);
+   } // if
+   return Found;
+} // static BOOLEAN LoaderFileExists()
+
+// Boot the loader that was last booted as the default entry, without
+// scanning for boot loaders or building the menu, provided that the
+// express_boot option is set, the menu has a timeout, no key is waiting,
+// the loader still matches default_selection, and its file still exists.
+// Returns if any of those conditions isn't met or if the loader returns.
+static VOID ExpressBoot(VOID) {
+   EFI_STATUS         Status;
+   EFI_INPUT_KEY      Key;
+   LOADER_ENTRY       *Entry;
+   REFIT_MENU_SCREEN  OneEntryMenu;
+   BOOLEAN            Matches = TRUE;
+   UINT64             StartTime;
+
+   if (!GlobalConfig.ExpressBoot || (GlobalConfig.Timeout == 0))
+      return;
+   Status = refit_call2_wrapper(ST->ConIn->ReadKeyStroke, ST->ConIn, &Key);
+   if (Status != EFI_NOT_READY)
+      return; // user is pressing a key, so wants the menu
+
+   StartTime = GetTimeStampUSec();
+   Entry = LoadExpressBootEntry();
+   if (Entry == NULL)
+      return;
+   if (GlobalConfig.DefaultSelection != NULL) {
+      ZeroMem(&OneEntryMenu, sizeof(REFIT_MENU_SCREEN));
+      OneEntryMenu.EntryCount = 1;
+      OneEntryMenu.Entries = (REFIT_MENU_ENTRY **) &Entry;
+      Matches = (FindMenuShortcutEntry(&OneEntryMenu, GlobalConfig.DefaultSelection) == 0);
+   } // if
+   Matches = Matches && LoaderFileExists(Entry);
+   RecordTiming(L"express boot check", StartTime);
+   if (Matches)
+      StartLoader(Entry);
+   FreeCachedEntry(Entry);
+} // static VOID ExpressBoot()
+
+// Remove all the entries from Menu, releasing their icons and badges. If Cached is
+// TRUE, the entries came from AddCachedLoaderEntries() and are freed in full.
+static VOID ClearMenuEntries(IN OUT REFIT_MENU_SCREEN *Menu, IN BOOLEAN Cached) {
+   UINTN i;
+
+   for (i = 0; i < Menu->EntryCount; i++) {
+      egReleaseIcon(Menu->Entries[i]->Image);
+      egReleaseIcon(Menu->Entries[i]->BadgeImage);
+      if (Cached)
+         FreeCachedEntry((LOADER_ENTRY *) Menu->Entries[i]);
+      else
+         MyFreePool(Menu->Entries[i]);
+   } // for
+   MyFreePool(Menu->Entries);
+   Menu->Entries = NULL;
+   Menu->EntryCount = 0;
+} // static VOID ClearMenuEntries()
 
 // Rescan for boot loaders
 VOID RescanAll(VOID) {
    EG_PIXEL           BGColor;
+   UINT64             StartTime;
 
+   StartTime = GetTimeStampUSec();
    BGColor.b = 255;
    BGColor.g = 175;
    BGColor.r = 100;
    BGColor.a = 0;
    egDisplayMessage(L"Scanning for new boot loaders; please wait....", &BGColor);
-   FreeList((VOID ***) &(MainMenu.Entries), &MainMenu.EntryCount);
-   MainMenu.Entries = NULL;
-   MainMenu.EntryCount = 0;
+   ClearMenuEntries(&MainMenu, FALSE);
    ReadConfig(CONFIG_FILE_NAME);
    ConnectAllDriversToAllControllers();
    ScanVolumes();
+   egFlushIconCache();   // after ScanVolumes() drops the old volumes' badges
    ScanForBootloaders();
    ScanForTools();
    SetupScreen();
+   if (GlobalConfig.UseScanCache)
+      UpdateScanCache(&MainMenu);
+   RecordTiming(L"RescanAll", StartTime);
 } // VOID RescanAll()
 
 #ifdef __MAKEWITH_TIANO
@@ -2101,37 +2922,71 @@ efi_main (EFI_HANDLE ImageHandle, EFI_SYSTEM_TABLE *SystemTable)
     BOOLEAN            MainLoopRunning = TRUE;
     BOOLEAN            MokProtocol;
     REFIT_MENU_ENTRY   *ChosenEntry;
-    UINTN              MenuExit, i;
+    UINTN              MenuExit, FirstTool;
     CHAR16             *Selection = NULL;
     EG_PIXEL           BGColor;
+    UINT64             BootStartTime, PhaseStartTime;
 
     // bootstrap
     InitializeLib(ImageHandle, SystemTable);
+    InitTimeStamps();
+    BootStartTime = GetTimeStampUSec();
+    ExportLoaderTime(L"LoaderTimeInitUSec");
     Status = InitRefitLib(ImageHandle);
     if (EFI_ERROR(Status))
         return Status;
+    RecordTiming(L"InitRefitLib", BootStartTime);
 
     // read configuration
     CopyMem(GlobalConfig.ScanFor, "ieom      ", NUM_SCAN_OPTIONS);
     FindLegacyBootType();
     if (GlobalConfig.LegacyType == LEGACY_TYPE_MAC)
        CopyMem(GlobalConfig.ScanFor, "ihebocm   ", NUM_SCAN_OPTIONS);
+    GlobalConfig.DontScanPartTypes = StrDuplicate(DONT_SCAN_PART_TYPES);
+    PhaseStartTime = GetTimeStampUSec();
     ScanVolumes();
+    RecordTiming(L"ScanVolumes (before reading config)", PhaseStartTime);
+    PhaseStartTime = GetTimeStampUSec();
     ReadConfig(CONFIG_FILE_NAME);
+    RecordTiming(L"ReadConfig", PhaseStartTime);
 
+    PhaseStartTime = GetTimeStampUSec();
     InitScreen();
+    RecordTiming(L"InitScreen", PhaseStartTime);
     WarnIfLegacyProblems();
     MainMenu.TimeoutSeconds = GlobalConfig.Timeout;
+    MainMenu.IdleFunc = PreloadLoaderImage;
 
     // disable EFI watchdog timer
     refit_call4_wrapper(BS->SetWatchdogTimer, 0x0000, 0x0000, 0x0000, NULL);
 
     // further bootstrap (now with config available)
+    PhaseStartTime = GetTimeStampUSec();
     MokProtocol = SecureBootSetup();
+    RecordTiming(L"SecureBootSetup", PhaseStartTime);
+    PhaseStartTime = GetTimeStampUSec();
     LoadDrivers();
+    RecordTiming(L"LoadDrivers", PhaseStartTime);
+    ExpressBoot();
+
+    // show the loaders found on the previous boot while the real scan runs
+    if (GlobalConfig.UseScanCache && LoadScanCache() && (AddCachedLoaderEntries(&MainMenu) > 0)) {
+       AssignShortcutDigits();
+       FirstTool = MainMenu.EntryCount;
+       ScanForTools();
+       SetupScreen();
+       PreviewMainMenu(&MainMenu, GlobalConfig.DefaultSelection);
+       KeepToolEntries(FirstTool);
+       ClearMenuEntries(&MainMenu, TRUE);
+    } // if
+
     ScanForBootloaders();
+    PhaseStartTime = GetTimeStampUSec();
     ScanForTools();
+    RecordTiming(L"ScanForTools", PhaseStartTime);
+    PhaseStartTime = GetTimeStampUSec();
     SetupScreen();
+    RecordTiming(L"SetupScreen", PhaseStartTime);
 
     if (GlobalConfig.ScanDelay > 0) {
        BGColor.b = 255;
@@ -2139,23 +2994,33 @@ efi_main (EFI_HANDLE ImageHandle, EFI_SYSTEM_TABLE *SystemTable)
        BGColor.r = 100;
        BGColor.a = 0;
        egDisplayMessage(L"Pausing before disk scan; please wait....", &BGColor);
-       for (i = 0; i < GlobalConfig.ScanDelay; i++)
-          refit_call1_wrapper(BS->Stall, 1000000);
-       RescanAll();
-    } // if
+       WaitForVolumes();
+       RescanAll();   // also updates the scan cache
+    } else if (GlobalConfig.UseScanCache) {
+       UpdateScanCache(&MainMenu);
+    } // if/else
 
     if (GlobalConfig.DefaultSelection)
        Selection = StrDuplicate(GlobalConfig.DefaultSelection);
 
+    RecordTiming(L"startup to main menu", BootStartTime);
     while (MainLoopRunning) {
+        PhaseStartTime = GetTimeStampUSec();
         MenuExit = RunMainMenu(&MainMenu, Selection, &ChosenEntry);
+        RecordTiming(L"main menu (user wait)", PhaseStartTime);
 
         // The Escape key triggers a re-scan operation....
         if (MenuExit == MENU_EXIT_ESCAPE) {
+            DiscardPreload();
+            ResetTimingLog();
             RescanAll();
             continue;
         }
 
+        // a preloaded boot loader is wanted only if it's being booted
+        if (ChosenEntry->Tag != TAG_LOADER)
+            DiscardPreload();
+
         switch (ChosenEntry->Tag) {
 
             case TAG_REBOOT:    // Reboot
@@ -2175,6 +3040,8 @@ efi_main (EFI_HANDLE ImageHandle, EFI_SYSTEM_TABLE *SystemTable)
                 break;
 
             case TAG_LOADER:   // Boot OS via .EFI loader
+                if (GlobalConfig.ExpressBoot && IsDefaultEntry(ChosenEntry))
+                   SaveExpressBootEntry((LOADER_ENTRY *)ChosenEntry);
                 StartLoader((LOADER_ENTRY *)ChosenEntry);
                 break;
 
@@ -69,16 +69,16 @@ typedef VOID (*MENU_STYLE_FUNC)(IN REFIT_MENU_SCREEN *Screen, IN SCROLL_STATE *S
 static CHAR16 ArrowUp[2] = { ARROW_UP, 0 };
 static CHAR16 ArrowDown[2] = { ARROW_DOWN, 0 };
 
-// Text and icon spacing constants....
-#define TEXT_YMARGIN (2)
+// Text and icon spacing constants, in pixels at ui_scale (GlobalConfig.Scale) 1....
+#define TEXT_YMARGIN (2 * GlobalConfig.Scale)
 //#define TEXT_XMARGIN (8)
 //#define TEXT_LINE_HEIGHT (FONT_CELL_HEIGHT + TEXT_YMARGIN * 2)
-#define TITLEICON_SPACING (16)
+#define TITLEICON_SPACING (16 * GlobalConfig.Scale)
 
-#define ROW0_TILESIZE (144)
-#define ROW1_TILESIZE (64)
-#define TILE_XSPACING (8)
-#define TILE_YSPACING (16)
+#define ROW0_TILESIZE (144 * GlobalConfig.Scale)
+#define ROW1_TILESIZE (64 * GlobalConfig.Scale)
+#define TILE_XSPACING (8 * GlobalConfig.Scale)
+#define TILE_YSPACING (16 * GlobalConfig.Scale)
 
 // Alignment values for PaintIcon()
 #define ALIGN_RIGHT 1
@@ -105,8 +105,11 @@ static VOID InitSelection(VOID)
     if (GlobalConfig.SelectionSmallFileName != NULL) {
         SelectionImages[1] = egLoadImage(SelfDir, GlobalConfig.SelectionSmallFileName, TRUE);
     }
+    if (SelectionImages[1] == NULL)
+        SelectionImages[1] = egLoadAtlasImage(L"selection_small");
     if (SelectionImages[1] == NULL)
         SelectionImages[1] = egPrepareEmbeddedImage(&egemb_back_selected_small, TRUE);
+    SelectionImages[1] = egApplyScale(SelectionImages[1], ROW1_TILESIZE, ROW1_TILESIZE);
     SelectionImages[1] = egEnsureImageSize(SelectionImages[1], ROW1_TILESIZE, ROW1_TILESIZE, &MenuBackgroundPixel);
     if (SelectionImages[1] == NULL)
         return;
@@ -114,6 +117,13 @@ static VOID InitSelection(VOID)
     // load big selection image
     if (GlobalConfig.SelectionBigFileName != NULL) {
         SelectionImages[0] = egLoadImage(SelfDir, GlobalConfig.SelectionBigFileName, TRUE);
+        SelectionImages[0] = egApplyScale(SelectionImages[0], ROW0_TILESIZE, ROW0_TILESIZE);
+        SelectionImages[0] = egEnsureImageSize(SelectionImages[0], ROW0_TILESIZE, ROW0_TILESIZE, &MenuBackgroundPixel);
+    }
+    // a theme's own small selection image takes precedence over the atlas's big one
+    if ((SelectionImages[0] == NULL) && (GlobalConfig.SelectionSmallFileName == NULL)) {
+        SelectionImages[0] = egLoadAtlasImage(L"selection_big");
+        SelectionImages[0] = egApplyScale(SelectionImages[0], ROW0_TILESIZE, ROW0_TILESIZE);
         SelectionImages[0] = egEnsureImageSize(SelectionImages[0], ROW0_TILESIZE, ROW0_TILESIZE, &MenuBackgroundPixel);
     }
     if (SelectionImages[0] == NULL) {
@@ -125,6 +135,7 @@ static VOID InitSelection(VOID)
             SelectionImages[1] = NULL;
             return;
         }
+        SelectionImages[0]->Premultiplied = SelectionImages[1]->Premultiplied;
 
         DestPtr = SelectionImages[0]->PixelData;
         SrcPtr  = SelectionImages[1]->PixelData;
@@ -305,7 +316,7 @@ VOID AddMenuEntry(IN REFIT_MENU_SCREEN *Screen, IN REFIT_MENU_ENTRY *Entry)
 }
 
 
-static INTN FindMenuShortcutEntry(IN REFIT_MENU_SCREEN *Screen, IN CHAR16 *Shortcut)
+INTN FindMenuShortcutEntry(IN REFIT_MENU_SCREEN *Screen, IN CHAR16 *Shortcut)
 {
     UINTN i;
 
@@ -367,6 +378,7 @@ static UINTN RunGenericMenu(IN REFIT_MENU_SCREEN *Screen, IN MENU_STYLE_FUNC Sty
     CHAR16 TimeoutMessage[256];
     CHAR16 KeyAsString[2];
     UINTN MenuExit;
+    UINT64 IdleStart, IdleTime, IdleTicks;
 
     if (Screen->TimeoutSeconds > 0) {
         HaveTimeout = TRUE;
@@ -402,7 +414,8 @@ static UINTN RunGenericMenu(IN REFIT_MENU_SCREEN *Screen, IN MENU_STYLE_FUNC Sty
             }
         }
 
-        // read key press (and wait for it if applicable)
+        // show what's been drawn, then read key press (and wait for it if applicable)
+        egFlush();
         Status = refit_call2_wrapper(ST->ConIn->ReadKeyStroke, ST->ConIn, &key);
         if (Status == EFI_NOT_READY) {
             if (HaveTimeout && TimeoutCountdown == 0) {
@@ -410,8 +423,21 @@ static UINTN RunGenericMenu(IN REFIT_MENU_SCREEN *Screen, IN MENU_STYLE_FUNC Sty
                 MenuExit = MENU_EXIT_TIMEOUT;
                 break;
             } else if (HaveTimeout) {
-                refit_call1_wrapper(BS->Stall, 100000); // Pause for 100 ms
-                TimeoutCountdown--;
+                // Let the screen's idle function (if any) use part of each
+                // 100 ms tick for the entry that will be booted on timeout.
+                // Work that runs past the tick counts against the timeout,
+                // and the pause then ends on a tick boundary.
+                IdleStart = GetTimeStampUSec();
+                IdleTime = 0;
+                if ((Screen->IdleFunc != NULL) && (State.CurrentSelection >= 0) &&
+                    Screen->IdleFunc(Screen->Entries[State.CurrentSelection]))
+                    IdleTime = GetTimeStampUSec() - IdleStart;
+                IdleTicks = (IdleTime + 99999) / 100000;
+                if (IdleTicks == 0)
+                    IdleTicks = 1;
+                if (IdleTime < IdleTicks * 100000)
+                    refit_call1_wrapper(BS->Stall, (UINTN) (IdleTicks * 100000 - IdleTime)); // Pause for rest of tick
+                TimeoutCountdown = (TimeoutCountdown > IdleTicks) ? TimeoutCountdown - (UINTN) IdleTicks : 0;
             } else
                 refit_call3_wrapper(BS->WaitForEvent, 1, &ST->ConIn->WaitForKey, &index);
             continue;
@@ -651,43 +677,14 @@ inline static UINTN TextLineHeight(VOID) {
 static VOID DrawText(IN CHAR16 *Text, IN BOOLEAN Selected, IN UINTN FieldWidth, IN UINTN XPos, IN UINTN YPos)
 {
    EG_IMAGE *TextBuffer;
-   EG_PIXEL Bg;
-
-   TextBuffer = egCreateImage(FieldWidth, TextLineHeight(), FALSE);
 
-   egFillImage(TextBuffer, &MenuBackgroundPixel);
-   Bg = MenuBackgroundPixel;
-   if (Selected) {
-       // draw selection bar background
-       egFillImageArea(TextBuffer, 0, 0, FieldWidth, TextBuffer->Height, &SelectionBackgroundPixel);
-       Bg = SelectionBackgroundPixel;
-   }
-
-   // render the text
-   egRenderText(Text, TextBuffer, egGetFontCellWidth(), TEXT_YMARGIN, (Bg.r + Bg.g + Bg.b) / 3);
-   egDrawImageWithTransparency(TextBuffer, NULL, XPos, YPos, TextBuffer->Width, TextBuffer->Height);
-//    BltImage(TextBuffer, XPos, YPos);
+   // render the text over the menu or selection bar background
+   TextBuffer = egRenderTextRun(Text, NULL, Selected ? &SelectionBackgroundPixel : &MenuBackgroundPixel,
+                                0, 0, FieldWidth, TextLineHeight(), egGetFontCellWidth(), TEXT_YMARGIN);
+   if (TextBuffer != NULL)
+      egDrawImageWithTransparency(TextBuffer, NULL, XPos, YPos, TextBuffer->Width, TextBuffer->Height);
 }
 
-// Finds the average brightness of the input Image.
-// NOTE: Passing an Image that covers the whole screen can strain the
-// capacity of a UINTN on a 32-bit system with a very large display.
-// Using UINT64 instead is unworkable, since the code won't compile
-// on a 32-bit system. As the intended use for this function is to handle
-// a single text string's background, this shouldn't be a problem, but it
-// may need addressing if it's applied more broadly....
-static UINT8 AverageBrightness(EG_IMAGE *Image) {
-   UINTN i;
-   UINTN Sum = 0;
-
-   if (Image != NULL) {
-      for (i = 0; i < (Image->Width * Image->Height); i++) {
-         Sum += (Image->PixelData[i].r + Image->PixelData[i].g + Image->PixelData[i].b);
-      }
-   } // if
-   return (UINT8) (Sum / (Image->Width * Image->Height * 3));
-} // UINT8 AverageBrightness()
-
 // Display text against the screen's background image. Special case: If Text is NULL
 // or 0-length, clear the line. Does NOT indent the text or reposition it relative
 // to the specified XPos and YPos values.
@@ -705,16 +702,13 @@ static VOID DrawTextWithTransparency(IN CHAR16 *Text, IN UINTN XPos, IN UINTN YP
        XPos = 0;
     }
 
-    TextBuffer = egCropImage(GlobalConfig.ScreenBackground, XPos, YPos, TextWidth, TextLineHeight());
+    // render the text over the background (or reuse the last rendering of it)
+    TextBuffer = egRenderTextRun(Text, GlobalConfig.ScreenBackground, NULL, XPos, YPos, TextWidth, TextLineHeight(), 0, 0);
     if (TextBuffer == NULL) {
        Print(L"Error: NULL TextBuffer in DrawTextWithTransparency()\n");
        return;
     }
-
-    // render the text
-    egRenderText(Text, TextBuffer, 0, 0, AverageBrightness(TextBuffer));
     egDrawImageWithTransparency(TextBuffer, NULL, XPos, YPos, TextBuffer->Width, TextBuffer->Height);
-    egFreeImage(TextBuffer);
 }
 
 // Compute the size & position of the window that will hold a subscreen's information.
@@ -871,10 +865,21 @@ static VOID GraphicsMenuStyle(IN REFIT_MENU_SCREEN *Screen, IN SCROLL_STATE *Sta
 // graphical main menu style
 //
 
+// Find and load Entry's icon and badge, if that was put off until it was
+// first drawn.
+static VOID LoadMenuEntryImages(IN OUT REFIT_MENU_ENTRY *Entry)
+{
+   if (Entry->LoadImages != NULL) {
+      Entry->LoadImages(Entry);
+      Entry->LoadImages = NULL;
+   }
+} // static VOID LoadMenuEntryImages()
+
 static VOID DrawMainMenuEntry(REFIT_MENU_ENTRY *Entry, BOOLEAN selected, UINTN XPos, UINTN YPos)
 {
    EG_IMAGE *Background;
 
+   LoadMenuEntryImages(Entry);
    if (SelectionImages != NULL) {
       if (selected) {
          Background = egCropImage(GlobalConfig.ScreenBackground, XPos, YPos,
@@ -959,16 +964,20 @@ static VOID PaintSelection(IN REFIT_MENU_SCREEN *Screen, IN SCROLL_STATE *State,
 // edge if Alignment == ALIGN_LEFT, and along the right edge if
 // Alignment == ALIGN_RIGHT
 static VOID PaintIcon(IN EG_EMBEDDED_IMAGE *BuiltInIcon, IN CHAR16 *ExternalFilename, UINTN PosX, UINTN PosY, UINTN Alignment) {
-   EG_IMAGE *Icon = NULL;
+   EG_IMAGE *Icon = NULL, *BuiltInImage = NULL;
 
    Icon = egFindIcon(ExternalFilename, 48);
    if (Icon == NULL)
-      Icon = egPrepareEmbeddedImage(BuiltInIcon, TRUE);
+      Icon = BuiltInImage = egApplyScale(egPrepareEmbeddedImage(BuiltInIcon, TRUE), UGAWidth, UGAHeight);
    if (Icon != NULL) {
       if (Alignment == ALIGN_RIGHT)
          PosX -= Icon->Width;
       egDrawImageWithTransparency(Icon, NULL, PosX, PosY - (Icon->Height / 2), Icon->Width, Icon->Height);
    }
+   if (BuiltInImage != NULL)
+      egFreeImage(BuiltInImage);
+   else
+      egReleaseIcon(Icon);
 } // static VOID ()
 
 inline UINTN ComputeRow0PosY(VOID) {
@@ -982,8 +991,8 @@ static VOID PaintArrows(SCROLL_STATE *State, UINTN PosX, UINTN PosY, UINTN row0L
    UINTN Width, Height, RightX, AdjPosY;
 
    // NOTE: Assume that left and right arrows are of the same size....
-   Width = egemb_arrow_left.Width;
-   Height = egemb_arrow_left.Height;
+   Width = egemb_arrow_left.Width * GlobalConfig.Scale;
+   Height = egemb_arrow_left.Height * GlobalConfig.Scale;
    RightX = (UGAWidth + (ROW0_TILESIZE + TILE_XSPACING) * State->MaxVisible) / 2 + TILE_XSPACING;
    AdjPosY = PosY - (Height / 2);
 
@@ -1154,6 +1163,10 @@ UINTN RunMainMenu(IN REFIT_MENU_SCREEN *Screen, IN CHAR16* DefaultSelection, OUT
 
         if (MenuExit == MENU_EXIT_DETAILS) {
             if (TempChosenEntry->SubScreen != NULL) {
+               if (AllowGraphicsMode && (TempChosenEntry->SubScreen->TitleImage == NULL)) {
+                  LoadMenuEntryImages(TempChosenEntry);
+                  TempChosenEntry->SubScreen->TitleImage = TempChosenEntry->Image;
+               }
                MenuExit = RunGenericMenu(TempChosenEntry->SubScreen, Style, &DefaultSubmenuIndex, &TempChosenEntry);
                if (MenuExit == MENU_EXIT_ESCAPE || TempChosenEntry->Tag == TAG_RETURN)
                    MenuExit = 0;
@@ -1171,3 +1184,30 @@ UINTN RunMainMenu(IN REFIT_MENU_SCREEN *Screen, IN CHAR16* DefaultSelection, OUT
         *ChosenEntry = TempChosenEntry;
     return MenuExit;
 } /* UINTN RunMainMenu() */
+
+// Paint the main menu as RunMainMenu() would initially, but return at once
+// without waiting for a key. Used to show the boot loaders cached from the
+// previous boot while the real scan proceeds.
+VOID PreviewMainMenu(IN REFIT_MENU_SCREEN *Screen, IN CHAR16 *DefaultSelection)
+{
+    SCROLL_STATE State;
+    MENU_STYLE_FUNC MainStyle = TextMenuStyle;
+    INTN DefaultEntryIndex = -1;
+
+    if (Screen->EntryCount == 0)
+        return;
+    if (DefaultSelection != NULL)
+        DefaultEntryIndex = FindMenuShortcutEntry(Screen, DefaultSelection);
+    if (AllowGraphicsMode)
+        MainStyle = MainMenuStyle;
+
+    MainStyle(Screen, &State, MENU_FUNCTION_INIT, NULL);
+    IdentifyRows(&State, Screen);
+    if (DefaultEntryIndex >= 0 && DefaultEntryIndex <= State.MaxIndex) {
+        State.CurrentSelection = DefaultEntryIndex;
+        UpdateScroll(&State, SCROLL_NONE);
+    }
+    MainStyle(Screen, &State, MENU_FUNCTION_PAINT_ALL, NULL);
+    MainStyle(Screen, &State, MENU_FUNCTION_CLEANUP, NULL);
+    egFlush();   // show the preview during the scan that follows
+} /* VOID PreviewMainMenu() */
@@ -0,0 +1,249 @@
+/*
+ * refind/pattern.c
+ * Precompiled filename patterns
+ *
+ * Copyright (c) 2013 Roderick W. Smith
+ * All rights reserved.
+ *
+ * This program is distributed under the terms of the GNU General Public
+ * License (GPL) version 3 (GPLv3), a copy of which must be distributed
+ * with this source code or binaries made from it.
+ *
+ */
+
+// Directory scans compare every entry against comma-delimited lists of
+// patterns ("*.efi,*.EFI", "vmlinuz*,bzImage*", the dont_scan_files list,
+// and so on). Splitting those lists, duplicating each element, and handing
+// it to the Unicode Collation protocol for each directory entry is slow, so
+// the lists are instead compiled once into case-folded PATTERN_LISTs, which
+// can be matched without allocating memory. Wildcards are those of the
+// Unicode Collation protocol's MetaiMatch(): "*", "?", and "[...]" sets,
+// which may include ranges (as in "[a-z]").
+//
+// This file depends only on basic EFI types and memory allocation, so that
+// it can also be built for the host by test/patbench.c.
+
+#include "pattern.h"
+
+// Ranges of uppercase letters and what to add to each to fold it to
+// lowercase. A Step of 2 covers alternating upper/lowercase pairs, in which
+// only the first letter of each pair (First, First + 2, ...) is uppercase.
+static struct {
+   CHAR16   First, Last;
+   UINT8    Step, Add;
+} FoldRanges[] = {
+   { 0x0041, 0x005A, 1, 0x20 },  // ASCII
+   { 0x00C0, 0x00D6, 1, 0x20 },  // Latin-1
+   { 0x00D8, 0x00DE, 1, 0x20 },
+   { 0x0100, 0x012F, 2, 1    },  // Latin Extended-A
+   { 0x0132, 0x0137, 2, 1    },
+   { 0x0139, 0x0148, 2, 1    },
+   { 0x014A, 0x0177, 2, 1    },
+   { 0x0179, 0x017E, 2, 1    },
+   { 0x0386, 0x0386, 1, 0x26 },  // Greek
+   { 0x0388, 0x038A, 1, 0x25 },
+   { 0x038C, 0x038C, 1, 0x40 },
+   { 0x038E, 0x038F, 1, 0x3F },
+   { 0x0391, 0x03A1, 1, 0x20 },
+   { 0x03A3, 0x03AB, 1, 0x20 },
+   { 0x0400, 0x040F, 1, 0x50 },  // Cyrillic
+   { 0x0410, 0x042F, 1, 0x20 },
+   { 0x0460, 0x0481, 2, 1    },
+   { 0x048A, 0x04BF, 2, 1    },
+   { 0x04C1, 0x04CE, 2, 1    },
+   { 0x04D0, 0x052F, 2, 1    }
+};
+
+// Fold C to lowercase. Handles the letters of ASCII, Latin-1, Latin
+// Extended-A, Greek, and Cyrillic, so patterns match volume labels and
+// filenames in those scripts regardless of case; other characters must
+// match exactly.
+static CHAR16 FoldChar(IN CHAR16 C) {
+   UINTN i;
+
+   if (C < 0x41)
+      return C;
+   if (C <= 0x5A)
+      return C + 0x20;
+   if (C < 0xC0)
+      return C;
+   for (i = 0; i < sizeof(FoldRanges) / sizeof(FoldRanges[0]); i++) {
+      if (C < FoldRanges[i].First)
+         break;
+      if ((C <= FoldRanges[i].Last) && (((C - FoldRanges[i].First) % FoldRanges[i].Step) == 0))
+         return C + FoldRanges[i].Add;
+   } // for
+   if (C == 0x0178) // Latin capital Y with diaeresis
+      return 0x00FF;
+   return C;
+} // static CHAR16 FoldChar()
+
+// Test whether C (already folded) is in the set beginning at Set, which
+// points to a "[" character. Returns the length of the set, including its
+// brackets, if C is a member, or 0 if C isn't a member or if the set is
+// unterminated.
+static UINTN MatchSet(IN CHAR16 *Set, IN CHAR16 C) {
+   CHAR16   *p = Set + 1;
+   BOOLEAN  Found = FALSE;
+
+   while ((*p != 0) && (*p != L']')) {
+      if ((p[1] == L'-') && (p[2] != 0) && (p[2] != L']')) {
+         if ((C >= p[0]) && (C <= p[2]))
+            Found = TRUE;
+         p += 3;
+      } else {
+         if (*p == C)
+            Found = TRUE;
+         p++;
+      } // if/else
+   } // while
+   if ((*p != L']') || !Found)
+      return 0;
+   return (UINTN) (p - Set) + 1;
+} // static UINTN MatchSet()
+
+// Match Name against the folded wildcard pattern Pattern. On a mismatch
+// after a "*", the match resumes one character further into Name from that
+// "*", so the cost is bounded by the product of the two lengths rather
+// than growing exponentially with the number of "*"s.
+static BOOLEAN GlobMatch(IN CHAR16 *Name, IN CHAR16 *Pattern) {
+   CHAR16  *StarPattern = NULL, *StarName = NULL, C;
+   UINTN   SetLength;
+
+   while (*Name != 0) {
+      C = FoldChar(*Name);
+      if (*Pattern == L'*') {
+         StarPattern = ++Pattern;
+         StarName = Name;
+         continue;
+      }
+      if (*Pattern == L'?') {
+         Pattern++;
+         Name++;
+         continue;
+      }
+      if (*Pattern == L'[') {
+         if ((SetLength = MatchSet(Pattern, C)) > 0) {
+            Pattern += SetLength;
+            Name++;
+            continue;
+         }
+      } else if ((*Pattern != 0) && (*Pattern == C)) {
+         Pattern++;
+         Name++;
+         continue;
+      } // if/else
+
+      // mismatch; let the most recent "*" absorb one more character
+      if (StarPattern == NULL)
+         return FALSE;
+      Pattern = StarPattern;
+      Name = ++StarName;
+   } // while
+
+   while (*Pattern == L'*')
+      Pattern++;
+   return (*Pattern == 0);
+} // static BOOLEAN GlobMatch()
+
+// Compare Name with the folded literal Text, case-insensitively.
+static BOOLEAN LiteralMatch(IN CHAR16 *Name, IN CHAR16 *Text) {
+   while ((*Text != 0) && (FoldChar(*Name) == *Text)) {
+      Name++;
+      Text++;
+   }
+   return ((*Name == 0) && (*Text == 0));
+} // static BOOLEAN LiteralMatch()
+
+// Add the patterns in the comma-delimited list Patterns to List. If Literal
+// is TRUE, the patterns are matched as plain (case-insensitive) names, as
+// IsIn() would; otherwise, wildcards in them are honored. Empty elements
+// are ignored.
+VOID AddPatterns(IN OUT PATTERN_LIST *List, IN CHAR16 *Patterns OPTIONAL, IN BOOLEAN Literal) {
+   PATTERN  *NewPatterns;
+   CHAR16   *Start, *End;
+   UINTN    Count = 1, i;
+
+   if ((List == NULL) || (Patterns == NULL) || (*Patterns == 0))
+      return;
+
+   for (End = Patterns; *End != 0; End++) {
+      if (*End == L',')
+         Count++;
+   } // for
+   NewPatterns = AllocateZeroPool((List->Count + Count) * sizeof(PATTERN));
+   if (NewPatterns == NULL)
+      return;
+   if (List->Patterns != NULL) {
+      CopyMem(NewPatterns, List->Patterns, List->Count * sizeof(PATTERN));
+      FreePool(List->Patterns);
+   }
+   List->Patterns = NewPatterns;
+
+   Start = Patterns;
+   do {
+      for (End = Start; (*End != 0) && (*End != L','); End++)
+         ;
+      if (End > Start) {
+         NewPatterns = &(List->Patterns[List->Count]);
+         NewPatterns->Length = (UINTN) (End - Start);
+         NewPatterns->Text = AllocatePool((NewPatterns->Length + 1) * sizeof(CHAR16));
+         if (NewPatterns->Text != NULL) {
+            for (i = 0; i < NewPatterns->Length; i++)
+               NewPatterns->Text[i] = FoldChar(Start[i]);
+            NewPatterns->Text[i] = 0;
+            NewPatterns->IsLiteral = Literal;
+            for (i = 0; !Literal && (i < NewPatterns->Length); i++) {
+               if ((Start[i] == L'*') || (Start[i] == L'?') || (Start[i] == L'['))
+                  break;
+            }
+            if (i == NewPatterns->Length)
+               NewPatterns->IsLiteral = TRUE;
+            List->Count++;
+         } // if
+      } // if
+      Start = End + 1;
+   } while (*End != 0);
+} // VOID AddPatterns()
+
+// Returns TRUE if Name matches any pattern in List.
+BOOLEAN MatchesPatternList(IN CHAR16 *Name, IN PATTERN_LIST *List) {
+   UINTN i;
+
+   if ((Name == NULL) || (List == NULL))
+      return FALSE;
+   for (i = 0; i < List->Count; i++) {
+      if (List->Patterns[i].IsLiteral ? LiteralMatch(Name, List->Patterns[i].Text) :
+                                        GlobMatch(Name, List->Patterns[i].Text))
+         return TRUE;
+   } // for
+   return FALSE;
+} // BOOLEAN MatchesPatternList()
+
+// Free the patterns in List, leaving it empty.
+VOID FreePatternList(IN OUT PATTERN_LIST *List) {
+   UINTN i;
+
+   if (List == NULL)
+      return;
+   for (i = 0; i < List->Count; i++)
+      FreePool(List->Patterns[i].Text);
+   if (List->Patterns != NULL)
+      FreePool(List->Patterns);
+   List->Patterns = NULL;
+   List->Count = 0;
+} // VOID FreePatternList()
+
+// Returns a 32-bit FNV-1a hash of String, case-folded as by the pattern
+// matcher, so that strings that differ only in case hash identically.
+UINT32 FoldedHash(IN CHAR16 *String) {
+   UINT32 Hash = 0x811c9dc5;
+
+   if (String != NULL) {
+      while (*String != 0)
+         Hash = (Hash ^ FoldChar(*String++)) * 0x01000193;
+   }
+   return Hash;
+} // UINT32 FoldedHash()
+
+/* EOF */
@@ -0,0 +1,50 @@
+/*
+ * refind/pattern.h
+ * Precompiled filename patterns
+ *
+ * Copyright (c) 2013 Roderick W. Smith
+ * All rights reserved.
+ *
+ * This program is distributed under the terms of the GNU General Public
+ * License (GPL) version 3 (GPLv3), a copy of which must be distributed
+ * with this source code or binaries made from it.
+ *
+ */
+
+#ifndef __PATTERN_H_
+#define __PATTERN_H_
+
+#ifdef HOST_POSIX
+#include "test/host_efi.h"
+#else
+#ifdef __MAKEWITH_GNUEFI
+#include "efi.h"
+#include "efilib.h"
+#else
+#include "../include/tiano_includes.h"
+#endif
+#endif
+
+// One compiled pattern. Text is case-folded; if IsLiteral is TRUE, it's
+// compared with names as a whole, without interpreting wildcards.
+typedef struct {
+   CHAR16   *Text;
+   UINTN    Length;
+   BOOLEAN  IsLiteral;
+} PATTERN;
+
+// A set of patterns, as compiled from one or more comma-delimited lists.
+// A zeroed structure is a valid empty list.
+typedef struct {
+   UINTN    Count;
+   PATTERN  *Patterns;
+} PATTERN_LIST;
+
+VOID AddPatterns(IN OUT PATTERN_LIST *List, IN CHAR16 *Patterns OPTIONAL, IN BOOLEAN Literal);
+BOOLEAN MatchesPatternList(IN CHAR16 *Name, IN PATTERN_LIST *List);
+VOID FreePatternList(IN OUT PATTERN_LIST *List);
+UINT32 FoldedHash(IN CHAR16 *String);
+
+#endif
+
+/* EOF */
@@ -0,0 +1,354 @@
+/*
+ * refind/scancache.c
+ * Functions to save and restore the list of boot loaders found by a scan
+ *
+ * Copyright (c) 2013 Roderick W. Smith
+ * All rights reserved.
+ *
+ * This program is distributed under the terms of the GNU General Public
+ * License (GPL) version 3 (GPLv3), a copy of which must be distributed
+ * with this source code or binaries made from it.
+ *
+ */
+
+#include "scancache.h"
+#include "lib.h"
+#include "icns.h"
+#include "menu.h"
+#include "../include/refit_call_wrapper.h"
+
+#ifndef __MAKEWITH_GNUEFI
+#define DevicePathSize GetDevicePathSize
+#endif
+
+#define SCAN_CACHE_STRINGS 6
+#define EVEN_SIZE(Size) (((Size) + 1) & ~((UINTN) 1))
+
+// The cache data as read at startup or last written, header included.
+static UINT8 *gScanCache = NULL;
+static UINTN gScanCacheSize = 0;
+
+// Returns TRUE if Size bytes at Data hold a complete cache of the current
+// version with a correct CRC.
+static BOOLEAN ScanCacheIsValid(IN UINT8 *Data, IN UINTN Size) {
+   SCAN_CACHE_HEADER *Header = (SCAN_CACHE_HEADER *) Data;
+   EFI_STATUS        Status;
+   UINT32            Crc = 0;
+
+   if ((Data == NULL) || (Size < sizeof(SCAN_CACHE_HEADER)) || (Header->Signature != SCAN_CACHE_SIGNATURE) ||
+       (Header->Version != SCAN_CACHE_VERSION) || (Header->DataSize != Size - sizeof(SCAN_CACHE_HEADER)))
+      return FALSE;
+   Status = refit_call3_wrapper(BS->CalculateCrc32, Data + sizeof(SCAN_CACHE_HEADER), Header->DataSize, &Crc);
+   return (!EFI_ERROR(Status) && (Crc == Header->DataCrc32));
+} // static BOOLEAN ScanCacheIsValid()
+
+// Read the cache data held in the NVRAM variable VarName. Returns NULL if
+// it's not there or isn't valid cache data.
+static UINT8 * ReadScanCacheVariable(IN CHAR16 *VarName, OUT UINTN *Size) {
+   EFI_STATUS  Status;
+   UINT8       *Data = NULL;
+
+   *Size = 0;
+   Status = refit_call5_wrapper(RT->GetVariable, VarName, &RefindGuid, NULL, Size, NULL);
+   if ((Status == EFI_BUFFER_TOO_SMALL) && ((Data = AllocatePool(*Size)) != NULL)) {
+      Status = refit_call5_wrapper(RT->GetVariable, VarName, &RefindGuid, NULL, Size, Data);
+      if (EFI_ERROR(Status) || !ScanCacheIsValid(Data, *Size)) {
+         MyFreePool(Data);
+         Data = NULL;
+      }
+   } // if
+   return Data;
+} // static UINT8 * ReadScanCacheVariable()
+
+// Read the scan cache left by a previous boot, from NVRAM or from rEFInd's
+// own directory. Returns TRUE if a valid cache was found.
+BOOLEAN LoadScanCache(VOID) {
+   EFI_STATUS  Status;
+
+   MyFreePool(gScanCache);
+   gScanCache = ReadScanCacheVariable(SCAN_CACHE_VAR_NAME, &gScanCacheSize);
+   if ((gScanCache == NULL) && (SelfDir != NULL)) {
+      Status = egLoadFile(SelfDir, SCAN_CACHE_FILE_NAME, &gScanCache, &gScanCacheSize);
+      if (EFI_ERROR(Status))
+         gScanCache = NULL;
+   } // if
+   if (!ScanCacheIsValid(gScanCache, gScanCacheSize)) {
+      MyFreePool(gScanCache);
+      gScanCache = NULL;
+      gScanCacheSize = 0;
+   } // if
+   return (gScanCache != NULL);
+} // BOOLEAN LoadScanCache()
+
+// Return a pointer to the null-terminated string at *Position and advance
+// *Position past it, or return NULL if no terminator occurs before End.
+static CHAR16 * NextString(IN OUT UINT8 **Position, IN UINT8 *End) {
+   CHAR16 *String = (CHAR16 *) *Position, *Char;
+
+   for (Char = String; (UINT8 *) (Char + 1) <= End; Char++) {
+      if (*Char == 0) {
+         *Position = (UINT8 *) (Char + 1);
+         return String;
+      }
+   } // for
+   return NULL;
+} // static CHAR16 * NextString()
+
+// Free a loader entry created by ParseRecord().
+VOID FreeCachedEntry(IN LOADER_ENTRY *Entry) {
+   if (Entry == NULL)
+      return;
+   MyFreePool(Entry->me.Title);
+   MyFreePool(Entry->Title);
+   MyFreePool(Entry->LoaderPath);
+   MyFreePool(Entry->VolName);
+   MyFreePool(Entry->LoadOptions);
+   MyFreePool(Entry->IconHints);
+   MyFreePool(Entry->DevicePath);
+   FreePool(Entry);
+} // VOID FreeCachedEntry()
+
+// Create a loader entry, minus its icon, from the cache record at *Position,
+// which must end before End, and advance *Position to the next record.
+// Returns NULL, with *Position set to End, if the record is corrupt; or
+// NULL if memory can't be allocated.
+static LOADER_ENTRY * ParseRecord(IN OUT UINT8 **Position, IN UINT8 *End) {
+   SCAN_CACHE_RECORD  *Record = (SCAN_CACHE_RECORD *) *Position;
+   LOADER_ENTRY       *Entry;
+   UINT8              *RecordEnd, *DevicePath, *Next;
+   CHAR16             *Strings[SCAN_CACHE_STRINGS];
+   UINTN              i;
+
+   if ((*Position + sizeof(SCAN_CACHE_RECORD) > End) || (*Position + Record->RecordSize > End) ||
+       (Record->RecordSize < sizeof(SCAN_CACHE_RECORD) + EVEN_SIZE(Record->DevicePathSize)) ||
+       (Record->DevicePathSize == 0)) {
+      *Position = End; // corrupt; shouldn't happen, since the CRC was OK....
+      return NULL;
+   } // if
+   RecordEnd = *Position + Record->RecordSize;
+   DevicePath = *Position + sizeof(SCAN_CACHE_RECORD);
+   Next = DevicePath + EVEN_SIZE(Record->DevicePathSize);
+   *Position = RecordEnd;
+   for (i = 0; i < SCAN_CACHE_STRINGS; i++) {
+      if ((Strings[i] = NextString(&Next, RecordEnd)) == NULL)
+         return NULL;
+   } // for
+   if ((Entry = InitializeLoaderEntry(NULL)) == NULL)
+      return NULL;
+
+   Entry->me.Title = StrDuplicate(Strings[0]);
+   Entry->me.Row = 0;
+   Entry->me.ShortcutLetter = Record->ShortcutLetter;
+   Entry->Title = StrDuplicate(Strings[1]);
+   Entry->LoaderPath = StrDuplicate(Strings[2]);
+   Entry->VolName = StrDuplicate(Strings[3]);
+   Entry->LoadOptions = (Strings[4][0] != 0) ? StrDuplicate(Strings[4]) : NULL;
+   Entry->IconHints = (Strings[5][0] != 0) ? StrDuplicate(Strings[5]) : NULL;
+   Entry->OSType = Record->OSType;
+   Entry->UseGraphicsMode = Record->UseGraphicsMode;
+   Entry->DevicePath = AllocatePool(Record->DevicePathSize);
+   if (Entry->DevicePath == NULL) {
+      FreeCachedEntry(Entry);
+      return NULL;
+   }
+   CopyMem(Entry->DevicePath, DevicePath, Record->DevicePathSize);
+   return Entry;
+} // static LOADER_ENTRY * ParseRecord()
+
+// Add a loader entry to Menu for each boot loader in the cache read by
+// LoadScanCache(). This involves no disk access; icons are loaded from the
+// icons directory when the entries are first drawn. The entries lack volume
+// badges and submenus, since those require scanning the volumes. Returns the
+// number of entries added.
+UINTN AddCachedLoaderEntries(IN REFIT_MENU_SCREEN *Menu) {
+   LOADER_ENTRY  *Entry;
+   UINT8         *Position, *End;
+   UINTN         i, Added = 0;
+
+   if (gScanCache == NULL)
+      return 0;
+
+   Position = gScanCache + sizeof(SCAN_CACHE_HEADER);
+   End = gScanCache + gScanCacheSize;
+   for (i = 0; (i < ((SCAN_CACHE_HEADER *) gScanCache)->EntryCount) && (Position < End); i++) {
+      Entry = ParseRecord(&Position, End);
+      if (Entry == NULL)
+         continue;
+
+      // Same icon search as for scanned entries, minus the volume's own
+      // icon and badge
+      Entry->me.LoadImages = LoadLoaderImages;
+
+      AddMenuEntry(Menu, (REFIT_MENU_ENTRY *) Entry);
+      Added++;
+   } // for
+   return Added;
+} // UINTN AddCachedLoaderEntries()
+
+// Returns the number of bytes String occupies in a cache record.
+static UINTN StringBytes(IN CHAR16 *String) {
+   return (String != NULL) ? StrSize(String) : sizeof(CHAR16);
+} // static UINTN StringBytes()
+
+// Copy String (or an empty string, if String is NULL) to *Position and
+// advance *Position past it.
+static VOID PutString(IN OUT UINT8 **Position, IN CHAR16 *String) {
+   UINTN Bytes = StringBytes(String);
+
+   if (String != NULL)
+      CopyMem(*Position, String, Bytes);
+   else
+      SetMem(*Position, Bytes, 0);
+   *Position += Bytes;
+} // static VOID PutString()
+
+// Returns the size of Entry's cache record, or 0 if Entry shouldn't or
+// can't be cached.
+static UINTN RecordSize(IN REFIT_MENU_ENTRY *MenuEntry) {
+   LOADER_ENTRY  *Entry = (LOADER_ENTRY *) MenuEntry;
+   UINTN         Size;
+
+   if ((MenuEntry->Tag != TAG_LOADER) || (Entry->DevicePath == NULL))
+      return 0;
+   Size = sizeof(SCAN_CACHE_RECORD) + EVEN_SIZE(DevicePathSize(Entry->DevicePath)) +
+          StringBytes(Entry->me.Title) + StringBytes(Entry->Title) + StringBytes(Entry->LoaderPath) +
+          StringBytes(Entry->VolName) + StringBytes(Entry->LoadOptions) + StringBytes(Entry->IconHints);
+   return (Size <= 0xFFFF) ? Size : 0;
+} // static UINTN RecordSize()
+
+// Serialize the boot loader entries among the EntryCount menu entries in
+// Entries.
+static UINT8 * BuildScanCache(IN REFIT_MENU_ENTRY **Entries, IN UINTN EntryCount, OUT UINTN *Size) {
+   SCAN_CACHE_HEADER  *Header;
+   SCAN_CACHE_RECORD  *Record;
+   LOADER_ENTRY       *Entry;
+   UINT8              *Data, *Position;
+   UINTN              i, ThisSize;
+
+   *Size = sizeof(SCAN_CACHE_HEADER);
+   for (i = 0; i < EntryCount; i++)
+      *Size += RecordSize(Entries[i]);
+   Data = AllocateZeroPool(*Size);
+   if (Data == NULL)
+      return NULL;
+
+   Header = (SCAN_CACHE_HEADER *) Data;
+   Header->Signature = SCAN_CACHE_SIGNATURE;
+   Header->Version = SCAN_CACHE_VERSION;
+   Header->DataSize = (UINT32) (*Size - sizeof(SCAN_CACHE_HEADER));
+   Position = Data + sizeof(SCAN_CACHE_HEADER);
+   for (i = 0; (i < EntryCount) && (Header->EntryCount < 0xFFFF); i++) {
+      if ((ThisSize = RecordSize(Entries[i])) == 0)
+         continue;
+      Entry = (LOADER_ENTRY *) Entries[i];
+      Record = (SCAN_CACHE_RECORD *) Position;
+      Record->RecordSize = (UINT16) ThisSize;
+      Record->DevicePathSize = (UINT16) DevicePathSize(Entry->DevicePath);
+      Record->ShortcutLetter = Entry->me.ShortcutLetter;
+      Record->OSType = (UINT8) Entry->OSType;
+      Record->UseGraphicsMode = Entry->UseGraphicsMode ? 1 : 0;
+      Position += sizeof(SCAN_CACHE_RECORD);
+      CopyMem(Position, Entry->DevicePath, Record->DevicePathSize);
+      Position += EVEN_SIZE(Record->DevicePathSize);
+      PutString(&Position, Entry->me.Title);
+      PutString(&Position, Entry->Title);
+      PutString(&Position, Entry->LoaderPath);
+      PutString(&Position, Entry->VolName);
+      PutString(&Position, Entry->LoadOptions);
+      PutString(&Position, Entry->IconHints);
+      Header->EntryCount++;
+   } // for
+   refit_call3_wrapper(BS->CalculateCrc32, Data + sizeof(SCAN_CACHE_HEADER), Header->DataSize, &(Header->DataCrc32));
+   return Data;
+} // static UINT8 * BuildScanCache()
+
+// Delete the cache file from rEFInd's directory, if it exists.
+static VOID DeleteScanCacheFile(VOID) {
+   EFI_STATUS       Status;
+   EFI_FILE_HANDLE  FileHandle;
+
+   if (SelfDir == NULL)
+      return;
+   Status = refit_call5_wrapper(SelfDir->Open, SelfDir, &FileHandle, SCAN_CACHE_FILE_NAME,
+                                EFI_FILE_MODE_READ | EFI_FILE_MODE_WRITE, 0);
+   if (!EFI_ERROR(Status))
+      refit_call1_wrapper(FileHandle->Delete, FileHandle);
+} // static VOID DeleteScanCacheFile()
+
+// Save the boot loader entries in Menu for use by the next boot, unless
+// they're unchanged from what's already saved. Small caches go in an NVRAM
+// variable and larger ones in a file in rEFInd's directory; whichever form
+// isn't used is deleted, so a stale copy can't be picked up later.
+// Returns TRUE if the cache had to be updated.
+BOOLEAN UpdateScanCache(IN REFIT_MENU_SCREEN *Menu) {
+   EFI_STATUS  Status = EFI_BUFFER_TOO_SMALL;
+   UINT8       *Data;
+   UINTN       Size;
+
+   Data = BuildScanCache(Menu->Entries, Menu->EntryCount, &Size);
+   if (Data == NULL)
+      return FALSE;
+   if ((Size == gScanCacheSize) && (CompareMem(Data, gScanCache, Size) == 0)) {
+      MyFreePool(Data);
+      return FALSE;
+   } // if
+
+   if (Size <= SCAN_CACHE_MAX_VAR_SIZE) {
+      Status = refit_call5_wrapper(RT->SetVariable, SCAN_CACHE_VAR_NAME, &RefindGuid,
+                                   EFI_VARIABLE_NON_VOLATILE | EFI_VARIABLE_BOOTSERVICE_ACCESS, Size, Data);
+      if (!EFI_ERROR(Status))
+         DeleteScanCacheFile();
+   } // if
+   if (EFI_ERROR(Status) && (SelfDir != NULL)) {
+      DeleteScanCacheFile();
+      Status = egSaveFile(SelfDir, SCAN_CACHE_FILE_NAME, Data, Size);
+      if (!EFI_ERROR(Status))
+         refit_call5_wrapper(RT->SetVariable, SCAN_CACHE_VAR_NAME, &RefindGuid,
+                             EFI_VARIABLE_NON_VOLATILE | EFI_VARIABLE_BOOTSERVICE_ACCESS, 0, NULL);
+   } // if
+
+   MyFreePool(gScanCache);
+   gScanCache = Data;
+   gScanCacheSize = Size;
+   return TRUE;
+} // BOOLEAN UpdateScanCache()
+
+// Return the boot loader entry saved by SaveExpressBootEntry(), without an
+// icon, or NULL if there's none. The caller must verify that the loader
+// still exists before using the entry, and free it with FreeCachedEntry().
+LOADER_ENTRY * LoadExpressBootEntry(VOID) {
+   LOADER_ENTRY  *Entry = NULL;
+   UINT8         *Data, *Position;
+   UINTN         Size;
+
+   Data = ReadScanCacheVariable(EXPRESS_BOOT_VAR_NAME, &Size);
+   if (Data != NULL) {
+      Position = Data + sizeof(SCAN_CACHE_HEADER);
+      if (((SCAN_CACHE_HEADER *) Data)->EntryCount == 1)
+         Entry = ParseRecord(&Position, Data + Size);
+      MyFreePool(Data);
+   } // if
+   return Entry;
+} // LOADER_ENTRY * LoadExpressBootEntry()
+
+// Save Entry for use by LoadExpressBootEntry() on the next boot. The NVRAM
+// variable is written only if its contents change, to spare the flash.
+VOID SaveExpressBootEntry(IN LOADER_ENTRY *Entry) {
+   UINT8  *Data, *OldData;
+   UINTN  Size, OldSize;
+
+   Data = BuildScanCache((REFIT_MENU_ENTRY **) &Entry, 1, &Size);
+   if ((Data == NULL) || (((SCAN_CACHE_HEADER *) Data)->EntryCount != 1)) {
+      MyFreePool(Data);
+      return;
+   } // if
+   OldData = ReadScanCacheVariable(EXPRESS_BOOT_VAR_NAME, &OldSize);
+   if ((OldData == NULL) || (OldSize != Size) || (CompareMem(OldData, Data, Size) != 0)) {
+      refit_call5_wrapper(RT->SetVariable, EXPRESS_BOOT_VAR_NAME, &RefindGuid,
+                          EFI_VARIABLE_NON_VOLATILE | EFI_VARIABLE_BOOTSERVICE_ACCESS, Size, Data);
+   } // if
+   MyFreePool(OldData);
+   MyFreePool(Data);
+} // VOID SaveExpressBootEntry()
+
+/* EOF */
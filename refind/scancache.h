@@ -0,0 +1,63 @@
+/*
+ * refind/scancache.h
+ * Functions to save and restore the list of boot loaders found by a scan
+ *
+ * Copyright (c) 2013 Roderick W. Smith
+ * All rights reserved.
+ *
+ * This program is distributed under the terms of the GNU General Public
+ * License (GPL) version 3 (GPLv3), a copy of which must be distributed
+ * with this source code or binaries made from it.
+ *
+ */
+
+#ifndef __SCANCACHE_H_
+#define __SCANCACHE_H_
+
+#ifdef __MAKEWITH_GNUEFI
+#include "efi.h"
+#include "efilib.h"
+#else
+#include "../include/tiano_includes.h"
+#endif
+
+#include "global.h"
+
+#define SCAN_CACHE_VAR_NAME      L"ScanCache"
+#define SCAN_CACHE_FILE_NAME     L"scancache.bin"
+#define SCAN_CACHE_SIGNATURE     0x43536672 /* "rfSC" */
+#define SCAN_CACHE_VERSION       1
+#define SCAN_CACHE_MAX_VAR_SIZE  2048 /* larger caches go to a file on the ESP */
+#define EXPRESS_BOOT_VAR_NAME    L"ExpressBoot"
+
+// Header of the cache data, followed by DataSize bytes of records
+typedef struct {
+   UINT32   Signature;
+   UINT16   Version;
+   UINT16   EntryCount;
+   UINT32   DataSize;
+   UINT32   DataCrc32;
+} SCAN_CACHE_HEADER;
+
+// One cached boot loader. Followed by the loader's device path, padded to
+// an even number of bytes, and then by six null-terminated strings: the
+// menu title, the loader title, the loader path, the volume name, the load
+// options, and the OS icon names. NULL strings are stored as empty strings.
+typedef struct {
+   UINT16   RecordSize;       // total size, including device path & strings
+   UINT16   DevicePathSize;   // unpadded
+   CHAR16   ShortcutLetter;
+   UINT8    OSType;
+   UINT8    UseGraphicsMode;
+} SCAN_CACHE_RECORD;
+
+BOOLEAN LoadScanCache(VOID);
+UINTN AddCachedLoaderEntries(IN REFIT_MENU_SCREEN *Menu);
+BOOLEAN UpdateScanCache(IN REFIT_MENU_SCREEN *Menu);
+LOADER_ENTRY * LoadExpressBootEntry(VOID);
+VOID FreeCachedEntry(IN LOADER_ENTRY *Entry);
+VOID SaveExpressBootEntry(IN LOADER_ENTRY *Entry);
+
+#endif
+
+/* EOF */
@@ -230,6 +230,8 @@ VOID BeginExternalScreen(IN BOOLEAN UseGraphicsMode, IN CHAR16 *Title)
         DrawScreenHeader(Title);
         SwitchToText(TRUE);
     }
+    egFlush();
+    egInvalidateShadow();   // the program we start may draw on the screen
 
     // reset error flag
     haveError = FALSE;
@@ -285,6 +287,7 @@ static VOID DrawScreenHeader(IN CHAR16 *Title)
     // reposition cursor
     refit_call2_wrapper(ST->ConOut->SetAttribute, ST->ConOut, ATTR_BASIC);
     refit_call3_wrapper(ST->ConOut->SetCursorPosition, ST->ConOut, 0, 4);
+    egInvalidateShadow();
 }
 
 //
@@ -313,7 +316,9 @@ VOID PauseForKey(VOID)
 {
     UINTN index;
 
+    egFlush();
     Print(L"\n* Hit any key to continue *");
+    egInvalidateShadow();
 
     if (ReadAllKeyStrokes()) {  // remove buffered key strokes
         refit_call1_wrapper(BS->Stall, 5000000);     // 5 seconds delay
@@ -431,24 +436,23 @@ VOID SwitchToGraphicsAndClear(VOID)
 
 VOID BltClearScreen(IN BOOLEAN ShowBanner)
 {
-    static EG_IMAGE *Banner = NULL, *CroppedBanner;
+    static EG_IMAGE *Banner = NULL;
     INTN BannerPosX, BannerPosY;
 
     if (ShowBanner && !(GlobalConfig.HideUIFlags & HIDEUI_FLAG_BANNER)) {
         // load banner on first call
         if (Banner == NULL) {
             if (GlobalConfig.BannerFileName == NULL) {
-                Banner = egPrepareEmbeddedImage(&egemb_refind_banner, FALSE);
+                Banner = egApplyScale(egPrepareEmbeddedImage(&egemb_refind_banner, FALSE), UGAWidth, UGAHeight);
             } else {
-                Banner = egLoadImage(SelfDir, GlobalConfig.BannerFileName, FALSE);
-                if (Banner && ((Banner->Width > UGAWidth) || (Banner->Height > UGAHeight))) {
-                   CroppedBanner = egCropImage(Banner, 0, 0, (Banner->Width > UGAWidth) ? UGAWidth : Banner->Width,
-                                               (Banner->Height > UGAHeight) ? UGAHeight : Banner->Height);
-                   MyFreePool(Banner);
-                   Banner = CroppedBanner;
-                } // if image too big
+                // a banner (or full-screen background) bigger than the screen is
+                // shrunk to fit as it's decoded
+                Banner = egLoadScaledImage(SelfDir, GlobalConfig.BannerFileName, UGAWidth, UGAHeight, FALSE);
+                // enlarge the banner with the rest of the UI, unless it would no
+                // longer fit on the screen (as with a full-screen background)
+                Banner = egApplyScale(Banner, UGAWidth, UGAHeight);
                 if (Banner == NULL) {
-                   Banner = egPrepareEmbeddedImage(&egemb_refind_banner, FALSE);
+                   Banner = egApplyScale(egPrepareEmbeddedImage(&egemb_refind_banner, FALSE), UGAWidth, UGAHeight);
                 } // if unusable image
             }
             if (Banner != NULL)
@@ -474,6 +478,7 @@ VOID BltClearScreen(IN BOOLEAN ShowBanner)
     GraphicsScreenDirty = FALSE;
     egFreeImage(GlobalConfig.ScreenBackground);
     GlobalConfig.ScreenBackground = egCopyScreen();
+    egFlush();   // show the banner during any lengthy scan that follows
 } /* VOID BltClearScreen() */
 
 VOID BltImage(IN EG_IMAGE *Image, IN UINTN XPos, IN UINTN YPos)
@@ -549,9 +554,10 @@ VOID BltImageCompositeBadge(IN EG_IMAGE *BaseImage, IN EG_IMAGE *TopImage, IN EG
      }
 
      // place the badge image
-     if (BadgeImage != NULL && CompImage != NULL && (BadgeImage->Width + 8) < CompWidth && (BadgeImage->Height + 8) < CompHeight) {
-         OffsetX += CompWidth  - 8 - BadgeImage->Width;
-         OffsetY += CompHeight - 8 - BadgeImage->Height;
+     if (BadgeImage != NULL && CompImage != NULL && (BadgeImage->Width + 8 * GlobalConfig.Scale) < CompWidth &&
+         (BadgeImage->Height + 8 * GlobalConfig.Scale) < CompHeight) {
+         OffsetX += CompWidth  - 8 * GlobalConfig.Scale - BadgeImage->Width;
+         OffsetY += CompHeight - 8 * GlobalConfig.Scale - BadgeImage->Height;
          egComposeImage(CompImage, BadgeImage, OffsetX, OffsetY);
      }
 
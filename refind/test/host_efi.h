@@ -0,0 +1,49 @@
+/*
+ * refind/test/host_efi.h
+ * Minimal EFI definitions for building rEFInd code on the host
+ *
+ * Copyright (c) 2013 Roderick W. Smith
+ * All rights reserved.
+ *
+ * This program is distributed under the terms of the GNU General Public
+ * License (GPL) version 3 (GPLv3), a copy of which must be distributed
+ * with this source code or binaries made from it.
+ *
+ */
+
+#ifndef __HOST_EFI_H_
+#define __HOST_EFI_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef uint16_t    CHAR16;
+typedef size_t      UINTN;
+typedef uint8_t     UINT8;
+typedef uint16_t    UINT16;
+typedef uint32_t    UINT32;
+typedef uint64_t    UINT64;
+typedef intptr_t    INTN;
+typedef int16_t     INT16;
+typedef int32_t     INT32;
+typedef uint8_t     BOOLEAN;
+typedef void        VOID;
+
+#define TRUE        1
+#define FALSE       0
+#define IN
+#define OUT
+#define OPTIONAL
+
+// Wide string literals must be 16 bits wide, as under EFI; compile with
+// -fshort-wchar. As under EFI, CopyMem() may be used on overlapping buffers.
+#define AllocatePool(Size)              malloc(Size)
+#define AllocateZeroPool(Size)          calloc(1, Size)
+#define FreePool(Pointer)               free(Pointer)
+#define CopyMem(Dest, Src, Size)        memmove(Dest, Src, Size)
+#define SetMem(Buffer, Size, Value)     memset(Buffer, Value, Size)
+
+#endif
+
+/* EOF */